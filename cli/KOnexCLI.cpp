@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 #include <iostream>
@@ -53,6 +54,19 @@ bool tooManyArgs(const vector<string>& args, int limit)
   return false;
 }
 
+// Bytes per value of a binary dataset named by "float" or "double", 0 if neither
+int parsePrecision(const string& arg)
+{
+  if (arg == "float") {
+    return sizeof(float);
+  }
+  if (arg == "double") {
+    return sizeof(double);
+  }
+  cout << "Error! Precision must be float or double" << endl;
+  return 0;
+}
+
 /**************************************************************************
  * HOW TO CREATE A NEW COMMAND
  *
@@ -75,7 +89,7 @@ bool tooManyArgs(const vector<string>& args, int limit)
 
 MAKE_COMMAND(LoadDataset,
   {
-    if (tooFewArgs(args, 2) || tooManyArgs(args, 5))
+    if (tooFewArgs(args, 2) || tooManyArgs(args, 6))
     {
       return false;
     }
@@ -84,10 +98,19 @@ MAKE_COMMAND(LoadDataset,
     int maxNumRow = args.size() > 2 ? stoi(args[2]) : 0;
     int startCol  = args.size() > 3 ? stoi(args[3]) : 0;
     string separators = args.size() > 4 ? args[4] : " ";
+    bool normalize = false;
+    if (args.size() > 5)
+    {
+      if (args[5] != "normalize") {
+        return false;
+      }
+      normalize = true;
+    }
 
     konex::dataset_info_t info;
     
-    info = gKOnexAPI.loadDataset(filePath, maxNumRow, startCol, separators);
+    info = gKOnexAPI.loadDataset(filePath, maxNumRow, startCol, separators,
+                                 std::max(1u, std::thread::hardware_concurrency()), normalize);
 
     cout << "Dataset loaded                         " << endl
               << "  Name:        " << info.name       << endl
@@ -101,9 +124,10 @@ MAKE_COMMAND(LoadDataset,
   "Load a dataset to the memory",
 
   "Dataset are text files with table-like format, such as comma-separated  \n"
-  "values files.                                                           \n"
+  "values files, or binary files written by 'saveBinary', which are mapped \n"
+  "to memory instead of being parsed.                                      \n"
   "                                                                        \n"
-  "Usage: load <filePath> [<maxNumRow> <startCol> <separators>]            \n"
+  "Usage: load <filePath> [<maxNumRow> <startCol> <separators> [normalize]]\n"
   "  filePath  - Path to a text file containing the dataset                \n"
   "  maxNumRow - Maximum number of rows will be read from the file. If this\n"
   "              number is non-positive or the number of actual line is    \n"
@@ -111,6 +135,44 @@ MAKE_COMMAND(LoadDataset,
   "  startCol  - Omit all columns before this column. (default: 0)         \n"
   "  separators - A list of characters used to separate values in the file \n"
   "              (default: <space>)                                        \n"
+  "  normalize - Normalize the dataset while it is loaded, as 'normalize'  \n"
+  "              would do afterwards                                       \n"
+  )
+
+MAKE_COMMAND(AppendDataset,
+  {
+    if (tooFewArgs(args, 3) || tooManyArgs(args, 5))
+    {
+      return false;
+    }
+
+    int index = stoi(args[1]);
+    string filePath = args[2];
+    int startCol  = args.size() > 3 ? stoi(args[3]) : 0;
+    string separators = args.size() > 4 ? args[4] : " ";
+
+    konex::dataset_info_t info = gKOnexAPI.appendDataset(
+      index, filePath, startCol, separators, std::max(1u, std::thread::hardware_concurrency()));
+
+    cout << "Appended " << filePath << " to dataset " << index << endl
+         << "  Item count:  " << info.itemCount << endl;
+
+    return true;
+  },
+
+  "Append the time series of a file to a loaded dataset",
+
+  "The series already loaded are kept as they are, so that only the new    \n"
+  "ones are read. They must have the same length. A normalized dataset     \n"
+  "normalizes the new series with its own minimum and maximum.             \n"
+  "A grouped dataset adds the new series to its groups.                    \n"
+  "                                                                        \n"
+  "Usage: append <dataset_index> <filePath> [<startCol> <separators>]      \n"
+  "  dataset_index - Index of the dataset to append to                     \n"
+  "  filePath  - Path to a text file or to a binary file, see 'load'       \n"
+  "  startCol  - Omit all columns before this column. (default: 0)         \n"
+  "  separators - A list of characters used to separate values in the file \n"
+  "              (default: <space>)                                        \n"
   )
 
 MAKE_COMMAND(SaveDataset,
@@ -140,6 +202,80 @@ MAKE_COMMAND(SaveDataset,
   "              (default: <space>)                                \n"
   )
 
+MAKE_COMMAND(SaveBinaryDataset,
+  {
+    if (tooFewArgs(args, 3) || tooManyArgs(args, 4))
+    {
+      return false;
+    }
+
+    int index = stoi(args[1]);
+    string filePath = args[2];
+    int precision = args.size() > 3 ? parsePrecision(args[3]) : sizeof(konex::data_t);
+    if (precision == 0) {
+      return false;
+    }
+
+    gKOnexAPI.saveBinaryDataset(index, filePath, precision);
+
+    cout << "Saved dataset " << index << " to " << filePath << endl;
+
+    return true;
+  },
+
+  "Save a dataset from memory to disk in binary form",
+
+  "The values are saved exactly, and 'load' maps the file back to memory  \n"
+  "without parsing it.                                                    \n"
+  "                                                                       \n"
+  "Usage: saveBinary <dataset_index> <filePath> [<precision>]             \n"
+  "  dataset_index - Index of the dataset to be saved                     \n"
+  "  filePath  - Path to the saved file                                   \n"
+  "  precision - float or double. Values saved as float are rounded and   \n"
+  "              take half the space, on disk and once loaded, until the  \n"
+  "              dataset is searched often. (default: precision of the    \n"
+  "              build)                                                   \n"
+  )
+
+MAKE_COMMAND(ConvertDataset,
+  {
+    if (tooFewArgs(args, 3) || tooManyArgs(args, 6))
+    {
+      return false;
+    }
+
+    string textPath = args[1];
+    string binaryPath = args[2];
+    int startCol  = args.size() > 3 ? stoi(args[3]) : 0;
+    string separators = args.size() > 4 ? args[4] : " ";
+    int precision = args.size() > 5 ? parsePrecision(args[5]) : sizeof(konex::data_t);
+    if (precision == 0) {
+      return false;
+    }
+
+    int itemCount = gKOnexAPI.convertDataset(textPath, binaryPath, startCol, separators, precision);
+
+    cout << "Converted " << itemCount << " time series to " << binaryPath << endl;
+
+    return true;
+  },
+
+  "Convert a text dataset to a binary dataset without loading it",
+
+  "The text file is parsed line by line, so that datasets larger than the \n"
+  "memory can be converted. 'load' maps the binary file to memory, and    \n"
+  "grouping and search then read it block by block.                       \n"
+  "                                                                       \n"
+  "Usage: convert <textPath> <binaryPath> [<startCol> <separators>        \n"
+  "                                        [<precision>]]                 \n"
+  "  textPath   - Path to a text file containing the dataset              \n"
+  "  binaryPath - Path to the binary file written                         \n"
+  "  startCol   - Omit all columns before this column. (default: 0)       \n"
+  "  separators - A list of characters used to separate values in the file\n"
+  "              (default: <space>)                                       \n"
+  "  precision  - float or double, see 'saveBinary'                       \n"
+  )
+
 MAKE_COMMAND(UnloadDataset,
   {
     if (tooFewArgs(args, 2) || tooManyArgs(args, 5))
@@ -163,6 +299,56 @@ MAKE_COMMAND(UnloadDataset,
   "                   loaded datasets.                         \n"
   )
 
+MAKE_COMMAND(CompressDataset,
+  {
+    if (tooFewArgs(args, 2) || tooManyArgs(args, 2))
+    {
+      return false;
+    }
+
+    int index = stoi(args[1]);
+    konex::dataset_info_t info = gKOnexAPI.getDatasetInfo(index);
+    size_t rawBytes = (size_t)info.itemCount * info.itemLength * sizeof(konex::data_t);
+
+    size_t compressedBytes = gKOnexAPI.compressDataset(index);
+
+    cout << "Compressed dataset " << index << " from " << rawBytes << " to "
+         << compressedBytes << " bytes" << endl;
+    return true;
+  },
+
+  "Compress an idle dataset in memory",
+
+  "The values are encoded without loss. The dataset is decompressed when \n"
+  "it is grouped, searched through its groups or saved. 'kSimRaw',       \n"
+  "'printTS' and 'distance' decode a block at a time, until the dataset  \n"
+  "is read often enough to decompress it.                                \n"
+  "                                                                      \n"
+  "Usage: compress <dataset_index>                                       \n"
+  "  dataset_index - Index of the dataset to be compressed               \n"
+  )
+
+MAKE_COMMAND(DecompressDataset,
+  {
+    if (tooFewArgs(args, 2) || tooManyArgs(args, 2))
+    {
+      return false;
+    }
+
+    int index = stoi(args[1]);
+
+    gKOnexAPI.decompressDataset(index);
+
+    cout << "Dataset " << index << " is decompressed" << endl;
+    return true;
+  },
+
+  "Decompress a dataset compressed by 'compress'",
+
+  "Usage: decompress <dataset_index>                             \n"
+  "  dataset_index - Index of the dataset to be decompressed     \n"
+  )
+
 MAKE_COMMAND(List,
   {
     if (tooFewArgs(args, 2) || tooManyArgs(args, 2))
@@ -235,6 +421,44 @@ MAKE_COMMAND(Timer,
   "Usage: timer [on|off]                                           \n"
   )
 
+MAKE_COMMAND(Cache,
+  {
+    if (tooFewArgs(args, 1) || tooManyArgs(args, 2))
+    {
+      return false;
+    }
+    if (args.size() == 2)
+    {
+      if (args[1] == "clear")
+      {
+        gKOnexAPI.clearQueryCache();
+        cout << "Query cache is cleared" << endl;
+        return true;
+      }
+      gKOnexAPI.setQueryCacheCapacity((size_t)(stod(args[1]) * (1 << 20)));
+    }
+    konex::query_cache_stats_t stats = gKOnexAPI.getQueryCacheStats();
+    cout << "Query cache: " << stats.entries << " entries, "
+         << setprecision(4) << stats.bytes / double(1 << 20) << "/"
+         << stats.capacity / double(1 << 20) << " MB" << endl
+         << "  Hits: " << stats.hits << ", misses: " << stats.misses
+         << " (hit rate " << setprecision(4) << stats.getHitRate() * 100 << "%)"
+         << ", evictions: " << stats.evictions << endl;
+    return true;
+  },
+
+  "Show or resize the cache of query results",
+
+  "Results of match, kSim and kSimRaw are cached and returned again \n"
+  "for the same query and settings until the dataset, its groups or \n"
+  "its search backend change.                                       \n"
+  "                                                                 \n"
+  "Usage: cache [clear|<megabytes>]                                 \n"
+  "  clear     - Drops all cached results                           \n"
+  "  megabytes - Memory the cached results may take. 0 disables the \n"
+  "              cache.                                             \n"
+  )
+
 MAKE_COMMAND(Distance,
   {
     if (tooFewArgs(args, 9) || tooManyArgs(args, 10))
@@ -546,9 +770,12 @@ MAKE_COMMAND(kSimRaw,
       PAABlock = stoi(args[7]);
     }
 
+    konex::QueryContext ctx;
+    ctx.setNumThreads(std::max(1u, std::thread::hardware_concurrency()));
+
     TIME_COMMAND(
       std::vector<konex::candidate_time_series_t> results = 
-        gKOnexAPI.kSimRaw(k, db_index, q_index, ts_index, start, end, PAABlock);
+        gKOnexAPI.kSimRaw(ctx, k, db_index, q_index, ts_index, start, end, PAABlock);
     )
 
     for (int i = 0; i < results.size(); i++)
@@ -577,6 +804,320 @@ MAKE_COMMAND(kSimRaw,
   )
 
 
+MAKE_COMMAND(kSimAnytime,
+  {
+    if (tooFewArgs(args, 6) || tooManyArgs(args, 8))
+    {
+      return false;
+    }
+
+    int k = stoi(args[1]);
+    int db_index = stoi(args[2]);
+    int  q_index = stoi(args[3]);
+    int ts_index = stoi(args[4]);
+    double milliseconds = stod(args[5]);
+    int start = -1;
+    int end = -1;
+
+    if (args.size() == 7)
+    {
+      cout << "Both start and end are required" << endl;
+      return false;
+    }
+    if (args.size() == 8)
+    {
+      start = stoi(args[6]);
+      end = stoi(args[7]);
+    }
+
+    int snapshots = 0;
+    TIME_COMMAND(
+      konex::progressive_result_t progress =
+        gKOnexAPI.progressiveKSim(k, konex::query_budget_t(milliseconds), 
+          [&snapshots](const konex::progressive_result_t& snapshot) {
+            snapshots++;
+            std::cout << "  " << setprecision(4) << snapshot.milliseconds << "ms - best distance = "
+                      << snapshot.results.front().dist << std::endl;
+            return true;
+          },
+          db_index, q_index, ts_index, start, end);
+    )
+
+    for (int i = 0; i < progress.results.size(); i++)
+    {
+      const konex::candidate_t& result = progress.results[i];
+      std::cout << "Timeseries " 
+                << result.index << " [" << result.start << ", " << result.start + result.length << "] "
+                << "- distance = " << result.dist 
+                << std::endl; 
+    }
+    std::cout << (progress.exact ? "Exact" : "Approximate") << " results after " << snapshots
+              << " improvements, " << progress.groupsExamined << "/" << progress.groupCount
+              << " groups and " << progress.evaluations << " distances" << std::endl;
+
+    return true;
+  },
+
+  "Find k similar time series to a query, improving them until a time budget runs out.",
+
+    "Usage: kSimAnytime <k> <target_dataset_idx> <q_dataset_idx> <ts_index> <milliseconds> [<start> <end>] \n"
+    "  k               - The number of neigbors                                                       \n"    
+    "  dataset_index   - Index of loaded dataset to get the result from.                              \n"
+    "                    Use 'list dataset' to retrieve the list of                                   \n"
+    "                    loaded datasets.                                                             \n"
+    "  q_dataset_idx   - Same as dataset_index, except for the query                                  \n"
+    "  ts_index        - Index of the query                                                           \n"
+    "  milliseconds    - Time budget of the query. If not positive, the query runs until the results  \n"
+    "                    are exact.                                                                   \n"
+    "  start           - The start location of the query in the timeseries                            \n"
+    "  end             - The end location of the query in the timeseries (this point is not included) \n"
+    )
+
+MAKE_COMMAND(Explain,
+  {
+    if (tooFewArgs(args, 6) || tooManyArgs(args, 9))
+    {
+      return false;
+    }
+
+    if (args[1] != "exact" && args[1] != "approximate")
+    {
+      cout << "Mode must be exact or approximate" << endl;
+      return false;
+    }
+    bool exact = args[1] == "exact";
+    int k = stoi(args[2]);
+    int db_index = stoi(args[3]);
+    int  q_index = stoi(args[4]);
+    int ts_index = stoi(args[5]);
+    int start = -1;
+    int end = -1;
+    int ke = k;
+
+    if (args.size() == 7)
+    {
+      ke = stoi(args[6]);
+    }
+    else if (args.size() > 7)
+    {
+      start = stoi(args[6]);
+      end = stoi(args[7]);
+    }
+    if (args.size() > 8)
+    {
+      ke = stoi(args[8]);
+    }
+
+    konex::query_plan_t plan = gKOnexAPI.explainKSim(k, ke, exact, db_index, q_index, ts_index, start, end);
+    cout << plan.explain();
+
+    return true;
+  },
+
+  "Show how kSimAuto would answer a query and the estimated cost of each strategy.",
+
+    "Usage: explain <mode> <k> <target_dataset_idx> <q_dataset_idx> <ts_index> [<start> <end>] [<ke>]\n"
+    "  mode            - 'exact' to only consider strategies giving the exact neighbors, or          \n"
+    "                    'approximate' to also consider the grouped search                            \n"
+    "  k               - The number of neigbors                                                       \n"
+    "  dataset_index   - Index of loaded dataset to get the result from.                              \n"
+    "                    Use 'list dataset' to retrieve the list of                                   \n"
+    "                    loaded datasets.                                                             \n"
+    "  q_dataset_idx   - Same as dataset_index, except for the query                                  \n"
+    "  ts_index        - Index of the query                                                           \n"
+    "  start           - The start location of the query in the timeseries                            \n"
+    "  end             - The end location of the query in the timeseries (this point is not included) \n"
+    "  ke              - How far that the grouped search explores the database (Default is equal to k)\n"
+    )
+
+MAKE_COMMAND(kSimAuto,
+  {
+    if (tooFewArgs(args, 6) || tooManyArgs(args, 9))
+    {
+      return false;
+    }
+
+    if (args[1] != "exact" && args[1] != "approximate")
+    {
+      cout << "Mode must be exact or approximate" << endl;
+      return false;
+    }
+    bool exact = args[1] == "exact";
+    int k = stoi(args[2]);
+    int db_index = stoi(args[3]);
+    int  q_index = stoi(args[4]);
+    int ts_index = stoi(args[5]);
+    int start = -1;
+    int end = -1;
+    int ke = k;
+
+    if (args.size() == 7)
+    {
+      ke = stoi(args[6]);
+    }
+    else if (args.size() > 7)
+    {
+      start = stoi(args[6]);
+      end = stoi(args[7]);
+    }
+    if (args.size() > 8)
+    {
+      ke = stoi(args[8]);
+    }
+
+    TIME_COMMAND(
+      vector<konex::candidate_time_series_t> results =
+        gKOnexAPI.kSimPlanned(k, ke, exact, db_index, q_index, ts_index, start, end);
+    )
+
+    for (int i = 0; i < results.size(); i++)
+    {
+      std::cout << "Timeseries " 
+                << results[i].data.getIndex() << " [" << results[i].data.getStart() << ", " << results[i].data.getEnd() << "] "
+                << "- distance = " << results[i].dist 
+                << std::endl; 
+    }
+
+    return true;
+  },
+
+  "Find k similar time series to a query with the cheapest strategy. See explain.",
+
+    "Usage: kSimAuto <mode> <k> <target_dataset_idx> <q_dataset_idx> <ts_index> [<start> <end>] [<ke>]\n"
+    "  mode            - 'exact' to only consider strategies giving the exact neighbors, or          \n"
+    "                    'approximate' to also consider the grouped search                            \n"
+    "  k               - The number of neigbors                                                       \n"
+    "  dataset_index   - Index of loaded dataset to get the result from.                              \n"
+    "                    Use 'list dataset' to retrieve the list of                                   \n"
+    "                    loaded datasets.                                                             \n"
+    "  q_dataset_idx   - Same as dataset_index, except for the query                                  \n"
+    "  ts_index        - Index of the query                                                           \n"
+    "  start           - The start location of the query in the timeseries                            \n"
+    "  end             - The end location of the query in the timeseries (this point is not included) \n"
+    "  ke              - How far that the grouped search explores the database (Default is equal to k)\n"
+    )
+
+MAKE_COMMAND(Range,
+  {
+    if (tooFewArgs(args, 5) || tooManyArgs(args, 7))
+    {
+      return false;
+    }
+
+    double epsilon = stod(args[1]);
+    int db_index = stoi(args[2]);
+    int  q_index = stoi(args[3]);
+    int ts_index = stoi(args[4]);
+    int start = -1;
+    int end = -1;
+
+    if (args.size() == 6)
+    {
+      cout << "Both start and end are required" << endl;
+      return false;
+    }
+    if (args.size() == 7)
+    {
+      start = stoi(args[5]);
+      end = stoi(args[6]);
+    }
+
+    TIME_COMMAND(
+      konex::range_stats_t stats = gKOnexAPI.rangeQuery(epsilon, 
+        [](const konex::candidate_t& match) {
+          std::cout << "Timeseries " 
+                    << match.index << " [" << match.start << ", " << match.start + match.length << "] "
+                    << "- distance <= " << match.dist 
+                    << std::endl; 
+          return true;
+        },
+        db_index, q_index, ts_index, start, end);
+    )
+
+    std::cout << stats.matches << " matches. Groups skipped: " << stats.groupsSkipped
+              << ", included: " << stats.groupsIncluded << ", verified: " << stats.groupsVerified
+              << std::endl;
+
+    return true;
+  },
+
+  "Find all time series within a distance of a query.",
+
+    "Usage: range <epsilon> <target_dataset_idx> <q_dataset_idx> <ts_index> [<start> <end>]          \n"
+    "  epsilon         - The largest distance of a match                                              \n"    
+    "  dataset_index   - Index of loaded dataset to get the result from.                              \n"
+    "                    Use 'list dataset' to retrieve the list of                                   \n"
+    "                    loaded datasets.                                                             \n"
+    "  q_dataset_idx   - Same as dataset_index, except for the query                                  \n"
+    "  ts_index        - Index of the query                                                           \n"
+    "  start           - The start location of the query in the timeseries                            \n"
+    "  end             - The end location of the query in the timeseries (this point is not included) \n"
+    )
+
+MAKE_COMMAND(Motif,
+  {
+    if (tooFewArgs(args, 4) || tooManyArgs(args, 6))
+    {
+      return false;
+    }
+
+    int db_index = stoi(args[1]);
+    int length = stoi(args[2]);
+    int k = stoi(args[3]);
+    string join = "within";
+    double fraction = 1.0;
+
+    if (args.size() > 4)
+    {
+      join = args[4];
+    }
+    if (args.size() > 5)
+    {
+      fraction = stod(args[5]);
+    }
+
+    TIME_COMMAND(
+      konex::matrix_profile_summary_t summary =
+        gKOnexAPI.findMotifs(db_index, length, k, join, fraction,
+                             std::max(1u, std::thread::hardware_concurrency()));
+    )
+
+    std::cout << "Motifs:" << std::endl;
+    for (int i = 0; i < summary.motifs.size(); i++)
+    {
+      const konex::motif_t& motif = summary.motifs[i];
+      std::cout << "Timeseries " << motif.index << " [" << motif.start << ", " << motif.start + length << "] "
+                << "and " << motif.neighborIndex << " [" << motif.neighborStart << ", "
+                << motif.neighborStart + length << "] "
+                << "- distance = " << motif.dist
+                << std::endl;
+    }
+    std::cout << "Discords:" << std::endl;
+    for (int i = 0; i < summary.discords.size(); i++)
+    {
+      const konex::candidate_t& discord = summary.discords[i];
+      std::cout << "Timeseries " << discord.index << " [" << discord.start << ", " << discord.start + length << "] "
+                << "- distance to closest match = " << discord.dist
+                << std::endl;
+    }
+
+    return true;
+  },
+
+  "Find the top motifs and discords of a dataset with its matrix profile.",
+
+  "Usage: motif <dataset_idx> <length> <k> [<join> [<fraction>]]                                   \n"
+  "  dataset_idx     - Index of loaded dataset to search.                                           \n"
+  "                    Use 'list dataset' to retrieve the list of                                   \n"
+  "                    loaded datasets.                                                             \n"
+  "  length          - Length of the motifs and discords.                                           \n"
+  "  k               - The number of motifs and of discords.                                        \n"
+  "  join            - 'within' to match sub-sequences of the same time series (default), or        \n"
+  "                    'across' to match sub-sequences of different time series.                    \n"
+  "  fraction        - Fraction of the matrix profile to compute, in (0, 1]. Results are exact      \n"
+  "                    if 1 (default), otherwise approximate.                                       "
+  )
+
   MAKE_COMMAND(PrintTS,
     {
       if (tooFewArgs(args, 5) || tooManyArgs(args, 5))
@@ -685,9 +1226,12 @@ MAKE_COMMAND(TestSim,
     chrono::duration<float> kSimRawPAATime;
     chrono::duration<float> kSimTime;
 
+    konex::QueryContext rawCtx;
+    rawCtx.setNumThreads(std::max(1u, std::thread::hardware_concurrency()));
+
     TIME_COMMAND(
       std::vector<konex::candidate_time_series_t> rawResults =
-        gKOnexAPI.kSimRaw(k, db_index, q_index, ts_index, start, end);
+        gKOnexAPI.kSimRaw(rawCtx, k, db_index, q_index, ts_index, start, end);
     )
     kSimRawTime = __end_time - __start_time;
 
@@ -788,10 +1332,16 @@ MAKE_COMMAND(TestSim,
 
 map<string, Command*> commands = {
   {"load", &cmdLoadDataset},
+  {"append", &cmdAppendDataset},
   {"save", &cmdSaveDataset},
+  {"saveBinary", &cmdSaveBinaryDataset},
+  {"convert", &cmdConvertDataset},
   {"unload", &cmdUnloadDataset},
+  {"compress", &cmdCompressDataset},
+  {"decompress", &cmdDecompressDataset},
   {"list", &cmdList},
   {"timer", &cmdTimer},
+  {"cache", &cmdCache},
   {"distance", &cmdDistance},
   {"group", &cmdGroupDataset},
   {"saveGroup", &cmdSaveGroup},
@@ -801,6 +1351,11 @@ map<string, Command*> commands = {
   {"match", &cmdMatch},
   {"kSim", &cmdkSim},
   {"kSimRaw", &cmdkSimRaw},
+  {"kSimAnytime", &cmdkSimAnytime},
+  {"kSimAuto", &cmdkSimAuto},
+  {"explain", &cmdExplain},
+  {"range", &cmdRange},
+  {"motif", &cmdMotif},
   {"printTS", &cmdPrintTS},
   {"testSim", &cmdTestSim }
 };
@@ -0,0 +1,41 @@
+#include "BinaryDataset.hpp"
+
+#include <cstring>
+#include <fstream>
+
+namespace konex {
+
+uint64_t computeChecksum(const void* data, size_t size)
+{
+  // FNV-1a over 8-byte words, mixed once more at the end
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, bytes + i, 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+uint64_t binary_dataset_header_t::computeHeaderChecksum() const
+{
+  return computeChecksum(this, offsetof(binary_dataset_header_t, headerChecksum));
+}
+
+bool isBinaryDataset(const std::string& path)
+{
+  std::ifstream f(path, std::ios::binary);
+  char magic[sizeof(binary_dataset_header_t::magic)];
+  return f.read(magic, sizeof(magic)) && memcmp(magic, BINARY_DATASET_MAGIC, sizeof(magic)) == 0;
+}
+
+} // namespace konex
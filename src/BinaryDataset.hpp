@@ -0,0 +1,58 @@
+#ifndef BINARY_DATASET_H
+#define BINARY_DATASET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define BINARY_DATASET_MAGIC "KONEXBIN"
+#define BINARY_DATASET_VERSION 1
+// Values start at a multiple of this offset, so that they can be read in
+// place with aligned vector loads
+#define BINARY_DATASET_ALIGNMENT 64
+
+namespace konex {
+
+/**
+ *  @brief the header at the start of a binary dataset file
+ *
+ *  The header is followed by padding up to dataOffset, then by the values,
+ *  row by row, in the native byte order. The header checksum covers the
+ *  header before it, the data checksum covers the values.
+ */
+struct binary_dataset_header_t
+{
+  char magic[8];
+  uint32_t version;
+  // bytes of a value, 4 or 8
+  uint32_t precision;
+  int64_t itemCount;
+  int64_t itemLength;
+  uint64_t dataOffset;
+  uint32_t normalized;
+  uint32_t reserved;
+  // bounds of the values before the dataset was normalized
+  double normalizationMin;
+  double normalizationMax;
+  uint64_t dataChecksum;
+  uint64_t headerChecksum;
+
+  /**
+   *  @brief checksum of the fields before headerChecksum
+   */
+  uint64_t computeHeaderChecksum() const;
+};
+
+/**
+ *  @brief 64-bit checksum of an array, reading 8 bytes at a time
+ */
+uint64_t computeChecksum(const void* data, size_t size);
+
+/**
+ *  @brief checks whether a file starts like a binary dataset
+ */
+bool isBinaryDataset(const std::string& path);
+
+} // namespace konex
+
+#endif // BINARY_DATASET_H
@@ -0,0 +1,269 @@
+#include "CompressedDataset.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace konex {
+
+// Bits of a value, read as an unsigned integer of the same size
+typedef std::conditional<sizeof(data_t) == 8, uint64_t, uint32_t>::type value_bits_t;
+
+#define VALUE_BITS (8 * (int)sizeof(value_bits_t))
+// Leading zeros are stored on 5 bits, longer runs are cut to 31
+#define LEAD_BITS 5
+#define MAX_LEAD 31
+// Number of meaningful bits, minus one
+#define LENGTH_BITS (VALUE_BITS == 64 ? 6 : 5)
+
+static inline int _leadingZeros(uint64_t x) { return __builtin_clzll(x); }
+static inline int _leadingZeros(uint32_t x) { return __builtin_clz(x); }
+static inline int _trailingZeros(uint64_t x) { return __builtin_ctzll(x); }
+static inline int _trailingZeros(uint32_t x) { return __builtin_ctz(x); }
+
+static inline value_bits_t _bits(data_t value)
+{
+  value_bits_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static inline data_t _value(value_bits_t bits)
+{
+  data_t value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ *  @brief appends bits to an array of words, most significant bit first
+ */
+struct bit_writer_t
+{
+  std::vector<uint64_t>& words;
+  // bits used in the last word
+  int used = 64;
+
+  explicit bit_writer_t(std::vector<uint64_t>& words) : words(words) {}
+
+  /**
+   *  @brief writes the count lowest bits of value, with count in [1, 64]
+   */
+  void write(uint64_t value, int count)
+  {
+    while (count > 0)
+    {
+      if (this->used == 64)
+      {
+        this->words.push_back(0);
+        this->used = 0;
+      }
+      int n = std::min(count, 64 - this->used);
+      uint64_t chunk = value >> (count - n);
+      if (n < 64) {
+        chunk &= (1ULL << n) - 1;
+      }
+      this->words.back() |= chunk << (64 - this->used - n);
+      this->used += n;
+      count -= n;
+    }
+  }
+};
+
+/**
+ *  @brief reads the bits written by bit_writer_t
+ */
+struct bit_reader_t
+{
+  const uint64_t* words;
+  size_t position = 0;
+
+  explicit bit_reader_t(const uint64_t* words) : words(words) {}
+
+  uint64_t read(int count)
+  {
+    uint64_t value = 0;
+    while (count > 0)
+    {
+      int offset = this->position & 63;
+      int n = std::min(count, 64 - offset);
+      uint64_t chunk = (this->words[this->position >> 6] << offset) >> (64 - n);
+      value = n == 64 ? chunk : (value << n) | chunk;
+      this->position += n;
+      count -= n;
+    }
+    return value;
+  }
+};
+
+static void _encodeSeries(const data_t* values, int length, bit_writer_t& writer)
+{
+  value_bits_t previous = _bits(values[0]);
+  writer.write(previous, VALUE_BITS);
+
+  // window of the meaningful bits of the previous XOR, none yet
+  int lead = -1, trail = 0;
+  for (int i = 1; i < length; i++)
+  {
+    value_bits_t bits = _bits(values[i]);
+    value_bits_t x = bits ^ previous;
+    previous = bits;
+    if (x == 0)
+    {
+      writer.write(0, 1);
+      continue;
+    }
+
+    int newLead = std::min(_leadingZeros(x), MAX_LEAD);
+    int newTrail = _trailingZeros(x);
+    if (lead >= 0 && newLead >= lead && newTrail >= trail)
+    {
+      // The meaningful bits fit in the previous window
+      writer.write(2, 2);
+      writer.write(x >> trail, VALUE_BITS - lead - trail);
+    }
+    else
+    {
+      lead = newLead;
+      trail = newTrail;
+      int meaningful = VALUE_BITS - lead - trail;
+      writer.write(3, 2);
+      writer.write(lead, LEAD_BITS);
+      writer.write(meaningful - 1, LENGTH_BITS);
+      writer.write(x >> trail, meaningful);
+    }
+  }
+}
+
+static void _decodeSeries(bit_reader_t& reader, int length, data_t* dest)
+{
+  value_bits_t previous = reader.read(VALUE_BITS);
+  dest[0] = _value(previous);
+
+  int lead = 0, trail = 0;
+  for (int i = 1; i < length; i++)
+  {
+    if (reader.read(1) != 0)
+    {
+      if (reader.read(1) != 0)
+      {
+        lead = reader.read(LEAD_BITS);
+        int meaningful = reader.read(LENGTH_BITS) + 1;
+        trail = VALUE_BITS - lead - meaningful;
+      }
+      previous ^= (value_bits_t)reader.read(VALUE_BITS - lead - trail) << trail;
+    }
+    dest[i] = _value(previous);
+  }
+}
+
+CompressedDataset::CompressedDataset(const data_t* values, int itemCount, int itemLength)
+  : itemCount(itemCount), itemLength(itemLength)
+{
+  this->blockRows = std::max(COMPRESSED_BLOCK_VALUES / std::max(itemLength, 1), 1);
+  if (itemLength == 0) {
+    return;
+  }
+  for (int first = 0; first < itemCount; first += this->blockRows)
+  {
+    this->blocks.push_back(std::vector<uint64_t>());
+    bit_writer_t writer(this->blocks.back());
+    int last = std::min(itemCount, first + this->blockRows);
+    for (int i = first; i < last; i++) {
+      _encodeSeries(values + (size_t)i * itemLength, itemLength, writer);
+    }
+    this->blocks.back().shrink_to_fit();
+  }
+}
+
+CompressedDataset::CompressedDataset(const float* values, int itemCount, int itemLength,
+                                     std::unique_ptr<MappedFile> file)
+  : itemCount(itemCount), itemLength(itemLength), floats(values), file(std::move(file))
+{
+  this->blockRows = std::max(COMPRESSED_BLOCK_VALUES / std::max(itemLength, 1), 1);
+}
+
+size_t CompressedDataset::getCompressedBytes() const
+{
+  if (this->floats != nullptr) {
+    return (size_t)this->itemCount * this->itemLength * sizeof(float);
+  }
+  size_t bytes = 0;
+  for (const auto& block : this->blocks) {
+    bytes += block.size() * sizeof(uint64_t);
+  }
+  return bytes;
+}
+
+void CompressedDataset::_decodeBlock(int block, data_t* dest) const
+{
+  int first = block * this->blockRows;
+  int last = std::min(this->itemCount, first + this->blockRows);
+  if (this->floats != nullptr)
+  {
+    const float* values = this->floats + (size_t)first * this->itemLength;
+    std::copy(values, values + (size_t)(last - first) * this->itemLength, dest);
+    return;
+  }
+  bit_reader_t reader(this->blocks[block].data());
+  for (int i = first; i < last; i++) {
+    _decodeSeries(reader, this->itemLength, dest + (size_t)(i - first) * this->itemLength);
+  }
+}
+
+void CompressedDataset::decompress(data_t* dest) const
+{
+  for (int b = 0; b < this->getBlockCount(); b++) {
+    this->_decodeBlock(b, dest + (size_t)b * this->blockRows * this->itemLength);
+  }
+}
+
+std::shared_ptr<const std::vector<data_t>> CompressedDataset::getBlock(int block) const
+{
+  if (block < 0 || block >= this->getBlockCount()) {
+    throw KOnexException("Invalid block index");
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->cacheMutex);
+    for (auto it = this->cache.begin(); it != this->cache.end(); it++)
+    {
+      if (it->first == block)
+      {
+        this->cache.splice(this->cache.begin(), this->cache, it);
+        return it->second;
+      }
+    }
+  }
+
+  // Decoded outside of the lock, so that readers of other blocks are not held
+  int rows = std::min(this->itemCount - block * this->blockRows, this->blockRows);
+  auto values = std::make_shared<std::vector<data_t>>((size_t)rows * this->itemLength);
+  this->_decodeBlock(block, values->data());
+
+  std::lock_guard<std::mutex> lock(this->cacheMutex);
+  for (const auto& entry : this->cache)
+  {
+    if (entry.first == block) {
+      return entry.second;
+    }
+  }
+  this->cache.emplace_front(block, values);
+  if (this->cache.size() > COMPRESSED_CACHE_BLOCKS) {
+    this->cache.pop_back();
+  }
+  return values;
+}
+
+void CompressedDataset::readRow(int index, data_t* dest) const
+{
+  if (index < 0 || index >= this->itemCount) {
+    throw KOnexException("Invalid time series index");
+  }
+  std::shared_ptr<const std::vector<data_t>> block = this->getBlock(index / this->blockRows);
+  const data_t* row = block->data() + (size_t)(index % this->blockRows) * this->itemLength;
+  std::copy(row, row + this->itemLength, dest);
+}
+
+} // namespace konex
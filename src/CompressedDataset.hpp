@@ -0,0 +1,129 @@
+#ifndef COMPRESSED_DATASET_H
+#define COMPRESSED_DATASET_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "TimeSeries.hpp"
+#include "MappedFile.hpp"
+
+// Values of the series encoded together in a block, rounded to whole series
+#define COMPRESSED_BLOCK_VALUES (1 << 16)
+// Decoded blocks kept by a compressed dataset
+#define COMPRESSED_CACHE_BLOCKS 4
+
+namespace konex {
+
+/**
+ *  @brief the values of a dataset encoded without loss, block of series by
+ *         block of series
+ *
+ *  Each series is encoded as in Gorilla: its first value is stored as is, and
+ *  every other value as the XOR of its bits with those of the previous value.
+ *  Successive values of a series tend to share their sign, exponent and high
+ *  bits of mantissa, so the XOR has long runs of leading and trailing zeros
+ *  and only the bits between them are stored. A value equal to the previous
+ *  one takes a single bit.
+ *
+ *  The values of a binary dataset saved as float, when data_t is double, are
+ *  kept as they are instead: the file stays mapped, and blocks are decoded
+ *  by widening its values to data_t. The dataset then takes half the memory
+ *  of its values in data_t, and reads them exactly.
+ *
+ *  Blocks are decoded on demand into a small cache shared by all readers, so
+ *  that reading a few series does not decode the whole dataset.
+ *
+ *  Example:
+ *    CompressedDataset compressed(values, itemCount, itemLength);
+ *    compressed.readRow(12, buffer);
+ *    compressed.decompress(values);
+ */
+class CompressedDataset
+{
+public:
+
+  /**
+   *  @param values the values of the dataset, row by row
+   *  @param itemCount number of series
+   *  @param itemLength number of values of a series
+   */
+  CompressedDataset(const data_t* values, int itemCount, int itemLength);
+
+  /**
+   *  @param values the float values of the dataset, row by row, in file
+   *  @param itemCount number of series
+   *  @param itemLength number of values of a series
+   *  @param file the mapped file holding the values, kept for as long as
+   *         this object is
+   */
+  CompressedDataset(const float* values, int itemCount, int itemLength, std::unique_ptr<MappedFile> file);
+
+  CompressedDataset(const CompressedDataset&) = delete;
+  CompressedDataset& operator=(const CompressedDataset&) = delete;
+
+  int getItemCount() const { return this->itemCount; }
+  int getItemLength() const { return this->itemLength; }
+  int getBlockRowCount() const { return this->blockRows; }
+  int getBlockCount() const
+  {
+    return this->itemLength == 0 ? 0 : (this->itemCount + this->blockRows - 1) / this->blockRows;
+  }
+
+  /**
+   *  @brief gets the bytes of a value as stored: those of float if the
+   *         values are kept as float, of data_t otherwise
+   */
+  int getPrecision() const { return this->floats != nullptr ? sizeof(float) : sizeof(data_t); }
+
+  /**
+   *  @brief gets the bytes taken by the encoded values
+   */
+  size_t getCompressedBytes() const;
+
+  /**
+   *  @brief decodes every value, row by row, into an array of
+   *         itemCount * itemLength values. The cache is left untouched.
+   */
+  void decompress(data_t* dest) const;
+
+  /**
+   *  @brief gets the decoded values of a block, from the cache if it is there
+   *
+   *  The block stays valid for as long as it is held, even once evicted from
+   *  the cache. Safe to call from several threads.
+   *
+   *  @param block index of the block
+   *  @return the values of the rows of the block, row by row
+   */
+  std::shared_ptr<const std::vector<data_t>> getBlock(int block) const;
+
+  /**
+   *  @brief copies the values of a series through the cache of blocks
+   *
+   *  @throw KOnexException if the index is not in range
+   */
+  void readRow(int index, data_t* dest) const;
+
+private:
+  int itemCount;
+  int itemLength;
+  int blockRows;
+  // the bits of each block, in 64-bit words
+  std::vector<std::vector<uint64_t>> blocks;
+  // or the values kept as float, in the mapped file
+  const float* floats = nullptr;
+  std::unique_ptr<MappedFile> file;
+
+  // the most recently used decoded blocks first
+  mutable std::list<std::pair<int, std::shared_ptr<const std::vector<data_t>>>> cache;
+  mutable std::mutex cacheMutex;
+
+  void _decodeBlock(int block, data_t* dest) const;
+};
+
+} // namespace konex
+
+#endif // COMPRESSED_DATASET_H
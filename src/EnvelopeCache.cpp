@@ -0,0 +1,219 @@
+#include "EnvelopeCache.hpp"
+#include "TimeSeriesSet.hpp"
+
+#include "lib/trillionDTW.h"
+
+#include <algorithm>
+
+namespace konex {
+
+EnvelopeCache::~EnvelopeCache()
+{
+  this->_free();
+}
+
+void EnvelopeCache::clear()
+{
+  this->_free();
+  this->maxLength = dataset.getItemLength();
+  this->slabs = new std::atomic<slab_t*>[this->maxLength + 1];
+  for (int len = 0; len <= this->maxLength; len++) {
+    this->slabs[len] = nullptr;
+  }
+}
+
+void EnvelopeCache::extend()
+{
+  for (int len = 0; len <= this->maxLength && this->slabs; len++)
+  {
+    for (slab_t* slab = this->slabs[len].load(); slab; slab = slab->next)
+    {
+      int rowCount = dataset.getItemCount();
+      std::atomic<std::atomic<data_t*>*>* rows = new std::atomic<std::atomic<data_t*>*>[rowCount];
+      for (int i = 0; i < rowCount; i++) {
+        rows[i] = i < slab->rowCount ? slab->rows[i].load() : nullptr;
+      }
+      // The rows are counted even over the cap, their slots and envelopes
+      // are not
+      this->memoryUsage += (rowCount - slab->rowCount) * sizeof(std::atomic<std::atomic<data_t*>*>);
+      delete[] slab->rows;
+      slab->rows = rows;
+      slab->rowCount = rowCount;
+    }
+  }
+}
+
+void EnvelopeCache::_free()
+{
+  for (int len = 0; len <= this->maxLength && this->slabs; len++)
+  {
+    slab_t* slab = this->slabs[len].load();
+    while (slab)
+    {
+      for (int i = 0; i < slab->rowCount; i++)
+      {
+        std::atomic<data_t*>* slots = slab->rows[i].load();
+        for (int j = 0; slots && j < slab->subTimeSeriesCount; j++) {
+          delete[] slots[j].load();
+        }
+        delete[] slots;
+      }
+      delete[] slab->rows;
+      slab_t* next = slab->next;
+      delete slab;
+      slab = next;
+    }
+  }
+  delete[] this->slabs;
+  this->slabs = nullptr;
+  this->maxLength = 0;
+  this->memoryUsage = 0;
+}
+
+bool EnvelopeCache::_reserve(size_t bytes) const
+{
+  size_t used = this->memoryUsage.fetch_add(bytes);
+  if (used + bytes > this->memoryLimit)
+  {
+    this->memoryUsage.fetch_sub(bytes);
+    return false;
+  }
+  return true;
+}
+
+EnvelopeCache::slab_t* EnvelopeCache::_getSlab(int length, int band) const
+{
+  std::atomic<slab_t*>& head = this->slabs[length];
+  slab_t* first = head.load(std::memory_order_acquire);
+  for (slab_t* s = first; s; s = s->next)
+  {
+    if (s->band == band) {
+      return s;
+    }
+  }
+
+  int rowCount = dataset.getItemCount();
+  size_t bytes = rowCount * sizeof(std::atomic<std::atomic<data_t*>*>);
+  if (!this->_reserve(bytes)) {
+    return nullptr;
+  }
+
+  slab_t* slab = new slab_t;
+  slab->length = length;
+  slab->band = band;
+  slab->subTimeSeriesCount = dataset.getItemLength() - length + 1;
+  slab->rowCount = rowCount;
+  slab->rows = new std::atomic<std::atomic<data_t*>*>[rowCount];
+  for (int i = 0; i < rowCount; i++) {
+    slab->rows[i] = nullptr;
+  }
+
+  // Publish the new slab at the head of the list. If another thread published
+  // a slab meanwhile, check that it is not for the same band before retrying.
+  slab->next = first;
+  while (!head.compare_exchange_weak(slab->next, slab,
+                                     std::memory_order_release,
+                                     std::memory_order_acquire))
+  {
+    for (slab_t* s = slab->next; s != first; s = s->next)
+    {
+      if (s->band == band)
+      {
+        delete[] slab->rows;
+        delete slab;
+        this->memoryUsage.fetch_sub(bytes);
+        return s;
+      }
+    }
+    first = slab->next;
+  }
+  return slab;
+}
+
+std::atomic<data_t*>* EnvelopeCache::_getRow(slab_t* slab, int index) const
+{
+  std::atomic<std::atomic<data_t*>*>& row = slab->rows[index];
+  std::atomic<data_t*>* slots = row.load(std::memory_order_acquire);
+  if (slots) {
+    return slots;
+  }
+
+  size_t bytes = slab->subTimeSeriesCount * sizeof(std::atomic<data_t*>);
+  if (!this->_reserve(bytes)) {
+    return nullptr;
+  }
+  slots = new std::atomic<data_t*>[slab->subTimeSeriesCount];
+  for (int i = 0; i < slab->subTimeSeriesCount; i++) {
+    slots[i] = nullptr;
+  }
+
+  std::atomic<data_t*>* expected = nullptr;
+  if (!row.compare_exchange_strong(expected, slots,
+                                   std::memory_order_release,
+                                   std::memory_order_acquire))
+  {
+    // another thread allocated the slots of this series first
+    delete[] slots;
+    this->memoryUsage.fetch_sub(bytes);
+    return expected;
+  }
+  return slots;
+}
+
+const data_t* EnvelopeCache::getEnvelope(int index, int start, int length, int band) const
+{
+  if (this->slabs == nullptr || length <= 0 || length > this->maxLength) {
+    return nullptr;
+  }
+  band = std::min(band, length - 1);
+
+  slab_t* slab = this->_getSlab(length, band);
+  std::atomic<data_t*>* slots = slab != nullptr ? this->_getRow(slab, index) : nullptr;
+  if (slots == nullptr) {
+    return nullptr;
+  }
+
+  std::atomic<data_t*>& slot = slots[start];
+  data_t* envelope = slot.load(std::memory_order_acquire);
+  if (envelope) {
+    return envelope;
+  }
+
+  if (!this->_reserve(2 * length * sizeof(data_t))) {
+    return nullptr;
+  }
+  envelope = new data_t[2 * length];
+  data_t* seriesData = const_cast<data_t*>(dataset.getTimeSeries(index).getData());
+
+  // Function provided by trillionDTW codebase
+  lower_upper_lemire(seriesData + start, length, band, envelope, envelope + length);
+
+  data_t* expected = nullptr;
+  if (!slot.compare_exchange_strong(expected, envelope,
+                                    std::memory_order_release,
+                                    std::memory_order_acquire))
+  {
+    // another thread computed the same envelope first
+    delete[] envelope;
+    this->memoryUsage.fetch_sub(2 * length * sizeof(data_t));
+    return expected;
+  }
+  return envelope;
+}
+
+bool EnvelopeCache::precompute(int length, int band)
+{
+  int subTimeSeriesCount = dataset.getItemLength() - length + 1;
+  for (int idx = 0; idx < dataset.getItemCount(); idx++)
+  {
+    for (int start = 0; start < subTimeSeriesCount; start++)
+    {
+      if (this->getEnvelope(idx, start, length, band) == nullptr) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace konex
@@ -0,0 +1,127 @@
+#ifndef ENVELOPE_CACHE_H
+#define ENVELOPE_CACHE_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+#define DEFAULT_ENVELOPE_CACHE_BYTES (256UL << 20)
+
+namespace konex {
+
+class TimeSeriesSet;
+
+/**
+ *  @brief a cache of Keogh envelopes for the sub-sequences of a dataset
+ *
+ *  Envelopes are keyed by (index, start, length, band) and are computed at most
+ *  once per dataset, either lazily when a TimeSeries view asks for them or
+ *  ahead of time for a whole length with precompute(). Reads never take a
+ *  lock: each slot is an atomic pointer that is filled once with a
+ *  compare-and-swap and never changes until the cache is cleared, so
+ *  concurrent queries can share the envelopes of the same sub-sequences.
+ *
+ *  The slots of a (length, band) pair are allocated a series at a time, as its
+ *  first envelope is stored, so that lengths used on a few series only take
+ *  memory for those. The total memory held by the cache, slots included, is
+ *  capped. Once the cap is reached, no new envelope is stored and getEnvelope
+ *  returns nullptr, in which case the caller computes the envelope on its own.
+ */
+class EnvelopeCache
+{
+public:
+
+  /**
+   *  @brief constructor for EnvelopeCache
+   *
+   *  @param dataset the dataset whose sub-sequences are cached
+   */
+  EnvelopeCache(const TimeSeriesSet& dataset)
+    : dataset(dataset), memoryLimit(DEFAULT_ENVELOPE_CACHE_BYTES), memoryUsage(0) {}
+
+  /**
+   *  @brief destructor
+   */
+  ~EnvelopeCache();
+
+  EnvelopeCache(const EnvelopeCache&) = delete;
+  EnvelopeCache& operator=(const EnvelopeCache&) = delete;
+
+  /**
+   *  @brief gets the envelope of a sub-sequence, computing it if needed
+   *
+   *  @param index index of the time series in the dataset
+   *  @param start starting position of the sub-sequence
+   *  @param length length of the sub-sequence
+   *  @param band size of the Sakoe-Chiba warping band
+   *  @return an array of 2 * length values, the lower envelope followed by the
+   *          upper envelope. Returns nullptr if the memory cap is reached.
+   */
+  const data_t* getEnvelope(int index, int start, int length, int band) const;
+
+  /**
+   *  @brief computes the envelopes of all sub-sequences of a given length
+   *
+   *  @return true if all envelopes fit in the memory cap
+   */
+  bool precompute(int length, int band);
+
+  /**
+   *  @brief frees all cached envelopes
+   *
+   *  This must be called whenever the data of the dataset changes. It must not
+   *  be called while other threads read from the cache.
+   */
+  void clear();
+
+  /**
+   *  @brief makes room for the series appended to the dataset, keeping the
+   *         envelopes of the others
+   *
+   *  Like clear, it must not be called while other threads read from the
+   *  cache. TimeSeriesSet::appendData waits for the queries of the dataset
+   *  before calling it, see ScopedDatasetQuery.
+   */
+  void extend();
+
+  void setMemoryLimit(size_t bytes) { this->memoryLimit = bytes; }
+  size_t getMemoryLimit() const { return this->memoryLimit; }
+  size_t getMemoryUsage() const { return this->memoryUsage; }
+
+private:
+
+  /**
+   *  @brief envelopes of all sub-sequences of one length for one band
+   */
+  struct slab_t
+  {
+    int length;
+    int band;
+    int subTimeSeriesCount;
+    int rowCount;
+    // the slots of each series, subTimeSeriesCount each, or null until one
+    // of its envelopes is stored
+    std::atomic<std::atomic<data_t*>*>* rows;
+    slab_t* next;
+  };
+
+  const TimeSeriesSet& dataset;
+  size_t memoryLimit;
+  mutable std::atomic<size_t> memoryUsage;
+
+  // slabs[length] is a linked list of the slabs of that length, one per band
+  std::atomic<slab_t*>* slabs = nullptr;
+  int maxLength = 0;
+
+  void _free();
+  slab_t* _getSlab(int length, int band) const;
+  std::atomic<data_t*>* _getRow(slab_t* slab, int index) const;
+  bool _reserve(size_t bytes) const;
+};
+
+} // namespace konex
+
+#endif // ENVELOPE_CACHE_H
@@ -0,0 +1,632 @@
+#include "ExhaustiveSearch.hpp"
+#include "TimeSeriesSet.hpp"
+#include "GlobalGroupSpace.hpp"
+#include "Exception.hpp"
+#include "distance/DistanceProfile.hpp"
+
+#include "lib/trillionDTW.h"
+#include "lib/ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+namespace konex {
+
+static inline acc_t _sq(data_t x, data_t y)
+{
+  return ((acc_t)x - y) * ((acc_t)x - y);
+}
+
+ExhaustiveSearch::ExhaustiveSearch(const TimeSeriesSet& dataset, const TimeSeries& query, QueryContext& ctx)
+  : dataset(dataset), ctx(ctx), mode(SHARED_PREFIX), k(0), nextTask(0), sharedBound(INF)
+{
+  if (query.getLength() < 2) {
+    throw KOnexException("Length of query must be larger than 1");
+  }
+  query_dist_t distance = ctx.getDistance();
+  this->znormalized = distance == static_cast<query_dist_t>(znormCascadeDistance)
+                   || distance == static_cast<query_dist_t>(znormWarpedDistance)
+                   || distance == static_cast<query_dist_t>(znormPairwiseDistance);
+  this->lockstep = isLockstepDistance(distance);
+
+  znorm_t zn = this->znormalized ? query.getZNorm() : znorm_t();
+  this->query.resize(query.getLength());
+  for (int i = 0; i < query.getLength(); i++) {
+    this->query[i] = this->znormalized ? zn(query[i]) : query[i];
+  }
+}
+
+bool ExhaustiveSearch::supports(const QueryContext& ctx)
+{
+  query_dist_t distance = ctx.getDistance();
+  return distance == static_cast<query_dist_t>(cascadeDistance)
+      || distance == static_cast<query_dist_t>(warpedDistance)
+      || distance == static_cast<query_dist_t>(pairwiseDistance)
+      || distance == static_cast<query_dist_t>(znormCascadeDistance)
+      || distance == static_cast<query_dist_t>(znormWarpedDistance)
+      || distance == static_cast<query_dist_t>(znormPairwiseDistance);
+}
+
+std::vector<candidate_t> ExhaustiveSearch::kSim(int k)
+{
+  if (k <= 0) {
+    throw KOnexException("K must be positive");
+  }
+  this->k = k;
+  this->sharedBound = this->ctx.getDropout();
+  if (this->ctx.getDistance() == static_cast<query_dist_t>(pairwiseDistance)) {
+    return this->_kSimEuclidean();
+  }
+
+  int numThreads = this->ctx.getNumThreads();
+  this->_prepareTasks(numThreads);
+  this->nextTask = 0;
+
+  std::vector<worker_t> workers(numThreads);
+  if (numThreads == 1) {
+    this->_run(workers[0]);
+  }
+  else
+  {
+    ThreadPool pool(numThreads);
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < numThreads; i++)
+    {
+      worker_t* worker = &workers[i];
+      futures.push_back(pool.enqueue([this, worker] { this->_run(*worker); }));
+    }
+    for (auto& f : futures) {
+      f.get();
+    }
+  }
+
+  // Every candidate of the global top k is in the top k of its worker, so the
+  // union of the heaps holds the result.
+  std::vector<candidate_t> results;
+  for (auto& worker : workers) {
+    results.insert(results.end(), worker.heap.begin(), worker.heap.end());
+  }
+  std::sort(results.begin(), results.end());
+  if (results.size() > k) {
+    results.resize(k);
+  }
+  return results;
+}
+
+std::vector<candidate_t> ExhaustiveSearch::_kSimEuclidean()
+{
+  int m = this->query.size();
+  int n = this->dataset.getItemLength();
+  std::vector<candidate_t> results;
+  // Without any sub-sequence of the length of the query, there is no k-th
+  // best estimate to bound the others with
+  if (m > n || this->dataset.getItemCount() == 0) {
+    return results;
+  }
+
+  // The spectra of the dataset are kept by it for the next queries
+  std::shared_ptr<const DistanceProfile> profile = this->dataset.getDistanceProfile();
+  int profileLength = profile->getProfileLength(m);
+  std::vector<double> estimates((size_t)this->dataset.getItemCount() * profileLength);
+  TimeSeries query(this->query.data(), m);
+  double slack = profile->compute(query, estimates.data());
+
+  // The exact k-th best distance is at most the k-th best estimate plus the
+  // error, so any candidate of the result has an estimate within twice the
+  // error of it
+  std::vector<double> sorted(estimates);
+  int kth = std::min<size_t>(this->k, sorted.size()) - 1;
+  std::nth_element(sorted.begin(), sorted.begin() + kth, sorted.end());
+  double limit = sorted[kth] + 2 * slack;
+  data_t dropout = this->ctx.getDropout();
+  if (dropout != INF) {
+    limit = std::min(limit, (double)dropout * dropout * m + slack);
+  }
+
+  for (size_t i = 0; i < estimates.size(); i++)
+  {
+    if (estimates[i] > limit) {
+      continue;
+    }
+    int index = i / profileLength;
+    int start = i % profileLength;
+    TimeSeries candidate = this->dataset.getTimeSeries(index, start, start + m);
+    data_t dist = pairwiseDistance(query, candidate, dropout);
+    if (dist <= dropout && dist != INF) {
+      results.push_back(candidate_t(index, start, m, dist));
+    }
+  }
+  std::sort(results.begin(), results.end());
+  if (results.size() > this->k) {
+    results.resize(this->k);
+  }
+  return results;
+}
+
+void ExhaustiveSearch::_prepareTasks(int numThreads)
+{
+  int m = this->query.size();
+  int n = this->dataset.getItemLength();
+  int count = this->dataset.getItemCount();
+
+  // A few chunks per thread per length balance the load without making the
+  // envelopes of the data recomputed too often.
+  int chunks = numThreads == 1 ? 1 : std::min(count, 4 * numThreads);
+  int chunkSize = (count + chunks - 1) / std::max(chunks, 1);
+
+  this->tasks.clear();
+  this->queryBands.clear();
+
+  // Lengths closer to the query tend to hold the best matches, so they are
+  // searched first to tighten the bound early. Lengths with the same warping
+  // band share the envelopes of the query and of the data.
+  std::vector<int> order = generateTraverseOrder(m, n, this->ctx.getWarpingBandRatio());
+  for (auto i = 0; i < order.size(); i++)
+  {
+    int length = order[i];
+    if (length < 2 || length > n || (this->lockstep && length != m)) {
+      continue;
+    }
+    int band = this->lockstep ? 0 : this->ctx.getWarpingBandSize(std::max(m, length));
+    auto qb = std::find_if(this->queryBands.begin(), this->queryBands.end(),
+                           [band](const query_band_t& other) { return other.band == band; });
+    if (qb == this->queryBands.end())
+    {
+      this->queryBands.push_back(query_band_t());
+      this->_prepareBand(this->queryBands.back(), band);
+      qb = this->queryBands.end() - 1;
+    }
+    qb->lengths.push_back(length);
+  }
+
+  // A mapped dataset larger than a block is searched block by block, all
+  // lengths of a block before the next one, so that each block is read from
+  // the file once. The first task of a block reads the next one ahead.
+  int blockRows = this->dataset.getBlockRowCount();
+  for (int first = 0; first < count; first += blockRows)
+  {
+    int last = std::min(count, first + blockRows);
+    for (int i = 0; i < this->queryBands.size(); i++)
+    {
+      for (int begin = first; begin < last; begin += chunkSize)
+      {
+        task_t task;
+        task.queryBand = i;
+        task.begin = begin;
+        task.end = std::min(last, begin + chunkSize);
+        if (begin == first && i == 0 && last < count)
+        {
+          task.prefetchBegin = last;
+          task.prefetchCount = blockRows;
+        }
+        this->tasks.push_back(task);
+      }
+    }
+  }
+}
+
+void ExhaustiveSearch::_run(worker_t& worker)
+{
+  int n = this->dataset.getItemLength();
+  worker.dataLower.resize(n);
+  worker.dataUpper.resize(n);
+  worker.cb.resize(n);
+  worker.cb1.resize(n);
+  worker.cb2.resize(n);
+  if (this->znormalized)
+  {
+    worker.tz.resize(n);
+    worker.tzLower.resize(n);
+    worker.tzUpper.resize(n);
+  }
+
+  int i;
+  while ((i = this->nextTask++) < this->tasks.size())
+  {
+    const task_t& task = this->tasks[i];
+    if (task.prefetchCount > 0) {
+      this->dataset.adviseAccess(ACCESS_WILLNEED, task.prefetchBegin, task.prefetchCount);
+    }
+    this->_searchTask(worker, task);
+  }
+}
+
+void ExhaustiveSearch::_prepareBand(query_band_t& qb, int band) const
+{
+  int m = this->query.size();
+  data_t* q = const_cast<data_t*>(this->query.data());
+
+  qb.band = band;
+  qb.lower.resize(m);
+  qb.upper.resize(m);
+  lower_upper_lemire(q, m, std::min(band, m - 1), qb.lower.data(), qb.upper.data());
+
+  // Visit the query points with the largest magnitude first, as they are
+  // likely to contribute the most to the lower bounds.
+  qb.order.resize(m);
+  for (int i = 0; i < m; i++) {
+    qb.order[i] = i;
+  }
+  std::sort(qb.order.begin(), qb.order.end(), [q](int a, int b) {
+    return std::fabs(q[a]) > std::fabs(q[b]);
+  });
+
+  qb.sortedQuery.resize(m);
+  qb.sortedLower.resize(m);
+  qb.sortedUpper.resize(m);
+  for (int i = 0; i < m; i++)
+  {
+    qb.sortedQuery[i] = q[qb.order[i]];
+    qb.sortedLower[i] = qb.lower[qb.order[i]];
+    qb.sortedUpper[i] = qb.upper[qb.order[i]];
+  }
+}
+
+acc_t ExhaustiveSearch::_threshold(const worker_t& worker, int length) const
+{
+  data_t dist = this->sharedBound.load(std::memory_order_relaxed);
+  if (worker.heap.size() == this->k) {
+    dist = std::min(dist, worker.heap.front().dist);
+  }
+  if (dist == INF) {
+    return INF;
+  }
+  // Bounds are compared in the squared, unnormalized space of the kernels. The
+  // bound is loosened slightly so that a candidate tying with the k-th best is
+  // still computed exactly and ordered by its coordinates.
+  acc_t cost;
+  if (this->lockstep) {
+    cost = dist * dist * this->query.size();
+  }
+  else
+  {
+    acc_t s = (acc_t)dist * 2 * std::max((int)this->query.size(), length);
+    cost = s * s;
+  }
+  return std::nextafter(cost * (1 + 1e-9), INF);
+}
+
+data_t ExhaustiveSearch::_toDistance(acc_t cost, int length) const
+{
+  if (this->lockstep) {
+    return sqrt(cost / this->query.size());
+  }
+  return sqrt(cost) / (2 * std::max((int)this->query.size(), length));
+}
+
+void ExhaustiveSearch::_offer(worker_t& worker, int index, int start, int length, data_t dist)
+{
+  std::vector<candidate_t>& heap = worker.heap;
+  candidate_t candidate(index, start, length, dist);
+  if (heap.size() < this->k)
+  {
+    heap.push_back(candidate);
+    std::push_heap(heap.begin(), heap.end());
+  }
+  else if (candidate < heap.front())
+  {
+    std::pop_heap(heap.begin(), heap.end());
+    heap.back() = candidate;
+    std::push_heap(heap.begin(), heap.end());
+  }
+  else {
+    return;
+  }
+
+  // Publish the k-th best distance of this worker. No candidate further than
+  // it can be in the top k of all workers.
+  if (heap.size() == this->k)
+  {
+    data_t kth = heap.front().dist;
+    data_t current = this->sharedBound.load(std::memory_order_relaxed);
+    while (kth < current && !this->sharedBound.compare_exchange_weak(current, kth, std::memory_order_relaxed)) {}
+  }
+}
+
+void ExhaustiveSearch::_searchTask(worker_t& worker, const task_t& task)
+{
+  int m = this->query.size();
+  int n = this->dataset.getItemLength();
+  const query_band_t& qb = this->queryBands[task.queryBand];
+  int maxLength = *std::max_element(qb.lengths.begin(), qb.lengths.end());
+
+  worker.dtwBuffer.resize(std::max(2 * (2 * std::min(qb.band, m - 1) + 1), 2 * maxLength));
+
+  for (int idx = task.begin; idx < task.end; idx++)
+  {
+    if (this->mode == SHARED_PREFIX && !this->znormalized && qb.lengths.size() > 1) {
+      this->_searchSharedPrefix(worker, qb, idx);
+      continue;
+    }
+
+    // The envelope of the whole series is at least as wide as the envelope
+    // of any of its sub-sequences, so it can be slid along the series.
+    data_t* t = const_cast<data_t*>(this->dataset.getTimeSeries(idx).getData());
+    lower_upper_lemire(t, n, std::min(qb.band, n - 1), worker.dataLower.data(), worker.dataUpper.data());
+
+    for (auto length : qb.lengths) {
+      this->_searchLength(worker, qb, length, idx);
+    }
+  }
+}
+
+void ExhaustiveSearch::_searchLength(worker_t& worker, const query_band_t& qb, int length, int idx)
+{
+  int m = this->query.size();
+  int n = this->dataset.getItemLength();
+  const data_t* t = this->dataset.getTimeSeries(idx).getData();
+
+  for (int start = 0; start + length <= n; start++)
+  {
+    acc_t bsf = this->_threshold(worker, length);
+    znorm_t zn = this->znormalized ? this->dataset.getZNorm(idx, start, length) : znorm_t();
+    acc_t d;
+    if (length == m) {
+      d = this->_sameLengthDistance(worker, t + start, qb, worker.dataLower.data() + start,
+                                    worker.dataUpper.data() + start, zn, bsf);
+    }
+    else {
+      d = this->_warpedDistance(worker, t + start, length, qb, worker.dataLower.data() + start,
+                                worker.dataUpper.data() + start, zn, bsf);
+    }
+    if (d < bsf)
+    {
+      data_t dist = this->_toDistance(d, length);
+      if (dist <= this->ctx.getDropout()) {
+        this->_offer(worker, idx, start, length, dist);
+      }
+    }
+  }
+}
+
+void ExhaustiveSearch::_searchSharedPrefix(worker_t& worker, const query_band_t& qb, int idx)
+{
+  int m = this->query.size();
+  int n = this->dataset.getItemLength();
+  int r = qb.band;
+  const data_t* q = this->query.data();
+  const data_t* series = this->dataset.getTimeSeries(idx).getData();
+
+  int minLength = *std::min_element(qb.lengths.begin(), qb.lengths.end());
+  int maxLength = *std::max_element(qb.lengths.begin(), qb.lengths.end());
+
+  for (int start = 0; start + minLength <= n; start++)
+  {
+    const data_t* t = series + start;
+    int columns = std::min(maxLength, n - start);
+
+    // The threshold grows with the length of the candidate, so the one of the
+    // longest candidate holds for all of them.
+    acc_t bsf = this->_threshold(worker, columns);
+
+    acc_t lb = _sq(t[0], q[0]);
+    if (lb >= bsf) {
+      continue;
+    }
+
+    // Every point of the shortest candidate is matched to a point of the query
+    // within the band, whatever the length of the candidate.
+    int len = std::min(m, minLength);
+    lb = 0;
+    for (int j = 0; j < len && lb < bsf; j++)
+    {
+      if (t[j] > qb.upper[j]) {
+        lb += _sq(t[j], qb.upper[j]);
+      }
+      else if (t[j] < qb.lower[j]) {
+        lb += _sq(t[j], qb.lower[j]);
+      }
+    }
+    if (lb >= bsf) {
+      continue;
+    }
+
+    // Rows follow the query and columns follow the longest candidate. The
+    // distance to the candidate of length L is in column L - 1 of the last row.
+    acc_t* prev = worker.dtwBuffer.data();
+    acc_t* curr = prev + columns;
+    bool abandoned = false;
+    for (int i = 0; i < m; i++)
+    {
+      int jStart = std::max(0, i - r);
+      int jEnd = std::min(columns - 1, i + r);
+      acc_t rowMin = INF;
+      for (int j = jStart; j <= jEnd; j++)
+      {
+        acc_t best;
+        if (i == 0 && j == 0) {
+          best = 0;
+        }
+        else
+        {
+          best = INF;
+          if (j > jStart) {
+            best = std::min(best, curr[j - 1]);
+          }
+          if (i > 0 && j > 0) {
+            best = std::min(best, prev[j - 1]);
+          }
+          if (i > 0 && j <= i - 1 + r) {
+            best = std::min(best, prev[j]);
+          }
+        }
+        curr[j] = best + _sq(q[i], t[j]);
+        rowMin = std::min(rowMin, curr[j]);
+      }
+      if (rowMin >= bsf)
+      {
+        abandoned = true;
+        break;
+      }
+      std::swap(prev, curr);
+    }
+    if (abandoned) {
+      continue;
+    }
+
+    for (auto length : qb.lengths)
+    {
+      if (length > columns) {
+        continue;
+      }
+      acc_t d = prev[length - 1];
+      if (d < this->_threshold(worker, length))
+      {
+        data_t dist = this->_toDistance(d, length);
+        if (dist <= this->ctx.getDropout()) {
+          this->_offer(worker, idx, start, length, dist);
+        }
+      }
+    }
+  }
+}
+
+acc_t ExhaustiveSearch::_sameLengthDistance(worker_t& worker, const data_t* t, const query_band_t& qb,
+                                            const data_t* lower, const data_t* upper, const znorm_t& zn,
+                                            acc_t bsf)
+{
+  int m = this->query.size();
+  data_t* tt = const_cast<data_t*>(t);
+  data_t* q = const_cast<data_t*>(this->query.data());
+  int* order = const_cast<int*>(qb.order.data());
+
+  // The hierarchy of LB_Kim needs the first and last three points to be disjoint
+  acc_t lb;
+  if (m >= 6) {
+    lb = lb_kim_hierarchy(tt, q, 0, m, zn.mean, zn.std, bsf);
+  }
+  else {
+    lb = _sq(zn(t[0]), q[0]) + _sq(zn(t[m - 1]), q[m - 1]);
+  }
+  if (lb >= bsf) {
+    return INF;
+  }
+
+  acc_t lbQuery = lb_keogh_cumulative(order, tt, const_cast<data_t*>(qb.sortedUpper.data()),
+                                       const_cast<data_t*>(qb.sortedLower.data()),
+                                       worker.cb1.data(), 0, m, zn.mean, zn.std, bsf);
+  if (lbQuery >= bsf) {
+    return INF;
+  }
+
+  acc_t lbData = lb_keogh_data_cumulative(order, tt, const_cast<data_t*>(qb.sortedQuery.data()),
+                                           worker.cb2.data(), const_cast<data_t*>(lower),
+                                           const_cast<data_t*>(upper), m, zn.mean, zn.std, bsf);
+  if (lbData >= bsf) {
+    return INF;
+  }
+
+  // Use the tighter bound for early abandoning the DTW
+  const acc_t* bound = lbQuery > lbData ? worker.cb1.data() : worker.cb2.data();
+  worker.cb[m - 1] = bound[m - 1];
+  for (int i = m - 2; i >= 0; i--) {
+    worker.cb[i] = worker.cb[i + 1] + bound[i];
+  }
+
+  if (this->znormalized)
+  {
+    for (int i = 0; i < m; i++) {
+      worker.tz[i] = zn(t[i]);
+    }
+    tt = worker.tz.data();
+  }
+  return dtw(tt, q, worker.cb.data(), m, std::min(qb.band, m - 1), bsf, worker.dtwBuffer.data());
+}
+
+acc_t ExhaustiveSearch::_warpedDistance(worker_t& worker, const data_t* t, int length, const query_band_t& qb,
+                                        const data_t* lower, const data_t* upper, const znorm_t& zn, acc_t bsf)
+{
+  int m = this->query.size();
+  int r = qb.band;
+  const data_t* q = this->query.data();
+
+  acc_t lb = _sq(zn(t[0]), q[0]) + _sq(zn(t[length - 1]), q[m - 1]);
+  if (lb >= bsf) {
+    return INF;
+  }
+
+  // The rest of the cascade reads every point, so the candidate and its part
+  // of the envelope are normalized once
+  if (this->znormalized)
+  {
+    for (int i = 0; i < length; i++)
+    {
+      worker.tz[i] = zn(t[i]);
+      worker.tzLower[i] = zn(lower[i]);
+      worker.tzUpper[i] = zn(upper[i]);
+    }
+    t = worker.tz.data();
+    lower = worker.tzLower.data();
+    upper = worker.tzUpper.data();
+  }
+
+  int len = std::min(m, length);
+  lb = 0;
+  for (int i = 0; i < len && lb < bsf; i++)
+  {
+    if (t[i] > qb.upper[i]) {
+      lb += _sq(t[i], qb.upper[i]);
+    }
+    else if (t[i] < qb.lower[i]) {
+      lb += _sq(t[i], qb.lower[i]);
+    }
+  }
+  if (lb >= bsf) {
+    return INF;
+  }
+
+  lb = 0;
+  for (int i = 0; i < len && lb < bsf; i++)
+  {
+    if (q[i] > upper[i]) {
+      lb += _sq(q[i], upper[i]);
+    }
+    else if (q[i] < lower[i]) {
+      lb += _sq(q[i], lower[i]);
+    }
+  }
+  if (lb >= bsf) {
+    return INF;
+  }
+
+  // Rows follow the query and columns follow the candidate. Cells out of the
+  // band of their row are never read.
+  acc_t* prev = worker.dtwBuffer.data();
+  acc_t* curr = prev + length;
+  for (int i = 0; i < m; i++)
+  {
+    int jStart = std::max(0, i - r);
+    int jEnd = std::min(length - 1, i + r);
+    acc_t rowMin = INF;
+    for (int j = jStart; j <= jEnd; j++)
+    {
+      acc_t best;
+      if (i == 0 && j == 0) {
+        best = 0;
+      }
+      else
+      {
+        best = INF;
+        if (j > jStart) {
+          best = std::min(best, curr[j - 1]);
+        }
+        if (i > 0 && j > 0) {
+          best = std::min(best, prev[j - 1]);
+        }
+        if (i > 0 && j <= i - 1 + r) {
+          best = std::min(best, prev[j]);
+        }
+      }
+      curr[j] = best + _sq(q[i], t[j]);
+      rowMin = std::min(rowMin, curr[j]);
+    }
+    if (rowMin >= bsf) {
+      return rowMin;
+    }
+    std::swap(prev, curr);
+  }
+  return prev[length - 1];
+}
+
+} // namespace konex
@@ -0,0 +1,189 @@
+#ifndef EXHAUSTIVE_SEARCH_H
+#define EXHAUSTIVE_SEARCH_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+#include "distance/QueryContext.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace konex {
+
+class TimeSeriesSet;
+
+/**
+ *  @brief an exact k-nearest-neighbor search over all sub-sequences of a dataset
+ *         under the warped distance
+ *
+ *  The search follows the UCR suite: every candidate goes through a cascade of
+ *  increasingly expensive lower bounds (LB_Kim on the first and last points,
+ *  LB_Keogh with the query envelope and LB_Keogh with the envelope of the data)
+ *  before the DTW is computed, and the DTW itself is abandoned as soon as its
+ *  partial cost plus the remaining lower bound exceeds the k-th best distance.
+ *  Envelopes of the data are computed once per time series and slid along it.
+ *
+ *  Lengths that cannot be reached within the warping band of the query are
+ *  skipped, so fewer than k results are returned if the dataset does not have k
+ *  sub-sequences within reach. Ties are broken by (index, start, length), which
+ *  makes the result independent of the order of the scan.
+ *
+ *  In the shared-prefix mode, the lengths that share a warping band are
+ *  searched together: for a given start, the DTW between the query and every
+ *  candidate [start, start + L) is read from column L - 1 of the last row of a
+ *  single cost matrix against the longest of these candidates. This replaces
+ *  one banded DTW per length with one per distinct band, at the cost of the
+ *  lower bounds that depend on the end of the candidate. Bands used by a single
+ *  length are still searched per length. This is the default mode.
+ *
+ *  The scan can be split across threads by (length, range of time series).
+ *  Each worker keeps its own top-k heap and publishes its k-th best distance to
+ *  a shared bound that every worker uses to abandon candidates. The heaps are
+ *  merged at the end, so the result is the same for any number of threads.
+ *
+ *  Under the Euclidean distance, only the sub-sequences of the length of the
+ *  query are compared with it. Their distances are estimated all at once from
+ *  the distance profiles of the query (MASS), and the candidates whose
+ *  estimate is within the error bound of the k-th best are compared exactly.
+ *  The spectra of the dataset are kept by it and shared by the queries.
+ *  This search runs on a single thread.
+ *
+ *  Under the z-normalized distances, the query is normalized once and each
+ *  candidate with its own mean and standard deviation, taken from the prefix
+ *  sums of the dataset. The lower bounds normalize the points they read, and
+ *  only the candidates that pass them are normalized before the DTW, as in the
+ *  UCR suite. The z-normalized Euclidean distance is searched as a DTW without
+ *  warping. The shared-prefix mode does not apply, since the candidates of a
+ *  start are normalized differently for each length.
+ */
+class ExhaustiveSearch
+{
+public:
+
+  /**
+   *  @brief how the candidates of the different lengths are compared to the query
+   */
+  enum search_mode_t
+  {
+    // one DTW per candidate with the full cascade of lower bounds
+    PER_LENGTH,
+    // one DTW per start and warping band, shared by all lengths of that band
+    SHARED_PREFIX
+  };
+
+  /**
+   *  @brief constructor for ExhaustiveSearch
+   *
+   *  @param dataset the dataset to be searched
+   *  @param query the query. Its values are copied.
+   *  @param ctx settings of the query. Its distance must be a warped distance or
+   *         the Euclidean distance, on the raw or the z-normalized values.
+   *
+   *  @throw KOnexException if the query is shorter than 2
+   */
+  ExhaustiveSearch(const TimeSeriesSet& dataset, const TimeSeries& query, QueryContext& ctx);
+
+  /**
+   *  @brief finds the k sub-sequences closest to the query
+   *
+   *  The number of threads is taken from the query context.
+   *
+   *  @return candidates sorted by increasing distance
+   */
+  std::vector<candidate_t> kSim(int k);
+
+  search_mode_t getMode() const { return this->mode; }
+  void setMode(search_mode_t mode) { this->mode = mode; }
+
+  /**
+   *  @return true if the distance of a context can be computed by this search
+   */
+  static bool supports(const QueryContext& ctx);
+
+private:
+
+  /**
+   *  @brief query data that depends on the warping band, shared by all candidates
+   *         of the lengths it is searched for
+   */
+  struct query_band_t
+  {
+    int band;
+    // lengths searched with this band, in the order they are searched
+    std::vector<int> lengths;
+    std::vector<data_t> lower;
+    std::vector<data_t> upper;
+
+    // Only for candidates of the same length as the query
+    std::vector<int> order;
+    std::vector<data_t> sortedQuery;
+    std::vector<data_t> sortedLower;
+    std::vector<data_t> sortedUpper;
+  };
+
+  /**
+   *  @brief the sub-sequences of the lengths of a query band in a range of
+   *         time series
+   */
+  struct task_t
+  {
+    int queryBand;
+    int begin;
+    int end;
+    // rows of a mapped dataset read ahead when the task starts, if any
+    int prefetchBegin = 0;
+    int prefetchCount = 0;
+  };
+
+  /**
+   *  @brief state of a thread of the search
+   */
+  struct worker_t
+  {
+    std::vector<candidate_t> heap;
+
+    // scratch buffers
+    std::vector<data_t> dataLower, dataUpper;
+    std::vector<acc_t> cb, cb1, cb2;
+    std::vector<acc_t> dtwBuffer;
+    // z-normalized candidate and envelope of the data
+    std::vector<data_t> tz, tzLower, tzUpper;
+  };
+
+  const TimeSeriesSet& dataset;
+  QueryContext& ctx;
+  std::vector<data_t> query;
+  search_mode_t mode;
+  int k;
+  // whether the candidates are z-normalized, the query then being stored normalized
+  bool znormalized;
+  // whether only candidates of the length of the query are compared, point by point
+  bool lockstep;
+
+  std::vector<task_t> tasks;
+  std::vector<query_band_t> queryBands;
+  std::atomic<int> nextTask;
+
+  // the smallest k-th best distance published by the workers
+  std::atomic<data_t> sharedBound;
+
+  std::vector<candidate_t> _kSimEuclidean();
+  void _prepareBand(query_band_t& qb, int band) const;
+  void _prepareTasks(int numThreads);
+  void _run(worker_t& worker);
+  void _searchTask(worker_t& worker, const task_t& task);
+  void _searchLength(worker_t& worker, const query_band_t& qb, int length, int idx);
+  void _searchSharedPrefix(worker_t& worker, const query_band_t& qb, int idx);
+  void _offer(worker_t& worker, int index, int start, int length, data_t dist);
+  acc_t _threshold(const worker_t& worker, int length) const;
+  data_t _toDistance(acc_t cost, int length) const;
+
+  acc_t _sameLengthDistance(worker_t& worker, const data_t* t, const query_band_t& qb,
+                            const data_t* lower, const data_t* upper, const znorm_t& zn, acc_t bsf);
+  acc_t _warpedDistance(worker_t& worker, const data_t* t, int length, const query_band_t& qb,
+                        const data_t* lower, const data_t* upper, const znorm_t& zn, acc_t bsf);
+};
+
+} // namespace konex
+
+#endif // EXHAUSTIVE_SEARCH_H
@@ -6,6 +6,8 @@
 #include "distance/Distance.hpp"
 #include "lib/ThreadPool.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <sstream>
 #include <functional>
@@ -14,6 +16,7 @@
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <memory>
 #include <boost/algorithm/string.hpp>
 
 
@@ -35,34 +38,133 @@ void GlobalGroupSpace::reset(void)
     this->localLengthGroupSpace[i] = nullptr;
   }
   this->localLengthGroupSpace.clear();
+  this->lengthStats.clear();
+  // Grouping and loading start from here too
+  this->generation++;
+}
+
+void GlobalGroupSpace::rebindCentroids()
+{
+  for (LocalLengthGroupSpace* space : this->localLengthGroupSpace)
+  {
+    if (space != nullptr) {
+      space->rebindCentroids();
+    }
+  }
+}
+
+void GlobalGroupSpace::_collectStats()
+{
+  this->lengthStats.assign(this->localLengthGroupSpace.size(), group_length_stats_t());
+  for (auto i = 0; i < this->localLengthGroupSpace.size(); i++)
+  {
+    const LocalLengthGroupSpace* space = this->localLengthGroupSpace[i];
+    if (space == nullptr) {
+      continue;
+    }
+    this->lengthStats[i].groupCount = space->getNumberOfGroups();
+    for (auto j = 0; j < space->getNumberOfGroups(); j++) {
+      this->lengthStats[i].memberCount += space->getGroup(j)->getCount();
+    }
+  }
 }
 
 void GlobalGroupSpace::_loadDistance(const string& distance_name)
 {
   this->distanceName = distance_name;
   this->pairwiseDistance = getDistance(distance_name);
-  this->warpedDistance = cascadeDistance;
 }
 
-int GlobalGroupSpace::_group(int i)
+std::shared_ptr<const DistanceProfile> GlobalGroupSpace::_makeDistanceProfile() const
+{
+  // The spectra of the dataset are shared by the groupings of all lengths
+  if (this->pairwiseDistance == static_cast<dist_t>(konex::pairwiseDistance)
+      && this->dataset.getItemLength() >= DISTANCE_PROFILE_MIN_LENGTH) {
+    return this->dataset.getDistanceProfile();
+  }
+  return nullptr;
+}
+
+int GlobalGroupSpace::_group(int i, const DistanceProfile* profile, int firstRow, int lastRow)
 {
-  this->localLengthGroupSpace[i] = new LocalLengthGroupSpace(this->dataset, i);
-  int noOfGenerated = this->localLengthGroupSpace[i]->generateGroups(this->pairwiseDistance, this->threshold);
+  if (this->localLengthGroupSpace[i] == nullptr) {
+    this->localLengthGroupSpace[i] = new LocalLengthGroupSpace(this->dataset, i);
+  }
+  int noOfGenerated = this->localLengthGroupSpace[i]->generateGroups(this->pairwiseDistance, this->threshold,
+                                                                     profile, firstRow, lastRow);
   return noOfGenerated;
 }
 
+int GlobalGroupSpace::_groupByBlock(int num_thread, int firstRow)
+{
+  int itemCount = this->dataset.getItemCount();
+  int blockRows = this->dataset.getBlockRowCount();
+  bool outOfCore = blockRows < itemCount;
+
+  // New series only join the lengths that were grouped
+  vector<int> lengths;
+  for (auto i = 2; i < this->localLengthGroupSpace.size(); i++)
+  {
+    if (firstRow == 0 || this->localLengthGroupSpace[i] != nullptr) {
+      lengths.push_back(i);
+    }
+  }
+
+  // The distance profile holds the spectra of the whole dataset, so it is only
+  // worth it when the dataset is grouped at once
+  std::shared_ptr<const DistanceProfile> profile = outOfCore || firstRow > 0 ? nullptr : this->_makeDistanceProfile();
+  std::unique_ptr<ThreadPool> pool(num_thread > 0 ? new ThreadPool(num_thread) : nullptr);
+  int numberOfGroups = 0;
+  for (int first = firstRow; first < itemCount; first += blockRows)
+  {
+    int last = std::min(itemCount, first + blockRows);
+    // The next block is read from the file while this one is grouped
+    if (outOfCore) {
+      this->dataset.adviseAccess(ACCESS_WILLNEED, last, blockRows);
+    }
+
+    if (pool == nullptr)
+    {
+      for (int i : lengths) {
+        numberOfGroups += this->_group(i, profile.get(), first, last);
+      }
+    }
+    else
+    {
+      vector< std::future<int> > groupCounts;
+      for (int i : lengths)
+      {
+        groupCounts.emplace_back(
+          pool->enqueue([this, i, &profile, first, last] {
+            return this->_group(i, profile.get(), first, last);
+          })
+        );
+      }
+      for (auto i = 0; i < groupCounts.size(); i++)
+      {
+        numberOfGroups += groupCounts[i].get();
+      }
+    }
+
+    if (outOfCore) {
+      this->dataset.adviseAccess(ACCESS_COLD, first, last - first);
+    }
+  }
+  // Searching the groups reads their members here and there
+  if (outOfCore) {
+    this->dataset.adviseAccess(ACCESS_RANDOM);
+  }
+  return numberOfGroups;
+}
+
 int GlobalGroupSpace::group(const string& distance_name, data_t threshold)
 {
   reset();
   this->_loadDistance(distance_name);
   this->localLengthGroupSpace.resize(dataset.getItemLength() + 1, nullptr);
   this->threshold = threshold;
-  int numberOfGroups = 0;
-
-  for (auto i = 2; i < this->localLengthGroupSpace.size(); i++)
-  {
-    numberOfGroups += this->_group(i);
-  }
+  int numberOfGroups = this->_groupByBlock(0);
+  this->_collectStats();
   return numberOfGroups;
 }
 
@@ -72,46 +174,47 @@ int GlobalGroupSpace::groupMultiThreaded(const std::string& distance_name, data_
   this->_loadDistance(distance_name);
   this->localLengthGroupSpace.resize(dataset.getItemLength() + 1, nullptr);
   this->threshold = threshold;
-  int numberOfGroups = 0;
+  int numberOfGroups = this->_groupByBlock(std::max(num_thread, 1));
+  this->_collectStats();
+  return numberOfGroups;
+}
 
-  ThreadPool pool(num_thread);
-  vector< std::future<int> > groupCounts;
-  for (auto i = 2; i < this->localLengthGroupSpace.size(); i++)
-  {
-    groupCounts.emplace_back(
-      pool.enqueue([this, i] {
-        return this->_group(i);
-      })
-    );
-  }
-  for (auto i = 0; i < groupCounts.size(); i++)
-  {
-    numberOfGroups += groupCounts[i].get();
+int GlobalGroupSpace::extend(int firstRow, int num_thread)
+{
+  if (!this->grouped()) {
+    throw KOnexException("No group found");
   }
+  int numberOfGroups = this->_groupByBlock(num_thread > 1 ? num_thread : 0, firstRow);
+  this->_collectStats();
+  this->generation++;
   return numberOfGroups;
 }
 
 
-candidate_time_series_t GlobalGroupSpace::getBestMatch(const TimeSeries& query)
+candidate_t GlobalGroupSpace::getBestMatch(const TimeSeries& query, QueryContext& ctx)
 {
   if (query.getLength() <= 1) {
     throw KOnexException("Length of query must be larger than 1");
   }
-  data_t bestSoFarDist = INF;
+  ScopedQuery scopedQuery(ctx, query);
+  data_t bestSoFarDist = ctx.getDropout();
   const Group* bestSoFarGroup = nullptr;
 
-  vector<int> order (generateTraverseOrder(query.getLength(), this->localLengthGroupSpace.size() - 1));
+  vector<int> order = generateReachableLengths(query.getLength(), this->localLengthGroupSpace.size() - 1, ctx);
   for (auto io = 0; io < order.size(); io++) {
     int i = order[io];
     // this looks through each group of a certain length finding the best of those groups
-    candidate_group_t candidate = this->localLengthGroupSpace[i]->getBestGroup(query, this->warpedDistance, bestSoFarDist);
+    candidate_group_t candidate = this->localLengthGroupSpace[i]->getBestGroup(query, ctx, bestSoFarDist);
     if (candidate.second < bestSoFarDist)
     {
       bestSoFarGroup = candidate.first;
       bestSoFarDist = candidate.second;
     }
   }
-  return bestSoFarGroup->getBestMatch(query, this->warpedDistance);
+  if (bestSoFarGroup == nullptr) {
+    throw KOnexException("No match is found within the dropout");
+  }
+  return bestSoFarGroup->getBestMatch(query, ctx);
 }
 
 bool GlobalGroupSpace::grouped(void) const
@@ -119,19 +222,20 @@ bool GlobalGroupSpace::grouped(void) const
   return localLengthGroupSpace.size() > 0;
 }
 
-std::vector<candidate_time_series_t> GlobalGroupSpace::kSim(const TimeSeries& query, int k)
+std::vector<candidate_t> GlobalGroupSpace::kSim(const TimeSeries& query, int k, QueryContext& ctx)
 {
-  std::vector<candidate_time_series_t> best;
+  std::vector<candidate_t> best;
   std::vector<group_index_t> bestSoFar;
   int kPrime = k;
+  ScopedQuery scopedQuery(ctx, query);
   
   // process each group of a certain length keeping top sum-k groups
-  vector<int> order (generateTraverseOrder(query.getLength(), this->localLengthGroupSpace.size() - 1));
+  vector<int> order = generateReachableLengths(query.getLength(), this->localLengthGroupSpace.size() - 1, ctx);
   for (auto io = 0; io < order.size(); io++) 
   {
     int i = order[io];
     kPrime = this->localLengthGroupSpace[i]->
-        interLevelKSim(query, this->warpedDistance, bestSoFar, kPrime);
+        interLevelKSim(query, ctx, bestSoFar, kPrime);
   }
   
   // process top group directly
@@ -139,9 +243,9 @@ std::vector<candidate_time_series_t> GlobalGroupSpace::kSim(const TimeSeries& qu
   {
     group_index_t g = bestSoFar.front();
     bestSoFar.erase(bestSoFar.begin());
-    vector<candidate_time_series_t> intraResults = 
+    vector<candidate_t> intraResults = 
         this->localLengthGroupSpace[g.length]->
-            getGroup(g.index)->intraGroupKSim(query, kPrime+g.members, this->warpedDistance);
+            getGroup(g.index)->intraGroupKSim(query, kPrime+g.members, ctx);
     // add all of the worst's best to answer
     for (int i = 0; i < intraResults.size(); ++i) 
     {
@@ -152,23 +256,240 @@ std::vector<candidate_time_series_t> GlobalGroupSpace::kSim(const TimeSeries& qu
   for (auto i = 0; i < bestSoFar.size(); i++)
   {
     group_index_t g = bestSoFar[i];  
-    vector<TimeSeries> members = 
+    vector<member_coord_t> members = 
         this->localLengthGroupSpace[g.length]->getGroup(g.index)->getMembers();
-    std::vector<candidate_time_series_t> withBounds;
-    for (auto i = 0; i < members.size(); i++) {
-      withBounds.push_back(candidate_time_series_t(members[i], g.dist + this->threshold));
+    for (auto j = 0; j < members.size(); j++) {
+      best.push_back(candidate_t(members[j].first, members[j].second, g.length, g.dist + this->threshold));
     }
-    best.insert(std::end(best), std::begin(withBounds), std::end(withBounds));  
   }
 
   for (auto i = 0; i < best.size(); i++) {
-    best[i].dist = this->warpedDistance(query, best[i].data, INF);
+    TimeSeries member = this->dataset.getTimeSeries(best[i].index, best[i].start, best[i].start + best[i].length);
+    best[i].dist = ctx.distanceBetween(query, member, INF);
   }
 
   // clean up
   return best;
 }
 
+progressive_result_t GlobalGroupSpace::progressiveKSim(const TimeSeries& query, int k, QueryContext& ctx,
+                                                      const query_budget_t& budget,
+                                                      const progress_callback_t& callback)
+{
+  if (k <= 0) {
+    throw KOnexException("Number of time series to look for must be positive");
+  }
+  if (query.getLength() <= 1) {
+    throw KOnexException("Length of query must be larger than 1");
+  }
+  ScopedQuery scopedQuery(ctx, query);
+  auto begin = std::chrono::steady_clock::now();
+  progressive_result_t progress;
+
+  bool bounded = this->hasGroupBounds(ctx);
+  data_t radius = this->_getRadius();
+
+  bool stopped = false;
+  auto exhausted = [&]() {
+    if (budget.evaluations > 0 && progress.evaluations >= budget.evaluations) {
+      return true;
+    }
+    // Reading the clock is cheap but not free next to short distances
+    if (budget.milliseconds > 0 && progress.evaluations % PROGRESSIVE_CLOCK_INTERVAL == 0)
+    {
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+      return elapsed.count() >= budget.milliseconds;
+    }
+    return false;
+  };
+
+  // Max-heap of the k best candidates
+  vector<candidate_t> best;
+  auto kthBest = [&]() { return best.size() < k ? INF : best.front().dist; };
+  auto offer = [&](const candidate_t& candidate) {
+    if (best.size() < k)
+    {
+      best.push_back(candidate);
+      std::push_heap(best.begin(), best.end());
+      return true;
+    }
+    if (candidate < best.front())
+    {
+      std::pop_heap(best.begin(), best.end());
+      best.back() = candidate;
+      std::push_heap(best.begin(), best.end());
+      return true;
+    }
+    return false;
+  };
+  auto report = [&]() {
+    progress.results = best;
+    std::sort_heap(progress.results.begin(), progress.results.end());
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+    progress.milliseconds = elapsed.count();
+    if (callback && !callback(progress)) {
+      stopped = true;
+    }
+  };
+
+  vector<int> lengths = generateReachableLengths(query.getLength(), this->localLengthGroupSpace.size() - 1, ctx);
+  for (auto il = 0; il < lengths.size(); il++) {
+    progress.groupCount += this->localLengthGroupSpace[lengths[il]]->getNumberOfGroups();
+  }
+
+  // Rank the groups by the distance to their centroids, starting from the length
+  // of the query. A centroid copied from a member is a result on its own. Beyond
+  // the k-th best plus the radius, the distance is abandoned and the group is
+  // ranked last.
+  vector<group_index_t> frontier;
+  frontier.reserve(progress.groupCount);
+  for (auto il = 0; il < lengths.size() && !stopped; il++)
+  {
+    const LocalLengthGroupSpace* space = this->localLengthGroupSpace[lengths[il]];
+    for (auto i = 0; i < space->getNumberOfGroups() && !stopped; i++)
+    {
+      if (exhausted())
+      {
+        stopped = true;
+        break;
+      }
+      const Group* group = space->getGroup(i);
+      data_t dist = ctx.distanceBetween(query, group->getCentroid(), kthBest() + radius);
+      progress.evaluations++;
+      frontier.push_back(group_index_t(lengths[il], i, group->getCount(), dist));
+
+      member_coord_t coord = group->getCentroidCoord();
+      if (coord.first != -1 && offer(candidate_t(coord.first, coord.second, lengths[il], dist))) {
+        report();
+      }
+    }
+  }
+  std::sort(frontier.begin(), frontier.end());
+
+  // Examine the members of the groups from the closest centroid
+  for (auto ig = 0; ig < frontier.size() && !stopped; ig++)
+  {
+    const group_index_t& g = frontier[ig];
+    if (bounded && g.dist - radius > kthBest())
+    {
+      // The groups left are even farther
+      progress.groupsExamined = progress.groupCount;
+      break;
+    }
+
+    const Group* group = this->localLengthGroupSpace[g.length]->getGroup(g.index);
+    member_coord_t centroidCoord = group->getCentroidCoord();
+    bool improved = false;
+    vector<member_coord_t> members = group->getMembers();
+    for (auto j = 0; j < members.size(); j++)
+    {
+      if (members[j] == centroidCoord) {
+        continue;
+      }
+      if (exhausted())
+      {
+        stopped = true;
+        break;
+      }
+      TimeSeries member = this->dataset.getTimeSeries(members[j].first, members[j].second,
+                                                      members[j].second + g.length);
+      data_t dist = ctx.distanceBetween(query, member, kthBest());
+      progress.evaluations++;
+      improved |= offer(candidate_t(members[j].first, members[j].second, g.length, dist));
+    }
+    if (!stopped) {
+      progress.groupsExamined++;
+    }
+    if (improved) {
+      report();
+    }
+  }
+
+  progress.results = best;
+  std::sort_heap(progress.results.begin(), progress.results.end());
+  progress.exact = !stopped;
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+  progress.milliseconds = elapsed.count();
+  return progress;
+}
+
+range_stats_t GlobalGroupSpace::rangeQuery(const TimeSeries& query, data_t epsilon, QueryContext& ctx,
+                                           const range_callback_t& callback, bool exactDistances)
+{
+  if (epsilon < 0) {
+    throw KOnexException("Distance of a range query must not be negative");
+  }
+  if (query.getLength() <= 1) {
+    throw KOnexException("Length of query must be larger than 1");
+  }
+  ScopedQuery scopedQuery(ctx, query);
+  range_stats_t stats;
+  bool bounded = this->hasGroupBounds(ctx);
+  data_t radius = this->_getRadius();
+
+  vector<int> lengths = generateReachableLengths(query.getLength(), this->localLengthGroupSpace.size() - 1, ctx);
+  for (auto il = 0; il < lengths.size() && stats.complete; il++)
+  {
+    int length = lengths[il];
+    const LocalLengthGroupSpace* space = this->localLengthGroupSpace[length];
+    for (auto i = 0; i < space->getNumberOfGroups() && stats.complete; i++)
+    {
+      const Group* group = space->getGroup(i);
+      bool wholesale = false;
+      data_t bound = INF;
+      if (bounded)
+      {
+        data_t dist = ctx.distanceBetween(query, group->getCentroid(), epsilon + radius);
+        stats.evaluations++;
+        if (dist - radius > epsilon)
+        {
+          stats.groupsSkipped++;
+          continue;
+        }
+        bound = dist + radius;
+        wholesale = bound <= epsilon;
+      }
+      wholesale ? stats.groupsIncluded++ : stats.groupsVerified++;
+
+      // Members are walked in place, as groups can be large
+      group->forEachMember([&](const member_coord_t& coord) {
+        data_t dist = bound;
+        if (!wholesale || exactDistances)
+        {
+          TimeSeries member = this->dataset.getTimeSeries(coord.first, coord.second, coord.second + length);
+          dist = ctx.distanceBetween(query, member, wholesale ? INF : epsilon);
+          stats.evaluations++;
+        }
+        if (!wholesale && dist > epsilon) {
+          return true;
+        }
+        stats.matches++;
+        stats.complete = callback(candidate_t(coord.first, coord.second, length, dist));
+        return stats.complete;
+      });
+    }
+  }
+  return stats;
+}
+
+bool GlobalGroupSpace::hasGroupBounds(QueryContext& ctx) const
+{
+  // Members are within threshold / 2 of their centroid on the distance of the
+  // grouping, which is a metric if it is the Euclidean distance, on the raw or
+  // on the z-normalized values
+  query_dist_t distance = ctx.getDistance();
+  return (distance == static_cast<query_dist_t>(konex::pairwiseDistance)
+          && this->pairwiseDistance == static_cast<dist_t>(konex::pairwiseDistance))
+      || (distance == static_cast<query_dist_t>(konex::znormPairwiseDistance)
+          && this->pairwiseDistance == static_cast<dist_t>(konex::znormPairwiseDistance));
+}
+
+data_t GlobalGroupSpace::_getRadius() const
+{
+  // Saved thresholds keep 6 significant digits
+  return this->threshold / 2 * (1 + GROUP_RADIUS_MARGIN);
+}
+
 void GlobalGroupSpace::saveGroups(ofstream &fout, bool groupSizeOnly) const
 {
   // Range of lengths and distance name
@@ -179,9 +500,10 @@ void GlobalGroupSpace::saveGroups(ofstream &fout, bool groupSizeOnly) const
   }
 }
 
-int GlobalGroupSpace::loadGroups(ifstream &fin)
+int GlobalGroupSpace::loadGroups(ifstream &fin, data_t threshold)
 {
   reset();
+  this->threshold = threshold;
 
   int lenFrom, lenTo;
   int numberOfGroups = 0;
@@ -195,10 +517,16 @@ int GlobalGroupSpace::loadGroups(ifstream &fin)
     numberOfGroups += gel->loadGroups(fin);
     this->localLengthGroupSpace[i] = gel;
   }
+  this->_collectStats();
   return numberOfGroups;
 }
 
 vector<int> generateTraverseOrder(int queryLength, int totalLength)
+{
+  return generateTraverseOrder(queryLength, totalLength, getWarpingBandRatio());
+}
+
+vector<int> generateTraverseOrder(int queryLength, int totalLength, double warpingBandRatio)
 {
   vector<int> order;
   int low = queryLength - 1;
@@ -212,7 +540,7 @@ vector<int> generateTraverseOrder(int queryLength, int totalLength)
 
     if (!lowStop) {
       // queryLength is always larger than low
-      int r = calculateWarpingBandSize(queryLength);
+      int r = calculateWarpingBandSize(queryLength, warpingBandRatio);
       if (low + r >= queryLength) {
         order.push_back(low);
         low--;
@@ -224,7 +552,7 @@ vector<int> generateTraverseOrder(int queryLength, int totalLength)
 
     if (!highStop) {
       // queryLength is always smaller than high
-      int r = calculateWarpingBandSize(high);
+      int r = calculateWarpingBandSize(high, warpingBandRatio);
       if (queryLength + r >= high) {
         order.push_back(high);
         high++;
@@ -237,4 +565,19 @@ vector<int> generateTraverseOrder(int queryLength, int totalLength)
   return order;
 }
 
+vector<int> generateReachableLengths(int queryLength, int totalLength, const QueryContext& ctx)
+{
+  vector<int> lengths;
+  bool euclidean = isLockstepDistance(ctx.getDistance());
+  vector<int> order (generateTraverseOrder(queryLength, totalLength, ctx.getWarpingBandRatio()));
+  for (auto io = 0; io < order.size(); io++)
+  {
+    int length = order[io];
+    if (length >= 2 && length <= totalLength && (!euclidean || length == queryLength)) {
+      lengths.push_back(length);
+    }
+  }
+  return lengths;
+}
+
 } // namespace konex
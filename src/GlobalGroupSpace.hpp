@@ -5,13 +5,95 @@
 #include "TimeSeries.hpp"
 #include "TimeSeriesSet.hpp"
 #include "distance/Distance.hpp"
+#include "distance/QueryContext.hpp"
 #include "Group.hpp"
 
+#include <functional>
+#include <memory>
 #include <vector>
 #include <fstream>
 
+// Progressive queries read the clock once per this many distances
+#define PROGRESSIVE_CLOCK_INTERVAL 32
+// Relative margin on the radius of the groups, whose saved thresholds are rounded
+#define GROUP_RADIUS_MARGIN 1e-5
+
 namespace konex {
 
+/**
+ *  @brief statistics of the groups of one length
+ */
+struct group_length_stats_t
+{
+  int groupCount = 0;
+  int memberCount = 0;
+
+  double getAverageMembers() const { return groupCount == 0 ? 0 : (double)memberCount / groupCount; }
+};
+
+/**
+ *  @brief limits of a progressive query. A limit that is not positive is not
+ *         enforced.
+ */
+struct query_budget_t
+{
+  // wall-clock time in milliseconds
+  double milliseconds;
+  // number of distances computed, those to the centroids included
+  long long evaluations;
+
+  query_budget_t(double milliseconds = 0, long long evaluations = 0)
+    : milliseconds(milliseconds), evaluations(evaluations) {}
+};
+
+/**
+ *  @brief the state of a progressive query
+ *
+ *  The results hold exact distances and are sorted from the closest. They are
+ *  provably the k nearest neighbors if exact is true.
+ */
+struct progressive_result_t
+{
+  std::vector<candidate_t> results;
+  bool exact = false;
+  long long evaluations = 0;
+  // groups whose members were all examined or ruled out
+  int groupsExamined = 0;
+  int groupCount = 0;
+  double milliseconds = 0;
+};
+
+/**
+ *  @brief receives the improved results of a progressive query
+ *
+ *  @return false to stop the query
+ */
+typedef std::function<bool(const progressive_result_t&)> progress_callback_t;
+
+/**
+ *  @brief how a range query went
+ */
+struct range_stats_t
+{
+  long long matches = 0;
+  long long evaluations = 0;
+  // groups ruled out by the distance to their centroid
+  int groupsSkipped = 0;
+  // groups whose members all matched without being compared with the query
+  int groupsIncluded = 0;
+  // groups whose members were compared with the query one by one
+  int groupsVerified = 0;
+  // false if the callback stopped the query
+  bool complete = true;
+};
+
+/**
+ *  @brief receives a match of a range query
+ *
+ *  @return false to stop the query
+ */
+typedef std::function<bool(const candidate_t&)> range_callback_t;
+
 /**
  *  The set of all groups of equal lengths for a dataset
  */
@@ -40,6 +122,12 @@ public:
    */
   void reset(void);
 
+  /**
+   *  @brief takes the views of the centroids again once the values of the
+   *         dataset moved, see Group::rebindCentroid
+   */
+  void rebindCentroids();
+
   /**
    *  @brief groups the dataset into groups of equal length
    *    using the metric to determine similarity
@@ -47,49 +135,184 @@ public:
    *  @param metric the metric used to group by
    *  @param threshold the threshold to be group with
    *  @return the number of groups it creates
+   *
+   *  A mapped dataset larger than a block (see TimeSeriesSet::getBlockRowCount)
+   *  is grouped block of series by block of series, all lengths of a block
+   *  before the next one, so that only about a block of it is read at a time.
+   *  The groups then depend on the block size, as series of later blocks join
+   *  the groups of earlier ones.
    */
   int group(const std::string& distance_name, data_t threshold);
   int groupMultiThreaded(const std::string& distance_name, data_t threshold, int num_thread);
 
+  /**
+   *  @brief groups the series appended to the dataset since it was grouped
+   *
+   *  Their sub-sequences join the existing groups, or start new ones, by the
+   *  same rule as group: the first closest centroid within threshold / 2. The
+   *  groups and their members are kept and grown in place, each length in a
+   *  task of its own. Only the lengths that were grouped are extended.
+   *
+   *  @param firstRow the index of the first appended series
+   *  @param num_thread number of threads grouping lengths in parallel
+   *  @return the number of groups created
+   *
+   *  @throw KOnexException if the dataset is not grouped
+   */
+  int extend(int firstRow, int num_thread);
+
+  /**
+   *  @brief gets a number that changes whenever the groups do, so that what
+   *         is derived from them can tell it is out of date
+   */
+  unsigned long getGeneration() const { return this->generation; }
+
   /**
    *  @brief gets the most similar sequence in the dataset
    *
    *  @param query gets most similar sequence to the query
+   *  @param ctx settings and scratch memory of the query
    *  @return the best match in the dataset
+   *
+   *  @throw KOnexException if no match is within the dropout of the context
    */
-  candidate_time_series_t getBestMatch(const TimeSeries& query);
+  candidate_t getBestMatch(const TimeSeries& query, QueryContext& ctx);
 
   /**
    *  @brief find k similar time series to the query
    *
    *  @param query gets most similar sequence to the query
    *  @param k number of similar time series
-   *  @param approx if true, return the approximated distance, otherwise return the exact distance
+   *  @param ctx settings and scratch memory of the query
    *  @return the best match in the dataset
    */
-  std::vector<candidate_time_series_t> kSim(const TimeSeries& query, int k);
+  std::vector<candidate_t> kSim(const TimeSeries& query, int k, QueryContext& ctx);
+
+  /**
+   *  @brief finds k similar time series to the query, best group first, until
+   *         a budget runs out
+   *
+   *  The distances to all centroids of the lengths reachable from the query
+   *  are computed first. The groups are then examined in increasing distance
+   *  of their centroids, each member being compared with the query with its
+   *  distance abandoned at the current k-th best. Every time a group improves
+   *  the results, a snapshot of them is passed to the callback.
+   *
+   *  When the data was grouped with the Euclidean distance and the query uses
+   *  it too, every member of a group is within threshold / 2 of its centroid,
+   *  so a group whose centroid is farther than the k-th best plus threshold / 2
+   *  cannot improve the results. Those groups, and all the groups after them,
+   *  are ruled out without being examined. With other distances, the results
+   *  are exact only once every group has been examined.
+   *
+   *  Distances are computed on the raw data, whatever the PAA block size of the
+   *  context.
+   *
+   *  @param query the query
+   *  @param k number of similar time series
+   *  @param ctx settings and scratch memory of the query
+   *  @param budget when to stop if the results are not exact yet
+   *  @param callback receives the improved results, can be empty
+   *  @return the best results found
+   *
+   *  @throw KOnexException if k is not positive or the query is too short
+   */
+  progressive_result_t progressiveKSim(const TimeSeries& query, int k, QueryContext& ctx,
+                                       const query_budget_t& budget,
+                                       const progress_callback_t& callback = progress_callback_t());
   
+  /**
+   *  @brief finds every time series within a distance of the query
+   *
+   *  When the data was grouped with the Euclidean distance and the query uses
+   *  it too, every member of a group is within threshold / 2 of its centroid.
+   *  A group whose centroid is farther than epsilon plus threshold / 2 is
+   *  skipped, and the members of a group whose centroid is closer than epsilon
+   *  minus threshold / 2 all match. Only the groups in between are verified,
+   *  each member being compared with its distance abandoned at epsilon. With
+   *  other distances, every group is verified.
+   *
+   *  Matches are passed to the callback as they are found, in no particular
+   *  order.
+   *
+   *  @param query the query
+   *  @param epsilon the largest distance of a match
+   *  @param ctx settings and scratch memory of the query
+   *  @param callback receives the matches
+   *  @param exactDistances if false, the members of a group matching as a whole
+   *         are given the distance of their centroid plus threshold / 2, a
+   *         bound of their distance. If true, their distances are computed.
+   *  @return counts of the matches and the work done
+   *
+   *  @throw KOnexException if epsilon is negative or the query is too short
+   */
+  range_stats_t rangeQuery(const TimeSeries& query, data_t epsilon, QueryContext& ctx,
+                           const range_callback_t& callback, bool exactDistances = false);
+
   void saveGroups(std::ofstream &fout, bool groupSizeOnly) const;
-  int loadGroups(std::ifstream &fin);
+  int loadGroups(std::ifstream &fin, data_t threshold);
   /**
    *  @brief returns true if dataset is grouped
    */
   bool grouped(void) const;
 
+  /**
+   *  @brief gets the statistics of the groups, collected when they are built or
+   *         loaded
+   *
+   *  @return one entry per length, indexed by the length. Lengths without
+   *          groups have empty entries.
+   */
+  const std::vector<group_length_stats_t>& getLengthStats() const { return this->lengthStats; }
+
+  /**
+   *  @brief checks if the distance of the query and the distance of the
+   *         grouping let the distance to a centroid bound the distances to the
+   *         members of its group
+   *
+   *  True if both are the Euclidean distance, which is a metric. Every member
+   *  is then within threshold / 2 of its centroid.
+   */
+  bool hasGroupBounds(QueryContext& ctx) const;
+
 private:
 
   std::vector<LocalLengthGroupSpace*> localLengthGroupSpace;
   const TimeSeriesSet& dataset;
   dist_t pairwiseDistance;
-  dist_t warpedDistance;
   data_t threshold;
   std::string distanceName;
+  std::vector<group_length_stats_t> lengthStats;
+  unsigned long generation = 0;
 
   void _loadDistance(const std::string& distanceName);
-  int _group(int i);
+  std::shared_ptr<const DistanceProfile> _makeDistanceProfile() const;
+  int _group(int i, const DistanceProfile* profile, int firstRow, int lastRow);
+  int _groupByBlock(int num_thread, int firstRow = 0);
+  data_t _getRadius() const;
+  void _collectStats();
 };
 
+/**
+ *  @brief orders the lengths to be searched for a query, starting from the length
+ *         of the query and moving away from it while the warping band allows it
+ *
+ *  The version without a ratio uses the process-wide default warping band ratio.
+ */
 vector<int> generateTraverseOrder(int queryLength, int totalLength);
+vector<int> generateTraverseOrder(int queryLength, int totalLength, double warpingBandRatio);
+
+/**
+ *  @brief gets the lengths of the sub-sequences a query can be compared with, in
+ *         the order of generateTraverseOrder
+ *
+ *  The Euclidean distance only compares time series of the same length.
+ *
+ *  @param queryLength length of the query
+ *  @param totalLength length of the time series of the dataset
+ *  @param ctx settings of the query
+ */
+vector<int> generateReachableLengths(int queryLength, int totalLength, const QueryContext& ctx);
 
 } // namespace konex
 #endif //GLOBAL_GROUP_SPACE_H
@@ -26,6 +26,15 @@ void Group::addMember(int tsIndex, int tsStart)
 void Group::setCentroid(int tsIndex, int tsStart)
 {
   this->centroid = this->dataset.getTimeSeries(tsIndex, tsStart, tsStart + this->memberLength);
+  this->centroidCoord = std::make_pair(tsIndex, tsStart);
+}
+
+void Group::rebindCentroid()
+{
+  // Other centroids were loaded from a file and own their values
+  if (this->centroidCoord.first >= 0) {
+    this->setCentroid(this->centroidCoord.first, this->centroidCoord.second);
+  }
 }
 
 data_t Group::distanceFromCentroid(const TimeSeries& query, const dist_t distance, data_t dropout)
@@ -34,8 +43,17 @@ data_t Group::distanceFromCentroid(const TimeSeries& query, const dist_t distanc
   return d;
 }
 
-candidate_time_series_t Group::getBestMatch(const TimeSeries& query, const dist_t warpedDistance) const
+data_t Group::distanceFromCentroid(const TimeSeries& query, QueryContext& ctx, data_t dropout) const
 {
+  return ctx.distanceBetween(this->centroid, query, dropout);
+}
+
+candidate_t Group::getBestMatch(const TimeSeries& query, QueryContext& ctx) const
+{
+  if (ctx.getPAABlock() > 0) {
+    return this->_PAAKSim(query, 1, ctx).front();
+  }
+
   member_coord_t currentMemberCoord = this->lastMemberCoord;
 
   data_t bestSoFarDist = INF;
@@ -47,7 +65,7 @@ candidate_time_series_t Group::getBestMatch(const TimeSeries& query, const dist_
     int currStart = currentMemberCoord.second;
 
     TimeSeries currentTimeSeries = this->dataset.getTimeSeries(currIndex, currStart, currStart + this->memberLength);
-    data_t currentDistance = warpedDistance(query, currentTimeSeries, bestSoFarDist);
+    data_t currentDistance = ctx.distanceBetween(query, currentTimeSeries, bestSoFarDist);
 
     if (currentDistance < bestSoFarDist)
     {
@@ -58,18 +76,20 @@ candidate_time_series_t Group::getBestMatch(const TimeSeries& query, const dist_
     currentMemberCoord = this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;
   }
 
-  int bestIndex = bestSoFarMember.first;
-  int bestStart = bestSoFarMember.second;
-  TimeSeries bestTimeSeries = this->dataset.getTimeSeries(bestIndex, bestStart, bestStart + this->memberLength);
-  candidate_time_series_t best(bestTimeSeries, bestSoFarDist);
-
-  return best;
+  return candidate_t(bestSoFarMember.first, bestSoFarMember.second, this->memberLength, bestSoFarDist);
 }
 
-vector<candidate_time_series_t> Group::intraGroupKSim(
-    const TimeSeries& query, int k, const dist_t warpedDistance) const
+vector<candidate_t> Group::intraGroupKSim(
+    const TimeSeries& query, int k, QueryContext& ctx) const
 {
-  vector<candidate_time_series_t> bestSoFar;
+  if (ctx.getPAABlock() > 0)
+  {
+    // EXPERIMENT
+    extraTimeSeries += this->count - std::max(0, k - this->count);
+    return this->_PAAKSim(query, k, ctx);
+  }
+
+  vector<candidate_t> bestSoFar;
 
   data_t bestSoFarDist = INF;
   member_coord_t bestSoFarMember;
@@ -87,8 +107,8 @@ vector<candidate_time_series_t> Group::intraGroupKSim(
 
     if (k > 0) // directly add to best 
     {
-      data_t currentDistance = warpedDistance(query, currentTimeSeries, INF);
-      bestSoFar.push_back(candidate_time_series_t(currentTimeSeries, currentDistance));
+      data_t currentDistance = ctx.distanceBetween(query, currentTimeSeries, INF);
+      bestSoFar.push_back(candidate_t(currIndex, currStart, this->memberLength, currentDistance));
       k -= 1;      
       if (k == 0) {
         // Heapify exactly once when the heap is filled.
@@ -98,11 +118,11 @@ vector<candidate_time_series_t> Group::intraGroupKSim(
     else // heap is full, keep only best k'
     { 
       bestSoFarDist = bestSoFar.front().dist;
-      data_t currentDistance = warpedDistance(query, currentTimeSeries, bestSoFarDist); 
+      data_t currentDistance = ctx.distanceBetween(query, currentTimeSeries, bestSoFarDist); 
 
       if (currentDistance < bestSoFarDist) 
       { 
-        bestSoFar.push_back(candidate_time_series_t(currentTimeSeries, currentDistance));
+        bestSoFar.push_back(candidate_t(currIndex, currStart, this->memberLength, currentDistance));
         std::push_heap(bestSoFar.begin(), bestSoFar.end());
         std::pop_heap(bestSoFar.begin(), bestSoFar.end());
         bestSoFar.pop_back();
@@ -115,17 +135,67 @@ vector<candidate_time_series_t> Group::intraGroupKSim(
   return bestSoFar;
 }
 
-vector<TimeSeries> Group::getMembers() const
+vector<candidate_t> Group::_PAAKSim(const TimeSeries& query, int k, QueryContext& ctx) const
 {
-  vector<TimeSeries> members;
+  int block = ctx.getPAABlock();
+  const PAACache& cache = this->dataset.getPAACache();
+  int PAAQueryLength = PAACache::getPAALength(query.getLength(), block);
+  int PAAMemberLength = PAACache::getPAALength(this->memberLength, block);
+
+  vector<data_t> values(PAAQueryLength + PAAMemberLength);
+  PAACache::computePAA(query, block, values.data());
+  TimeSeries PAAQuery(values.data(), PAAQueryLength);
+  data_t* memberValues = values.data() + PAAQueryLength;
+
+  vector<candidate_t> bestSoFar;
   member_coord_t currentMemberCoord = this->lastMemberCoord;
   while (currentMemberCoord.first != -1)
   {
     int currIndex = currentMemberCoord.first;
     int currStart = currentMemberCoord.second;
 
-    TimeSeries currentTimeSeries = this->dataset.getTimeSeries(currIndex, currStart, currStart + this->memberLength);
-    members.push_back(currentTimeSeries);
+    cache.getPAA(currIndex, currStart, this->memberLength, block, memberValues);
+    TimeSeries PAAMember(memberValues, PAAMemberLength);
+    data_t bestSoFarDist = bestSoFar.size() < k ? INF : bestSoFar.front().dist;
+    candidate_t candidate(currIndex, currStart, this->memberLength,
+                          ctx.distanceBetween(PAAQuery, PAAMember, bestSoFarDist));
+
+    if (bestSoFar.size() < k)
+    {
+      bestSoFar.push_back(candidate);
+      std::push_heap(bestSoFar.begin(), bestSoFar.end());
+    }
+    else if (candidate < bestSoFar.front())
+    {
+      std::pop_heap(bestSoFar.begin(), bestSoFar.end());
+      bestSoFar.back() = candidate;
+      std::push_heap(bestSoFar.begin(), bestSoFar.end());
+    }
+    currentMemberCoord = this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;
+  }
+
+  // Refine the candidates found on the PAA with the raw data
+  for (auto i = 0; i < bestSoFar.size(); i++)
+  {
+    TimeSeries member = this->dataset.getTimeSeries(bestSoFar[i].index, bestSoFar[i].start,
+                                                    bestSoFar[i].start + this->memberLength);
+    bestSoFar[i].dist = ctx.distanceBetween(query, member, INF);
+  }
+  std::make_heap(bestSoFar.begin(), bestSoFar.end());
+  return bestSoFar;
+}
+
+vector<member_coord_t> Group::getMembers() const
+{
+  vector<member_coord_t> members;
+  members.reserve(this->count);
+  member_coord_t currentMemberCoord = this->lastMemberCoord;
+  while (currentMemberCoord.first != -1)
+  {
+    int currIndex = currentMemberCoord.first;
+    int currStart = currentMemberCoord.second;
+
+    members.push_back(currentMemberCoord);
     currentMemberCoord = this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;
   }
   return members;
@@ -164,6 +234,17 @@ void Group::loadGroup(ifstream &fin)
     fin >> index >> start;
     this->addMember(index, start);
   }
+
+  // Members are saved from the last one added, so the member the centroid was
+  // set from comes last. Its values only match if they survived the text.
+  this->centroidCoord = std::make_pair(-1, -1);
+  if (cnt > 0)
+  {
+    TimeSeries first = this->dataset.getTimeSeries(index, start, start + this->memberLength);
+    if (std::equal(&first[0], &first[0] + this->memberLength, &this->centroid[0])) {
+      this->centroidCoord = std::make_pair(index, start);
+    }
+  }
 }
 
 } // namespace konex
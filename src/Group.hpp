@@ -6,6 +6,7 @@
 #include "TimeSeries.hpp"   // INF
 #include "TimeSeriesSet.hpp"
 #include "distance/Distance.hpp"
+#include "distance/QueryContext.hpp"
 
 #include <fstream>
 
@@ -75,6 +76,7 @@ public:
     dataset(dataset),
     memberMap(memberMap),
     centroid(memberLength),
+    centroidCoord(std::make_pair(-1, -1)),
     lastMemberCoord(std::make_pair(-1, -1)),
     count(0) {}
 
@@ -94,6 +96,12 @@ public:
    */
   void setCentroid(int index, int start);
 
+  /**
+   *  @brief takes the view of a centroid set from a member again, once the
+   *         values of the dataset moved
+   */
+  void rebindCentroid();
+
   /**
    *  @brief gets the centroid of the group
    *
@@ -104,6 +112,14 @@ public:
     return this->centroid;
   }
 
+  /**
+   *  @brief gets the member the centroid is a copy of
+   *
+   *  @return the coordinate of the member, or (-1, -1) if the centroid is not
+   *          known to be a member
+   */
+  member_coord_t getCentroidCoord() const { return this->centroidCoord; }
+
   /**
    *  @brief gets the length of each sequence in the group
    *
@@ -127,29 +143,59 @@ public:
    *  @return the distance between the query and the centroid
    */
   data_t distanceFromCentroid(const TimeSeries& query, const dist_t pairwiseDistance, data_t dropout);
+  data_t distanceFromCentroid(const TimeSeries& query, QueryContext& ctx, data_t dropout) const;
 
   /**
-   *  @brief gets the best match of a query in this group using the given distance
+   *  @brief gets the best match of a query in this group using the distance of
+   *         the query context
+   *
+   *  If the context has a PAA block size, the member closest on the PAA is
+   *  returned with its distance on the raw data.
    */
-  candidate_time_series_t getBestMatch(const TimeSeries& query, const dist_t distance) const;
+  candidate_t getBestMatch(const TimeSeries& query, QueryContext& ctx) const;
 
   /**
    *  @brief gets all the members in a group
    *
-   *  @return the TimeSeries for each value in the group.
+   *  @return the coordinate (index, start) of each member in the group.
    */
-  std::vector<TimeSeries> getMembers() const;
+  std::vector<member_coord_t> getMembers() const;
+
+  /**
+   *  @brief calls a function with the coordinate of each member, without
+   *         copying the members
+   *
+   *  @param visit called as visit(const member_coord_t&). Returning false stops
+   *         the walk.
+   *  @return false if the walk was stopped
+   */
+  template <typename Visitor>
+  bool forEachMember(Visitor visit) const
+  {
+    member_coord_t currentMemberCoord = this->lastMemberCoord;
+    while (currentMemberCoord.first != -1)
+    {
+      if (!visit(currentMemberCoord)) {
+        return false;
+      }
+      currentMemberCoord =
+        this->memberMap[currentMemberCoord.first * this->subTimeSeriesCount + currentMemberCoord.second].prev;
+    }
+    return true;
+  }
 
   /**
    *  @brief performs necessary KNN operations a group
    *
    *  @param query to find similar to
    *  @param k is the adjusted k, how many neighbors to find within the group.
-   *  @param warpedDistance to be used for the distance metric
+   *  @param ctx the query context providing the distance metric. If it has a
+   *         PAA block size, the neighbors are selected on the PAA and returned
+   *         with their distances on the raw data.
    *  @return neighbors
    */
-  std::vector<candidate_time_series_t> intraGroupKSim(
-      const TimeSeries& query, int k, const dist_t warpedDistance) const;
+  std::vector<candidate_t> intraGroupKSim(
+      const TimeSeries& query, int k, QueryContext& ctx) const;
   
   void saveGroup(std::ofstream &fout) const;
   void loadGroup(std::ifstream &fin);
@@ -160,6 +206,7 @@ private:
 
   int groupIndex;
 
+  member_coord_t centroidCoord;
   member_coord_t lastMemberCoord;
 
   int memberLength;
@@ -167,6 +214,8 @@ private:
   int count;
 
   TimeSeries centroid;
+
+  std::vector<candidate_t> _PAAKSim(const TimeSeries& query, int k, QueryContext& ctx) const;
 };
 
 } // namespace konex
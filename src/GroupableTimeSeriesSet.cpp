@@ -16,6 +16,7 @@ namespace konex {
 GroupableTimeSeriesSet::~GroupableTimeSeriesSet()
 {
   this->reset();
+  this->clearSAXIndex();
 }
 
 int GroupableTimeSeriesSet::groupAllLengths(const std::string& distance_name, data_t threshold, int numThreads)
@@ -24,6 +25,7 @@ int GroupableTimeSeriesSet::groupAllLengths(const std::string& distance_name, da
   {
     throw KOnexException("No data to group");
   }
+  this->decompress();
 
   // clear old groups
   reset();
@@ -41,6 +43,7 @@ int GroupableTimeSeriesSet::groupAllLengths(const std::string& distance_name, da
   }
 
   this->threshold = threshold;
+  this->generation++;
   return cntGroups;
 }
 
@@ -53,6 +56,23 @@ void GroupableTimeSeriesSet::reset()
 {
   delete this->groupsAllLengthSet;
   this->groupsAllLengthSet = nullptr;
+  this->generation++;
+}
+
+void GroupableTimeSeriesSet::_dataAppended(int firstRow, int numThreads)
+{
+  // The index does not cover the new series
+  this->clearSAXIndex();
+  if (this->groupsAllLengthSet != nullptr) {
+    this->groupsAllLengthSet->extend(firstRow, numThreads);
+  }
+}
+
+void GroupableTimeSeriesSet::_dataMoved()
+{
+  if (this->groupsAllLengthSet != nullptr) {
+    this->groupsAllLengthSet->rebindCentroids();
+  }
 }
 
 void GroupableTimeSeriesSet::saveGroups(const string& path, bool groupSizeOnly) const
@@ -79,6 +99,7 @@ void GroupableTimeSeriesSet::saveGroups(const string& path, bool groupSizeOnly)
 
 int GroupableTimeSeriesSet::loadGroups(const string& path)
 {
+  this->decompress();
   int numberOfGroups = 0;
   ifstream fin(path);
   if (fin)
@@ -102,39 +123,134 @@ int GroupableTimeSeriesSet::loadGroups(const string& path)
     reset();
     this->threshold = threshold;
     this->groupsAllLengthSet = new GlobalGroupSpace(*this);
-    numberOfGroups = this->groupsAllLengthSet->loadGroups(fin);
+    numberOfGroups = this->groupsAllLengthSet->loadGroups(fin, threshold);
   }
   else
   {
     throw KOnexException("Cannot open file");
   }
+  this->generation++;
   return numberOfGroups;
 }
 
-candidate_time_series_t GroupableTimeSeriesSet::getBestMatch(const TimeSeries& query) const
+candidate_t GroupableTimeSeriesSet::getBestMatch(const TimeSeries& query) const
+{
+  QueryContext ctx;
+  return this->getBestMatch(query, ctx);
+}
+
+candidate_t GroupableTimeSeriesSet::getBestMatch(const TimeSeries& query, QueryContext& ctx) const
 {
+  if (this->backend != GROUP_BACKEND)
+  {
+    std::vector<candidate_t> results = this->backend == SAX_BACKEND
+        ? this->saxIndex->kSim(query, 1, ctx)
+        : this->saxIndex->approximateKSim(query, 1, 1, ctx);
+    if (results.empty()) {
+      throw KOnexException("No indexed sub-sequence can be compared with the query");
+    }
+    return results[0];
+  }
   if (this->groupsAllLengthSet) //not nullptr
   {
-    return this->groupsAllLengthSet->getBestMatch(query);
+    return this->groupsAllLengthSet->getBestMatch(query, ctx);
   }
   throw KOnexException("Dataset is not grouped");
 }
 
-std::vector<candidate_time_series_t> GroupableTimeSeriesSet::kSim(const TimeSeries& query, int k, int h)
+std::vector<candidate_t> GroupableTimeSeriesSet::kSim(const TimeSeries& query, int k, int h)
+{
+  QueryContext ctx;
+  return this->kSim(query, k, h, ctx);
+}
+
+std::vector<candidate_t> GroupableTimeSeriesSet::kSim(const TimeSeries& query, int k, int h, QueryContext& ctx)
 {
+  if (this->backend == SAX_BACKEND)
+  {
+    if (h < k) {
+      throw KOnexException("Number of examined time series must be larger than "
+                           "or equal to the number of time series to look for");
+    }
+    return this->saxIndex->kSim(query, k, ctx);
+  }
+  if (this->backend == SAX_APPROXIMATE_BACKEND) {
+    return this->saxIndex->approximateKSim(query, k, h, ctx);
+  }
   if (this->groupsAllLengthSet) //not nullptr
   {
     if (h < k) {
       throw KOnexException("Number of examined time series must be larger than "
                            "or equal to the number of time series to look for");
     }
-    std::vector<candidate_time_series_t> results = this->groupsAllLengthSet->kSim(query, h);
+    std::vector<candidate_t> results = this->groupsAllLengthSet->kSim(query, h, ctx);
     std::sort(results.begin(), results.end());
-    results.resize(k);
+    if (results.size() > k) {
+      results.resize(k);
+    }
     return results;
   }
   throw KOnexException("Dataset is not grouped");
 }
 
+progressive_result_t GroupableTimeSeriesSet::progressiveKSim(const TimeSeries& query, int k,
+                                                            const query_budget_t& budget,
+                                                            const progress_callback_t& callback,
+                                                            QueryContext& ctx)
+{
+  if (this->groupsAllLengthSet == nullptr) {
+    throw KOnexException("Dataset is not grouped");
+  }
+  return this->groupsAllLengthSet->progressiveKSim(query, k, ctx, budget, callback);
+}
+
+range_stats_t GroupableTimeSeriesSet::rangeQuery(const TimeSeries& query, data_t epsilon,
+                                                 const range_callback_t& callback,
+                                                 QueryContext& ctx, bool exactDistances)
+{
+  if (this->groupsAllLengthSet == nullptr) {
+    throw KOnexException("Dataset is not grouped");
+  }
+  return this->groupsAllLengthSet->rangeQuery(query, epsilon, ctx, callback, exactDistances);
+}
+
+int GroupableTimeSeriesSet::buildSAXIndex(const std::vector<int>& lengths, int wordLength, int leafCapacity)
+{
+  if (!this->isLoaded())
+  {
+    throw KOnexException("No data to index");
+  }
+  this->decompress();
+
+  SAXIndex* index = new SAXIndex(*this, wordLength, leafCapacity);
+  try {
+    index->build(lengths);
+  }
+  catch (...) {
+    delete index;
+    throw;
+  }
+  delete this->saxIndex;
+  this->saxIndex = index;
+  this->generation++;
+  return index->getEntryCount();
+}
+
+void GroupableTimeSeriesSet::clearSAXIndex()
+{
+  delete this->saxIndex;
+  this->saxIndex = nullptr;
+  this->backend = GROUP_BACKEND;
+  this->generation++;
+}
+
+void GroupableTimeSeriesSet::setSearchBackend(search_backend_t backend)
+{
+  if (backend != GROUP_BACKEND && this->saxIndex == nullptr) {
+    throw KOnexException("Dataset is not indexed");
+  }
+  this->backend = backend;
+  this->generation++;
+}
 
 } // namespace konex
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "TimeSeriesSet.hpp"
 #include "GlobalGroupSpace.hpp"
+#include "SAXIndex.hpp"
 #include <vector>
 
 #include "distance/Distance.hpp"
@@ -11,6 +12,15 @@
 
 namespace konex {
 
+/**
+ *  @brief the structure answering getBestMatch and kSim
+ *
+ *  GROUP_BACKEND searches the similarity groups. SAX_BACKEND searches the SAX
+ *  index exactly and SAX_APPROXIMATE_BACKEND stops after examining h
+ *  sub-sequences of the SAX index.
+ */
+enum search_backend_t { GROUP_BACKEND, SAX_BACKEND, SAX_APPROXIMATE_BACKEND };
+
 /**
  *  @brief a GroupableTimeSeriesSet object is a TimeSeriesSet with grouping
  *         functionalities
@@ -45,6 +55,11 @@ public:
     */
   bool isGrouped() const;
 
+  /**
+   *  @brief gets the groups, or nullptr if the dataset is not grouped
+   */
+  const GlobalGroupSpace* getGroupSpace() const { return this->groupsAllLengthSet; }
+
   void saveGroups(const std::string& path, bool groupSizeOnly) const;
   int loadGroups(const std::string& path);
   
@@ -52,11 +67,14 @@ public:
    * @brief Finds the best matching subsequence in the dataset
    *
    * @param other the timeseries to find the match for
+   * @param ctx settings and scratch memory of the query. Without it, the query
+   *        uses the process-wide default settings.
    *
    * @return a struct containing the closest TimeSeries and the distance between them
    * @throws exception if dataset is not grouped
    */
-  candidate_time_series_t getBestMatch(const TimeSeries& other) const;
+  candidate_t getBestMatch(const TimeSeries& other) const;
+  candidate_t getBestMatch(const TimeSeries& other, QueryContext& ctx) const;
 
   /**
    * @brief Finds k similar timeseries.
@@ -64,16 +82,73 @@ public:
    * @param data the timeseries to find the matches for
    * @param k the number of time series to look for.
    * @param h the number of time series to examine.
-   * @param approx if true, return the approximated distance, otherwise return the exact distance
+   * @param ctx settings and scratch memory of the query. Without it, the query
+   *        uses the process-wide default settings.
    * 
    * @return a vector of struct containing the closest TimeSeries and the distance between them
    * @throws exception if dataset is not grouped
    */
-  std::vector<candidate_time_series_t> kSim(const TimeSeries& data, int k, int h);
-  
+  std::vector<candidate_t> kSim(const TimeSeries& data, int k, int h);
+  std::vector<candidate_t> kSim(const TimeSeries& data, int k, int h, QueryContext& ctx);
+
+  /**
+   *  @brief finds k similar time series in the groups until a budget runs out
+   *
+   *  See GlobalGroupSpace::progressiveKSim. The groups are searched whatever
+   *  the search backend.
+   *
+   *  @throws exception if dataset is not grouped
+   */
+  progressive_result_t progressiveKSim(const TimeSeries& data, int k, const query_budget_t& budget,
+                                       const progress_callback_t& callback, QueryContext& ctx);
+
+  /**
+   *  @brief finds every time series within a distance of the query in the groups
+   *
+   *  See GlobalGroupSpace::rangeQuery. The groups are searched whatever the
+   *  search backend.
+   *
+   *  @throws exception if dataset is not grouped
+   */
+  range_stats_t rangeQuery(const TimeSeries& data, data_t epsilon, const range_callback_t& callback,
+                           QueryContext& ctx, bool exactDistances = false);
+
+  /**
+   *  @brief indexes the sub-sequences of the given lengths in a SAX index
+   *
+   *  The index replaces any previous one and must be rebuilt whenever the data
+   *  changes. Building it does not change the search backend.
+   *
+   *  @return the number of indexed sub-sequences
+   */
+  int buildSAXIndex(const std::vector<int>& lengths,
+                    int wordLength = SAX_DEFAULT_WORD_LENGTH,
+                    int leafCapacity = SAX_DEFAULT_LEAF_CAPACITY);
+  void clearSAXIndex();
+  const SAXIndex* getSAXIndex() const { return this->saxIndex; }
+
+  /**
+   *  @brief selects the structure answering getBestMatch and kSim
+   *
+   *  @throw KOnexException when selecting a SAX backend without a SAX index
+   */
+  void setSearchBackend(search_backend_t backend);
+  search_backend_t getSearchBackend() const { return this->backend; }
+
+protected:
+  void _dataMoved() override;
+
+  /**
+   *  @brief groups the appended series if the dataset is grouped, see
+   *         GlobalGroupSpace::extend, and drops the SAX index
+   */
+  void _dataAppended(int firstRow, int numThreads) override;
+
 private:
   GlobalGroupSpace* groupsAllLengthSet = nullptr;
   data_t threshold;
+  SAXIndex* saxIndex = nullptr;
+  search_backend_t backend = GROUP_BACKEND;
 };
 
 } // namespace konex
@@ -1,5 +1,6 @@
 #include "KOnexAPI.hpp"
 
+#include "BinaryDataset.hpp"
 #include "Exception.hpp"
 #include "GroupableTimeSeriesSet.hpp"
 #include "distance/Distance.hpp"
@@ -18,12 +19,25 @@ KOnexAPI::~KOnexAPI()
 }
 
 dataset_info_t KOnexAPI::loadDataset(const string& filePath, int maxNumRow,
-                                     int startCol, const string& separators)
+                                     int startCol, const string& separators, int numThreads,
+                                     bool normalize)
 {
 
   auto newSet = new GroupableTimeSeriesSet();
   try {
-    newSet->loadData(filePath, maxNumRow, startCol, separators);
+    if (isBinaryDataset(filePath))
+    {
+      if (startCol > 0) {
+        throw KOnexException("Columns of a binary dataset cannot be skipped");
+      }
+      newSet->loadBinary(filePath, maxNumRow);
+      if (normalize && !newSet->isNormalized() && newSet->getItemCount() > 0) {
+        newSet->normalize();
+      }
+    }
+    else {
+      newSet->loadData(filePath, maxNumRow, startCol, separators, numThreads, normalize);
+    }
   } catch (KOnexException& e)
   {
     delete newSet;
@@ -51,18 +65,44 @@ dataset_info_t KOnexAPI::loadDataset(const string& filePath, int maxNumRow,
   return this->getDatasetInfo(nextIndex);
 }
 
-void KOnexAPI::saveDataset(int index, const string& filePath, char separator)
+dataset_info_t KOnexAPI::appendDataset(int index, const string& filePath, int startCol,
+                                       const string& separators, int numThreads)
 {
   this->_checkDatasetIndex(index);
+  // Waits for the queries in progress on the dataset. Their cached results
+  // are keyed by the former generation, and freed here.
+  this->loadedDatasets[index]->appendData(filePath, startCol, separators, numThreads);
+  this->queryCache.invalidate(index);
+  return this->getDatasetInfo(index);
+}
+
+void KOnexAPI::saveDataset(int index, const string& filePath, char separator)
+{
+  this->_useDataset(index);
+  ScopedDatasetQuery scoped(*this->loadedDatasets[index]);
   this->loadedDatasets[index]->saveData(filePath, separator);
 }
 
+void KOnexAPI::saveBinaryDataset(int index, const string& filePath, int precision)
+{
+  this->_useDataset(index);
+  ScopedDatasetQuery scoped(*this->loadedDatasets[index]);
+  this->loadedDatasets[index]->saveBinary(filePath, precision);
+}
+
+int KOnexAPI::convertDataset(const string& textPath, const string& binaryPath,
+                             int startCol, const string& separators, int precision)
+{
+  return TimeSeriesSet::convertToBinary(textPath, binaryPath, startCol, separators, precision);
+}
+
 void KOnexAPI::unloadDataset(int index)
 {
   this->_checkDatasetIndex(index);
 
   delete loadedDatasets[index];
   loadedDatasets[index] = nullptr;
+  this->queryCache.invalidate(index);
   if (index == loadedDatasets.size() - 1)
   {
     loadedDatasets.pop_back();
@@ -70,6 +110,18 @@ void KOnexAPI::unloadDataset(int index)
   this->datasetCount--;
 }
 
+size_t KOnexAPI::compressDataset(int index)
+{
+  this->_checkDatasetIndex(index);
+  return this->loadedDatasets[index]->compress();
+}
+
+void KOnexAPI::decompressDataset(int index)
+{
+  this->_checkDatasetIndex(index);
+  this->loadedDatasets[index]->decompress();
+}
+
 void KOnexAPI::unloadAllDataset()
 {
   for (auto i = 0; i < this->loadedDatasets.size(); i++)
@@ -78,6 +130,7 @@ void KOnexAPI::unloadAllDataset()
   }
   this->loadedDatasets.clear();
   this->datasetCount = 0;
+  this->queryCache.clear();
 }
 
 int KOnexAPI::getDatasetCount()
@@ -114,13 +167,18 @@ vector<dataset_info_t> KOnexAPI::getAllDatasetInfo()
 std::pair<data_t, data_t> KOnexAPI::normalizeDataset(int idx)
 {
   this->_checkDatasetIndex(idx);
-  return this->loadedDatasets[idx]->normalize();
+  this->loadedDatasets[idx]->clearSAXIndex();
+  std::pair<data_t, data_t> bounds = this->loadedDatasets[idx]->normalize();
+  this->queryCache.invalidate(idx);
+  return bounds;
 }
 
 int KOnexAPI::groupDataset(int index, data_t threshold, const string& distance_name, int numThreads)
 {
   this->_checkDatasetIndex(index);
-  return this->loadedDatasets[index]->groupAllLengths(distance_name, threshold, numThreads);
+  int numberOfGroups = this->loadedDatasets[index]->groupAllLengths(distance_name, threshold, numThreads);
+  this->queryCache.invalidate(index);
+  return numberOfGroups;
 }
 
 void KOnexAPI::saveGroup(int index, const string &path, bool groupSizeOnly)
@@ -132,7 +190,45 @@ void KOnexAPI::saveGroup(int index, const string &path, bool groupSizeOnly)
 int KOnexAPI::loadGroup(int index, const string& path)
 {
   this->_checkDatasetIndex(index);
-  return this->loadedDatasets[index]->loadGroups(path);
+  int numberOfGroups = this->loadedDatasets[index]->loadGroups(path);
+  this->queryCache.invalidate(index);
+  return numberOfGroups;
+}
+
+int KOnexAPI::buildSAXIndex(int idx, const vector<int>& lengths, int wordLength)
+{
+  this->_checkDatasetIndex(idx);
+  int entryCount = this->loadedDatasets[idx]->buildSAXIndex(lengths, wordLength);
+  this->queryCache.invalidate(idx);
+  return entryCount;
+}
+
+void KOnexAPI::setSearchBackend(int idx, const string& backend)
+{
+  this->_checkDatasetIndex(idx);
+  if (backend == "groups") {
+    this->loadedDatasets[idx]->setSearchBackend(GROUP_BACKEND);
+  }
+  else if (backend == "sax") {
+    this->loadedDatasets[idx]->setSearchBackend(SAX_BACKEND);
+  }
+  else if (backend == "sax_approximate") {
+    this->loadedDatasets[idx]->setSearchBackend(SAX_APPROXIMATE_BACKEND);
+  }
+  else {
+    throw KOnexException("Unknown search backend: " + backend);
+  }
+  this->queryCache.invalidate(idx);
+}
+
+matrix_profile_summary_t KOnexAPI::findMotifs(int idx, int length, int k, const string& join,
+                                              double fraction, int numThreads)
+{
+  this->_useDataset(idx);
+  ScopedDatasetQuery scoped(*this->loadedDatasets[idx]);
+  MatrixProfile profile(*this->loadedDatasets[idx], length);
+  profile.compute(MatrixProfile::parseJoin(join), fraction, numThreads);
+  return profile.summarize(k);
 }
 
 void KOnexAPI::setWarpingBandRatio(double ratio)
@@ -140,37 +236,185 @@ void KOnexAPI::setWarpingBandRatio(double ratio)
   konex::setWarpingBandRatio(ratio);
 }
 
+void KOnexAPI::setQueryCacheCapacity(size_t bytes)
+{
+  this->queryCache.setCapacity(bytes);
+}
+
+void KOnexAPI::clearQueryCache()
+{
+  this->queryCache.clear();
+}
+
+query_cache_stats_t KOnexAPI::getQueryCacheStats() const
+{
+  return this->queryCache.getStats();
+}
+
 candidate_time_series_t KOnexAPI::getBestMatch(int result_idx, int query_idx, int index, int start, int end)
 {
-  this->_checkDatasetIndex(result_idx);
+  QueryContext ctx;
+  return this->getBestMatch(ctx, result_idx, query_idx, index, start, end);
+}
+
+candidate_time_series_t KOnexAPI::getBestMatch(QueryContext& ctx,
+  int result_idx, int query_idx, int index, int start, int end)
+{
+  this->_useDataset(result_idx);
   this->_checkDatasetIndex(query_idx);
+  ScopedDatasetQuery scoped(*loadedDatasets[result_idx], *loadedDatasets[query_idx]);
 
-  const TimeSeries& query = loadedDatasets[query_idx]->getTimeSeries(index, start, end);
-  return loadedDatasets[result_idx]->getBestMatch(query);
+  const TimeSeries& query = this->_getTimeSeries(query_idx, index, start, end);
+  query_key_t key(BEST_MATCH_QUERY, result_idx, query, 1, 1, ctx.getPAABlock(), ctx,
+                  loadedDatasets[result_idx]->getGeneration());
+  vector<candidate_t> results;
+  if (!this->queryCache.find(key, results))
+  {
+    results.push_back(loadedDatasets[result_idx]->getBestMatch(query, ctx));
+    this->queryCache.insert(key, results);
+  }
+  return loadedDatasets[result_idx]->materialize(results.front());
 }
 
 vector<candidate_time_series_t> KOnexAPI::kSim(int k, int h, int result_idx, int query_idx, int index, int start, int end)
 {
-  this->_checkDatasetIndex(result_idx);
+  QueryContext ctx;
+  return this->kSim(ctx, k, h, result_idx, query_idx, index, start, end);
+}
+
+vector<candidate_time_series_t> KOnexAPI::kSim(QueryContext& ctx,
+  int k, int h, int result_idx, int query_idx, int index, int start, int end)
+{
+  this->_useDataset(result_idx);
+  this->_checkDatasetIndex(query_idx);
+  ScopedDatasetQuery scoped(*loadedDatasets[result_idx], *loadedDatasets[query_idx]);
+
+  const TimeSeries& query = this->_getTimeSeries(query_idx, index, start, end);
+  query_key_t key(KSIM_QUERY, result_idx, query, k, h, ctx.getPAABlock(), ctx,
+                  loadedDatasets[result_idx]->getGeneration());
+  vector<candidate_t> results;
+  if (!this->queryCache.find(key, results))
+  {
+    results = loadedDatasets[result_idx]->kSim(query, k, h, ctx);
+    this->queryCache.insert(key, results);
+  }
+  return loadedDatasets[result_idx]->materialize(results);
+}
+
+progressive_result_t KOnexAPI::progressiveKSim(int k, const query_budget_t& budget,
+  const progress_callback_t& callback, int result_idx, int query_idx, int index, int start, int end)
+{
+  QueryContext ctx;
+  return this->progressiveKSim(ctx, k, budget, callback, result_idx, query_idx, index, start, end);
+}
+
+progressive_result_t KOnexAPI::progressiveKSim(QueryContext& ctx, int k, const query_budget_t& budget,
+  const progress_callback_t& callback, int result_idx, int query_idx, int index, int start, int end)
+{
+  this->_useDataset(result_idx);
   this->_checkDatasetIndex(query_idx);
+  ScopedDatasetQuery scoped(*loadedDatasets[result_idx], *loadedDatasets[query_idx]);
 
-  const TimeSeries& query = loadedDatasets[query_idx]->getTimeSeries(index, start, end);
-  return loadedDatasets[result_idx]->kSim(query, k, h);
+  const TimeSeries& query = this->_getTimeSeries(query_idx, index, start, end);
+  return loadedDatasets[result_idx]->progressiveKSim(query, k, budget, callback, ctx);
+}
+
+range_stats_t KOnexAPI::rangeQuery(data_t epsilon, const range_callback_t& callback,
+  int result_idx, int query_idx, int index, int start, int end, bool exactDistances)
+{
+  QueryContext ctx;
+  return this->rangeQuery(ctx, epsilon, callback, result_idx, query_idx, index, start, end, exactDistances);
+}
+
+range_stats_t KOnexAPI::rangeQuery(QueryContext& ctx, data_t epsilon, const range_callback_t& callback,
+  int result_idx, int query_idx, int index, int start, int end, bool exactDistances)
+{
+  this->_useDataset(result_idx);
+  this->_checkDatasetIndex(query_idx);
+  ScopedDatasetQuery scoped(*loadedDatasets[result_idx], *loadedDatasets[query_idx]);
+
+  const TimeSeries& query = this->_getTimeSeries(query_idx, index, start, end);
+  return loadedDatasets[result_idx]->rangeQuery(query, epsilon, callback, ctx, exactDistances);
+}
+
+query_plan_t KOnexAPI::explainKSim(int k, int h, bool exact, int result_idx, int query_idx, int index, int start, int end)
+{
+  QueryContext ctx;
+  return this->explainKSim(ctx, k, h, exact, result_idx, query_idx, index, start, end);
+}
+
+query_plan_t KOnexAPI::explainKSim(QueryContext& ctx,
+  int k, int h, bool exact, int result_idx, int query_idx, int index, int start, int end)
+{
+  this->_useDataset(result_idx);
+  this->_checkDatasetIndex(query_idx);
+  ScopedDatasetQuery scoped(*loadedDatasets[result_idx], *loadedDatasets[query_idx]);
+
+  const TimeSeries& query = this->_getTimeSeries(query_idx, index, start, end);
+  return QueryPlanner(*loadedDatasets[result_idx]).plan(query, k, h, exact, ctx);
+}
+
+vector<candidate_time_series_t> KOnexAPI::kSimPlanned(int k, int h, bool exact,
+  int result_idx, int query_idx, int index, int start, int end)
+{
+  QueryContext ctx;
+  return this->kSimPlanned(ctx, k, h, exact, result_idx, query_idx, index, start, end);
+}
+
+vector<candidate_time_series_t> KOnexAPI::kSimPlanned(QueryContext& ctx,
+  int k, int h, bool exact, int result_idx, int query_idx, int index, int start, int end)
+{
+  this->_useDataset(result_idx);
+  this->_checkDatasetIndex(query_idx);
+  ScopedDatasetQuery scoped(*loadedDatasets[result_idx], *loadedDatasets[query_idx]);
+
+  const TimeSeries& query = this->_getTimeSeries(query_idx, index, start, end);
+  QueryPlanner planner(*loadedDatasets[result_idx]);
+  query_plan_t plan = planner.plan(query, k, h, exact, ctx);
+  // The results of the exact strategies are the same whichever is chosen
+  query_key_t key(exact ? KSIM_EXACT_QUERY : KSIM_PLANNED_QUERY, result_idx, query, k, exact ? 0 : h, 0, ctx,
+                  loadedDatasets[result_idx]->getGeneration());
+  vector<candidate_t> results;
+  if (!this->queryCache.find(key, results))
+  {
+    results = planner.execute(plan, query, ctx);
+    this->queryCache.insert(key, results);
+  }
+  return loadedDatasets[result_idx]->materialize(results);
 }
 
 vector<candidate_time_series_t> KOnexAPI::kSimRaw(int k, int result_idx, int query_idx, int index, int start, int end, int PAABlockSize)
 {
+  QueryContext ctx;
+  return this->kSimRaw(ctx, k, result_idx, query_idx, index, start, end, PAABlockSize);
+}
+
+vector<candidate_time_series_t> KOnexAPI::kSimRaw(QueryContext& ctx,
+  int k, int result_idx, int query_idx, int index, int start, int end, int PAABlockSize)
+{
+  // A compressed dataset is searched block by block until it is hot
   this->_checkDatasetIndex(result_idx);
   this->_checkDatasetIndex(query_idx);
-
-  const TimeSeries& query = loadedDatasets[query_idx]->getTimeSeries(index, start, end);
-  return loadedDatasets[result_idx]->kSimRaw(query, k, PAABlockSize);
+  ScopedDatasetQuery scoped(*loadedDatasets[result_idx], *loadedDatasets[query_idx]);
+
+  const TimeSeries& query = this->_getTimeSeries(query_idx, index, start, end);
+  query_key_t key(KSIM_RAW_QUERY, result_idx, query, k, 0,
+                  PAABlockSize > 0 ? PAABlockSize : ctx.getPAABlock(), ctx,
+                  loadedDatasets[result_idx]->getGeneration());
+  vector<candidate_t> results;
+  if (!this->queryCache.find(key, results))
+  {
+    results = loadedDatasets[result_idx]->kSimRaw(query, k, ctx, PAABlockSize);
+    this->queryCache.insert(key, results);
+  }
+  return loadedDatasets[result_idx]->materialize(results);
 }
 
 dataset_info_t KOnexAPI::PAA(int idx, int n)
 {
   this->_checkDatasetIndex(idx);
   this->loadedDatasets[idx]->PAA(n);
+  this->queryCache.invalidate(idx);
   return this->getDatasetInfo(idx);
 }
 
@@ -180,8 +424,9 @@ data_t KOnexAPI::distanceBetween(int ds1, int idx1, int start1, int end1,
 {
   this->_checkDatasetIndex(ds1);
   this->_checkDatasetIndex(ds2);
-  TimeSeries ts1 = this->loadedDatasets[ds1]->getTimeSeries(idx1, start1, end1);
-  TimeSeries ts2 = this->loadedDatasets[ds1]->getTimeSeries(idx2, start2, end2);  
+  ScopedDatasetQuery scoped(*this->loadedDatasets[ds1], *this->loadedDatasets[ds2]);
+  TimeSeries ts1 = this->_getTimeSeries(ds1, idx1, start1, end1);
+  TimeSeries ts2 = this->_getTimeSeries(ds2, idx2, start2, end2);
   const dist_t distance = getDistance(distance_name);
   return distance(ts1, ts2, INF);
 }
@@ -189,7 +434,8 @@ data_t KOnexAPI::distanceBetween(int ds1, int idx1, int start1, int end1,
 void KOnexAPI::printTS(int ds, int idx, int start, int end)
 {
   this->_checkDatasetIndex(ds);
-  TimeSeries ts = this->loadedDatasets[ds]->getTimeSeries(idx, start, end);
+  ScopedDatasetQuery scoped(*this->loadedDatasets[ds]);
+  TimeSeries ts = this->_getTimeSeries(ds, idx, start, end);
   ts.printData(std::cout);
   std::cout << std::endl;
 }
@@ -202,4 +448,22 @@ void KOnexAPI::_checkDatasetIndex(int index)
   }
 }
 
+void KOnexAPI::_useDataset(int index)
+{
+  this->_checkDatasetIndex(index);
+  this->loadedDatasets[index]->decompress();
+}
+
+TimeSeries KOnexAPI::_getTimeSeries(int ds, int index, int start, int end)
+{
+  this->_checkDatasetIndex(ds);
+  GroupableTimeSeriesSet* dataset = this->loadedDatasets[ds];
+  // Copied, so that a compressed dataset is only decompressed once it is hot
+  if (dataset->isCompressed() && !dataset->isHot()) {
+    return dataset->copyTimeSeries(index, start, end);
+  }
+  dataset->decompress();
+  return dataset->getTimeSeries(index, start, end);
+}
+
 } // namespace konex
@@ -5,7 +5,11 @@
 #include <string>
 
 #include "GroupableTimeSeriesSet.hpp"
+#include "MatrixProfile.hpp"
+#include "QueryCache.hpp"
+#include "QueryPlanner.hpp"
 #include "TimeSeries.hpp"
+#include "distance/QueryContext.hpp"
 
 using std::string;
 using std::vector;
@@ -68,15 +72,66 @@ public:
    *  @param separator a string containings possible separator characters for values
    *         in a line
    *  @param startCol columns before startCol are discarded
+   *  @param numThreads number of threads parsing the file
+   *  @param normalize if true, the dataset is normalized as it is loaded, see
+   *         normalizeDataset
    *  @return an index used to refer to the just loaded dataset
    *
+   *  Binary datasets saved by saveBinaryDataset are recognized and mapped to
+   *  memory instead of being parsed. Their columns cannot be skipped.
+   *
    *  @throw KOnexException if cannot read from the given file
    */
   dataset_info_t loadDataset(const string& filePath, int maxNumRow,
-                             int startCol, const string& separators);
+                             int startCol, const string& separators, int numThreads = 1,
+                             bool normalize = false);
+
+  /**
+   *  @brief adds the series of a file after those of a loaded dataset, see
+   *         TimeSeriesSet::appendData
+   *
+   *  The time series returned by earlier queries stay valid. If the dataset is
+   *  grouped, the new series join its groups or start new ones, see
+   *  GlobalGroupSpace::extend. Its SAX index is dropped. The series are added
+   *  once the queries in progress on the dataset are done, and the queries
+   *  of the other threads wait for them.
+   *
+   *  @param index index of the dataset
+   *  @param filePath path to a text file or to a binary dataset
+   *  @param startCol columns before startCol are discarded
+   *  @param separators a string containings possible separator characters
+   *         for values in a line
+   *  @param numThreads number of threads parsing a text file and grouping the
+   *         new series
+   *  @return the information of the dataset, with its new number of series
+   *
+   *  @throw KOnexException if the file cannot be read or its series do not
+   *         have the length of those of the dataset
+   */
+  dataset_info_t appendDataset(int index, const string& filePath, int startCol = 0,
+                               const string& separators = " ", int numThreads = 1);
 
   void saveDataset(int index, const string& filePath, char separator);                           
 
+  /**
+   *  @brief saves a dataset to a binary file, which loadDataset maps back to
+   *         memory without parsing it
+   *
+   *  @param index index of the dataset
+   *  @param filePath path to the saved file
+   *  @param precision bytes of a saved value, see TimeSeriesSet::saveBinary
+   */
+  void saveBinaryDataset(int index, const string& filePath, int precision = sizeof(data_t));
+
+  /**
+   *  @brief converts a text dataset to a binary file without loading it, see
+   *         TimeSeriesSet::convertToBinary
+   *
+   *  @return the number of time series converted
+   */
+  int convertDataset(const string& textPath, const string& binaryPath,
+                     int startCol, const string& separators, int precision = sizeof(data_t));
+
   /**
    *  @brief unloads a dataset at given index
    *
@@ -84,6 +139,28 @@ public:
    */
   void unloadDataset(int index);
 
+  /**
+   *  @brief compresses an idle dataset to save memory, see
+   *         TimeSeriesSet::compress
+   *
+   *  The dataset is decompressed as soon as it is grouped, indexed, searched
+   *  through its groups or index, or saved. Its series are copied as queries,
+   *  printed or compared, and kSimRaw searches it block by block, until it is
+   *  hot enough to decompress, see TimeSeriesSet::isHot. The time series
+   *  returned by earlier queries are invalidated.
+   *
+   *  @param index index of the dataset
+   *  @return the bytes taken by the compressed values
+   */
+  size_t compressDataset(int index);
+
+  /**
+   *  @brief decompresses a compressed dataset, does nothing otherwise
+   *
+   *  @param index index of the dataset
+   */
+  void decompressDataset(int index);
+
   /**
    *  @brief unloads all datasets
    */
@@ -134,8 +211,50 @@ public:
   void saveGroup(int idx, const string& path, bool groupSizeOnly);
   int loadGroup(int idx, const string& path);
 
+  /**
+   *  @brief indexes the sub-sequences of some lengths of a dataset in a SAX index
+   *
+   *  The index is dropped when the dataset is normalized.
+   *
+   *  @param idx the index of the dataset
+   *  @param lengths the lengths of the indexed sub-sequences
+   *  @param wordLength number of segments of the SAX words
+   *  @return the number of indexed sub-sequences
+   */
+  int buildSAXIndex(int idx, const vector<int>& lengths, int wordLength = SAX_DEFAULT_WORD_LENGTH);
+
+  /**
+   *  @brief selects the structure answering getBestMatch and kSim on a dataset
+   *
+   *  @param idx the index of the dataset
+   *  @param backend "groups", "sax" for an exact search of the SAX index, or
+   *         "sax_approximate" for a search of the SAX index that examines at
+   *         most h sub-sequences
+   */
+  void setSearchBackend(int idx, const string& backend);
+
+  /**
+   *  @brief sets the default warping band ratio
+   *
+   *  The default applies to the queries made without a QueryContext and to
+   *  contexts created afterwards without an explicit ratio.
+   */
   void setWarpingBandRatio(double ratio);
 
+  /**
+   *  @brief sets the memory the cached results of getBestMatch, kSim and kSimRaw
+   *         may take
+   *
+   *  Repeated queries with the same values and settings on a dataset get the
+   *  cached results back. They are dropped whenever the dataset, its groups or
+   *  its search backend change.
+   *
+   *  @param bytes the capacity of the cache. The cache is disabled if 0.
+   */
+  void setQueryCacheCapacity(size_t bytes);
+  void clearQueryCache();
+  query_cache_stats_t getQueryCacheStats() const;
+
   /**
    *  @brief gets the best match in a dataset
    *
@@ -149,6 +268,14 @@ public:
   candidate_time_series_t getBestMatch(
       int result_idx, int query_idx, int index, int start = -1, int end = -1);
 
+  /**
+   *  @brief gets the best match in a dataset with the settings of a query context
+   *
+   *  Queries with their own contexts can be made concurrently from different threads.
+   */
+  candidate_time_series_t getBestMatch(QueryContext& ctx,
+      int result_idx, int query_idx, int index, int start = -1, int end = -1);
+
 
   /**
    *  @brief gets k similar TimeSeries to the query. Provides a bound of dist
@@ -166,6 +293,86 @@ public:
    */
   std::vector<candidate_time_series_t> kSim(
     int k, int h, int result_idx, int query_idx, int index, int start = -1, int end = -1);
+  std::vector<candidate_time_series_t> kSim(QueryContext& ctx,
+    int k, int h, int result_idx, int query_idx, int index, int start = -1, int end = -1);
+
+  /**
+   *  @brief gets k similar TimeSeries to the query, improving them until a time
+   *         or work budget runs out
+   *
+   *  The groups are examined from the one with the closest centroid. Every time
+   *  the results improve, they are passed to the callback, which can stop the
+   *  query by returning false. The results have exact distances, and are
+   *  flagged exact once they are provably the k nearest neighbors.
+   *
+   *  @param k the number of similar time series to find
+   *  @param budget the time and the number of distances allowed
+   *  @param callback receives the improved results, can be empty
+   *  @param result_idx the index of the result dataset
+   *  @param query_idx the index of the query dataset
+   *  @param index the index of the timeseries in the query dataset
+   *  @param start the start of the index
+   *  @param end the end of the index
+   *  @return the best results found
+   */
+  progressive_result_t progressiveKSim(int k, const query_budget_t& budget,
+    const progress_callback_t& callback, int result_idx, int query_idx, int index, int start = -1, int end = -1);
+  progressive_result_t progressiveKSim(QueryContext& ctx, int k, const query_budget_t& budget,
+    const progress_callback_t& callback, int result_idx, int query_idx, int index, int start = -1, int end = -1);
+
+  /**
+   *  @brief finds every sub-sequence within a distance of the query
+   *
+   *  Groups are skipped or included as a whole when the distance to their
+   *  centroid decides it, see GlobalGroupSpace::rangeQuery. Matches are passed
+   *  to the callback as they are found instead of being collected.
+   *
+   *  @param epsilon the largest distance of a match
+   *  @param callback receives each match, and returns false to stop the query
+   *  @param result_idx the index of the result dataset
+   *  @param query_idx the index of the query dataset
+   *  @param index the index of the timeseries in the query dataset
+   *  @param start the start of the index
+   *  @param end the end of the index
+   *  @param exactDistances if false, members of groups included as a whole are
+   *         given a bound of their distance
+   *  @return counts of the matches and the work done
+   */
+  range_stats_t rangeQuery(data_t epsilon, const range_callback_t& callback,
+    int result_idx, int query_idx, int index, int start = -1, int end = -1, bool exactDistances = false);
+  range_stats_t rangeQuery(QueryContext& ctx, data_t epsilon, const range_callback_t& callback,
+    int result_idx, int query_idx, int index, int start = -1, int end = -1, bool exactDistances = false);
+
+  /**
+   *  @brief estimates the strategies that can answer a kSim query and chooses
+   *         the cheapest one, see QueryPlanner
+   *
+   *  @param k the number of similar time series to find
+   *  @param h the number of time series the grouped search examines
+   *  @param exact if true, only strategies giving the exact k nearest
+   *         neighbors are considered
+   *  @param result_idx the index of the result dataset
+   *  @param query_idx the index of the query dataset
+   *  @param index the index of the timeseries in the query dataset
+   *  @param start the start of the index
+   *  @param end the end of the index
+   *  @return the chosen strategy and the estimates of every strategy
+   */
+  query_plan_t explainKSim(
+    int k, int h, bool exact, int result_idx, int query_idx, int index, int start = -1, int end = -1);
+  query_plan_t explainKSim(QueryContext& ctx,
+    int k, int h, bool exact, int result_idx, int query_idx, int index, int start = -1, int end = -1);
+
+  /**
+   *  @brief gets k similar TimeSeries to the query with the strategy chosen by
+   *         explainKSim
+   *
+   *  @return k similar time series
+   */
+  std::vector<candidate_time_series_t> kSimPlanned(
+    int k, int h, bool exact, int result_idx, int query_idx, int index, int start = -1, int end = -1);
+  std::vector<candidate_time_series_t> kSimPlanned(QueryContext& ctx,
+    int k, int h, bool exact, int result_idx, int query_idx, int index, int start = -1, int end = -1);
 
  /**
    *  @brief gets k similar TimeSeries to the query, exhaustively.
@@ -181,6 +388,24 @@ public:
    */
   std::vector<candidate_time_series_t> kSimRaw(
     int k, int result_idx, int query_idx, int index, int start = -1, int end = -1, int PAABlockSize = 0);
+  std::vector<candidate_time_series_t> kSimRaw(QueryContext& ctx,
+    int k, int result_idx, int query_idx, int index, int start = -1, int end = -1, int PAABlockSize = 0);
+
+  /**
+   *  @brief finds the top motifs and discords of a dataset with its matrix profile
+   *
+   *  @param idx the index of the dataset
+   *  @param length the length of the sub-sequences
+   *  @param k the number of motifs and of discords to find
+   *  @param join "within" to match sub-sequences of the same time series, or
+   *         "across" to match sub-sequences of different time series
+   *  @param fraction fraction of the matrix profile to compute. Results are
+   *         exact if 1, otherwise approximate (SCRIMP++).
+   *  @param numThreads number of threads
+   *  @return the motifs and discords
+   */
+  matrix_profile_summary_t findMotifs(int idx, int length, int k, const string& join = "within",
+                                      double fraction = 1.0, int numThreads = 1);
 
   dataset_info_t PAA(int idx, int n);
 
@@ -193,7 +418,20 @@ public:
 private:
   void _checkDatasetIndex(int index);
 
+  /**
+   *  @brief checks the index and decompresses the dataset if needed, before
+   *         its values are viewed
+   */
+  void _useDataset(int index);
+
+  /**
+   *  @brief checks the index and gets a view of a series, or a copy if its
+   *         dataset is compressed and not hot yet
+   */
+  TimeSeries _getTimeSeries(int ds, int index, int start, int end);
+
   vector<GroupableTimeSeriesSet*> loadedDatasets;
+  QueryCache queryCache;
   int datasetCount = 0;
 };
 
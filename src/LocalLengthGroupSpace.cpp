@@ -5,6 +5,7 @@
 #include <atomic>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <chrono>
 
 #include "TimeSeries.hpp"
@@ -47,8 +48,25 @@ void LocalLengthGroupSpace::reset()
 
 std::atomic<long> gLastTime(duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
 
-int LocalLengthGroupSpace::generateGroups(const dist_t pairwiseDistance, data_t threshold)
+int LocalLengthGroupSpace::generateGroups(const dist_t pairwiseDistance, data_t threshold,
+                                          const DistanceProfile* profile, int firstRow, int lastRow)
 {
+  if (lastRow < 0 || lastRow > dataset.getItemCount()) {
+    lastRow = dataset.getItemCount();
+  }
+  // Series appended since the groups were made get room in the map. Groups
+  // refer to the map itself, which stays where it is.
+  size_t cells = (size_t)dataset.getItemCount() * this->subTimeSeriesCount;
+  if (this->memberMap.size() < cells) {
+    this->memberMap.resize(cells);
+  }
+  int groupsBefore = this->groups.size();
+  if (profile != nullptr && this->length >= DISTANCE_PROFILE_MIN_LENGTH
+      && pairwiseDistance == static_cast<dist_t>(konex::pairwiseDistance)
+      && firstRow == 0 && lastRow == dataset.getItemCount() && groupsBefore == 0) {
+    return this->_generateGroupsWithProfile(pairwiseDistance, threshold, *profile);
+  }
+
   long nowInSec = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
   long elapsedSeconds = nowInSec - gLastTime;
   bool doLog = false;
@@ -59,15 +77,15 @@ int LocalLengthGroupSpace::generateGroups(const dist_t pairwiseDistance, data_t
   if (doLog) {
     cout << "Processing time series space of length " << this->length << endl;
   }
-  int totalTimeSeries = this->subTimeSeriesCount * dataset.getItemCount();
+  int totalTimeSeries = this->subTimeSeriesCount * (lastRow - firstRow);
   int counter = 0;
   for (int start = 0; start < this->subTimeSeriesCount; start++)
   {
-    for (int idx = 0; idx < dataset.getItemCount(); idx++)
+    for (int idx = firstRow; idx < lastRow; idx++)
     {
       counter++;
       if (doLog) {
-        if (counter % (totalTimeSeries / LOG_FREQ) == 0) {
+        if (counter % std::max(totalTimeSeries / LOG_FREQ, 1) == 0) {
           cout << "  Grouping progress... " << counter << "/" << totalTimeSeries 
                << " (" << counter*100/totalTimeSeries << "%)" << endl;
         }
@@ -101,6 +119,105 @@ int LocalLengthGroupSpace::generateGroups(const dist_t pairwiseDistance, data_t
     }
   }
 
+  return this->getNumberOfGroups() - groupsBefore;
+}
+
+int LocalLengthGroupSpace::_generateGroupsWithProfile(const dist_t pairwiseDistance, data_t threshold,
+                                                      const DistanceProfile& profile)
+{
+  // Sub-sequences are visited in the same order as generateGroups. For each one
+  // not visited yet, the two smallest approximate distances to the centroids
+  // so far are kept, along with the group of the smallest. When a sub-sequence
+  // is visited, its exact distance to that group is computed. If the second
+  // smallest approximate distance is certainly larger, that group is the one
+  // the direct scan would pick. Otherwise all groups are scanned as usual.
+  int itemCount = this->dataset.getItemCount();
+  int total = itemCount * this->subTimeSeriesCount;
+  vector<double> best(total, INF), second(total, INF);
+  vector<int> bestGroup(total, -1);
+  vector<double> distances(total);
+  double slack = 0;
+
+  for (int start = 0; start < this->subTimeSeriesCount; start++)
+  {
+    for (int idx = 0; idx < itemCount; idx++)
+    {
+      TimeSeries query = dataset.getTimeSeries(idx, start, start + this->length);
+      int cell = idx * this->subTimeSeriesCount + start;
+
+      data_t bestSoFar = INF;
+      int bestSoFarIndex = -1;
+      if (bestGroup[cell] >= 0)
+      {
+        int g = bestGroup[cell];
+        data_t dist = this->groups[g]->distanceFromCentroid(query, pairwiseDistance, INF);
+        double exact = (double)dist * dist * this->length;
+        // dist is rounded to data_t, so its square is only known to a few ulps
+        double rounding = 4 * exact * std::numeric_limits<data_t>::epsilon();
+        if (second[cell] > exact + 2 * slack + rounding)
+        {
+          bestSoFar = dist;
+          bestSoFarIndex = g;
+        }
+        else
+        {
+          // The scan below still finds the first closest group, as every
+          // group at least as close as g is within this dropout
+          bestSoFar = std::nextafter(dist, (data_t)INF);
+        }
+      }
+      if (bestSoFarIndex < 0)
+      {
+        int fallback = bestGroup[cell];
+        for (auto i = 0; i < groups.size(); i++)
+        {
+          data_t dist = this->groups[i]->distanceFromCentroid(query, pairwiseDistance, bestSoFar);
+          if (dist < bestSoFar)
+          {
+            bestSoFar = dist;
+            bestSoFarIndex = i;
+          }
+        }
+        if (bestSoFarIndex < 0 && fallback >= 0)
+        {
+          bestSoFarIndex = fallback;
+          bestSoFar = this->groups[fallback]->distanceFromCentroid(query, pairwiseDistance, INF);
+        }
+      }
+
+      if (bestSoFar > threshold / 2 || this->groups.size() == 0)
+      {
+        bestSoFarIndex = this->groups.size();
+        int newGroupIndex = this->groups.size();
+        this->groups.push_back(new Group(newGroupIndex, this->length, this->subTimeSeriesCount,
+                                         this->dataset, this->memberMap));
+        this->groups[bestSoFarIndex]->setCentroid(idx, start);
+
+        // Score the new centroid against the sub-sequences visited after this one
+        slack = std::max(slack, profile.compute(query, distances.data()));
+        for (int later = start; later < this->subTimeSeriesCount; later++)
+        {
+          for (int i = (later == start ? idx + 1 : 0); i < itemCount; i++)
+          {
+            int c = i * this->subTimeSeriesCount + later;
+            double d = distances[c];
+            if (d < best[c])
+            {
+              second[c] = best[c];
+              best[c] = d;
+              bestGroup[c] = newGroupIndex;
+            }
+            else if (d < second[c]) {
+              second[c] = d;
+            }
+          }
+        }
+      }
+
+      this->groups[bestSoFarIndex]->addMember(idx, start);
+    }
+  }
+
   return this->getNumberOfGroups();
 }
 
@@ -117,6 +234,13 @@ const Group* LocalLengthGroupSpace::getGroup(int idx) const
   return this->groups[idx];
 }
 
+void LocalLengthGroupSpace::rebindCentroids()
+{
+  for (Group* group : this->groups) {
+    group->rebindCentroid();
+  }
+}
+
 void LocalLengthGroupSpace::saveGroups(ofstream &fout, bool groupSizeOnly) const 
 {
   // Number of groups having time series of this length
@@ -152,13 +276,13 @@ int LocalLengthGroupSpace::loadGroups(ifstream &fin)
 }
 
 candidate_group_t LocalLengthGroupSpace::getBestGroup(const TimeSeries& query,
-  const dist_t warpedDistance,
+  QueryContext& ctx,
   data_t dropout) const
 {
   data_t bestSoFarDist = dropout;
   const Group* bestSoFarGroup = nullptr;
   for (auto i = 0; i < groups.size(); i++) {
-    data_t dist = groups[i]->distanceFromCentroid(query, warpedDistance, bestSoFarDist);
+    data_t dist = groups[i]->distanceFromCentroid(query, ctx, bestSoFarDist);
     if (dist < bestSoFarDist) {
       bestSoFarDist = dist;
       bestSoFarGroup = groups[i];
@@ -169,7 +293,7 @@ candidate_group_t LocalLengthGroupSpace::getBestGroup(const TimeSeries& query,
 }
 
 int LocalLengthGroupSpace::interLevelKSim(const TimeSeries& query, 
-    const dist_t warpedDistance,
+    QueryContext& ctx,
     std::vector<group_index_t> &bestSoFar,
     int k)
 {
@@ -177,7 +301,7 @@ int LocalLengthGroupSpace::interLevelKSim(const TimeSeries& query,
       if (k <= 0) // if heap is full, keep only sum-k groups
       {
         data_t bestSoFarDist = bestSoFar.front().dist;
-        data_t dist = groups[i]->distanceFromCentroid(query, warpedDistance, bestSoFarDist);
+        data_t dist = groups[i]->distanceFromCentroid(query, ctx, bestSoFarDist);
         if (dist < bestSoFarDist) {
           int membersAdded = groups[i]->getCount();
           bestSoFar.push_back(group_index_t(this->length, i, membersAdded, dist));
@@ -195,7 +319,7 @@ int LocalLengthGroupSpace::interLevelKSim(const TimeSeries& query,
       else // heap is not full, directly add to heap.
       {
         int membersAdded = groups[i]->getCount();
-        data_t dist = groups[i]->distanceFromCentroid(query, warpedDistance, INF);
+        data_t dist = groups[i]->distanceFromCentroid(query, ctx, INF);
         bestSoFar.push_back(group_index_t(this->length, i, membersAdded, dist));
         k -= membersAdded;
         if (k <= 0) {
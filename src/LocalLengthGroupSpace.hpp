@@ -7,6 +7,7 @@
 
 #include "TimeSeries.hpp"
 #include "distance/Distance.hpp"
+#include "distance/DistanceProfile.hpp"
 #include "Group.hpp"
 
 using std::vector;
@@ -47,6 +48,11 @@ public:
    */
   const Group* getGroup(int idx) const;
   
+  /**
+   *  @brief takes the views of the centroids again, see Group::rebindCentroid
+   */
+  void rebindCentroids();
+
   void saveGroups(std::ofstream &fout, bool groupSizeOnly) const;
   int loadGroups(std::ifstream &fin);
   
@@ -55,23 +61,34 @@ public:
    *
    *  @param pairwiseDistance the distance to use when computing the groups
    *  @param threshold the threshold to use when splitting into new groups
-   *  @return number of generated groups
+   *  @param profile if given and the distance is the Euclidean distance, each
+   *         new centroid is compared with all later sub-sequences at once
+   *         through its distance profile. The groups are the same as without it.
+   *         It is only used when all rows are grouped at once.
+   *  @param firstRow the first series to group
+   *  @param lastRow the series after the last one to group, or a negative number
+   *         for all series after firstRow. Series grouped by earlier calls keep
+   *         their groups, and the new ones join them or start new groups.
+   *         Series appended to the dataset since the groups were made can
+   *         be grouped this way too.
+   *  @return number of groups generated by this call
    */
-  int generateGroups(const dist_t pairwiseDistance, data_t threshold);
+  int generateGroups(const dist_t pairwiseDistance, data_t threshold,
+                     const DistanceProfile* profile = nullptr, int firstRow = 0, int lastRow = -1);
 
   /**
    *  @brief gets the group closest to a query (measured from the centroid)
    *
    *  @param query the time series we're operating with
-   *  @param metric the metric that determines the distance between ts
+   *  @param ctx the query context providing the distance between ts
    *  @param dropout the dropout optimization param
    */
   candidate_group_t getBestGroup(const TimeSeries& query,
-                                 const dist_t warpedDistance,
+                                 QueryContext& ctx,
                                  data_t dropout) const;
 
   int interLevelKSim(const TimeSeries& query, 
-    const dist_t warpedDistance, 
+    QueryContext& ctx, 
     vector<group_index_t> &bestSoFar, 
     int k);
     
@@ -80,6 +97,9 @@ private:
   const TimeSeriesSet& dataset;
   vector<Group*> groups;
   vector<group_membership_t> memberMap;
+
+  int _generateGroupsWithProfile(const dist_t pairwiseDistance, data_t threshold,
+                                 const DistanceProfile& profile);
 };
 
 } // namespace konex
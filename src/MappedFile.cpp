@@ -0,0 +1,88 @@
+#include "MappedFile.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace konex {
+
+MappedFile::MappedFile(const std::string& path, bool copyOnWrite)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw KOnexException("Cannot open " + path);
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    close(fd);
+    throw KOnexException("Cannot open " + path);
+  }
+
+  // An empty file cannot be mapped, and has nothing to map anyway
+  this->size = info.st_size;
+  if (this->size > 0)
+  {
+    int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* mapping = mmap(nullptr, this->size, protection, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+      close(fd);
+      throw KOnexException("Cannot map " + path + " to memory");
+    }
+    this->data = static_cast<const char*>(mapping);
+  }
+  // The mapping stays valid once the descriptor is closed
+  close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+  if (this->data != nullptr) {
+    munmap(const_cast<char*>(this->data), this->size);
+  }
+}
+
+void MappedFile::adviseSequential() const
+{
+  this->advise(ACCESS_SEQUENTIAL, 0, this->size);
+}
+
+void MappedFile::advise(access_pattern_t pattern, size_t offset, size_t length) const
+{
+  if (this->data == nullptr || offset >= this->size) {
+    return;
+  }
+  length = std::min(length, this->size - offset);
+
+  // madvise wants a page-aligned start. The mapping itself starts on a page.
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t begin = offset / pageSize * pageSize;
+  size_t end = offset + length;
+
+  int advice;
+  switch (pattern)
+  {
+    case ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+    case ACCESS_RANDOM: advice = MADV_RANDOM; break;
+    case ACCESS_WILLNEED: advice = MADV_WILLNEED; break;
+    case ACCESS_COLD:
+#ifdef MADV_COLD
+      advice = MADV_COLD;
+      break;
+#else
+      // MADV_DONTNEED would drop the written pages of a private mapping
+      return;
+#endif
+    default: advice = MADV_NORMAL; break;
+  }
+  // Advice is a hint, so a kernel refusing it is not an error
+  madvise(const_cast<char*>(this->data) + begin, end - begin, advice);
+}
+
+} // namespace konex
@@ -0,0 +1,93 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+namespace konex {
+
+/**
+ *  @brief how the pages of a mapping are about to be read, see madvise
+ */
+enum access_pattern_t
+{
+  // the kernel reads a few pages ahead of each fault
+  ACCESS_NORMAL,
+  // read from start to end, so pages are read well ahead and dropped behind
+  ACCESS_SEQUENTIAL,
+  // read in no particular order, so only the touched pages are read
+  ACCESS_RANDOM,
+  // read soon, so the pages are read in the background now
+  ACCESS_WILLNEED,
+  // not read again for a while, so the pages are the first to be reclaimed
+  ACCESS_COLD
+};
+
+/**
+ *  @brief a file mapped into memory
+ *
+ *  The pages are read by the kernel as they are touched, and stay in the page
+ *  cache shared with other processes reading the same file. The mapping is
+ *  released with the object.
+ *
+ *  The file is read-only, unless it is mapped copy-on-write, in which case
+ *  only the pages written to stop being shared.
+ *
+ *  Example:
+ *    MappedFile file("data.txt");
+ *    std::count(file.begin(), file.end(), '\n');
+ */
+class MappedFile
+{
+public:
+
+  /**
+   *  @param path path to the file
+   *  @param copyOnWrite if true, the mapping can be written to. Written pages
+   *         are copied, the file is never changed.
+   *
+   *  @throw KOnexException if the file cannot be opened or mapped
+   */
+  explicit MappedFile(const std::string& path, bool copyOnWrite = false);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* begin() const { return this->data; }
+  /**
+   *  @brief the start of a mapping made with copyOnWrite, which can be
+   *         written to
+   */
+  char* beginWritable() const { return const_cast<char*>(this->data); }
+  const char* end() const { return this->data + this->size; }
+  size_t getSize() const { return this->size; }
+
+  /**
+   *  @brief tells the kernel the file is read from start to end, so that it
+   *         reads ahead and drops the pages behind
+   */
+  void adviseSequential() const;
+
+  /**
+   *  @brief tells the kernel how a range of the file is about to be read
+   *
+   *  The range is widened to whole pages and clipped to the file. Advice is
+   *  only a hint: it never changes the content of the mapping, including
+   *  pages written to in a copy-on-write mapping.
+   *
+   *  @param pattern the expected access pattern
+   *  @param offset the start of the range, in bytes
+   *  @param length the size of the range, in bytes
+   */
+  void advise(access_pattern_t pattern, size_t offset, size_t length) const;
+
+private:
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+} // namespace konex
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,379 @@
+#include "MatrixProfile.hpp"
+#include "TimeSeriesSet.hpp"
+#include "Exception.hpp"
+#include "distance/Distance.hpp"
+#include "distance/DistanceProfile.hpp"
+
+#include "lib/ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <future>
+#include <memory>
+
+// Number of diagonals a thread takes at once
+#define MATRIX_PROFILE_CHUNK 16
+
+namespace konex {
+
+static long long _gcd(long long a, long long b)
+{
+  while (b != 0)
+  {
+    long long t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+MatrixProfile::MatrixProfile(const TimeSeriesSet& dataset, int length)
+  : dataset(dataset), length(length), join(WITHIN_SERIES)
+{
+  int n = dataset.getItemLength();
+  if (length < 2 || length > n) {
+    throw KOnexException("Length of sub-sequences must be between 2 and " + std::to_string(n));
+  }
+  this->profileLength = n - length + 1;
+  this->exclusionZone = (length + MATRIX_PROFILE_EXCLUSION_DIVISOR - 1) / MATRIX_PROFILE_EXCLUSION_DIVISOR;
+
+  int count = dataset.getItemCount();
+  this->rows.resize(count);
+  this->squareSums.resize(count * (n + 1));
+  for (int a = 0; a < count; a++)
+  {
+    TimeSeries ts = dataset.getTimeSeries(a);
+    this->rows[a] = ts.getData() + ts.getStart();
+    double* sums = this->squareSums.data() + a * (n + 1);
+    sums[0] = 0;
+    for (int i = 0; i < n; i++) {
+      sums[i + 1] = sums[i] + (double)this->rows[a][i] * this->rows[a][i];
+    }
+  }
+}
+
+MatrixProfile::join_t MatrixProfile::parseJoin(const std::string& name)
+{
+  if (name == "within") {
+    return WITHIN_SERIES;
+  }
+  if (name == "across") {
+    return ACROSS_SERIES;
+  }
+  throw KOnexException("Unknown join: " + name + ". Use 'within' or 'across'");
+}
+
+void MatrixProfile::compute(join_t join, double fraction, int numThreads)
+{
+  if (!(fraction > 0 && fraction <= 1)) {
+    throw KOnexException("Fraction of diagonals must be in (0, 1]");
+  }
+  if (numThreads <= 0) {
+    throw KOnexException("Number of threads must be positive");
+  }
+  this->join = join;
+  this->pairs.clear();
+  if (join == ACROSS_SERIES)
+  {
+    for (int a = 0; a < this->dataset.getItemCount(); a++)
+    {
+      for (int b = a + 1; b < this->dataset.getItemCount(); b++) {
+        this->pairs.push_back(std::make_pair(a, b));
+      }
+    }
+  }
+
+  // In the anytime mode the diagonals are visited in the order of a
+  // multiplicative permutation, which spreads them over the whole matrix
+  long long total = this->_getDiagonalCount();
+  long long visits = total;
+  long long stride = 1;
+  bool anytime = fraction < 1;
+  if (anytime && total > 0)
+  {
+    visits = std::max(1LL, (long long)std::ceil(fraction * total));
+    stride = std::max(1LL, (long long)(total * 0.6180339887));
+    while (_gcd(stride, total) != 1) {
+      stride++;
+    }
+  }
+
+  // PreSCRIMP samples one sub-sequence every exclusion zone
+  int samplesPerSeries = (this->profileLength - 1) / this->exclusionZone + 1;
+  long long sampleCount = anytime ? (long long)this->dataset.getItemCount() * samplesPerSeries : 0;
+  std::shared_ptr<const DistanceProfile> distanceProfile = anytime ? this->dataset.getDistanceProfile() : nullptr;
+
+  std::atomic<long long> nextSample(0), nextDiagonal(0);
+  int cells = this->dataset.getItemCount() * this->profileLength;
+  std::vector<worker_t> workers(numThreads);
+  auto run = [&](worker_t& worker) {
+    worker.profile.assign(cells, INF);
+    worker.neighbors.assign(cells, -1);
+    long long s;
+    while ((s = nextSample.fetch_add(1)) < sampleCount)
+    {
+      this->_preScrimp(worker, *distanceProfile, s / samplesPerSeries,
+                       (s % samplesPerSeries) * this->exclusionZone);
+    }
+    long long c;
+    while ((c = nextDiagonal.fetch_add(MATRIX_PROFILE_CHUNK)) < visits)
+    {
+      for (long long t = c; t < std::min(c + MATRIX_PROFILE_CHUNK, visits); t++) {
+        this->_diagonal(worker, anytime ? (t * stride) % total : t);
+      }
+    }
+  };
+
+  if (numThreads == 1) {
+    run(workers[0]);
+  }
+  else
+  {
+    ThreadPool pool(numThreads);
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < numThreads; i++)
+    {
+      worker_t* worker = &workers[i];
+      futures.push_back(pool.enqueue([&run, worker] { run(*worker); }));
+    }
+    for (auto& f : futures) {
+      f.get();
+    }
+  }
+  // Ties are broken by the position of the match, so the merged profile does
+  // not depend on the number of threads
+  this->profile.swap(workers[0].profile);
+  this->neighbors.swap(workers[0].neighbors);
+  for (int w = 1; w < numThreads; w++)
+  {
+    for (int u = 0; u < cells; u++)
+    {
+      double d = workers[w].profile[u];
+      int v = workers[w].neighbors[u];
+      if (d < this->profile[u] || (d == this->profile[u] && v >= 0 && v < this->neighbors[u]))
+      {
+        this->profile[u] = d;
+        this->neighbors[u] = v;
+      }
+    }
+  }
+}
+
+long long MatrixProfile::_getDiagonalCount() const
+{
+  if (this->join == WITHIN_SERIES) {
+    return (long long)this->dataset.getItemCount() * std::max(0, this->profileLength - this->exclusionZone);
+  }
+  return (long long)this->pairs.size() * (2 * this->profileLength - 1);
+}
+
+void MatrixProfile::_diagonal(worker_t& worker, long long diagonal) const
+{
+  int P = this->profileLength;
+  if (this->join == WITHIN_SERIES)
+  {
+    // only the upper half of the matrix of a series against itself, beyond
+    // the exclusion zone
+    int perSeries = P - this->exclusionZone;
+    int a = diagonal / perSeries;
+    int k = this->exclusionZone + diagonal % perSeries;
+    this->_walk(worker, a, a, 0, k, P - k);
+  }
+  else
+  {
+    const std::pair<int, int>& pair = this->pairs[diagonal / (2 * P - 1)];
+    int k = diagonal % (2 * P - 1) - (P - 1);
+    int i = std::max(0, -k);
+    this->_walk(worker, pair.first, pair.second, i, i + k, P - std::abs(k));
+  }
+}
+
+void MatrixProfile::_walk(worker_t& worker, int a, int b, int i, int j, int steps) const
+{
+  const data_t* x = this->rows[a];
+  const data_t* y = this->rows[b];
+  int m = this->length;
+  double dot = 0;
+  for (int q = 0; q < steps; q++, i++, j++)
+  {
+    if (q % MATRIX_PROFILE_REFRESH == 0) {
+      dot = this->_dot(a, i, b, j);
+    }
+    else {
+      dot += (double)x[i + m - 1] * y[j + m - 1] - (double)x[i - 1] * y[j - 1];
+    }
+    if (!this->_excluded(a, i, b, j))
+    {
+      double d = this->_energy(a, i) + this->_energy(b, j) - 2 * dot;
+      this->_update(worker, a, i, b, j, std::max(0.0, d));
+    }
+  }
+}
+
+void MatrixProfile::_preScrimp(worker_t& worker, const DistanceProfile& distanceProfile, int a, int i) const
+{
+  int P = this->profileLength;
+  TimeSeries query = this->dataset.getTimeSeries(a, i, i + this->length);
+  std::vector<double> distances;
+  if (this->join == WITHIN_SERIES)
+  {
+    distances.resize(P);
+    distanceProfile.compute(query, a, distances.data());
+    for (int j = 0; j < P; j++)
+    {
+      if (!this->_excluded(a, i, a, j)) {
+        this->_update(worker, a, i, a, j, distances[j]);
+      }
+    }
+  }
+  else
+  {
+    distances.resize((size_t)this->dataset.getItemCount() * P);
+    distanceProfile.compute(query, distances.data());
+    for (int b = 0; b < this->dataset.getItemCount(); b++)
+    {
+      for (int j = 0; b != a && j < P; j++) {
+        this->_update(worker, a, i, b, j, distances[b * P + j]);
+      }
+    }
+  }
+
+  // Neighbors of close matches tend to be close matches too, so the diagonal
+  // through the best match is refined around the sample
+  int v = worker.neighbors[a * P + i];
+  if (v < 0) {
+    return;
+  }
+  int b = v / P;
+  int j = v % P;
+  int back = std::min(this->exclusionZone, std::min(i, j));
+  int forward = std::min(this->exclusionZone, std::min(P - 1 - i, P - 1 - j));
+  this->_walk(worker, a, b, i - back, j - back, back);
+  this->_walk(worker, a, b, i + 1, j + 1, forward);
+}
+
+double MatrixProfile::_dot(int a, int i, int b, int j) const
+{
+  const data_t* x = this->rows[a] + i;
+  const data_t* y = this->rows[b] + j;
+  double dot = 0;
+  for (int q = 0; q < this->length; q++) {
+    dot += (double)x[q] * y[q];
+  }
+  return dot;
+}
+
+double MatrixProfile::_energy(int a, int i) const
+{
+  const double* sums = this->squareSums.data() + a * (this->dataset.getItemLength() + 1);
+  return sums[i + this->length] - sums[i];
+}
+
+bool MatrixProfile::_excluded(int a, int i, int b, int j) const
+{
+  return a == b && std::abs(i - j) < this->exclusionZone;
+}
+
+void MatrixProfile::_update(worker_t& worker, int a, int i, int b, int j, double d) const
+{
+  int u = a * this->profileLength + i;
+  int v = b * this->profileLength + j;
+  if (d < worker.profile[u] || (d == worker.profile[u] && v < worker.neighbors[u]))
+  {
+    worker.profile[u] = d;
+    worker.neighbors[u] = v;
+  }
+  if (d < worker.profile[v] || (d == worker.profile[v] && u < worker.neighbors[v]))
+  {
+    worker.profile[v] = d;
+    worker.neighbors[v] = u;
+  }
+}
+
+data_t MatrixProfile::getDistance(int index, int start) const
+{
+  if (this->profile.empty()) {
+    throw KOnexException("Matrix profile is not computed");
+  }
+  double d = this->profile[index * this->profileLength + start];
+  return d == INF ? INF : std::sqrt(d / this->length);
+}
+
+std::pair<int, int> MatrixProfile::getNeighbor(int index, int start) const
+{
+  if (this->neighbors.empty()) {
+    throw KOnexException("Matrix profile is not computed");
+  }
+  int v = this->neighbors[index * this->profileLength + start];
+  if (v < 0) {
+    return std::make_pair(-1, -1);
+  }
+  return std::make_pair(v / this->profileLength, v % this->profileLength);
+}
+
+matrix_profile_summary_t MatrixProfile::summarize(int k) const
+{
+  if (this->profile.empty()) {
+    throw KOnexException("Matrix profile is not computed");
+  }
+  if (k <= 0) {
+    throw KOnexException("K must be positive");
+  }
+
+  int P = this->profileLength;
+  int m = this->length;
+  std::vector<int> order;
+  for (int u = 0; u < this->profile.size(); u++)
+  {
+    if (this->neighbors[u] >= 0) {
+      order.push_back(u);
+    }
+  }
+  std::sort(order.begin(), order.end(), [this](int u, int v) {
+    return this->profile[u] < this->profile[v] || (this->profile[u] == this->profile[v] && u < v);
+  });
+
+  auto overlaps = [this, P](const std::vector<int>& chosen, int u) {
+    for (int c : chosen)
+    {
+      if (c / P == u / P && std::abs(c % P - u % P) < this->exclusionZone) {
+        return true;
+      }
+    }
+    return false;
+  };
+  auto exactDistance = [this, P, m](int u, int v) {
+    TimeSeries x = this->dataset.getTimeSeries(u / P, u % P, u % P + m);
+    TimeSeries y = this->dataset.getTimeSeries(v / P, v % P, v % P + m);
+    return pairwiseDistance(x, y, INF);
+  };
+
+  matrix_profile_summary_t summary;
+  std::vector<int> chosen;
+  for (int o = 0; o < order.size() && summary.motifs.size() < k; o++)
+  {
+    int u = order[o];
+    int v = this->neighbors[u];
+    if (overlaps(chosen, u) || overlaps(chosen, v)) {
+      continue;
+    }
+    summary.motifs.push_back(motif_t(u / P, u % P, v / P, v % P, m, exactDistance(u, v)));
+    chosen.push_back(u);
+    chosen.push_back(v);
+  }
+
+  chosen.clear();
+  for (int o = order.size() - 1; o >= 0 && summary.discords.size() < k; o--)
+  {
+    int u = order[o];
+    if (overlaps(chosen, u)) {
+      continue;
+    }
+    summary.discords.push_back(candidate_t(u / P, u % P, m, exactDistance(u, this->neighbors[u])));
+    chosen.push_back(u);
+  }
+  return summary;
+}
+
+} // namespace konex
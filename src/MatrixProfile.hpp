@@ -0,0 +1,185 @@
+#ifndef MATRIX_PROFILE_H
+#define MATRIX_PROFILE_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Sub-sequences of the same time series closer than length / divisor to each
+// other are trivial matches
+#define MATRIX_PROFILE_EXCLUSION_DIVISOR 4
+// Dot products slid along a diagonal are recomputed from scratch this often
+#define MATRIX_PROFILE_REFRESH 256
+
+namespace konex {
+
+class TimeSeriesSet;
+class DistanceProfile;
+
+/**
+ *  @brief a pair of sub-sequences that are each other's closest match
+ */
+struct motif_t
+{
+  int index;
+  int start;
+  int neighborIndex;
+  int neighborStart;
+  int length;
+  data_t dist;
+
+  motif_t(int index, int start, int neighborIndex, int neighborStart, int length, data_t dist)
+    : index(index), start(start), neighborIndex(neighborIndex), neighborStart(neighborStart),
+      length(length), dist(dist) {}
+};
+
+/**
+ *  @brief the top motifs and discords of a matrix profile
+ */
+struct matrix_profile_summary_t
+{
+  std::vector<motif_t> motifs;
+  // each discord holds the distance to its closest match
+  std::vector<candidate_t> discords;
+};
+
+/**
+ *  @brief the matrix profile of the sub-sequences of one length of a dataset
+ *
+ *  For every sub-sequence, the matrix profile holds the distance to its closest
+ *  non-trivial match and where that match is. Motifs are the sub-sequences with
+ *  the smallest values and discords those with the largest. Distances are the
+ *  Euclidean distances of the grouping, sqrt(sum of squares / length), on the
+ *  data as it is loaded.
+ *
+ *  The profile is computed diagonal by diagonal, as in STOMP/SCRIMP: along a
+ *  diagonal of the distance matrix of two time series, the dot product of the
+ *  next pair of sub-sequences is derived from the previous one in constant
+ *  time. Diagonals are spread across threads, each updating its own profile,
+ *  and the profiles are merged at the end.
+ *
+ *  The anytime mode (SCRIMP++) first seeds the profile with the full distance
+ *  profiles of a sample of the sub-sequences (PreSCRIMP), then visits only a
+ *  fraction of the diagonals in a pseudo-random order. The result is an upper
+ *  bound of the exact profile that converges to it as the fraction grows.
+ *
+ *  The sums of squares of the data are taken when the profile is constructed,
+ *  so a MatrixProfile must not outlive changes of the data.
+ *
+ *  Example:
+ *    MatrixProfile profile(dataset, 50);
+ *    profile.compute(MatrixProfile::WITHIN_SERIES, 0.1, 4);
+ *    matrix_profile_summary_t summary = profile.summarize(3);
+ */
+class MatrixProfile
+{
+public:
+
+  /**
+   *  @brief which sub-sequences a sub-sequence is matched with
+   */
+  enum join_t
+  {
+    // the other sub-sequences of its own time series (self-join)
+    WITHIN_SERIES,
+    // the sub-sequences of the other time series (AB-join of every pair)
+    ACROSS_SERIES
+  };
+
+  /**
+   *  @brief constructor for MatrixProfile
+   *
+   *  @param dataset the dataset
+   *  @param length length of the sub-sequences
+   *
+   *  @throw KOnexException if the length is not between 2 and the length of the
+   *         time series of the dataset
+   */
+  MatrixProfile(const TimeSeriesSet& dataset, int length);
+
+  /**
+   *  @brief computes the matrix profile
+   *
+   *  @param join which sub-sequences are matched
+   *  @param fraction fraction of the diagonals to visit, in (0, 1]. The profile
+   *         is exact if 1.
+   *  @param numThreads number of threads
+   *
+   *  @throw KOnexException if the fraction or the number of threads is out of
+   *         range
+   */
+  void compute(join_t join, double fraction = 1.0, int numThreads = 1);
+
+  int getLength() const { return this->length; }
+  int getExclusionZone() const { return this->exclusionZone; }
+
+  /**
+   *  @brief gets the distance of a sub-sequence to its closest match
+   *
+   *  @return the distance, or INF if it has no match
+   */
+  data_t getDistance(int index, int start) const;
+
+  /**
+   *  @brief gets the closest match of a sub-sequence
+   *
+   *  @return the (index, start) of the match, or (-1, -1) if it has no match
+   */
+  std::pair<int, int> getNeighbor(int index, int start) const;
+
+  /**
+   *  @brief gets the best motifs and discords
+   *
+   *  A sub-sequence that overlaps a previously selected one by more than the
+   *  exclusion zone is skipped. The distances reported are computed exactly
+   *  between the sub-sequences of the results.
+   *
+   *  @param k maximum number of motifs and of discords
+   */
+  matrix_profile_summary_t summarize(int k) const;
+
+  /**
+   *  @brief parses "within" or "across"
+   */
+  static join_t parseJoin(const std::string& name);
+
+private:
+
+  struct worker_t
+  {
+    // squared, unnormalized distances
+    std::vector<double> profile;
+    std::vector<int> neighbors;
+  };
+
+  const TimeSeriesSet& dataset;
+  int length;
+  int profileLength;
+  int exclusionZone;
+  join_t join;
+
+  std::vector<const data_t*> rows;
+  // sums of squares of the time series, itemLength + 1 values per series
+  std::vector<double> squareSums;
+  // pairs of time series joined across series
+  std::vector<std::pair<int, int>> pairs;
+
+  std::vector<double> profile;
+  std::vector<int> neighbors;
+
+  long long _getDiagonalCount() const;
+  void _diagonal(worker_t& worker, long long diagonal) const;
+  void _walk(worker_t& worker, int a, int b, int i, int j, int steps) const;
+  void _preScrimp(worker_t& worker, const DistanceProfile& distanceProfile, int a, int i) const;
+  double _dot(int a, int i, int b, int j) const;
+  double _energy(int a, int i) const;
+  bool _excluded(int a, int i, int b, int j) const;
+  void _update(worker_t& worker, int a, int i, int b, int j, double d) const;
+};
+
+} // namespace konex
+
+#endif // MATRIX_PROFILE_H
@@ -0,0 +1,186 @@
+#include "PAACache.hpp"
+#include "TimeSeriesSet.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace konex {
+
+/**
+ *  @brief computes the block means of a sub-sequence from its prefix sums
+ *
+ *  The PAA of whole series and of unaligned sub-sequences both go through it,
+ *  so that a block has the same mean whichever way it is read.
+ *
+ *  @param sums the prefix sums of the sub-sequence, or null if the dataset
+ *         keeps none, in which case the values are summed
+ *  @param values the values of the sub-sequence
+ */
+static void _blockMeans(const double* sums, const data_t* values, int length, int blockSize, data_t* dest)
+{
+  for (int block = 0; block < PAACache::getPAALength(length, blockSize); block++)
+  {
+    int begin = block * blockSize;
+    int end = std::min(length, begin + blockSize);
+    double sum = 0;
+    if (sums != nullptr) {
+      sum = sums[end] - sums[begin];
+    }
+    else
+    {
+      for (int i = begin; i < end; i++) {
+        sum += values[i];
+      }
+    }
+    dest[block] = sum / (end - begin);
+  }
+}
+
+PAACache::~PAACache()
+{
+  this->clear();
+}
+
+void PAACache::clear()
+{
+  blocks_t* b = this->blocks.exchange(nullptr);
+  while (b)
+  {
+    blocks_t* next = b->next;
+    delete[] b->values;
+    delete b;
+    b = next;
+  }
+}
+
+int PAACache::_getItemLength() const
+{
+  return this->dataset.getItemLength();
+}
+
+void PAACache::computePAA(const TimeSeries& source, int blockSize, data_t* dest)
+{
+  if (blockSize <= 0) {
+    throw KOnexException("Block size must be positive");
+  }
+  const data_t* t = source.getData() + source.getStart();
+  int length = source.getLength();
+  for (int block = 0; block < getPAALength(length, blockSize); block++)
+  {
+    int end = std::min(length, (block + 1) * blockSize);
+    acc_t sum = 0;
+    for (int i = block * blockSize; i < end; i++) {
+      sum += t[i];
+    }
+    dest[block] = sum / (end - block * blockSize);
+  }
+}
+
+const double* PAACache::getPrefixSums() const
+{
+  if (this->dataset.getItemCount() == 0) {
+    return nullptr;
+  }
+  return this->dataset.getPrefixSums(0);
+}
+
+const double* PAACache::getPrefixSums(int index) const
+{
+  return this->dataset.getPrefixSums(index);
+}
+
+void PAACache::extend(int firstRow)
+{
+  for (blocks_t* b = this->blocks.load(); b; b = b->next)
+  {
+    size_t paaLength = getPAALength(this->dataset.getItemLength(), b->blockSize);
+    data_t* values = new data_t[(size_t)this->dataset.getItemCount() * paaLength];
+    std::copy(b->values, b->values + firstRow * paaLength, values);
+    this->_computeBlocks(values, b->blockSize, firstRow);
+    delete[] b->values;
+    b->values = values;
+  }
+}
+
+void PAACache::_computeBlocks(data_t* values, int blockSize, int firstRow) const
+{
+  int n = this->dataset.getItemLength();
+  int paaLength = getPAALength(n, blockSize);
+  for (int idx = firstRow; idx < this->dataset.getItemCount(); idx++)
+  {
+    _blockMeans(this->getPrefixSums(idx), this->dataset.getTimeSeries(idx).getData(), n, blockSize,
+                values + (size_t)idx * paaLength);
+  }
+}
+
+const PAACache::blocks_t* PAACache::_getBlocks(int blockSize) const
+{
+  blocks_t* first = this->blocks.load(std::memory_order_acquire);
+  for (blocks_t* b = first; b; b = b->next)
+  {
+    if (b->blockSize == blockSize) {
+      return b;
+    }
+  }
+
+  int n = this->dataset.getItemLength();
+  int paaLength = getPAALength(n, blockSize);
+  blocks_t* b = new blocks_t;
+  b->blockSize = blockSize;
+  b->values = new data_t[(size_t)this->dataset.getItemCount() * paaLength];
+  this->_computeBlocks(b->values, blockSize, 0);
+
+  // Publish at the head of the list. If another thread published meanwhile,
+  // check that it is not for the same block size before retrying.
+  b->next = first;
+  while (!this->blocks.compare_exchange_weak(b->next, b,
+                                             std::memory_order_release,
+                                             std::memory_order_acquire))
+  {
+    for (blocks_t* other = b->next; other != first; other = other->next)
+    {
+      if (other->blockSize == blockSize)
+      {
+        delete[] b->values;
+        delete b;
+        return other;
+      }
+    }
+    first = b->next;
+  }
+  return b;
+}
+
+const data_t* PAACache::getPAA(int blockSize) const
+{
+  if (blockSize <= 0) {
+    throw KOnexException("Block size must be positive");
+  }
+  return this->_getBlocks(blockSize)->values;
+}
+
+void PAACache::getPAA(int index, int start, int length, int blockSize, data_t* dest) const
+{
+  if (blockSize <= 0) {
+    throw KOnexException("Block size must be positive");
+  }
+  int n = this->dataset.getItemLength();
+  int paaLength = getPAALength(length, blockSize);
+
+  // Without prefix sums, the sub-sequence is summed on its own rather than
+  // through the PAA of every series, which would take memory in proportion
+  // to the dataset
+  const double* sums = this->getPrefixSums(index);
+  if (sums != nullptr && start % blockSize == 0 && (length % blockSize == 0 || start + length == n))
+  {
+    const data_t* series = this->_getBlocks(blockSize)->values + (size_t)index * getPAALength(n, blockSize);
+    memcpy(dest, series + start / blockSize, paaLength * sizeof(data_t));
+    return;
+  }
+
+  _blockMeans(sums ? sums + start : nullptr, this->dataset.getTimeSeries(index).getData() + start,
+              length, blockSize, dest);
+}
+
+} // namespace konex
@@ -0,0 +1,146 @@
+#ifndef PAA_CACHE_H
+#define PAA_CACHE_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+
+#include <atomic>
+
+namespace konex {
+
+class TimeSeriesSet;
+
+/**
+ *  @brief piecewise aggregate approximations of the sub-sequences of a dataset
+ *
+ *  The mean of any block of any sub-sequence is derived in constant time from
+ *  the prefix sums kept by the dataset. A mapped or compressed dataset keeps
+ *  none, and its blocks are summed from the values instead. The cache keeps
+ *  the PAA of every whole time series for each block size that was asked
+ *  for. The raw
+ *  data of the dataset is left untouched, so results found on the PAA can be
+ *  refined on the raw values.
+ *
+ *  Everything is built lazily on first use. Like the EnvelopeCache, reads
+ *  never take a lock: arrays are published once with a compare-and-swap and
+ *  never change until the cache is cleared.
+ */
+class PAACache
+{
+public:
+
+  /**
+   *  @brief constructor for PAACache
+   *
+   *  @param dataset the dataset whose sub-sequences are approximated
+   */
+  PAACache(const TimeSeriesSet& dataset) : dataset(dataset) {}
+
+  /**
+   *  @brief destructor
+   */
+  ~PAACache();
+
+  PAACache(const PAACache&) = delete;
+  PAACache& operator=(const PAACache&) = delete;
+
+  /**
+   *  @brief gets the number of blocks of the PAA of a time series
+   *
+   *  The last block is shorter than the others if the length is not a multiple
+   *  of the block size.
+   */
+  static int getPAALength(int length, int blockSize) { return (length - 1) / blockSize + 1; }
+
+  /**
+   *  @brief computes the PAA of a time series that is not in the dataset
+   *
+   *  @param dest array of at least getPAALength(source.getLength(), blockSize) values
+   */
+  static void computePAA(const TimeSeries& source, int blockSize, data_t* dest);
+
+  /**
+   *  @brief gets the dataset whose sub-sequences are approximated
+   */
+  const TimeSeriesSet& getDataset() const { return this->dataset; }
+
+  /**
+   *  @brief gets the prefix sums of all time series, see
+   *         TimeSeriesSet::getPrefixSums
+   *
+   *  @return an array of getItemCount() rows of getItemLength() + 1 values. The
+   *          value j of row i is the sum of the first j values of series i.
+   *          nullptr if the dataset keeps no prefix sums.
+   */
+  const double* getPrefixSums() const;
+
+  /**
+   *  @brief gets the prefix sums of one time series
+   *
+   *  @return the row of getPrefixSums() for the time series, or nullptr
+   */
+  const double* getPrefixSums(int index) const;
+
+  /**
+   *  @brief gets the PAA of all time series for a block size
+   *
+   *  @return an array of getItemCount() rows of getPAALength(getItemLength(),
+   *          blockSize) values
+   *
+   *  @throw KOnexException if the block size is not positive
+   */
+  const data_t* getPAA(int blockSize) const;
+
+  /**
+   *  @brief computes the PAA of a sub-sequence without allocating
+   *
+   *  Blocks start at the beginning of the sub-sequence. Sub-sequences aligned
+   *  with the blocks of their series are copied from the PAA of the series.
+   *
+   *  @param dest array of at least getPAALength(length, blockSize) values
+   */
+  void getPAA(int index, int start, int length, int blockSize, data_t* dest) const;
+
+  /**
+   *  @brief frees everything held by the cache
+   *
+   *  This must be called whenever the data of the dataset changes. It must not
+   *  be called while other threads read from the cache.
+   */
+  void clear();
+
+  /**
+   *  @brief computes the PAA of the series appended to the dataset, for the
+   *         block sizes already cached
+   *
+   *  Like clear, it must not be called while other threads read from the
+   *  cache. TimeSeriesSet::appendData waits for the queries of the dataset
+   *  before calling it, see ScopedDatasetQuery.
+   *
+   *  @param firstRow the index of the first appended series
+   */
+  void extend(int firstRow);
+
+private:
+
+  /**
+   *  @brief the PAA of all time series for one block size
+   */
+  struct blocks_t
+  {
+    int blockSize;
+    data_t* values;
+    blocks_t* next;
+  };
+
+  const TimeSeriesSet& dataset;
+  mutable std::atomic<blocks_t*> blocks{nullptr};
+
+  const blocks_t* _getBlocks(int blockSize) const;
+  void _computeBlocks(data_t* values, int blockSize, int firstRow) const;
+  int _getItemLength() const;
+};
+
+} // namespace konex
+
+#endif // PAA_CACHE_H
@@ -0,0 +1,135 @@
+#include "QueryCache.hpp"
+#include "distance/QueryContext.hpp"
+
+#include <boost/functional/hash.hpp>
+
+namespace konex {
+
+query_key_t::query_key_t(query_kind_t kind, int dataset, const TimeSeries& query, int k, int h, int PAABlock,
+                         const QueryContext& ctx, unsigned long generation)
+  : kind(kind), dataset(dataset), query(&query[0], &query[0] + query.getLength()), k(k), h(h),
+    PAABlock(PAABlock), warpingBandRatio(ctx.getWarpingBandRatio()), distance(ctx.getDistance()),
+    dropout(ctx.getDropout()), generation(generation)
+{
+  this->hash = boost::hash_range(this->query.begin(), this->query.end());
+  boost::hash_combine(this->hash, (int)kind);
+  boost::hash_combine(this->hash, dataset);
+  boost::hash_combine(this->hash, k);
+  boost::hash_combine(this->hash, h);
+  boost::hash_combine(this->hash, PAABlock);
+  boost::hash_combine(this->hash, this->warpingBandRatio);
+  boost::hash_combine(this->hash, (const void*)this->distance);
+  boost::hash_combine(this->hash, dropout);
+  boost::hash_combine(this->hash, generation);
+}
+
+bool query_key_t::operator==(const query_key_t& rhs) const
+{
+  return this->hash == rhs.hash
+      && this->kind == rhs.kind
+      && this->dataset == rhs.dataset
+      && this->k == rhs.k
+      && this->h == rhs.h
+      && this->PAABlock == rhs.PAABlock
+      && this->warpingBandRatio == rhs.warpingBandRatio
+      && this->distance == rhs.distance
+      && this->dropout == rhs.dropout
+      && this->generation == rhs.generation
+      && this->query == rhs.query;
+}
+
+bool QueryCache::find(const query_key_t& key, std::vector<candidate_t>& results)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto found = this->index.find(&key);
+  if (found == this->index.end())
+  {
+    this->misses++;
+    return false;
+  }
+  this->hits++;
+  this->entries.splice(this->entries.begin(), this->entries, found->second);
+  results = found->second->results;
+  return true;
+}
+
+void QueryCache::insert(const query_key_t& key, const std::vector<candidate_t>& results)
+{
+  // The nodes of the list and of the map are counted along with the arrays
+  size_t bytes = sizeof(entry_t) + 4 * sizeof(void*)
+               + key.query.size() * sizeof(data_t)
+               + results.size() * sizeof(candidate_t);
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto found = this->index.find(&key);
+  if (found != this->index.end()) {
+    this->_erase(found->second);
+  }
+  if (bytes > this->capacity) {
+    return;
+  }
+
+  this->entries.push_front(entry_t{key, results, bytes});
+  this->index[&this->entries.front().key] = this->entries.begin();
+  this->bytes += bytes;
+  this->_evict();
+}
+
+void QueryCache::invalidate(int dataset)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (auto it = this->entries.begin(); it != this->entries.end(); )
+  {
+    auto next = std::next(it);
+    if (it->key.dataset == dataset) {
+      this->_erase(it);
+    }
+    it = next;
+  }
+}
+
+void QueryCache::clear()
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->index.clear();
+  this->entries.clear();
+  this->bytes = 0;
+}
+
+void QueryCache::setCapacity(size_t capacity)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->capacity = capacity;
+  this->_evict();
+}
+
+query_cache_stats_t QueryCache::getStats() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  query_cache_stats_t stats;
+  stats.hits = this->hits;
+  stats.misses = this->misses;
+  stats.evictions = this->evictions;
+  stats.entries = this->entries.size();
+  stats.bytes = this->bytes;
+  stats.capacity = this->capacity;
+  return stats;
+}
+
+void QueryCache::_erase(entry_list_t::iterator it)
+{
+  this->bytes -= it->bytes;
+  this->index.erase(&it->key);
+  this->entries.erase(it);
+}
+
+void QueryCache::_evict()
+{
+  while (this->bytes > this->capacity)
+  {
+    this->_erase(std::prev(this->entries.end()));
+    this->evictions++;
+  }
+}
+
+} // namespace konex
@@ -0,0 +1,165 @@
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+#include "distance/Distance.hpp"
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Memory the results of repeated queries may take by default
+#define QUERY_CACHE_DEFAULT_CAPACITY (64 << 20)
+
+namespace konex {
+
+class QueryContext;
+
+/**
+ *  @brief the searches whose results are cached
+ */
+enum query_kind_t { BEST_MATCH_QUERY, KSIM_QUERY, KSIM_RAW_QUERY, KSIM_PLANNED_QUERY, KSIM_EXACT_QUERY };
+
+/**
+ *  @brief everything the results of a search depend on
+ *
+ *  The values of the query are kept so that two queries are only the same if
+ *  their values are, whatever their hashes. The state of the searched dataset
+ *  is told by its generation, see TimeSeriesSet::getGeneration: results of a
+ *  query that overlapped a change are cached under the former generation,
+ *  which is never looked up again.
+ */
+struct query_key_t
+{
+  query_kind_t kind;
+  int dataset;
+  std::vector<data_t> query;
+  int k;
+  int h;
+  int PAABlock;
+  double warpingBandRatio;
+  query_dist_t distance;
+  data_t dropout;
+  unsigned long generation;
+  size_t hash;
+
+  query_key_t(query_kind_t kind, int dataset, const TimeSeries& query, int k, int h, int PAABlock,
+              const QueryContext& ctx, unsigned long generation = 0);
+
+  bool operator==(const query_key_t& rhs) const;
+};
+
+/**
+ *  @brief counters of a QueryCache
+ */
+struct query_cache_stats_t
+{
+  long long hits = 0;
+  long long misses = 0;
+  long long evictions = 0;
+  int entries = 0;
+  size_t bytes = 0;
+  size_t capacity = 0;
+
+  double getHitRate() const { return hits + misses == 0 ? 0 : (double)hits / (hits + misses); }
+};
+
+/**
+ *  @brief least-recently-used cache of the results of searches
+ *
+ *  Results are kept as candidates, which are cheap to store and to turn back
+ *  into time series. Entries are evicted from the least recently used one
+ *  whenever their total size exceeds the capacity. Entries of former
+ *  generations of a dataset are left to be evicted, unless whoever changes the
+ *  dataset invalidates them to free their memory sooner.
+ *
+ *  All methods lock the cache, so it can be shared by concurrent queries.
+ */
+class QueryCache
+{
+public:
+
+  /**
+   *  @param capacity the most bytes the entries may take. The cache is
+   *         disabled if 0.
+   */
+  explicit QueryCache(size_t capacity = QUERY_CACHE_DEFAULT_CAPACITY) : capacity(capacity) {}
+
+  QueryCache(const QueryCache&) = delete;
+  QueryCache& operator=(const QueryCache&) = delete;
+
+  /**
+   *  @brief looks up the results of a search
+   *
+   *  @param key the search
+   *  @param results receives the results if they are cached
+   *  @return true if the results are cached
+   */
+  bool find(const query_key_t& key, std::vector<candidate_t>& results);
+
+  /**
+   *  @brief caches the results of a search, replacing any previous ones
+   *
+   *  Results larger than the capacity are not cached.
+   */
+  void insert(const query_key_t& key, const std::vector<candidate_t>& results);
+
+  /**
+   *  @brief drops the results of the searches of a dataset
+   */
+  void invalidate(int dataset);
+
+  /**
+   *  @brief drops all results. The counters are kept.
+   */
+  void clear();
+
+  /**
+   *  @brief changes the capacity, evicting entries if needed
+   */
+  void setCapacity(size_t capacity);
+
+  query_cache_stats_t getStats() const;
+
+private:
+
+  struct entry_t
+  {
+    query_key_t key;
+    std::vector<candidate_t> results;
+    size_t bytes;
+  };
+
+  struct key_hash_t
+  {
+    size_t operator()(const query_key_t* key) const { return key->hash; }
+  };
+
+  struct key_equal_t
+  {
+    bool operator()(const query_key_t* a, const query_key_t* b) const { return *a == *b; }
+  };
+
+  typedef std::list<entry_t> entry_list_t;
+
+  mutable std::mutex mutex;
+  // from the most recently used
+  entry_list_t entries;
+  // keyed by the keys stored in the entries
+  std::unordered_map<const query_key_t*, entry_list_t::iterator, key_hash_t, key_equal_t> index;
+  size_t capacity;
+  size_t bytes = 0;
+  long long hits = 0;
+  long long misses = 0;
+  long long evictions = 0;
+
+  void _erase(entry_list_t::iterator it);
+  void _evict();
+};
+
+} // namespace konex
+
+#endif // QUERY_CACHE_H
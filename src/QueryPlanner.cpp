@@ -0,0 +1,282 @@
+#include "QueryPlanner.hpp"
+#include "GroupableTimeSeriesSet.hpp"
+#include "ExhaustiveSearch.hpp"
+#include "PAACache.hpp"
+#include "Exception.hpp"
+#include "distance/QueryContext.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace konex {
+
+/**
+ *  @brief cells of a distance between sub-sequences of two lengths
+ */
+static double _cells(int m, int n, bool euclidean, const QueryContext& ctx)
+{
+  if (euclidean) {
+    return m;
+  }
+  int longer = std::max(m, n);
+  return (double)longer * (2 * ctx.getWarpingBandSize(longer) + 1);
+}
+
+/**
+ *  @brief cost of comparing the query with a sub-sequence
+ *
+ *  @param abandoned whether the comparison can be abandoned at the k-th best
+ *         distance
+ */
+static double _comparison(int m, int n, bool euclidean, bool abandoned, const QueryContext& ctx)
+{
+  double cells = _cells(m, n, euclidean, ctx) * PLANNER_CELL_COST;
+  if (euclidean) {
+    return PLANNER_ABANDONED_COST + PLANNER_EUCLIDEAN_SURVIVAL * cells;
+  }
+  if (abandoned) {
+    return PLANNER_ABANDONED_COST + PLANNER_ABANDONED_SURVIVAL * cells;
+  }
+  return PLANNER_COMPARISON_COST + cells;
+}
+
+const plan_estimate_t& query_plan_t::getChosen() const
+{
+  for (const plan_estimate_t& estimate : this->estimates)
+  {
+    if (estimate.strategy == this->strategy) {
+      return estimate;
+    }
+  }
+  throw KOnexException("Plan has no estimate of its strategy");
+}
+
+std::string query_plan_t::explain() const
+{
+  std::ostringstream out;
+  out << "Plan for a query of length " << this->queryLength << ", k = " << this->k << ", h = " << this->h
+      << (this->exactRequired ? ", exact results" : ", approximate results allowed") << std::endl;
+  for (const plan_estimate_t& estimate : this->estimates)
+  {
+    out << (estimate.strategy == this->strategy ? "* " : "  ")
+        << std::left << std::setw(14) << QueryPlanner::getStrategyName(estimate.strategy)
+        << std::setw(12) << (estimate.exact ? "exact" : "approximate");
+    if (estimate.eligible) {
+      out << "cost " << std::setw(10) << std::setprecision(3) << estimate.cost;
+    }
+    else {
+      out << std::setw(15) << "not eligible";
+    }
+    out << estimate.note << std::endl;
+  }
+  return out.str();
+}
+
+std::string QueryPlanner::getStrategyName(plan_strategy_t strategy)
+{
+  switch (strategy)
+  {
+    case GROUPED_PLAN: return "grouped";
+    case GROUPED_EXACT_PLAN: return "grouped_exact";
+    case EXHAUSTIVE_PLAN: return "exhaustive";
+    case PAA_FILTER_PLAN: return "paa_filter";
+  }
+  return "unknown";
+}
+
+query_plan_t QueryPlanner::plan(const TimeSeries& query, int k, int h, bool exact, QueryContext& ctx) const
+{
+  if (k <= 0) {
+    throw KOnexException("Number of time series to look for must be positive");
+  }
+  if (h < k) {
+    throw KOnexException("Number of examined time series must be larger than "
+                         "or equal to the number of time series to look for");
+  }
+
+  int m = query.getLength();
+  int itemCount = this->dataset.getItemCount();
+  int itemLength = this->dataset.getItemLength();
+  bool euclidean = isLockstepDistance(ctx.getDistance());
+  std::vector<int> lengths = generateReachableLengths(m, itemLength, ctx);
+
+  query_plan_t plan;
+  plan.queryLength = m;
+  plan.k = k;
+  plan.h = h;
+  plan.exactRequired = exact;
+
+  // Search of the groups
+  const GlobalGroupSpace* groups = this->dataset.getGroupSpace();
+  std::string groupNote;
+  if (groups == nullptr) {
+    groupNote = "dataset is not grouped";
+  }
+  else if (this->dataset.getSearchBackend() != GROUP_BACKEND) {
+    groupNote = "search backend is not the groups";
+  }
+
+  // Comparisons with the centroids of the reachable lengths, and with all
+  // their members, when nothing bounds the distance and when the k-th best
+  // distance does
+  double centroids = 0, centroidCost = 0, abandonedCentroidCost = 0, abandonedMemberCost = 0;
+  double queryLengthMembers = 0;
+  if (groupNote.empty())
+  {
+    const std::vector<group_length_stats_t>& stats = groups->getLengthStats();
+    for (int length : lengths)
+    {
+      const group_length_stats_t& s = stats[length];
+      double abandoned = _comparison(m, length, euclidean, true, ctx);
+      centroids += s.groupCount;
+      centroidCost += s.groupCount * _comparison(m, length, euclidean, false, ctx);
+      abandonedCentroidCost += s.groupCount * abandoned;
+      abandonedMemberCost += s.memberCount * abandoned;
+    }
+    queryLengthMembers = m < stats.size() ? stats[m].getAverageMembers() : 0;
+  }
+  std::string centroidNote = std::to_string((long long)centroids) + " centroids";
+
+  plan_estimate_t grouped = { GROUPED_PLAN, false, groupNote.empty(), 0, groupNote };
+  if (grouped.eligible)
+  {
+    // Every centroid is compared, then the members of the best groups
+    grouped.cost = centroidCost + (h + queryLengthMembers) * _comparison(m, m, euclidean, false, ctx);
+    grouped.note = centroidNote;
+  }
+  plan.estimates.push_back(grouped);
+
+  plan_estimate_t groupedExact = { GROUPED_EXACT_PLAN, true, groupNote.empty(), 0, groupNote };
+  if (groupedExact.eligible)
+  {
+    QueryContext boundCtx(ctx);
+    if (groups->hasGroupBounds(boundCtx))
+    {
+      // Groups farther than the k-th best plus their radius are ruled out,
+      // which leaves about the best groups
+      groupedExact.cost = abandonedCentroidCost
+                        + (k + 2 * queryLengthMembers) * _comparison(m, m, euclidean, true, ctx);
+      groupedExact.note = centroidNote + ", groups bounded by their radius";
+    }
+    else
+    {
+      groupedExact.cost = abandonedCentroidCost + abandonedMemberCost;
+      groupedExact.note = centroidNote + ", every member";
+    }
+  }
+  plan.estimates.push_back(groupedExact);
+
+  plan_estimate_t exhaustive = { EXHAUSTIVE_PLAN, true, true, 0, "" };
+  if (ctx.getDistance() == static_cast<query_dist_t>(pairwiseDistance))
+  {
+    // Distance profiles of every time series, then the best candidates
+    double fftSize = 1;
+    while (fftSize < itemLength) {
+      fftSize *= 2;
+    }
+    exhaustive.cost = PLANNER_FFT_COST * itemCount * fftSize * std::log2(fftSize)
+                    + k * _comparison(m, m, true, false, ctx);
+    exhaustive.note = "distance profiles of " + std::to_string(itemCount) + " time series";
+  }
+  else if (ExhaustiveSearch::supports(ctx))
+  {
+    // Sub-sequences of the reachable lengths
+    double subsequences = 0;
+    for (int length : lengths)
+    {
+      double count = (double)itemCount * (itemLength - length + 1);
+      subsequences += count;
+      exhaustive.cost += count * (PLANNER_EXHAUSTIVE_COST
+                                  + PLANNER_EXHAUSTIVE_SURVIVAL * PLANNER_CELL_COST * _cells(m, length, euclidean, ctx));
+    }
+    exhaustive.note = std::to_string((long long)subsequences) + " sub-sequences";
+  }
+  else
+  {
+    // Plain scan of the sub-sequences of every length
+    for (int length = 2; length <= itemLength; length++)
+    {
+      exhaustive.cost += (double)itemCount * (itemLength - length + 1)
+                       * _comparison(m, length, false, true, ctx);
+    }
+    exhaustive.note = "scan of every length, the distance has no exhaustive engine";
+  }
+  plan.estimates.push_back(exhaustive);
+
+  // Scan of the PAA of the sub-sequences of every length, the best ones being
+  // compared on the raw data
+  plan_estimate_t PAAFilter = { PAA_FILTER_PLAN, false, true, 0, "" };
+  if (euclidean)
+  {
+    PAAFilter.eligible = false;
+    PAAFilter.note = "the scan compares every length";
+  }
+  else if (m < 2 * PLANNER_PAA_BLOCK)
+  {
+    PAAFilter.eligible = false;
+    PAAFilter.note = "query shorter than two blocks";
+  }
+  else
+  {
+    int PAAQueryLength = PAACache::getPAALength(m, PLANNER_PAA_BLOCK);
+    for (int length = 2; length <= itemLength; length++)
+    {
+      int PAALength = PAACache::getPAALength(length, PLANNER_PAA_BLOCK);
+      PAAFilter.cost += (double)itemCount * (itemLength - length + 1)
+                      * (PLANNER_PAA_COST + _comparison(PAAQueryLength, PAALength, false, true, ctx)
+                         - PLANNER_ABANDONED_COST);
+    }
+    PAAFilter.cost += k * _comparison(m, m, false, false, ctx);
+    PAAFilter.note = "block of " + std::to_string(PLANNER_PAA_BLOCK);
+  }
+  plan.estimates.push_back(PAAFilter);
+
+  const plan_estimate_t* best = nullptr;
+  for (const plan_estimate_t& estimate : plan.estimates)
+  {
+    if (!estimate.eligible || (exact && !estimate.exact)) {
+      continue;
+    }
+    if (best == nullptr || estimate.cost < best->cost) {
+      best = &estimate;
+    }
+  }
+  // The exhaustive search is always eligible and exact
+  plan.strategy = best->strategy;
+
+  for (plan_estimate_t& estimate : plan.estimates)
+  {
+    if (estimate.eligible && exact && !estimate.exact)
+    {
+      estimate.eligible = false;
+      estimate.note = "results would not be exact";
+    }
+  }
+  return plan;
+}
+
+std::vector<candidate_t> QueryPlanner::execute(const query_plan_t& plan, const TimeSeries& query, QueryContext& ctx)
+{
+  if (query.getLength() != plan.queryLength) {
+    throw KOnexException("Plan was made for a query of another length");
+  }
+
+  QueryContext planCtx(ctx);
+  planCtx.setPAABlock(0);
+  switch (plan.strategy)
+  {
+    case GROUPED_PLAN:
+      return this->dataset.kSim(query, plan.k, plan.h, planCtx);
+    case GROUPED_EXACT_PLAN:
+      return this->dataset.progressiveKSim(query, plan.k, query_budget_t(), progress_callback_t(), planCtx).results;
+    case EXHAUSTIVE_PLAN:
+      return this->dataset.kSimRaw(query, plan.k, planCtx);
+    case PAA_FILTER_PLAN:
+      return this->dataset.kSimRaw(query, plan.k, planCtx, PLANNER_PAA_BLOCK);
+  }
+  throw KOnexException("Unknown strategy");
+}
+
+} // namespace konex
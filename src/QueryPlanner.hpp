@@ -0,0 +1,141 @@
+#ifndef QUERY_PLANNER_H
+#define QUERY_PLANNER_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+
+#include <string>
+#include <vector>
+
+// Costs are in nanoseconds, measured on random walks. Only their ratios
+// matter.
+//
+// A cell of the warping matrix of a distance
+#define PLANNER_CELL_COST 3.5
+// A comparison of the query with a sub-sequence, besides its cells, when
+// nothing bounds the distance
+#define PLANNER_COMPARISON_COST 300
+// A comparison that can be abandoned once it exceeds the k-th best distance,
+// besides its cells
+#define PLANNER_ABANDONED_COST 60
+// A sub-sequence of the exhaustive search, which shares its lower bounds
+// across sub-sequences, besides its cells
+#define PLANNER_EXHAUSTIVE_COST 6
+// A sub-sequence of the PAA filter, whose PAA is computed, besides its cells
+#define PLANNER_PAA_COST 200
+// A multiply-add of the FFTs of the exhaustive Euclidean search
+#define PLANNER_FFT_COST 6
+// Shares of the cells that are computed, the rest being pruned by the lower
+// bounds or abandoned
+#define PLANNER_ABANDONED_SURVIVAL 0.03
+#define PLANNER_EXHAUSTIVE_SURVIVAL 0.002
+#define PLANNER_EUCLIDEAN_SURVIVAL 0.25
+// Block size of the PAA filter
+#define PLANNER_PAA_BLOCK 4
+
+namespace konex {
+
+class GroupableTimeSeriesSet;
+class QueryContext;
+
+/**
+ *  @brief the ways a kSim query can be answered
+ *
+ *  GROUPED_PLAN is the grouped search of kSim, examining h sub-sequences.
+ *  GROUPED_EXACT_PLAN examines the groups best first until no group can
+ *  improve the results (progressiveKSim without a budget). EXHAUSTIVE_PLAN
+ *  is kSimRaw. PAA_FILTER_PLAN is kSimRaw selecting its candidates on the PAA.
+ */
+enum plan_strategy_t { GROUPED_PLAN, GROUPED_EXACT_PLAN, EXHAUSTIVE_PLAN, PAA_FILTER_PLAN };
+
+/**
+ *  @brief the estimated cost of a strategy for a query
+ */
+struct plan_estimate_t
+{
+  plan_strategy_t strategy;
+  // whether the strategy gives the exact k nearest neighbors
+  bool exact;
+  // whether the strategy can answer the query
+  bool eligible;
+  double cost;
+  // why the strategy is not eligible, or how the cost was estimated
+  std::string note;
+};
+
+/**
+ *  @brief the strategy chosen for a query and the estimates it was chosen from
+ */
+struct query_plan_t
+{
+  plan_strategy_t strategy;
+  int queryLength;
+  int k;
+  int h;
+  bool exactRequired;
+  std::vector<plan_estimate_t> estimates;
+
+  const plan_estimate_t& getChosen() const;
+
+  /**
+   *  @brief describes the plan, one line per strategy
+   */
+  std::string explain() const;
+};
+
+/**
+ *  @brief chooses how to answer a kSim query from the statistics of the groups
+ *
+ *  Each strategy is estimated as the number of comparisons it makes times the
+ *  cost of a comparison. The number of comparisons comes from the number of
+ *  sub-sequences and the statistics of the groups of every length the query
+ *  reaches, collected when the groups are built or loaded. The cost of a
+ *  comparison comes from the length of the sub-sequences, the warping band and
+ *  how much of it lower bounds and early abandoning are expected to save.
+ *
+ *  Example:
+ *    QueryPlanner planner(dataset);
+ *    query_plan_t plan = planner.plan(query, 5, 5, true, ctx);
+ *    std::cout << plan.explain();
+ *    std::vector<candidate_t> results = planner.execute(plan, query, ctx);
+ */
+class QueryPlanner
+{
+public:
+
+  /**
+   *  @param dataset the searched dataset
+   */
+  explicit QueryPlanner(GroupableTimeSeriesSet& dataset) : dataset(dataset) {}
+
+  /**
+   *  @brief estimates every strategy and chooses the cheapest eligible one
+   *
+   *  @param query the query
+   *  @param k the number of time series to look for
+   *  @param h the number of time series the grouped search examines
+   *  @param exact if true, only strategies giving the exact k nearest
+   *         neighbors are eligible
+   *  @param ctx settings of the query. Its PAA block size is ignored, the
+   *         strategy deciding of it.
+   *
+   *  @throw KOnexException if k is not positive or h is smaller than k
+   */
+  query_plan_t plan(const TimeSeries& query, int k, int h, bool exact, QueryContext& ctx) const;
+
+  /**
+   *  @brief answers a query with the strategy of a plan
+   *
+   *  @return the results, sorted from the closest
+   */
+  std::vector<candidate_t> execute(const query_plan_t& plan, const TimeSeries& query, QueryContext& ctx);
+
+  static std::string getStrategyName(plan_strategy_t strategy);
+
+private:
+  GroupableTimeSeriesSet& dataset;
+};
+
+} // namespace konex
+
+#endif // QUERY_PLANNER_H
@@ -0,0 +1,526 @@
+#include "SAXIndex.hpp"
+#include "TimeSeriesSet.hpp"
+#include "PAACache.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+// Number of segment means sampled per length to place the breakpoints
+#define SAX_BREAKPOINT_SAMPLES 65536
+
+namespace konex {
+
+static const int SAX_SYMBOLS = 1 << SAX_MAX_BITS;
+
+/**
+ *  @brief computes the means of the first segments of a sub-sequence, from the
+ *         prefix sums of the dataset or, if it keeps none, from the values
+ */
+static void _segmentMeans(const TimeSeriesSet& dataset, int index, int start, int segments,
+                          int segmentSize, data_t* means)
+{
+  const double* sums = dataset.getPAACache().getPrefixSums(index);
+  if (sums != nullptr)
+  {
+    sums += start;
+    for (int j = 0; j < segments; j++) {
+      means[j] = (sums[(j + 1) * segmentSize] - sums[j * segmentSize]) / segmentSize;
+    }
+    return;
+  }
+  const data_t* values = dataset.getTimeSeries(index).getData() + start;
+  for (int j = 0; j < segments; j++)
+  {
+    double sum = 0;
+    for (int i = j * segmentSize; i < (j + 1) * segmentSize; i++) {
+      sum += values[i];
+    }
+    means[j] = sum / segmentSize;
+  }
+}
+
+SAXIndex::SAXIndex(const TimeSeriesSet& dataset, int wordLength, int leafCapacity)
+  : dataset(dataset), wordLength(wordLength), leafCapacity(leafCapacity)
+{
+  if (wordLength <= 0 || wordLength > SAX_MAX_WORD_LENGTH) {
+    throw KOnexException("Word length must be between 1 and " + std::to_string(SAX_MAX_WORD_LENGTH));
+  }
+  if (leafCapacity <= 0) {
+    throw KOnexException("Leaf capacity must be positive");
+  }
+}
+
+SAXIndex::~SAXIndex()
+{
+  this->clear();
+}
+
+void SAXIndex::clear()
+{
+  for (tree_t& tree : this->trees) {
+    this->_free(tree.root);
+  }
+  this->trees.clear();
+  this->lengths.clear();
+}
+
+void SAXIndex::_free(node_t* node)
+{
+  if (node == nullptr) {
+    return;
+  }
+  this->_free(node->children[0]);
+  this->_free(node->children[1]);
+  delete node;
+}
+
+bool SAXIndex::supports(const QueryContext& ctx)
+{
+  query_dist_t distance = ctx.getDistance();
+  return distance == static_cast<query_dist_t>(cascadeDistance)
+      || distance == static_cast<query_dist_t>(warpedDistance)
+      || distance == static_cast<query_dist_t>(pairwiseDistance);
+}
+
+void SAXIndex::build(const std::vector<int>& lengths)
+{
+  int itemLength = this->dataset.getItemLength();
+  for (int length : lengths)
+  {
+    if (length < 2 || length > itemLength) {
+      throw KOnexException("Indexed lengths must be between 2 and " + std::to_string(itemLength));
+    }
+  }
+
+  this->clear();
+  std::vector<int> sorted(lengths);
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+  std::vector<data_t> means(SAX_MAX_WORD_LENGTH);
+  for (int length : sorted)
+  {
+    tree_t tree;
+    tree.length = length;
+    this->_prepareTree(tree);
+
+    // Every sub-sequence goes in the root, which is then split top-down
+    int count = this->dataset.getItemCount() * (itemLength - length + 1);
+    tree.root->entries.reserve(count);
+    for (int index = 0; index < this->dataset.getItemCount(); index++)
+    {
+      for (int start = 0; start + length <= itemLength; start++)
+      {
+        entry_t entry;
+        this->_encode(tree, index, start, entry, means.data());
+        tree.root->entries.push_back(entry);
+      }
+    }
+    this->_split(tree, tree.root);
+
+    this->trees.push_back(tree);
+    this->lengths.push_back(length);
+  }
+}
+
+void SAXIndex::insert(int index, int start, int length)
+{
+  tree_t* tree = this->_getTree(length);
+  if (tree == nullptr) {
+    throw KOnexException("Length " + std::to_string(length) + " is not indexed");
+  }
+  if (index < 0 || index >= this->dataset.getItemCount()
+      || start < 0 || start + length > this->dataset.getItemLength()) {
+    throw KOnexException("Sub-sequence is out of the dataset");
+  }
+
+  std::vector<data_t> means(SAX_MAX_WORD_LENGTH);
+  entry_t entry;
+  this->_encode(*tree, index, start, entry, means.data());
+
+  node_t* node = tree->root;
+  while (!node->isLeaf())
+  {
+    int j = node->splitSegment;
+    int bit = (entry.word[j] >> (SAX_MAX_BITS - 1 - node->bits[j])) & 1;
+    node = node->children[bit];
+  }
+  node->entries.push_back(entry);
+  if (node->entries.size() > this->leafCapacity) {
+    this->_split(*tree, node);
+  }
+}
+
+SAXIndex::tree_t* SAXIndex::_getTree(int length)
+{
+  for (tree_t& tree : this->trees)
+  {
+    if (tree.length == length) {
+      return &tree;
+    }
+  }
+  return nullptr;
+}
+
+void SAXIndex::_prepareTree(tree_t& tree) const
+{
+  // The tail that does not fill a segment is left out of the word
+  tree.segmentSize = std::max(1, tree.length / this->wordLength);
+  tree.segments = std::min(this->wordLength, tree.length);
+
+  // The breakpoints are quantiles of the segment means of a sample of the
+  // sub-sequences, so the symbols are about equally frequent
+  int itemLength = this->dataset.getItemLength();
+  int perSeries = itemLength - tree.length + 1;
+  long long count = (long long)this->dataset.getItemCount() * perSeries;
+  long long stride = std::max(1LL, count * tree.segments / SAX_BREAKPOINT_SAMPLES);
+
+  std::vector<data_t> samples;
+  data_t means[SAX_MAX_WORD_LENGTH];
+  for (long long i = 0; i < count; i += stride)
+  {
+    _segmentMeans(this->dataset, i / perSeries, i % perSeries, tree.segments, tree.segmentSize, means);
+    samples.insert(samples.end(), means, means + tree.segments);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  tree.breakpoints.resize(SAX_SYMBOLS - 1);
+  for (int v = 0; v < SAX_SYMBOLS - 1; v++) {
+    tree.breakpoints[v] = samples[(v + 1) * samples.size() / SAX_SYMBOLS];
+  }
+
+  tree.root = new node_t();
+  std::fill(tree.root->symbols, tree.root->symbols + SAX_MAX_WORD_LENGTH, 0);
+  std::fill(tree.root->bits, tree.root->bits + SAX_MAX_WORD_LENGTH, 0);
+}
+
+void SAXIndex::_encode(const tree_t& tree, int index, int start, entry_t& entry, data_t* means) const
+{
+  _segmentMeans(this->dataset, index, start, tree.segments, tree.segmentSize, means);
+  entry.index = index;
+  entry.start = start;
+  std::fill(entry.word, entry.word + SAX_MAX_WORD_LENGTH, 0);
+  for (int j = 0; j < tree.segments; j++)
+  {
+    entry.word[j] = std::lower_bound(tree.breakpoints.begin(), tree.breakpoints.end(), means[j])
+                    - tree.breakpoints.begin();
+  }
+}
+
+void SAXIndex::_split(tree_t& tree, node_t* node)
+{
+  // Refine the segment whose next bit divides the entries most evenly
+  int n = node->entries.size();
+  int bestSegment = -1;
+  int bestBalance = -1;
+  for (int j = 0; j < tree.segments; j++)
+  {
+    if (node->bits[j] == SAX_MAX_BITS) {
+      continue;
+    }
+    int shift = SAX_MAX_BITS - 1 - node->bits[j];
+    int ones = 0;
+    for (const entry_t& entry : node->entries) {
+      ones += (entry.word[j] >> shift) & 1;
+    }
+    int balance = std::min(ones, n - ones);
+    if (balance > bestBalance) {
+      bestBalance = balance;
+      bestSegment = j;
+    }
+  }
+  if (bestSegment < 0) {
+    // every symbol is at full cardinality, the leaf stays over capacity
+    return;
+  }
+
+  int j = bestSegment;
+  int shift = SAX_MAX_BITS - 1 - node->bits[j];
+  for (int bit = 0; bit < 2; bit++)
+  {
+    node_t* child = new node_t();
+    std::copy(node->symbols, node->symbols + SAX_MAX_WORD_LENGTH, child->symbols);
+    std::copy(node->bits, node->bits + SAX_MAX_WORD_LENGTH, child->bits);
+    child->symbols[j] = (child->symbols[j] << 1) | bit;
+    child->bits[j]++;
+    node->children[bit] = child;
+  }
+  for (const entry_t& entry : node->entries) {
+    node->children[(entry.word[j] >> shift) & 1]->entries.push_back(entry);
+  }
+  node->splitSegment = j;
+  std::vector<entry_t>().swap(node->entries);
+
+  for (int bit = 0; bit < 2; bit++)
+  {
+    if (node->children[bit]->entries.size() > this->leafCapacity) {
+      this->_split(tree, node->children[bit]);
+    }
+  }
+}
+
+int SAXIndex::getEntryCount() const
+{
+  int count = 0;
+  std::function<void(const node_t*)> visit = [&](const node_t* node) {
+    if (node->isLeaf()) {
+      count += node->entries.size();
+    }
+    else {
+      visit(node->children[0]);
+      visit(node->children[1]);
+    }
+  };
+  for (const tree_t& tree : this->trees) {
+    visit(tree.root);
+  }
+  return count;
+}
+
+int SAXIndex::getLeafCount() const
+{
+  int count = 0;
+  std::function<void(const node_t*)> visit = [&](const node_t* node) {
+    if (node->isLeaf()) {
+      count++;
+    }
+    else {
+      visit(node->children[0]);
+      visit(node->children[1]);
+    }
+  };
+  for (const tree_t& tree : this->trees) {
+    visit(tree.root);
+  }
+  return count;
+}
+
+std::vector<candidate_t> SAXIndex::kSim(const TimeSeries& query, int k, QueryContext& ctx) const
+{
+  return this->_search(query, k, -1, ctx);
+}
+
+std::vector<candidate_t> SAXIndex::approximateKSim(const TimeSeries& query, int k, int h, QueryContext& ctx) const
+{
+  if (h < k) {
+    throw KOnexException("Number of examined time series must be larger than "
+                         "or equal to the number of time series to look for");
+  }
+  return this->_search(query, k, h, ctx);
+}
+
+/**
+ *  @brief the query as seen from the tree of one length
+ */
+struct sax_query_t
+{
+  int usableSegments;
+  data_t scale;
+  bool warped;
+  // range of the query over each segment
+  std::vector<data_t> lower;
+  std::vector<data_t> upper;
+  // mean of the query over each segment
+  std::vector<data_t> means;
+};
+
+/**
+ *  @brief squared distance between the range of the query and the range of
+ *         values of a symbol prefix
+ */
+static inline data_t _gap(const std::vector<data_t>& breakpoints, int symbol, int bits,
+                          data_t queryLower, data_t queryUpper)
+{
+  int first = symbol << (SAX_MAX_BITS - bits);
+  int last = first + (1 << (SAX_MAX_BITS - bits)) - 1;
+  if (first > 0 && queryUpper < breakpoints[first - 1]) {
+    return (breakpoints[first - 1] - queryUpper) * (breakpoints[first - 1] - queryUpper);
+  }
+  if (last < breakpoints.size() && queryLower > breakpoints[last]) {
+    return (queryLower - breakpoints[last]) * (queryLower - breakpoints[last]);
+  }
+  return 0;
+}
+
+std::vector<candidate_t> SAXIndex::_search(const TimeSeries& query, int k, int h, QueryContext& ctx) const
+{
+  if (k <= 0) {
+    throw KOnexException("K must be positive");
+  }
+  if (!SAXIndex::supports(ctx)) {
+    throw KOnexException("The distance of the query is not supported by the SAX index");
+  }
+  ScopedQuery scopedQuery(ctx, query);
+
+  int m = query.getLength();
+  bool warped = ctx.getDistance() != static_cast<query_dist_t>(pairwiseDistance);
+
+  // Only the lengths that the distance can reach from the query are searched
+  std::vector<sax_query_t> views(this->trees.size());
+  for (int t = 0; t < this->trees.size(); t++)
+  {
+    const tree_t& tree = this->trees[t];
+    int L = tree.length;
+    sax_query_t& view = views[t];
+    view.usableSegments = -1;
+    view.warped = warped;
+    int maxLength = std::max(m, L);
+    int band = ctx.getWarpingBandSize(maxLength);
+    if (warped ? std::abs(L - m) > band : L != m) {
+      continue;
+    }
+
+    // The segments of the candidate are bounded by the envelope of the query
+    // over the same points, as in LB_Keogh. Only segments inside both series
+    // are used.
+    int s = tree.segmentSize;
+    view.usableSegments = std::min(tree.segments, std::min(m, L) / s);
+    view.scale = warped ? 2.0 * maxLength : L;
+    std::vector<data_t> envLower(m), envUpper(m);
+    if (warped) {
+      query.computeKeoghEnvelope(band, envLower.data(), envUpper.data());
+    }
+    view.lower.resize(view.usableSegments);
+    view.upper.resize(view.usableSegments);
+    view.means.resize(view.usableSegments);
+    for (int j = 0; j < view.usableSegments; j++)
+    {
+      data_t sum = 0;
+      for (int i = j * s; i < (j + 1) * s; i++) {
+        sum += query[i];
+      }
+      view.means[j] = sum / s;
+      if (warped)
+      {
+        view.lower[j] = *std::min_element(envLower.begin() + j * s, envLower.begin() + (j + 1) * s);
+        view.upper[j] = *std::max_element(envUpper.begin() + j * s, envUpper.begin() + (j + 1) * s);
+      }
+      else
+      {
+        // the squared distance over a segment is at least s times the squared
+        // difference of the means
+        view.lower[j] = view.upper[j] = view.means[j];
+      }
+    }
+  }
+
+  auto normalize = [](const sax_query_t& view, data_t lb) {
+    lb *= 1 - 1e-9;
+    return view.warped ? std::sqrt(lb) / view.scale : std::sqrt(lb / view.scale);
+  };
+  // Nodes are ranked by their lower bound, then by how far they are from the
+  // word of the query itself. Many nodes share a lower bound of 0 under
+  // warping, and the second key sends the approximate search to the leaves
+  // most likely to hold close matches.
+  typedef std::pair<data_t, data_t> rank_t;
+  auto nodeRank = [&](int t, const node_t* node) {
+    const sax_query_t& view = views[t];
+    const tree_t& tree = this->trees[t];
+    data_t lb = 0, hint = 0;
+    for (int j = 0; j < view.usableSegments; j++)
+    {
+      lb += _gap(tree.breakpoints, node->symbols[j], node->bits[j], view.lower[j], view.upper[j]);
+      hint += _gap(tree.breakpoints, node->symbols[j], node->bits[j], view.means[j], view.means[j]);
+    }
+    return rank_t(normalize(view, lb * tree.segmentSize), hint);
+  };
+  // The entries of a leaf are ranked the same way, with the distance between
+  // the segment means of the query and of the entry as the second key
+  auto entryRank = [&](int t, const entry_t& entry) {
+    const sax_query_t& view = views[t];
+    const tree_t& tree = this->trees[t];
+    int s = tree.segmentSize;
+    data_t means[SAX_MAX_WORD_LENGTH];
+    _segmentMeans(this->dataset, entry.index, entry.start, view.usableSegments, s, means);
+    data_t lb = 0, hint = 0;
+    for (int j = 0; j < view.usableSegments; j++)
+    {
+      lb += _gap(tree.breakpoints, entry.word[j], SAX_MAX_BITS, view.lower[j], view.upper[j]);
+      hint += (means[j] - view.means[j]) * (means[j] - view.means[j]);
+    }
+    return rank_t(normalize(view, lb * s), hint);
+  };
+
+  typedef std::pair<rank_t, std::pair<int, const node_t*>> visit_t;
+  std::priority_queue<visit_t, std::vector<visit_t>, std::greater<visit_t>> frontier;
+  for (int t = 0; t < this->trees.size(); t++)
+  {
+    if (views[t].usableSegments >= 0) {
+      frontier.push(visit_t(nodeRank(t, this->trees[t].root), {t, this->trees[t].root}));
+    }
+  }
+
+  std::vector<candidate_t> best;
+  int examined = 0;
+  auto kth = [&]() {
+    return best.size() < k ? ctx.getDropout() : std::min(ctx.getDropout(), best.front().dist);
+  };
+
+  while (!frontier.empty() && (h < 0 || examined < h))
+  {
+    visit_t top = frontier.top();
+    frontier.pop();
+    if (top.first.first > kth()) {
+      break;
+    }
+    int t = top.second.first;
+    const node_t* node = top.second.second;
+    if (!node->isLeaf())
+    {
+      for (int bit = 0; bit < 2; bit++)
+      {
+        rank_t rank = nodeRank(t, node->children[bit]);
+        if (rank.first <= kth()) {
+          frontier.push(visit_t(rank, {t, node->children[bit]}));
+        }
+      }
+      continue;
+    }
+
+    int L = this->trees[t].length;
+    std::vector<std::pair<rank_t, int>> order;
+    order.reserve(node->entries.size());
+    for (int e = 0; e < node->entries.size(); e++) {
+      order.push_back(std::make_pair(entryRank(t, node->entries[e]), e));
+    }
+    std::sort(order.begin(), order.end());
+
+    for (const std::pair<rank_t, int>& ranked : order)
+    {
+      if (h >= 0 && examined >= h) {
+        break;
+      }
+      data_t bound = kth();
+      if (ranked.first.first > bound) {
+        continue;
+      }
+      const entry_t& entry = node->entries[ranked.second];
+      TimeSeries candidate = this->dataset.getTimeSeries(entry.index, entry.start, entry.start + L);
+      data_t dist = ctx.distanceBetween(query, candidate, bound);
+      examined++;
+      if (dist > bound || dist == INF) {
+        continue;
+      }
+      candidate_t c(entry.index, entry.start, L, dist);
+      if (best.size() < k)
+      {
+        best.push_back(c);
+        std::push_heap(best.begin(), best.end());
+      }
+      else if (c < best.front())
+      {
+        std::pop_heap(best.begin(), best.end());
+        best.back() = c;
+        std::push_heap(best.begin(), best.end());
+      }
+    }
+  }
+
+  std::sort(best.begin(), best.end());
+  return best;
+}
+
+} // namespace konex
@@ -0,0 +1,173 @@
+#ifndef SAX_INDEX_H
+#define SAX_INDEX_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+#include "distance/QueryContext.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#define SAX_MAX_WORD_LENGTH 16
+#define SAX_MAX_BITS 8
+#define SAX_DEFAULT_WORD_LENGTH 8
+#define SAX_DEFAULT_LEAF_CAPACITY 64
+
+namespace konex {
+
+class TimeSeriesSet;
+
+/**
+ *  @brief an iSAX-style index of the sub-sequences of a dataset
+ *
+ *  Each indexed length has its own binary tree. A sub-sequence is summarized
+ *  by the PAA of wordLength segments, and each segment mean is mapped to one of
+ *  2^SAX_MAX_BITS symbols. The breakpoints between symbols are quantiles of
+ *  the segment means of the dataset rather than of a normal distribution, as
+ *  sub-sequences are not z-normalized. A node covers the sub-sequences whose
+ *  symbols share a prefix of a given number of bits in every segment. When a
+ *  leaf overflows, it is split on the segment whose next bit divides its
+ *  entries most evenly.
+ *
+ *  Searches visit the nodes best-first by a lower bound of the distance
+ *  between the query and anything in the node: for each segment, the gap
+ *  between the range of symbols of the node and the range of the envelope of
+ *  the query over the segment. The exact search stops once no node can hold a
+ *  candidate closer than the k-th best; the approximate search also stops after
+ *  examining a given number of candidates.
+ *
+ *  Example:
+ *    SAXIndex index(dataset);
+ *    index.build({20, 21, 22});
+ *    std::vector<candidate_t> results = index.kSim(query, 5, ctx);
+ */
+class SAXIndex
+{
+public:
+
+  /**
+   *  @brief constructor for SAXIndex
+   *
+   *  @param dataset the dataset to be indexed
+   *  @param wordLength number of segments of a word
+   *  @param leafCapacity a leaf holding more entries than this is split
+   *
+   *  @throw KOnexException if the word length or the capacity is out of range
+   */
+  SAXIndex(const TimeSeriesSet& dataset,
+           int wordLength = SAX_DEFAULT_WORD_LENGTH,
+           int leafCapacity = SAX_DEFAULT_LEAF_CAPACITY);
+
+  /**
+   *  @brief destructor
+   */
+  ~SAXIndex();
+
+  SAXIndex(const SAXIndex&) = delete;
+  SAXIndex& operator=(const SAXIndex&) = delete;
+
+  /**
+   *  @brief bulk loads all sub-sequences of the given lengths
+   *
+   *  The index is cleared first.
+   *
+   *  @throw KOnexException if a length is not between 2 and the length of the
+   *         time series in the dataset
+   */
+  void build(const std::vector<int>& lengths);
+
+  /**
+   *  @brief adds a sub-sequence to the tree of its length, splitting the leaf
+   *         it lands in if needed
+   *
+   *  @throw KOnexException if its length is not indexed
+   */
+  void insert(int index, int start, int length);
+
+  /**
+   *  @brief deletes all trees
+   */
+  void clear();
+
+  const std::vector<int>& getLengths() const { return this->lengths; }
+  int getWordLength() const { return this->wordLength; }
+  int getLeafCapacity() const { return this->leafCapacity; }
+  int getEntryCount() const;
+  int getLeafCount() const;
+
+  /**
+   *  @brief finds the k sub-sequences closest to the query among the indexed
+   *         lengths reachable from the query
+   *
+   *  @return candidates sorted by increasing distance
+   *
+   *  @throw KOnexException if k is not positive or the distance of the context
+   *         is not supported
+   */
+  std::vector<candidate_t> kSim(const TimeSeries& query, int k, QueryContext& ctx) const;
+
+  /**
+   *  @brief same as kSim but examines at most h candidates
+   */
+  std::vector<candidate_t> approximateKSim(const TimeSeries& query, int k, int h, QueryContext& ctx) const;
+
+  /**
+   *  @return true if the distance of a context can be bounded by this index
+   */
+  static bool supports(const QueryContext& ctx);
+
+private:
+
+  struct entry_t
+  {
+    int index;
+    int start;
+    uint8_t word[SAX_MAX_WORD_LENGTH];
+  };
+
+  struct node_t
+  {
+    uint8_t symbols[SAX_MAX_WORD_LENGTH];
+    uint8_t bits[SAX_MAX_WORD_LENGTH];
+
+    // leaf
+    std::vector<entry_t> entries;
+
+    // internal node, split on the next bit of one segment
+    int splitSegment = -1;
+    node_t* children[2] = {nullptr, nullptr};
+
+    bool isLeaf() const { return this->children[0] == nullptr; }
+  };
+
+  /**
+   *  @brief the tree of one length
+   */
+  struct tree_t
+  {
+    int length;
+    int segmentSize;
+    int segments;
+    // breakpoints[v] is the upper bound of symbol v
+    std::vector<data_t> breakpoints;
+    node_t* root;
+  };
+
+  const TimeSeriesSet& dataset;
+  int wordLength;
+  int leafCapacity;
+  std::vector<int> lengths;
+  std::vector<tree_t> trees;
+
+  tree_t* _getTree(int length);
+  void _prepareTree(tree_t& tree) const;
+  void _encode(const tree_t& tree, int index, int start, entry_t& entry, data_t* means) const;
+  void _split(tree_t& tree, node_t* node);
+  void _free(node_t* node);
+
+  std::vector<candidate_t> _search(const TimeSeries& query, int k, int h, QueryContext& ctx) const;
+};
+
+} // namespace konex
+
+#endif // SAX_INDEX_H
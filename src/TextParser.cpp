@@ -0,0 +1,219 @@
+#include "TextParser.hpp"
+#include "Exception.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace konex {
+
+// Powers of ten that doubles hold exactly
+static const double EXACT_POWERS_OF_TEN[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+void ValueBuffer::reserve(size_t capacity)
+{
+  if (capacity <= this->capacity) {
+    return;
+  }
+  data_t* values = new data_t[capacity];
+  if (this->size > 0) {
+    memcpy(values, this->values, this->size * sizeof(data_t));
+  }
+  delete[] this->values;
+  this->values = values;
+  this->capacity = capacity;
+}
+
+data_t* ValueBuffer::release()
+{
+  data_t* values = this->values;
+  if (this->size == 0)
+  {
+    delete[] values;
+    values = nullptr;
+  }
+  else if (this->capacity - this->size > this->size / 8)
+  {
+    values = new data_t[this->size];
+    memcpy(values, this->values, this->size * sizeof(data_t));
+    delete[] this->values;
+  }
+  this->values = nullptr;
+  this->size = 0;
+  this->capacity = 0;
+  return values;
+}
+
+static inline bool _isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+/**
+ *  @brief parses a number with strtod, which needs a null-terminated copy
+ */
+static const char* _parseValueSlow(const char* begin, const char* end, double& value)
+{
+  const char* last = begin;
+  while (last < end && (isalnum((unsigned char)*last) || *last == '.' || *last == '+' || *last == '-')) {
+    last++;
+  }
+  std::string text(begin, last);
+  char* stop;
+  errno = 0;
+  double parsed = strtod(text.c_str(), &stop);
+  if (stop == text.c_str()) {
+    return begin;
+  }
+  if (errno == ERANGE && std::isinf(parsed)) {
+    throw KOnexException("Values are out of range");
+  }
+  value = parsed;
+  return begin + (stop - text.c_str());
+}
+
+const char* parseValue(const char* begin, const char* end, double& value)
+{
+  const char* p = begin;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    negative = *p == '-';
+    p++;
+  }
+
+  // Up to 19 digits fit in the mantissa, but only 15 are sure to round right
+  uint64_t mantissa = 0;
+  int significant = 0;
+  int exponent = 0;
+  bool hasDigits = false;
+  for (; p < end && _isDigit(*p); p++)
+  {
+    hasDigits = true;
+    if (mantissa != 0 || *p != '0') {
+      significant++;
+    }
+    if (significant <= 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+    }
+  }
+  if (p < end && *p == '.')
+  {
+    for (p++; p < end && _isDigit(*p); p++)
+    {
+      hasDigits = true;
+      if (mantissa != 0 || *p != '0') {
+        significant++;
+      }
+      if (significant <= 19)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (!hasDigits) {
+    // Infinities, NaNs or no number at all
+    return _parseValueSlow(begin, end, value);
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char* q = p + 1;
+    bool negativeExponent = false;
+    if (q < end && (*q == '-' || *q == '+'))
+    {
+      negativeExponent = *q == '-';
+      q++;
+    }
+    // Without digits, the 'e' is not part of the number
+    if (q < end && _isDigit(*q))
+    {
+      int e = 0;
+      for (; q < end && _isDigit(*q); q++) {
+        e = e < 10000 ? e * 10 + (*q - '0') : e;
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  if (significant > 15 || exponent < -22 || exponent > 22) {
+    return _parseValueSlow(begin, end, value);
+  }
+  // Both the mantissa and the power of ten are exact, so a single operation
+  // rounds correctly
+  double result = (double)mantissa;
+  result = exponent < 0 ? result / EXACT_POWERS_OF_TEN[-exponent] : result * EXACT_POWERS_OF_TEN[exponent];
+  value = negative ? -result : result;
+  return p;
+}
+
+TextParser::TextParser(const std::string& separators, int startCol)
+  : startCol(startCol)
+{
+  memset(this->separator, 0, sizeof(this->separator));
+  for (char c : separators) {
+    this->separator[(unsigned char)c] = true;
+  }
+}
+
+const char* TextParser::_endOfToken(const char* p, const char* end) const
+{
+  while (p < end && *p != '\n' && !this->_isSeparator(*p)) {
+    p++;
+  }
+  return p;
+}
+
+int TextParser::parseLine(const char*& p, const char* end, ValueBuffer& values) const
+{
+  int col = 0;
+  while (true)
+  {
+    while (p < end && (this->_isSeparator(*p) || *p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if (p == end) {
+      break;
+    }
+    if (*p == '\n')
+    {
+      p++;
+      break;
+    }
+    if (*p == '\r' && (p + 1 == end || p[1] == '\n'))
+    {
+      p += p + 1 == end ? 1 : 2;
+      break;
+    }
+
+    if (col < this->startCol) {
+      p = this->_endOfToken(p, end);
+    }
+    else
+    {
+      double value;
+      const char* last = parseValue(p, end, value);
+      const char* next = last;
+      while (next < end && !this->_isSeparator(*next) && (*next == ' ' || *next == '\t' || *next == '\r')) {
+        next++;
+      }
+      if (last == p || (next < end && *next != '\n' && !this->_isSeparator(*next))) {
+        throw KOnexException("Dataset file contains unparsable text");
+      }
+      values.push_back((data_t)value);
+      p = last;
+    }
+    col++;
+  }
+  return col;
+}
+
+} // namespace konex
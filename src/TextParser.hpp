@@ -0,0 +1,122 @@
+#ifndef TEXT_PARSER_H
+#define TEXT_PARSER_H
+
+#include "config.hpp"
+#include "TimeSeries.hpp"
+
+#include <cstddef>
+#include <string>
+
+namespace konex {
+
+/**
+ *  @brief a growable array of values, whose storage can be handed over
+ *
+ *  Unlike a std::vector, the array can be released to an owner that frees it
+ *  with delete[], like TimeSeriesSet does, without being copied.
+ */
+class ValueBuffer
+{
+public:
+  ValueBuffer() {}
+  ~ValueBuffer() { delete[] this->values; }
+
+  ValueBuffer(const ValueBuffer&) = delete;
+  ValueBuffer& operator=(const ValueBuffer&) = delete;
+
+  void push_back(data_t value)
+  {
+    if (this->size == this->capacity) {
+      this->reserve(this->capacity < 1024 ? 1024 : this->capacity * 2);
+    }
+    this->values[this->size++] = value;
+  }
+
+  /**
+   *  @brief makes room for at least capacity values
+   */
+  void reserve(size_t capacity);
+
+  /**
+   *  @brief drops the values beyond a size
+   */
+  void truncate(size_t size) { if (size < this->size) this->size = size; }
+
+  /**
+   *  @brief gives up the array, which the caller frees with delete[]
+   *
+   *  The array is shrunk first if much of it is unused.
+   */
+  data_t* release();
+
+  data_t* getValues() const { return this->values; }
+  size_t getSize() const { return this->size; }
+  size_t getCapacity() const { return this->capacity; }
+
+private:
+  data_t* values = nullptr;
+  size_t size = 0;
+  size_t capacity = 0;
+};
+
+/**
+ *  @brief parses a number at the start of a text
+ *
+ *  Decimal numbers of up to 15 significant digits and exponents up to 22 are
+ *  parsed without leaving the text, and rounded exactly like strtod does.
+ *  Anything else (longer numbers, hexadecimals, infinities) is handed to
+ *  strtod.
+ *
+ *  @param begin the start of the number
+ *  @param end the end of the text, which does not need to be null-terminated
+ *  @param value receives the number
+ *  @return the end of the number, or begin if there is no number
+ *
+ *  @throw KOnexException if the number is too large for a double
+ */
+const char* parseValue(const char* begin, const char* end, double& value);
+
+/**
+ *  @brief parses the lines of a table of numbers, in a single pass
+ *
+ *  Values are separated by any run of separator characters, and lines end with
+ *  '\n' or "\r\n". Spaces and tabs around a value are ignored.
+ *
+ *  Example:
+ *    TextParser parser(" ,", 1);
+ *    int columns = parser.parseLine(p, end, values);
+ */
+class TextParser
+{
+public:
+
+  /**
+   *  @param separators the characters separating values
+   *  @param startCol columns before startCol are skipped without being parsed
+   */
+  TextParser(const std::string& separators, int startCol);
+
+  /**
+   *  @brief parses a line and appends its values from startCol on
+   *
+   *  @param p the start of the line, moved past its end
+   *  @param end the end of the text
+   *  @param values receives the values
+   *  @return the number of columns of the line, including those before
+   *          startCol
+   *
+   *  @throw KOnexException if a value cannot be parsed or is out of range
+   */
+  int parseLine(const char*& p, const char* end, ValueBuffer& values) const;
+
+private:
+  bool separator[256];
+  int startCol;
+
+  bool _isSeparator(char c) const { return this->separator[(unsigned char)c]; }
+  const char* _endOfToken(const char* p, const char* end) const;
+};
+
+} // namespace konex
+
+#endif // TEXT_PARSER_H
@@ -1,4 +1,7 @@
 #include "TimeSeries.hpp"
+#include "EnvelopeCache.hpp"
+#include "PAACache.hpp"
+#include "TimeSeriesSet.hpp"
 #include "Exception.hpp"
 
 #include "lib/trillionDTW.h"
@@ -11,25 +14,28 @@
 #include <cstring>
 
 // EXPERIMENT
-int extraTimeSeries = 0;
+std::atomic<int> extraTimeSeries(0);
 
 namespace konex {
 
 
 TimeSeries& TimeSeries::operator=(const TimeSeries& other)
 {
-  if (isOwnerOfData) {
-    delete[] this->data;
+  if (this == &other) {
+    return *this;
   }
+  release();
   isOwnerOfData = other.isOwnerOfData;
   index = other.index;
   start = other.start;
   end = other.end;
   length = other.length;
+  envelopeCache = other.envelopeCache;
+  paaCache = other.paaCache;
   if (other.isOwnerOfData)
   {
-    this->data = new data_t[length];
-    memcpy(this->data, other.data, length * sizeof(data_t));
+    this->data = new data_t[end];
+    memcpy(this->data, other.data, end * sizeof(data_t));
   }
   else {
     this->data = other.data;
@@ -39,28 +45,59 @@ TimeSeries& TimeSeries::operator=(const TimeSeries& other)
 
 TimeSeries& TimeSeries::operator=(TimeSeries&& other)
 {
+  if (this == &other) {
+    return *this;
+  }
+  release();
   data = other.data;
   index = other.index;
   start = other.start;
   end = other.end;
   length = other.length;
   isOwnerOfData = other.isOwnerOfData;
+  keoghCacheValid = other.keoghCacheValid;
+  keoghLower = other.keoghLower;
+  keoghUpper = other.keoghUpper;
+  cachedWarpingBand = other.cachedWarpingBand;
+  envelopeCache = other.envelopeCache;
+  paaCache = other.paaCache;
   other.data = nullptr;
+  other.isOwnerOfData = false;
+  other.keoghCacheValid = false;
+  other.keoghLower = nullptr;
+  other.keoghUpper = nullptr;
   return *this;
 }
 
+TimeSeries TimeSeries::copy() const
+{
+  TimeSeries copy(this->end);
+  memcpy(copy.data, this->data, this->end * sizeof(data_t));
+  copy.index = this->index;
+  copy.start = this->start;
+  copy.length = this->length;
+  return copy;
+}
+
 TimeSeries::~TimeSeries()
+{
+  release();
+}
+
+void TimeSeries::release()
 {
   // if object allocated the data, delete it
   if (this->isOwnerOfData)
   {
-    delete this->data;
-    this->data = nullptr;
+    delete[] this->data;
   }
+  this->data = nullptr;
+  this->isOwnerOfData = false;
   delete[] keoghLower;
   keoghLower = nullptr;
   delete[] keoghUpper;
   keoghUpper = nullptr;
+  keoghCacheValid = false;
 }
 
 data_t& TimeSeries::operator[](int idx) const
@@ -85,8 +122,43 @@ TimeSeries& TimeSeries::operator+=(const TimeSeries& other)
   return *this;
 }
 
+const data_t* TimeSeries::getSharedKeoghEnvelope(int warpingBand) const
+{
+  if (envelopeCache && !isOwnerOfData) {
+    return envelopeCache->getEnvelope(index, start, length, warpingBand);
+  }
+  return nullptr;
+}
+
+const double* TimeSeries::getSharedPrefixSums() const
+{
+  const double* sums = paaCache && !isOwnerOfData ? paaCache->getPrefixSums(index) : nullptr;
+  return sums ? sums + start : nullptr;
+}
+
+znorm_t TimeSeries::getZNorm() const
+{
+  if (paaCache && !isOwnerOfData) {
+    return paaCache->getDataset().getZNorm(index, start, length);
+  }
+  double sum = 0, sumOfSquares = 0;
+  for (int i = 0; i < length; i++)
+  {
+    double x = data[start + i];
+    sum += x;
+    sumOfSquares += x * x;
+  }
+  double mean = length > 0 ? sum / length : 0;
+  double variance = length > 0 ? sumOfSquares / length - mean * mean : 0;
+  return znorm_t(mean, std::sqrt(std::max(variance, 0.0)));
+}
+
 const data_t* TimeSeries::getKeoghLower(int warpingBand) const
 {
+  const data_t* envelope = this->getSharedKeoghEnvelope(warpingBand);
+  if (envelope) {
+    return envelope;
+  }
   if (!keoghCacheValid || warpingBand != cachedWarpingBand) {
     this->generateKeoghLU(warpingBand);
     cachedWarpingBand = warpingBand;
@@ -96,6 +168,10 @@ const data_t* TimeSeries::getKeoghLower(int warpingBand) const
 
 const data_t* TimeSeries::getKeoghUpper(int warpingBand) const
 {
+  const data_t* envelope = this->getSharedKeoghEnvelope(warpingBand);
+  if (envelope) {
+    return envelope + length;
+  }
   if (!keoghCacheValid || warpingBand != cachedWarpingBand) {
     this->generateKeoghLU(warpingBand);
     cachedWarpingBand = warpingBand;
@@ -112,14 +188,17 @@ void TimeSeries::generateKeoghLU(int warpingBand) const
 
   keoghLower = new data_t[this->length];
   keoghUpper = new data_t[this->length];
+  this->computeKeoghEnvelope(warpingBand, this->keoghLower, this->keoghUpper);
+
+  keoghCacheValid = true;
+}
 
+void TimeSeries::computeKeoghEnvelope(int warpingBand, data_t* lower, data_t* upper) const
+{
   warpingBand = min(warpingBand, this->length - 1);
 
   // Function provided by trillionDTW codebase
-  lower_upper_lemire(this->data + this->start, this->length, warpingBand,
-                     this->keoghLower, this->keoghUpper);
-
-  keoghCacheValid = true;
+  lower_upper_lemire(this->data + this->start, this->length, warpingBand, lower, upper);
 }
 
 const data_t* TimeSeries::getData() const
@@ -2,6 +2,7 @@
 #define TIMESERIES_H
 
 #include "config.hpp"
+#include <atomic>
 #include <string>
 #include <limits>
 #include <cmath>
@@ -12,18 +13,42 @@
 #define EPS 1e-12
 
 // EXPERIMENT
-extern int extraTimeSeries;
+extern std::atomic<int> extraTimeSeries;
 
 namespace konex {
 
+class EnvelopeCache;
+class PAACache;
+
 #ifdef SINGLE_PRECISION
 typedef float data_t;
 #else
 typedef double data_t;
 #endif
 
+// Sums of squared differences are accumulated in double, whatever the
+// precision the values are stored in
+typedef double acc_t;
+
 int calculateWarpingBandSize(int length, double ratio);
 
+/**
+ *  @brief the transform z-normalizing a time series, x' = (x - mean) / std
+ *
+ *  A constant time series has a std of 0 and is normalized to zeros, so its
+ *  std is replaced by 1.
+ */
+struct znorm_t
+{
+  double mean;
+  double std;
+
+  znorm_t() : mean(0), std(1) {}
+  znorm_t(double mean, double std) : mean(mean), std(std > EPS ? std : 1) {}
+
+  data_t operator()(data_t x) const { return (x - this->mean) / this->std; }
+};
+
 /**
  *  @brief header of a time series
  *
@@ -47,9 +72,15 @@ public:
    *  @param index index of this time series in a TimeSeriesSet
    *  @param start starting position of this time series
    *  @param end ending position of this time series
+   *  @param envelopeCache the envelope cache of the TimeSeriesSet holding the data.
+   *         If given, Keogh envelopes are taken from this shared cache.
+   *  @param paaCache the PAA cache of the TimeSeriesSet holding the data. If
+   *         given, block means are derived from its prefix sums.
    */
-  TimeSeries(data_t *data, int index, int start, int end)
-    : data(data), index(index), start(start), end(end), keoghCacheValid(false), isOwnerOfData(false) {
+  TimeSeries(data_t *data, int index, int start, int end, const EnvelopeCache* envelopeCache = nullptr,
+             const PAACache* paaCache = nullptr)
+    : data(data), index(index), start(start), end(end), keoghCacheValid(false), isOwnerOfData(false),
+      envelopeCache(envelopeCache), paaCache(paaCache) {
       this->length = end - start;
     };
 
@@ -93,16 +124,48 @@ public:
     start = other.start;
     end = other.end;
     length = other.length;
+    envelopeCache = other.envelopeCache;
+    paaCache = other.paaCache;
+    // An owned series holds its values from position 0, see copy
     if (isOwnerOfData)
     {
-      this->data = new data_t[length];
-      memcpy(this->data, other.data, length * sizeof(data_t));
+      this->data = new data_t[end];
+      memcpy(this->data, other.data, end * sizeof(data_t));
     }
     else {
       this->data = other.data;
     }
   }
 
+  /**
+   * @brief Move constructor
+   *
+   * Takes over the data (if owned) and the cached Keogh envelopes of the other
+   * time series, leaving it as an empty non-owning series.
+   */
+  TimeSeries(TimeSeries&& other)
+    : data(other.data), isOwnerOfData(other.isOwnerOfData), index(other.index),
+      start(other.start), end(other.end), length(other.length),
+      keoghCacheValid(other.keoghCacheValid), keoghLower(other.keoghLower),
+      keoghUpper(other.keoghUpper), cachedWarpingBand(other.cachedWarpingBand),
+      envelopeCache(other.envelopeCache), paaCache(other.paaCache)
+  {
+    other.data = nullptr;
+    other.isOwnerOfData = false;
+    other.keoghCacheValid = false;
+    other.keoghLower = nullptr;
+    other.keoghUpper = nullptr;
+  }
+
+  /**
+   *  @brief copies the values of this series, keeping its index and its
+   *         positions, so that the copy outlives the data it was viewing
+   *
+   *  The values before the start of the series are copied too, as values are
+   *  read from data + start.
+   */
+  TimeSeries copy() const;
+
   /**
    *  @brief Copy assignment and move assignment
    */
@@ -166,9 +229,57 @@ public:
    */
   int getEnd() const { return this->end; }
 
+  /**
+   *  @brief gets the lower and upper envelopes used in Keogh lower bound calculation
+   *
+   *  Envelopes of a sub-sequence of a TimeSeriesSet come from the envelope cache of
+   *  the set and can be safely read from multiple threads. Otherwise, they are cached
+   *  in this object.
+   *
+   *  @param warpingBand size of the Sakoe-Chiba warping band
+   */
   const data_t* getKeoghLower(int warpingBand) const;
   const data_t* getKeoghUpper(int warpingBand) const;
 
+  /**
+   *  @brief gets the envelopes of this time series from the shared envelope cache
+   *
+   *  Unlike getKeoghLower and getKeoghUpper, this never touches the envelopes
+   *  cached in this object, so it is safe to call from concurrent queries.
+   *
+   *  @param warpingBand size of the Sakoe-Chiba warping band
+   *  @return the lower envelope followed by the upper envelope, or nullptr if
+   *          this series is not backed by an envelope cache or the cache is full
+   */
+  const data_t* getSharedKeoghEnvelope(int warpingBand) const;
+
+  /**
+   *  @brief computes the envelopes of this time series into the given arrays
+   *
+   *  @param warpingBand size of the Sakoe-Chiba warping band
+   *  @param lower array of at least getLength() values for the lower envelope
+   *  @param upper array of at least getLength() values for the upper envelope
+   */
+  void computeKeoghEnvelope(int warpingBand, data_t* lower, data_t* upper) const;
+
+  /**
+   *  @brief gets the prefix sums of this time series from the shared PAA cache
+   *
+   *  @return an array 'sums' of getLength() + 1 values such that the sum of the
+   *          values [i, j) of this time series is sums[j] - sums[i], or nullptr
+   *          if this series is not backed by a PAA cache or its dataset keeps
+   *          no prefix sums
+   */
+  const double* getSharedPrefixSums() const;
+
+  /**
+   *  @brief gets the mean and the standard deviation of this time series
+   *
+   *  They come in constant time from the prefix sums of the dataset holding
+   *  the series, if any, and are computed from the values otherwise.
+   */
+  znorm_t getZNorm() const;
+
   const data_t* getData() const;
   std::string getIdentifierString() const;
   void printData(std::ostream &out = std::cout) const;
@@ -185,7 +296,15 @@ private:
   mutable bool keoghCacheValid = false;
   mutable data_t* keoghLower = nullptr;
   mutable data_t* keoghUpper = nullptr;
-  mutable double cachedWarpingBand;
+  mutable int cachedWarpingBand = 0;
+
+  const EnvelopeCache* envelopeCache = nullptr;
+  const PAACache* paaCache = nullptr;
+
+  /**
+   * @brief frees the data if owned and the cached Keogh envelopes
+   */
+  void release();
 
   /**
    * @brief generates the upper and lower envelope used in Keogh lower bound calculation
@@ -195,6 +314,43 @@ private:
 
 };
 
+/**
+ *  @brief a compact search result
+ *
+ *  Identifies a sub-sequence of a dataset by its index, starting position and
+ *  length, and pairs it with its distance to a query. This is what search
+ *  routines keep in their heaps and return; a TimeSeries view is only created
+ *  from it when the results are handed out by the API
+ *  (see TimeSeriesSet::materialize).
+ */
+struct candidate_t
+{
+  int index;
+  int start;
+  int length;
+  data_t dist;
+
+  bool operator<(const candidate_t& rhs) const
+  {
+    if (dist == rhs.dist)
+    {
+      if (index == rhs.index)
+      {
+        if (start == rhs.start)
+        {
+          return length < rhs.length;
+        }
+        return start < rhs.start;
+      }
+      return index < rhs.index;
+    }
+    return dist < rhs.dist;
+  }
+  candidate_t(int index, int start, int length, data_t dist)
+    : index(index), start(start), length(length), dist(dist) {};
+  candidate_t() : index(0), start(0), length(0), dist(0) {}
+};
+
 /**
  *  @brief a struct pairing a dist with a time series
  *
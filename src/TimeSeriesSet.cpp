@@ -4,11 +4,19 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <cmath>
 #include <cstring>
-#include <boost/tokenizer.hpp>
+#include <iomanip>
+#include <limits>
+#include <memory>
 
 #include "distance/Distance.hpp"
+#include "ExhaustiveSearch.hpp"
 #include "Exception.hpp"
+#include "BinaryDataset.hpp"
+#include "MappedFile.hpp"
+#include "TextParser.hpp"
+#include "lib/ThreadPool.hpp"
 
 using std::string;
 using std::cout;
@@ -21,16 +29,6 @@ TimeSeriesSet::~TimeSeriesSet()
   this->clearData();
 }
 
-int countNumberOfLines(std::ifstream& f)
-{
-  int lineCount = 0;
-  string line;
-  for (lineCount = 0; std::getline(f, line); ++lineCount);
-  f.clear();
-  f.seekg(0);
-  return lineCount;
-}
-
 inline int calcPAALength(int srcLength, int n)
 {
   return (srcLength - 1) / n + 1;
@@ -73,125 +71,815 @@ TimeSeries tsPAA(const TimeSeries& source, int n)
   return dest;
 }
 
-void TimeSeriesSet::loadData(const string& filePath, int maxNumRow,
-                             int startCol, const string& separators)
+/**
+ *  @brief summarizes the Keogh envelope of a query by the range it spans over
+ *         each whole block
+ *
+ *  @param lower the lowest value of the lower envelope over each block
+ *  @param upper the highest value of the upper envelope over each block
+ */
+static void _blockEnvelope(const TimeSeries& query, int warpingBand, int blockSize,
+                           std::vector<data_t>& envelopeLower, std::vector<data_t>& envelopeUpper,
+                           data_t* lower, data_t* upper)
 {
-  this->clearData();
+  int length = query.getLength();
+  envelopeLower.resize(length);
+  envelopeUpper.resize(length);
+  query.computeKeoghEnvelope(warpingBand, envelopeLower.data(), envelopeUpper.data());
+  for (int block = 0; block < length / blockSize; block++)
+  {
+    int first = block * blockSize;
+    lower[block] = *std::min_element(&envelopeLower[first], &envelopeLower[first] + blockSize);
+    upper[block] = *std::max_element(&envelopeUpper[first], &envelopeUpper[first] + blockSize);
+  }
+}
 
-  std::ifstream f(filePath);
-  if (!f.is_open())
+/**
+ *  @brief computes LB_PAA from the block means of a candidate
+ *
+ *  Each block of blockSize points costs at least blockSize times the squared
+ *  distance from the mean of the candidate over the block to the interval of
+ *  the query over it, since the squared distance to an interval is convex.
+ *
+ *  @return the squared, unnormalized bound, abandoned once it exceeds bound
+ */
+static acc_t _paaBound(const data_t* paa, const data_t* lower, const data_t* upper,
+                       int blocks, int blockSize, acc_t bound)
+{
+  acc_t lb = 0;
+  for (int i = 0; i < blocks && lb <= bound; i++)
   {
-    f.close();
-    throw KOnexException(string("Cannot open ") + filePath);
+    acc_t d = paa[i] > upper[i] ? (acc_t)paa[i] - upper[i]
+            : paa[i] < lower[i] ? (acc_t)lower[i] - paa[i] : 0;
+    lb += blockSize * d * d;
   }
+  return lb;
+}
 
-  if (maxNumRow <= 0) {
-    maxNumRow = countNumberOfLines(f);
+/**
+ *  @brief computes the statistics and the cumulative sums of a series
+ *
+ *  @param sums receives n + 1 cumulative sums of the values, unless null
+ *  @param squares receives n + 1 cumulative sums of their squares, unless null
+ */
+static void _seriesStats(const data_t* values, int n, series_stats_t& stats, double* sums, double* squares)
+{
+  data_t min = n > 0 ? values[0] : 0;
+  data_t max = min;
+  double sum = 0, sumOfSquares = 0;
+  if (sums != nullptr)
+  {
+    sums[0] = 0;
+    squares[0] = 0;
   }
-  else {
-    maxNumRow = std::min(maxNumRow, countNumberOfLines(f));
+  for (int i = 0; i < n; i++)
+  {
+    data_t x = values[i];
+    min = std::min(min, x);
+    max = std::max(max, x);
+    sum += x;
+    sumOfSquares += (double)x * x;
+    if (sums != nullptr)
+    {
+      sums[i + 1] = sum;
+      squares[i + 1] = sumOfSquares;
+    }
   }
+  stats.min = min;
+  stats.max = max;
+  stats.mean = n > 0 ? sum / n : 0;
+  stats.std = n > 0 ? std::sqrt(std::max(sumOfSquares / n - stats.mean * stats.mean, 0.0)) : 0;
+}
 
-  int length = -1;
-  string line;
-  boost::char_separator<char> sep(separators.c_str());
-  typedef boost::tokenizer<boost::char_separator<char>> tokenizer;
+/**
+ *  @brief writes series scaled from [min, min + diff] to [0, 1], along with
+ *         their statistics. The source and the destination may be the same.
+ */
+static void _normalizeSeries(const data_t* source, data_t* dest, int count, int length,
+                             data_t min, data_t diff, series_stats_t* stats,
+                             double* sums, double* squares)
+{
+  for (int ts = 0; ts < count; ts++)
+  {
+    const data_t* s = source + (size_t)ts * length;
+    data_t* d = dest + (size_t)ts * length;
+    for (int i = 0; i < length; i++) {
+      d[i] = diff == 0 ? 0 : (s[i] - min) / diff;
+    }
+    // The series is still in cache for its statistics
+    _seriesStats(d, length, stats[ts], sums ? sums + (size_t)ts * (length + 1) : nullptr,
+                 squares ? squares + (size_t)ts * (length + 1) : nullptr);
+  }
+}
 
-  this->itemCount = 0;
-  for (int row = 0; row < maxNumRow; row++, this->itemCount++)
+/**
+ *  @brief a part of a text file made of whole lines, parsed on its own
+ */
+struct text_chunk_t
+{
+  const char* begin;
+  const char* end;
+  ValueBuffer values;
+  int rowCount = 0;
+  std::vector<series_stats_t> stats;
+  std::vector<double> sums;
+  std::vector<double> squares;
+
+  /**
+   *  @brief computes the statistics of the row ending the values, which
+   *         starts at rowStart
+   */
+  void addRowStats(size_t rowStart)
   {
-    // Read and process line by line
-    if (getline(f, line))
-    {
-      tokenizer tokens(line, sep);
+    int n = this->values.getSize() - rowStart;
+    this->stats.push_back(series_stats_t());
+    this->sums.resize(this->sums.size() + n + 1);
+    this->squares.resize(this->squares.size() + n + 1);
+    _seriesStats(this->values.getValues() + rowStart, n, this->stats.back(),
+                 &this->sums[this->sums.size() - n - 1], &this->squares[this->squares.size() - n - 1]);
+  }
+};
 
-      // Number of columns in the first line is assumed to be number of columns of
-      // the whole dataset
-      if (row == 0)
-      {
-        // If this is the first row, set length of each row to length of this row
-        length = std::distance(tokens.begin(), tokens.end());
-        this->data = new data_t[maxNumRow * length];
-        memset(this->data, 0, maxNumRow * length * sizeof(data_t*));
+/**
+ *  @brief parses the lines of a chunk, checking they all have length columns
+ *
+ *  @param maxRows the most rows the chunk may hold, or -1 for no limit
+ */
+static void _parseChunk(const TextParser& parser, int length, int maxRows, text_chunk_t& chunk)
+{
+  const char* p = chunk.begin;
+  while (p < chunk.end && (maxRows < 0 || chunk.rowCount < maxRows))
+  {
+    size_t rowStart = chunk.values.getSize();
+    if (parser.parseLine(p, chunk.end, chunk.values) != length) {
+      throw KOnexException("File contains time series with inconsistent lengths");
+    }
+    // The row is still in cache for its statistics
+    chunk.addRowStats(rowStart);
+    chunk.rowCount++;
+  }
+}
+
+void TimeSeriesSet::loadData(const string& filePath, int maxNumRow,
+                             int startCol, const string& separators, int numThreads, bool normalize)
+{
+  this->clearData();
+
+  MappedFile file(filePath);
+  file.adviseSequential();
+  TextParser parser(separators, startCol);
+  const char* begin = file.begin();
+  const char* end = file.end();
+  if (begin == end)
+  {
+    this->filePath = filePath;
+    return;
+  }
+
+  // Number of columns in the first line is assumed to be number of columns of
+  // the whole dataset. Its size gives an estimate of the number of lines.
+  const char* p = begin;
+  ValueBuffer firstLine;
+  int length = parser.parseLine(p, end, firstLine);
+  size_t lineBytes = std::max<ptrdiff_t>(p - begin, 1);
+  size_t lineValues = std::max<ptrdiff_t>(firstLine.getSize(), 1);
+  size_t estimatedLines = (end - begin) / lineBytes + 1;
+
+  // Lines are split in chunks ending at a line end. A single chunk is parsed
+  // when only the first rows of a large file are wanted.
+  int chunkCount = 1;
+  if (numThreads > 1 && (maxNumRow <= 0 || estimatedLines <= 2 * (size_t)maxNumRow))
+  {
+    chunkCount = std::min<size_t>(numThreads * LOAD_CHUNKS_PER_THREAD,
+                                  (end - p) / LOAD_MIN_CHUNK_SIZE + 1);
+  }
+  std::vector<text_chunk_t> chunks(chunkCount);
+  for (int i = 0; i < chunkCount; i++)
+  {
+    text_chunk_t& chunk = chunks[i];
+    chunk.begin = i == 0 ? p : chunks[i - 1].end;
+    chunk.end = i == chunkCount - 1 ? end : std::max(chunk.begin, p + (end - p) * (i + 1) / chunkCount);
+    chunk.end = std::find(chunk.end, end, '\n');
+    chunk.end = chunk.end == end ? end : chunk.end + 1;
+    size_t lines = (chunk.end - chunk.begin) / lineBytes + 2;
+    chunk.values.reserve(lines * lineValues);
+    chunk.stats.reserve(lines);
+    chunk.sums.reserve(lines * (lineValues + 1));
+    chunk.squares.reserve(lines * (lineValues + 1));
+  }
+  // The first chunk starts with the first line
+  text_chunk_t& first = chunks[0];
+  for (size_t i = 0; i < firstLine.getSize(); i++) {
+    first.values.push_back(firstLine.getValues()[i]);
+  }
+  first.addRowStats(0);
+  first.rowCount = 1;
 
+  int maxRows = maxNumRow > 0 ? maxNumRow : -1;
+  if (chunkCount == 1) {
+    _parseChunk(parser, length, maxRows, first);
+  }
+  else
+  {
+    ThreadPool pool(std::min(numThreads, chunkCount));
+    std::vector<std::future<void>> parsed;
+    for (text_chunk_t& chunk : chunks)
+    {
+      text_chunk_t* c = &chunk;
+      parsed.push_back(pool.enqueue([&parser, length, maxRows, c] { _parseChunk(parser, length, maxRows, *c); }));
+    }
+    // Errors are reported in the order of the lines, and only if they are in
+    // the rows that are kept
+    int rowsBefore = 0;
+    for (int i = 0; i < chunkCount; i++)
+    {
+      try {
+        parsed[i].get();
       }
-      else if (length != std::distance(tokens.begin(), tokens.end()))
+      catch (const KOnexException&)
       {
-        f.close();
-        this->clearData();
-        throw KOnexException("File contains time series with inconsistent lengths");
+        if (maxRows < 0 || rowsBefore + chunks[i].rowCount < maxRows) {
+          throw;
+        }
       }
+      rowsBefore += chunks[i].rowCount;
+    }
+  }
 
-      int col = 0;
-      for (tokenizer::iterator tok_iter = tokens.begin();
-           tok_iter != tokens.end(); tok_iter++, col++)
-      {
-        // Only read columns from startCol and after
-        if (col >= startCol)
+  int itemLength = length - startCol;
+  int itemCount = 0;
+  for (const text_chunk_t& chunk : chunks) {
+    itemCount += chunk.rowCount;
+  }
+  if (maxRows > 0) {
+    itemCount = std::min(itemCount, maxRows);
+  }
+
+  // The bounds of the dataset come from those of the series kept
+  data_t min = INF, max = -INF;
+  int rowsBefore = 0;
+  for (const text_chunk_t& chunk : chunks)
+  {
+    for (int i = 0; i < chunk.rowCount && rowsBefore + i < itemCount; i++)
+    {
+      min = std::min(min, chunk.stats[i].min);
+      max = std::max(max, chunk.stats[i].max);
+    }
+    rowsBefore += chunk.rowCount;
+  }
+
+  size_t seriesSize = (size_t)itemLength + 1;
+  if (chunkCount == 1)
+  {
+    first.values.truncate((size_t)itemCount * itemLength);
+    this->data = first.values.release();
+    first.stats.resize(itemCount);
+    first.sums.resize(itemCount * seriesSize);
+    first.squares.resize(itemCount * seriesSize);
+    this->seriesStats.swap(first.stats);
+    this->prefixSums.swap(first.sums);
+    this->prefixSquares.swap(first.squares);
+    if (normalize && this->data != nullptr) {
+      _normalizeSeries(this->data, this->data, itemCount, itemLength, min, max - min,
+                       this->seriesStats.data(), this->prefixSums.data(), this->prefixSquares.data());
+    }
+  }
+  else
+  {
+    // Chunks are stitched in their order, each by a thread, and normalized
+    // on the way if asked to
+    this->data = new data_t[(size_t)itemCount * itemLength];
+    this->seriesStats.resize(itemCount);
+    this->prefixSums.resize(itemCount * seriesSize);
+    this->prefixSquares.resize(itemCount * seriesSize);
+    ThreadPool pool(std::min(numThreads, chunkCount));
+    std::vector<std::future<void>> copied;
+    int row = 0;
+    for (text_chunk_t& chunk : chunks)
+    {
+      int count = std::min(chunk.rowCount, itemCount - row);
+      data_t* dest = this->data + (size_t)row * itemLength;
+      series_stats_t* stats = this->seriesStats.data() + row;
+      double* sums = this->prefixSums.data() + row * seriesSize;
+      double* squares = this->prefixSquares.data() + row * seriesSize;
+      text_chunk_t* c = &chunk;
+      copied.push_back(pool.enqueue([=] {
+        if (normalize)
         {
-          try
-          {
-            data[row * (length - startCol) + (col - startCol)] = (data_t)std::stod(*tok_iter);
-          }
-          catch (const std::invalid_argument& e)
-          {
-            f.close();
-            this->clearData();
-            throw KOnexException("Dataset file contains unparsable text");
-          }
-          catch (const std::out_of_range& e)
-          {
-            f.close();
-            this->clearData();
-            throw KOnexException("Values are out of range");
-          }
+          _normalizeSeries(c->values.getValues(), dest, count, itemLength, min, max - min,
+                           stats, sums, squares);
+          return;
         }
-      }
+        memcpy(dest, c->values.getValues(), (size_t)count * itemLength * sizeof(data_t));
+        std::copy(c->stats.begin(), c->stats.begin() + count, stats);
+        std::copy(c->sums.begin(), c->sums.begin() + count * seriesSize, sums);
+        std::copy(c->squares.begin(), c->squares.begin() + count * seriesSize, squares);
+      }));
+      row += count;
     }
-    else {
-      break;
+    for (auto& f : copied) {
+      f.get();
     }
   }
-
-  if (f.bad())
+  this->statsValid = true;
+  if (normalize && itemCount > 0)
   {
-    f.close();
-    this->clearData();
-    throw KOnexException("Error while reading file");
+    this->normalized = true;
+    this->normalization = std::make_pair(min, max);
   }
 
-  this->itemLength = length - startCol;
+  this->itemCount = itemCount;
+  this->itemLength = itemLength;
   this->filePath = filePath;
+  this->envelopeCache.clear();
+  this->paaCache.clear();
+  this->_invalidateDistanceProfile();
+  this->generation++;
+}
 
-  f.close();
+int TimeSeriesSet::appendData(const string& filePath, int startCol, const string& separator,
+                              int numThreads)
+{
+  if (!this->isLoaded()) {
+    throw KOnexException("No dataset to append to");
+  }
+
+  TimeSeriesSet appended;
+  if (isBinaryDataset(filePath))
+  {
+    if (startCol > 0) {
+      throw KOnexException("Columns of a binary dataset cannot be skipped");
+    }
+    appended.loadBinary(filePath);
+    appended.decompress();
+    if (appended.isNormalized()) {
+      throw KOnexException("Cannot append a normalized dataset");
+    }
+  }
+  else {
+    appended.loadData(filePath, 0, startCol, separator, numThreads);
+  }
+  int count = appended.getItemCount();
+  if (count == 0) {
+    return 0;
+  }
+  if (appended.getItemLength() != this->itemLength) {
+    throw KOnexException("Appended series must have the length of the series of the dataset");
+  }
+
+  // Holds back new queries while waiting for the ones in progress, so that a
+  // steady flow of queries cannot starve the append, and until the series
+  // are added
+  {
+    std::unique_lock<std::mutex> lock(this->appendMutex);
+    this->pendingAppends++;
+    this->appendDone.wait(lock, [this]() { return this->activeQueries == 0 && !this->appending; });
+    this->pendingAppends--;
+    this->appending = true;
+  }
+  struct append_guard_t
+  {
+    TimeSeriesSet& dataset;
+    ~append_guard_t()
+    {
+      std::lock_guard<std::mutex> lock(this->dataset.appendMutex);
+      this->dataset.appending = false;
+      this->dataset.appendDone.notify_all();
+    }
+  } guard{*this};
+  this->decompress();
+
+  // Values in memory are taken over, mapped ones are copied
+  data_t* values = appended.data;
+  if (appended.isMapped())
+  {
+    values = new data_t[(size_t)count * this->itemLength];
+    std::copy(appended.data, appended.data + (size_t)count * this->itemLength, values);
+  }
+  else {
+    appended.data = nullptr;
+  }
+
+  // The statistics of text files are computed while parsing, and follow the
+  // values when they are normalized
+  if (this->statsValid || this->normalized) {
+    appended._ensureStats();
+  }
+  if (this->normalized)
+  {
+    data_t min = this->normalization.first;
+    _normalizeSeries(values, values, count, this->itemLength, min, this->normalization.second - min,
+                     appended.seriesStats.data(), appended.prefixSums.data(),
+                     appended.prefixSquares.data());
+  }
+  if (this->statsValid)
+  {
+    this->seriesStats.insert(this->seriesStats.end(),
+                             appended.seriesStats.begin(), appended.seriesStats.end());
+    if (!this->prefixSums.empty())
+    {
+      this->prefixSums.insert(this->prefixSums.end(),
+                              appended.prefixSums.begin(), appended.prefixSums.end());
+      this->prefixSquares.insert(this->prefixSquares.end(),
+                                 appended.prefixSquares.begin(), appended.prefixSquares.end());
+    }
+  }
+
+  int firstRow = this->itemCount;
+  this->appendedChunks.push_back(values);
+  this->appendedFirstRows.push_back(firstRow);
+  this->itemCount += count;
+  this->envelopeCache.extend();
+  this->paaCache.extend(firstRow);
+  this->_invalidateDistanceProfile();
+  this->_dataAppended(firstRow, numThreads);
+  this->generation++;
+  return count;
 }
 
 void TimeSeriesSet::saveData(const string& filePath, char separator) const
 {
+  this->_checkUncompressed();
   std::ofstream f(filePath);
   if (!f.is_open())
   {
     f.close();
     throw KOnexException(string("Cannot open ") + filePath);
   }
+  f << std::setprecision(std::numeric_limits<data_t>::max_digits10);
   for (int i = 0; i < itemCount; i++) {
+    const data_t* row = this->_row(i);
     for (int j = 0; j < itemLength; j++) {
-      f << data[i * itemLength + j] << separator;
+      f << row[j] << separator;
     }
     f << endl;
   }
   f.close();
 }
 
-void TimeSeriesSet::clearData()
+/**
+ *  @brief a binary header for values of the given precision, without checksums
+ */
+static binary_dataset_header_t _makeBinaryHeader(int64_t itemCount, int64_t itemLength, int precision)
+{
+  if (precision != sizeof(float) && precision != sizeof(double)) {
+    throw KOnexException("Precision of a binary dataset must be 4 or 8 bytes");
+  }
+  binary_dataset_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BINARY_DATASET_MAGIC, sizeof(header.magic));
+  header.version = BINARY_DATASET_VERSION;
+  header.precision = precision;
+  header.itemCount = itemCount;
+  header.itemLength = itemLength;
+  header.dataOffset = (sizeof(header) + BINARY_DATASET_ALIGNMENT - 1) / BINARY_DATASET_ALIGNMENT
+                    * BINARY_DATASET_ALIGNMENT;
+  return header;
+}
+
+template <typename T>
+static void _writeConverted(std::ofstream& f, const data_t* values, size_t count)
+{
+  std::vector<T> buffer(std::min(count, (size_t)CONVERT_BUFFER_VALUES));
+  for (size_t i = 0; i < count; i += buffer.size())
+  {
+    size_t n = std::min(buffer.size(), count - i);
+    std::copy(values + i, values + i + n, buffer.begin());
+    f.write(reinterpret_cast<const char*>(buffer.data()), n * sizeof(T));
+  }
+}
+
+/**
+ *  @brief writes values of data_t with the precision of a binary dataset
+ */
+static void _writeValues(std::ofstream& f, const data_t* values, size_t count, int precision)
+{
+  if (precision == sizeof(data_t)) {
+    f.write(reinterpret_cast<const char*>(values), count * sizeof(data_t));
+  }
+  else if (precision == sizeof(float)) {
+    _writeConverted<float>(f, values, count);
+  }
+  else {
+    _writeConverted<double>(f, values, count);
+  }
+}
+
+/**
+ *  @brief fills in the checksums of a header and writes it at the start of a
+ *         binary dataset whose values are written
+ */
+static void _writeHeader(std::ofstream& f, const string& path, binary_dataset_header_t& header)
+{
+  f.flush();
+  if (!f) {
+    throw KOnexException(string("Error while writing ") + path);
+  }
+
+  // The values are read back through the page cache for their checksum
+  size_t valueBytes = (size_t)header.itemCount * header.itemLength * header.precision;
+  {
+    MappedFile written(path);
+    written.adviseSequential();
+    header.dataChecksum = computeChecksum(written.begin() + header.dataOffset, valueBytes);
+  }
+  header.headerChecksum = header.computeHeaderChecksum();
+  f.seekp(0);
+  f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!f) {
+    throw KOnexException(string("Error while writing ") + path);
+  }
+}
+
+void TimeSeriesSet::saveBinary(const string& filePath, int precision) const
+{
+  this->_checkUncompressed();
+  binary_dataset_header_t header = _makeBinaryHeader(this->itemCount, this->itemLength, precision);
+  header.normalized = this->normalized;
+  header.normalizationMin = this->normalization.first;
+  header.normalizationMax = this->normalization.second;
+
+  std::ofstream f(filePath, std::ios::binary);
+  if (!f.is_open()) {
+    throw KOnexException(string("Cannot open ") + filePath);
+  }
+  // The header is written once the values are
+  char padding[BINARY_DATASET_ALIGNMENT] = {};
+  f.write(padding, header.dataOffset);
+  _writeValues(f, this->data, (size_t)this->_dataItemCount() * this->itemLength, precision);
+  for (int c = 0; c < this->appendedChunks.size(); c++)
+  {
+    int last = c + 1 < this->appendedChunks.size() ? this->appendedFirstRows[c + 1] : this->itemCount;
+    _writeValues(f, this->appendedChunks[c],
+                 (size_t)(last - this->appendedFirstRows[c]) * this->itemLength, precision);
+  }
+  _writeHeader(f, filePath, header);
+}
+
+int TimeSeriesSet::convertToBinary(const string& textPath, const string& binaryPath,
+                                   int startCol, const string& separators, int precision)
 {
-  delete[] this->data;
+  MappedFile text(textPath);
+  text.adviseSequential();
+  TextParser parser(separators, startCol);
+
+  // The header is written once the values are known
+  binary_dataset_header_t header = _makeBinaryHeader(0, 0, precision);
+  std::ofstream f(binaryPath, std::ios::binary);
+  if (!f.is_open()) {
+    throw KOnexException(string("Cannot open ") + binaryPath);
+  }
+  char padding[BINARY_DATASET_ALIGNMENT] = {};
+  f.write(padding, header.dataOffset);
+
+  ValueBuffer values;
+  values.reserve(CONVERT_BUFFER_VALUES);
+  int length = -1;
+  int64_t itemCount = 0;
+  const char* p = text.begin();
+  while (p < text.end())
+  {
+    int n = parser.parseLine(p, text.end(), values);
+    if (length >= 0 && n != length) {
+      throw KOnexException("File contains time series with inconsistent lengths");
+    }
+    length = n;
+    itemCount++;
+    if (values.getSize() >= CONVERT_BUFFER_VALUES)
+    {
+      _writeValues(f, values.getValues(), values.getSize(), precision);
+      values.truncate(0);
+    }
+  }
+  _writeValues(f, values.getValues(), values.getSize(), precision);
+  if (itemCount > INT32_MAX) {
+    throw KOnexException("Too many time series in " + textPath);
+  }
+
+  header.itemCount = itemCount;
+  header.itemLength = std::max(length - startCol, 0);
+  _writeHeader(f, binaryPath, header);
+  return itemCount;
+}
+
+void TimeSeriesSet::loadBinary(const string& filePath, int maxNumRow, bool verify)
+{
+  this->clearData();
+
+  std::unique_ptr<MappedFile> file(new MappedFile(filePath, true));
+  binary_dataset_header_t header;
+  if (file->getSize() < sizeof(header)) {
+    throw KOnexException(filePath + " is not a binary dataset");
+  }
+  memcpy(&header, file->begin(), sizeof(header));
+  if (memcmp(header.magic, BINARY_DATASET_MAGIC, sizeof(header.magic)) != 0) {
+    throw KOnexException(filePath + " is not a binary dataset");
+  }
+  if (header.version != BINARY_DATASET_VERSION) {
+    throw KOnexException("Unsupported version of binary dataset: " + std::to_string(header.version));
+  }
+  if (header.headerChecksum != header.computeHeaderChecksum()
+      || (header.precision != sizeof(float) && header.precision != sizeof(double))
+      || header.itemCount < 0 || header.itemLength < 0 || header.itemCount > INT32_MAX
+      || header.dataOffset % BINARY_DATASET_ALIGNMENT != 0
+      || header.dataOffset < sizeof(header))
+  {
+    throw KOnexException("Binary dataset has a corrupted header");
+  }
+  size_t valueBytes = (size_t)header.itemCount * header.itemLength * header.precision;
+  if (file->getSize() < header.dataOffset + valueBytes) {
+    throw KOnexException("Binary dataset is truncated");
+  }
+  char* values = file->beginWritable() + header.dataOffset;
+  if (verify && computeChecksum(values, valueBytes) != header.dataChecksum) {
+    throw KOnexException("Binary dataset has corrupted values");
+  }
+
+  int itemCount = maxNumRow > 0 ? std::min<int64_t>(maxNumRow, header.itemCount) : header.itemCount;
+  size_t count = (size_t)itemCount * header.itemLength;
+  if (header.precision == sizeof(data_t))
+  {
+    this->data = reinterpret_cast<data_t*>(values);
+    this->mappedFile = file.release();
+  }
+  else if (header.precision == sizeof(float))
+  {
+    // Kept as float, and widened as it is read until the dataset is hot
+    std::atomic_store(&this->compressed, std::shared_ptr<const CompressedDataset>(
+      std::make_shared<CompressedDataset>(reinterpret_cast<const float*>(values), itemCount,
+                                          header.itemLength, std::move(file))));
+  }
+  else
+  {
+    // Double values are rounded to a single-precision data_t
+    this->data = new data_t[count];
+    for (size_t i = 0; i < count; i++) {
+      this->data[i] = (data_t)reinterpret_cast<const double*>(values)[i];
+    }
+  }
+
+  this->itemCount = itemCount;
+  this->itemLength = header.itemLength;
+  this->normalized = header.normalized;
+  this->normalization = std::make_pair((data_t)header.normalizationMin, (data_t)header.normalizationMax);
+  this->filePath = filePath;
+  this->envelopeCache.clear();
+  this->paaCache.clear();
+  this->_invalidateDistanceProfile();
+  this->generation++;
+}
+
+void TimeSeriesSet::_releaseData()
+{
+  for (data_t* chunk : this->appendedChunks) {
+    delete[] chunk;
+  }
+  this->appendedChunks.clear();
+  this->appendedFirstRows.clear();
+  std::atomic_store(&this->compressed, std::shared_ptr<const CompressedDataset>());
+  this->compressedReads = 0;
+  this->compressedScans = 0;
+  if (this->mappedFile != nullptr)
+  {
+    delete this->mappedFile;
+    this->mappedFile = nullptr;
+  }
+  else {
+    delete[] this->data;
+  }
   this->data = nullptr;
+}
+
+data_t* TimeSeriesSet::_row(int index) const
+{
+  if (this->appendedFirstRows.empty() || index < this->appendedFirstRows[0]) {
+    return this->data + (size_t)index * this->itemLength;
+  }
+  int c = std::upper_bound(this->appendedFirstRows.begin(), this->appendedFirstRows.end(), index)
+        - this->appendedFirstRows.begin() - 1;
+  return this->appendedChunks[c] + (size_t)(index - this->appendedFirstRows[c]) * this->itemLength;
+}
+
+int TimeSeriesSet::_dataItemCount() const
+{
+  return this->appendedFirstRows.empty() ? this->itemCount : this->appendedFirstRows[0];
+}
+
+void TimeSeriesSet::_mergeChunks()
+{
+  if (this->appendedChunks.empty()) {
+    return;
+  }
+  data_t* values = new data_t[(size_t)this->itemCount * this->itemLength];
+  for (int i = 0; i < this->itemCount; i++) {
+    std::copy(this->_row(i), this->_row(i) + this->itemLength, values + (size_t)i * this->itemLength);
+  }
+  this->_releaseData();
+  this->data = values;
+}
+
+void TimeSeriesSet::clearData()
+{
+  this->_releaseData();
   this->itemCount = 0;
   this->itemLength = 0;
+  this->normalized = false;
+  this->normalization = std::make_pair(0, 0);
+  this->_invalidateStats();
+  this->envelopeCache.clear();
+  this->paaCache.clear();
+  this->_invalidateDistanceProfile();
+  this->generation++;
 }
 
-TimeSeries TimeSeriesSet::getTimeSeries(int index, int start, int end) const
+void TimeSeriesSet::adviseAccess(access_pattern_t pattern, int firstRow, int rowCount) const
+{
+  // Only the series before the appended ones are mapped
+  int mappedCount = this->_dataItemCount();
+  if (this->mappedFile == nullptr || firstRow >= mappedCount) {
+    return;
+  }
+  if (rowCount < 0 || rowCount > mappedCount - firstRow) {
+    rowCount = mappedCount - firstRow;
+  }
+  size_t rowBytes = (size_t)this->itemLength * sizeof(data_t);
+  const char* first = reinterpret_cast<const char*>(this->data + (size_t)firstRow * this->itemLength);
+  this->mappedFile->advise(pattern, first - this->mappedFile->begin(), rowCount * rowBytes);
+}
+
+int TimeSeriesSet::getBlockRowCount() const
+{
+  size_t rowBytes = std::max<size_t>((size_t)this->itemLength * sizeof(data_t), 1);
+  if (this->mappedFile == nullptr || (size_t)this->itemCount * rowBytes <= this->blockSize) {
+    return std::max(this->itemCount, 1);
+  }
+  return std::max<size_t>(this->blockSize / rowBytes, 1);
+}
+
+size_t TimeSeriesSet::compress()
+{
+  if (this->compressed == nullptr)
+  {
+    this->_mergeChunks();
+    std::shared_ptr<const CompressedDataset> compressed =
+      std::make_shared<CompressedDataset>(this->data, this->itemCount, this->itemLength);
+    this->_releaseData();
+    std::atomic_store(&this->compressed, compressed);
+    // The statistics take more memory than the values, and are computed
+    // again from the blocks if needed
+    this->_invalidateStats();
+    this->envelopeCache.clear();
+    this->paaCache.clear();
+    this->_invalidateDistanceProfile();
+  }
+  return this->compressed->getCompressedBytes();
+}
+
+void TimeSeriesSet::decompress()
+{
+  // Queries that find the values decompressed still wait here until the
+  // views of the subclass are taken again
+  std::lock_guard<std::mutex> lock(this->compressionMutex);
+  if (this->compressed == nullptr) {
+    return;
+  }
+  data_t* values = new data_t[(size_t)this->itemCount * this->itemLength];
+  this->compressed->decompress(values);
+  {
+    // Statistics gathered while compressed have no prefix sums. They are
+    // added now, as readers ignore them until the compressed values are gone.
+    std::lock_guard<std::mutex> statsLock(this->statsMutex);
+    if (this->statsValid && this->prefixSums.empty() && this->mappedFile == nullptr)
+    {
+      size_t seriesSize = (size_t)this->itemLength + 1;
+      this->prefixSums.resize(this->itemCount * seriesSize);
+      this->prefixSquares.resize(this->itemCount * seriesSize);
+      for (int ts = 0; ts < this->itemCount; ts++)
+      {
+        series_stats_t stats;
+        _seriesStats(values + (size_t)ts * this->itemLength, this->itemLength, stats,
+                     &this->prefixSums[ts * seriesSize], &this->prefixSquares[ts * seriesSize]);
+      }
+    }
+  }
+  // The values are in place before the compressed ones are dropped, so that
+  // a reader seeing no compressed values sees these. The compressed ones are
+  // freed by their last reader.
+  this->data = values;
+  std::atomic_store(&this->compressed, std::shared_ptr<const CompressedDataset>());
+  this->compressedReads = 0;
+  this->compressedScans = 0;
+  this->_dataMoved();
+}
+
+void TimeSeriesSet::_checkUncompressed() const
+{
+  if (this->isCompressed()) {
+    throw KOnexException("The dataset is compressed, decompress it first");
+  }
+}
+
+void TimeSeriesSet::_checkRange(int index, int& start, int& end) const
 {
   if (index < 0 || index >= this->itemCount)
   {
@@ -199,99 +887,246 @@ TimeSeries TimeSeriesSet::getTimeSeries(int index, int start, int end) const
   }
   if (start < 0 && end < 0)
   {
-    return TimeSeries(this->data + index * this->itemLength, index, 0, this->itemLength);
+    start = 0;
+    end = this->itemLength;
   }
-  if (start < 0 || start >= end || end > this->itemLength)
+  else if (start < 0 || start >= end || end > this->itemLength)
   {
     throw KOnexException("Invalid starting or ending position of a time series");
   }
-  return TimeSeries(this->data + index * this->itemLength, index, start, end);
 }
 
-std::pair<data_t, data_t> TimeSeriesSet::normalize(void)
+TimeSeries TimeSeriesSet::getTimeSeries(int index, int start, int end) const
+{
+  this->_checkRange(index, start, end);
+  this->_checkUncompressed();
+  return TimeSeries(this->_row(index), index, start, end, &this->envelopeCache, &this->paaCache);
+}
+
+TimeSeries TimeSeriesSet::copyTimeSeries(int index, int start, int end) const
 {
-  int length = this->getItemLength() * this->getItemCount();
+  this->_checkRange(index, start, end);
+  std::shared_ptr<const CompressedDataset> compressed = std::atomic_load(&this->compressed);
+  if (compressed == nullptr) {
+    return TimeSeries(this->_row(index), index, start, end).copy();
+  }
+  std::vector<data_t> row(this->itemLength);
+  compressed->readRow(index, row.data());
+  this->compressedReads++;
+  return TimeSeries(row.data(), index, start, end).copy();
+}
 
-  if (!length)
+candidate_time_series_t TimeSeriesSet::materialize(const candidate_t& candidate) const
+{
+  int end = candidate.start + candidate.length;
+  if (this->isCompressed()) {
+    return candidate_time_series_t(this->copyTimeSeries(candidate.index, candidate.start, end),
+                                   candidate.dist);
+  }
+  return candidate_time_series_t(this->getTimeSeries(candidate.index, candidate.start, end),
+                                 candidate.dist);
+}
+
+std::vector<candidate_time_series_t> TimeSeriesSet::materialize(
+  const std::vector<candidate_t>& candidates) const
+{
+  std::vector<candidate_time_series_t> results;
+  results.reserve(candidates.size());
+  for (const auto& c : candidates)
+  {
+    results.push_back(this->materialize(c));
+  }
+  return results;
+}
+
+std::pair<data_t, data_t> TimeSeriesSet::normalize(void)
+{
+  if (!(this->itemLength * this->itemCount))
   {
     throw KOnexException("No data to normalize");
   }
+  this->decompress();
 
-  // auto minAndMax = std::minmax(this->data);
-  // data_t diff = *minAndMax.first - *minAndMax.second;
-  data_t MIN = INF;
-  data_t MAX = -INF;
-  unsigned int i;
+  // The bounds come from the statistics of the series, and the statistics
+  // are updated in the same pass as the values
+  std::pair<data_t, data_t> bounds = this->getBounds();
+  data_t MIN = bounds.first;
+  data_t MAX = bounds.second;
+  // Appended chunks are normalized in place too, so that views stay valid
+  size_t seriesSize = (size_t)this->itemLength + 1;
+  bool prefixed = !this->prefixSums.empty();
+  int first = 0;
+  for (int c = 0; c <= this->appendedChunks.size(); c++)
+  {
+    int last = c < this->appendedFirstRows.size() ? this->appendedFirstRows[c] : this->itemCount;
+    _normalizeSeries(this->_row(first), this->_row(first), last - first, this->itemLength, MIN, MAX - MIN,
+                     this->seriesStats.data() + first,
+                     prefixed ? this->prefixSums.data() + first * seriesSize : nullptr,
+                     prefixed ? this->prefixSquares.data() + first * seriesSize : nullptr);
+    first = last;
+  }
 
-  // find min and max in 1.5 comparisons per element
-  for (int ts = 0; ts < this->itemCount; ts++)
+  normalized = true;
+  this->normalization = std::make_pair(MIN, MAX);
+  this->envelopeCache.clear();
+  this->paaCache.clear();
+  this->_invalidateDistanceProfile();
+  this->generation++;
+  return std::make_pair(MIN, MAX);
+}
+
+const series_stats_t& TimeSeriesSet::getSeriesStats(int index) const
+{
+  if (index < 0 || index >= this->itemCount) {
+    throw KOnexException("Invalid time series index");
+  }
+  this->_ensureStats();
+  return this->seriesStats[index];
+}
+
+std::pair<data_t, data_t> TimeSeriesSet::getBounds() const
+{
+  if (this->itemCount == 0 || this->itemLength == 0) {
+    return std::make_pair(0, 0);
+  }
+  this->_ensureStats();
+  data_t min = INF, max = -INF;
+  for (const series_stats_t& stats : this->seriesStats)
   {
-    data_t x, y, z;
+    min = std::min(min, stats.min);
+    max = std::max(max, stats.max);
+  }
+  return std::make_pair(min, max);
+}
 
-    // start at 0 if even, 1 if odd
-    if ((i = (length % 2 != 0)))
-    {
-      if (data[ts * this->itemLength] < MIN)
-      {
-        MIN = data[ts * this->itemLength];
-      }
-      if (data[ts * this->itemLength] > MAX)
-      {
-        MAX = data[ts * this->itemLength];
-      }
-    }
+const double* TimeSeriesSet::getPrefixSums(int index) const
+{
+  if (index < 0 || index >= this->itemCount) {
+    throw KOnexException("Invalid time series index");
+  }
+  this->_ensureStats();
+  // Those of a compressed dataset are only filled in as it is decompressed
+  if (std::atomic_load(&this->compressed) != nullptr || this->prefixSums.empty()) {
+    return nullptr;
+  }
+  return this->prefixSums.data() + (size_t)index * (this->itemLength + 1);
+}
 
-    for (; i < this->itemLength - 1; i += 2)
-    {
-      x = data[ts * this->itemLength + i];
-      y = data[ts * this->itemLength + (i + 1)];
-      if ( x > y )
-      {
-        z = y;
-        y = x;
-        x = z;
-      }
-      if ( y > MAX )
-      {
-        MAX = y;
-      }
-      if ( x < MIN )
-      {
-        MIN = x;
-      }
-    }
+const double* TimeSeriesSet::getPrefixSquares(int index) const
+{
+  if (index < 0 || index >= this->itemCount) {
+    throw KOnexException("Invalid time series index");
+  }
+  this->_ensureStats();
+  // Those of a compressed dataset are only filled in as it is decompressed
+  if (std::atomic_load(&this->compressed) != nullptr || this->prefixSquares.empty()) {
+    return nullptr;
   }
+  return this->prefixSquares.data() + (size_t)index * (this->itemLength + 1);
+}
 
-  data_t diff = MAX - MIN;
+size_t TimeSeriesSet::getStatsBytes() const
+{
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  return this->seriesStats.capacity() * sizeof(series_stats_t)
+       + (this->prefixSums.capacity() + this->prefixSquares.capacity()) * sizeof(double);
+}
 
-  // do not divide by zero
-  if (diff == 0.0)
+znorm_t TimeSeriesSet::getZNorm(int index, int start, int length) const
+{
+  if (start < 0 || length <= 0 || start + length > this->itemLength) {
+    throw KOnexException("Invalid starting or ending position of a time series");
+  }
+  const double* sums = this->getPrefixSums(index);
+  const double* squares = this->getPrefixSquares(index);
+  double sum, sumOfSquares;
+  if (sums != nullptr)
   {
-    if (MAX != 0)
+    sum = sums[start + length] - sums[start];
+    sumOfSquares = squares[start + length] - squares[start];
+  }
+  else
+  {
+    // Without prefix sums, the values are summed. They are about to be read
+    // by the distance anyway.
+    std::vector<data_t> row;
+    std::shared_ptr<const CompressedDataset> compressed = std::atomic_load(&this->compressed);
+    const data_t* values = compressed == nullptr ? this->_row(index) : nullptr;
+    if (values == nullptr)
     {
-      // zero out data (use memset instead...)
-      for (int ts = 0; ts < this->itemCount; ts++)
-      {
-        for (i = 0; i < this->itemLength; i++)
-        {
-          data[ts * this->itemLength + i] = 0;
-        }
-      }
+      row.resize(this->itemLength);
+      compressed->readRow(index, row.data());
+      values = row.data();
+    }
+    sum = sumOfSquares = 0;
+    for (int i = start; i < start + length; i++)
+    {
+      sum += values[i];
+      sumOfSquares += (double)values[i] * values[i];
     }
   }
-  else
+  double mean = sum / length;
+  double variance = sumOfSquares / length - mean * mean;
+  return znorm_t(mean, std::sqrt(std::max(variance, 0.0)));
+}
+
+void TimeSeriesSet::_ensureStats() const
+{
+  if (this->statsValid.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(this->statsMutex);
+  if (this->statsValid.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // The prefix sums take twice the memory of the values. They are only kept
+  // for values in memory, so that a mapped or compressed dataset does not end
+  // up with more than its size in RAM. Its series stats are one per series.
+  std::shared_ptr<const CompressedDataset> compressed = std::atomic_load(&this->compressed);
+  bool prefixed = this->mappedFile == nullptr && compressed == nullptr;
+  size_t seriesSize = (size_t)this->itemLength + 1;
+  this->seriesStats.resize(this->itemCount);
+  this->prefixSums.resize(prefixed ? this->itemCount * seriesSize : 0);
+  this->prefixSquares.resize(prefixed ? this->itemCount * seriesSize : 0);
+  // A compressed dataset is decoded one series at a time
+  std::vector<data_t> row(compressed != nullptr ? this->itemLength : 0);
+  for (int ts = 0; ts < this->itemCount; ts++)
   {
-    // normalize
-    for (int ts = 0; ts < this->itemCount; ts++)
+    const data_t* values = compressed == nullptr ? this->_row(ts) : nullptr;
+    if (compressed != nullptr)
     {
-      for (i = 0; i < this->itemLength; i++)
-      {
-        data[ts * this->itemLength + i] = (data[ts * this->itemLength + i] - MIN)/ diff;
-      }
+      compressed->readRow(ts, row.data());
+      values = row.data();
     }
+    _seriesStats(values, this->itemLength, this->seriesStats[ts],
+                 prefixed ? &this->prefixSums[ts * seriesSize] : nullptr,
+                 prefixed ? &this->prefixSquares[ts * seriesSize] : nullptr);
   }
-  normalized = true;
-  return std::make_pair(MIN, MAX);
+  this->statsValid.store(true, std::memory_order_release);
+}
+
+void TimeSeriesSet::_invalidateStats()
+{
+  this->statsValid = false;
+  // The memory is freed, as a mapped dataset may never need them
+  std::vector<series_stats_t>().swap(this->seriesStats);
+  std::vector<double>().swap(this->prefixSums);
+  std::vector<double>().swap(this->prefixSquares);
+}
+
+std::shared_ptr<const DistanceProfile> TimeSeriesSet::getDistanceProfile() const
+{
+  std::lock_guard<std::mutex> lock(this->profileMutex);
+  if (this->distanceProfile == nullptr) {
+    this->distanceProfile = std::make_shared<DistanceProfile>(*this);
+  }
+  return this->distanceProfile;
+}
+
+void TimeSeriesSet::_invalidateDistanceProfile()
+{
+  std::lock_guard<std::mutex> lock(this->profileMutex);
+  this->distanceProfile.reset();
 }
 
 void TimeSeriesSet::PAA(int n)
@@ -299,99 +1134,238 @@ void TimeSeriesSet::PAA(int n)
   if (n <= 0) {
     throw KOnexException("Block size must be positive");
   }
+  this->decompress();
   int newItemLength = calcPAALength(this->itemLength, n);
   auto new_data = new data_t[this->itemCount * newItemLength];
   for (int ts = 0; ts < this->itemCount; ts++)
   {
-    doPAA(this->data + ts * this->itemLength, new_data + ts * newItemLength,
+    doPAA(this->_row(ts), new_data + ts * newItemLength,
       this->itemLength, n);
   }
-  delete this->data;
+  this->_releaseData();
   this->data = new_data;
   this->itemLength = newItemLength;
+  this->_invalidateStats();
+  this->envelopeCache.clear();
+  this->paaCache.clear();
+  this->_invalidateDistanceProfile();
+  this->generation++;
 }
 
 bool TimeSeriesSet::isLoaded()
 {
-  return this->data != nullptr;
+  return this->data != nullptr || this->isCompressed();
+}
+
+void TimeSeriesSet::beginQuery() const
+{
+  std::unique_lock<std::mutex> lock(this->appendMutex);
+  this->appendDone.wait(lock, [this]() { return !this->appending && this->pendingAppends == 0; });
+  this->activeQueries++;
+}
+
+void TimeSeriesSet::endQuery() const
+{
+  std::lock_guard<std::mutex> lock(this->appendMutex);
+  if (--this->activeQueries == 0) {
+    this->appendDone.notify_all();
+  }
 }
 
-std::vector<candidate_time_series_t> TimeSeriesSet::kSimRaw(
+std::vector<candidate_t> TimeSeriesSet::kSimRaw(
   const TimeSeries& query, int k, int PAABlock)
+{
+  QueryContext ctx;
+  return this->kSimRaw(query, k, ctx, PAABlock);
+}
+
+std::vector<candidate_t> TimeSeriesSet::kSimRaw(
+  const TimeSeries& query, int k, QueryContext& ctx, int PAABlock)
 {
   if (k <= 0) {
     throw KOnexException("K must be positive");
   }
-  std::vector<candidate_time_series_t> bestSoFar;
-  dist_t warpedDistance = cascadeDistance;
-  data_t bestSoFarDist, currentDist;
+  std::shared_ptr<const CompressedDataset> compressed = std::atomic_load(&this->compressed);
+  if (compressed != nullptr && !this->isHot())
+  {
+    this->compressedScans++;
+    return this->_kSimRawBlocks(*compressed, query, k, ctx, PAABlock);
+  }
+  this->decompress();
+  if (PAABlock <= 0) {
+    PAABlock = ctx.getPAABlock();
+  }
+  if (PAABlock <= 0 && ExhaustiveSearch::supports(ctx))
+  {
+    ExhaustiveSearch search(*this, query, ctx);
+    return search.kSim(k);
+  }
+
+  std::vector<candidate_t> bestSoFar;
   int timeSeriesLength = getItemLength();
   int numberTimeSeries = getItemCount();
-  
-  TimeSeries PAAQuery(0);
-  if (PAABlock > 0)
+  int m = query.getLength();
+  ScopedQuery scopedQuery(ctx, query);
+
+  // LB_PAA only bounds the distances on the raw values. Under the others,
+  // every candidate is compared exactly.
+  query_dist_t distance = ctx.getDistance();
+  bool lockstep = isLockstepDistance(distance);
+  bool bounded = PAABlock > 0
+              && (distance == static_cast<query_dist_t>(pairwiseDistance)
+               || distance == static_cast<query_dist_t>(warpedDistance)
+               || distance == static_cast<query_dist_t>(cascadeDistance));
+
+  // The PAA of the candidates is derived from the cache into a single buffer,
+  // so the scan does not allocate. Each block of the query is summarized by
+  // an interval: its mean under the lockstep distance, the range of its
+  // envelope under the warped ones.
+  int queryBlocks = bounded ? m / PAABlock : 0;
+  std::vector<data_t> PAABuffer(queryBlocks), blockLower(queryBlocks), blockUpper(queryBlocks);
+  std::vector<data_t> envelopeLower, envelopeUpper;
+  int envelopeBand = -1;
+  if (lockstep && queryBlocks > 0)
   {
-    PAAQuery = tsPAA(query, PAABlock);
+    PAACache::computePAA(query, PAABlock, blockLower.data());
+    blockUpper = blockLower;
   }
 
-  // iterate through every timeseries
   for (int idx = 0; idx < numberTimeSeries; idx++)
   {
-    // iterate through every length of interval
-    for (int intervalLength = 2; intervalLength <= timeSeriesLength;
-        intervalLength++) 
+    for (int intervalLength = 2; intervalLength <= timeSeriesLength; intervalLength++)
     {
-      // iterate through all interval window lengths
-      for (int start = 0; start <= timeSeriesLength - intervalLength; 
-            start++) 
+      if (lockstep && intervalLength != m) {
+        continue;
+      }
+      int maxLength = std::max(m, intervalLength);
+      int blocks = bounded ? std::min(m, intervalLength) / PAABlock : 0;
+      if (blocks > 0 && !lockstep && ctx.getWarpingBandSize(maxLength) != envelopeBand)
       {
-        TimeSeries currentTimeSeries = getTimeSeries(idx, start, start + intervalLength);
-        if (k > 0) {
-          if (PAABlock > 0)
-          {
-            TimeSeries PAACurrentTimeSeries = tsPAA(currentTimeSeries, PAABlock);
-            currentDist = warpedDistance(PAAQuery, PAACurrentTimeSeries, INF);
-          }
-          else {
-            currentDist = warpedDistance(query, currentTimeSeries, INF);
-          }
-          bestSoFar.push_back(candidate_time_series_t(currentTimeSeries, currentDist));
-          k--;
-          if (k == 0) {
-            // Heapify exactly once when the heap is filled.
-            std::make_heap(bestSoFar.begin(), bestSoFar.end());
-          }
-        } 
-        else
+        envelopeBand = ctx.getWarpingBandSize(maxLength);
+        _blockEnvelope(query, envelopeBand, PAABlock, envelopeLower, envelopeUpper,
+                       blockLower.data(), blockUpper.data());
+      }
+
+      for (int start = 0; start <= timeSeriesLength - intervalLength; start++)
+      {
+        data_t kth = bestSoFar.size() < k ? ctx.getDropout() : bestSoFar.front().dist;
+        if (blocks > 0 && kth != INF)
         {
-          bestSoFarDist = bestSoFar.front().dist;
-          if (PAABlock > 0)
-          {
-            TimeSeries PAACurrentTimeSeries = tsPAA(currentTimeSeries, PAABlock);
-            currentDist = warpedDistance(PAAQuery, PAACurrentTimeSeries, bestSoFarDist);
-          }
-          else {
-            currentDist = warpedDistance(query, currentTimeSeries, bestSoFarDist);
+          // kth as a squared, unnormalized distance
+          acc_t bound = lockstep ? (acc_t)kth * kth * maxLength
+                                 : ((acc_t)kth * 2 * maxLength) * ((acc_t)kth * 2 * maxLength);
+          this->paaCache.getPAA(idx, start, blocks * PAABlock, PAABlock, PAABuffer.data());
+          acc_t lb = _paaBound(PAABuffer.data(), blockLower.data(), blockUpper.data(), blocks, PAABlock, bound);
+          // Block means from prefix sums are rounded differently from the sums
+          // of the distances, so the bound is lowered slightly to stay below them
+          if (lb * (1 - 1e-9) > bound) {
+            continue;
           }
-          if (currentDist < bestSoFarDist)
-          { 
-            bestSoFar.push_back(candidate_time_series_t(currentTimeSeries, currentDist));
-            std::push_heap(bestSoFar.begin(), bestSoFar.end());
-            std::pop_heap(bestSoFar.begin(), bestSoFar.end());
-            bestSoFar.pop_back();
-          } 
+        }
+
+        TimeSeries candidate = getTimeSeries(idx, start, start + intervalLength);
+        candidate_t c(idx, start, intervalLength, ctx.distanceBetween(query, candidate, kth));
+        if (c.dist > ctx.getDropout()) {
+          continue;
+        }
+        if (bestSoFar.size() < k)
+        {
+          bestSoFar.push_back(c);
+          std::push_heap(bestSoFar.begin(), bestSoFar.end());
+        }
+        else if (c < bestSoFar.front())
+        {
+          std::pop_heap(bestSoFar.begin(), bestSoFar.end());
+          bestSoFar.back() = c;
+          std::push_heap(bestSoFar.begin(), bestSoFar.end());
         }
       }
     }
   }
 
-  if (PAABlock > 0) {
-    for (auto i = 0; i < bestSoFar.size(); i++) {
-      bestSoFar[i].dist = warpedDistance(query, bestSoFar[i].data, INF);
+  std::sort(bestSoFar.begin(), bestSoFar.end());
+  
+  return bestSoFar;
+}
+
+std::vector<candidate_t> TimeSeriesSet::_kSimRawBlocks(const CompressedDataset& compressed,
+  const TimeSeries& query, int k, QueryContext& ctx, int PAABlock)
+{
+  // Each block is searched in place, and only for what beats the k-th best of
+  // the blocks before it. Under the lockstep distances, the sub-sequences of
+  // the length of the query are compared directly rather than through the
+  // distance profiles of every block.
+  std::vector<candidate_t> bestSoFar;
+  auto offer = [&bestSoFar, k](const candidate_t& c) {
+    if (bestSoFar.size() < k)
+    {
+      bestSoFar.push_back(c);
+      std::push_heap(bestSoFar.begin(), bestSoFar.end());
+    }
+    else if (c < bestSoFar.front())
+    {
+      std::pop_heap(bestSoFar.begin(), bestSoFar.end());
+      bestSoFar.back() = c;
+      std::push_heap(bestSoFar.begin(), bestSoFar.end());
+    }
+  };
+  data_t dropout = ctx.getDropout();
+  bool lockstep = isLockstepDistance(ctx.getDistance());
+  int m = query.getLength();
+
+  for (int b = 0; b < compressed.getBlockCount(); b++)
+  {
+    std::shared_ptr<const std::vector<data_t>> values = compressed.getBlock(b);
+    data_t* block = const_cast<data_t*>(values->data());
+    int rows = values->size() / std::max(this->itemLength, 1);
+    int firstRow = b * compressed.getBlockRowCount();
+
+    if (lockstep)
+    {
+      ScopedQuery scopedQuery(ctx, query);
+      for (int r = 0; r < rows; r++)
+      {
+        for (int start = 0; start <= this->itemLength - m; start++)
+        {
+          data_t kth = bestSoFar.size() < k ? dropout : bestSoFar.front().dist;
+          TimeSeries candidate(block + (size_t)r * this->itemLength, firstRow + r, start, start + m);
+          data_t dist = ctx.distanceBetween(query, candidate, kth);
+          if (dist <= dropout) {
+            offer(candidate_t(firstRow + r, start, m, dist));
+          }
+        }
+      }
+      continue;
+    }
+
+    // The block is lent to a dataset of its own, which gives it back before
+    // being destroyed
+    TimeSeriesSet scratch;
+    scratch.itemLength = this->itemLength;
+    scratch.itemCount = rows;
+    scratch.data = block;
+    struct lend_guard_t
+    {
+      TimeSeriesSet& scratch;
+      ~lend_guard_t() { this->scratch.data = nullptr; }
+    } lend{scratch};
+
+    struct dropout_guard_t
+    {
+      QueryContext& ctx;
+      data_t dropout;
+      ~dropout_guard_t() { this->ctx.setDropout(this->dropout); }
+    } restore{ctx, dropout};
+    ctx.setDropout(bestSoFar.size() < k ? dropout : bestSoFar.front().dist);
+
+    for (candidate_t c : scratch.kSimRaw(query, k, ctx, PAABlock))
+    {
+      c.index += firstRow;
+      offer(c);
     }
   }
+
   std::sort(bestSoFar.begin(), bestSoFar.end());
-  
   return bestSoFar;
 }
 
@@ -1,16 +1,55 @@
 #ifndef TIMESERIESSET_H
 #define TIMESERIESSET_H
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "TimeSeries.hpp"
+#include "EnvelopeCache.hpp"
+#include "PAACache.hpp"
+#include "MappedFile.hpp"
+#include "CompressedDataset.hpp"
 #include "distance/Distance.hpp"
+#include "distance/DistanceProfile.hpp"
+#include "distance/QueryContext.hpp"
+
+// Chunks of a text file parsed by each thread, so that threads finishing
+// early pick up more
+#define LOAD_CHUNKS_PER_THREAD 4
+// Smallest chunk worth a task
+#define LOAD_MIN_CHUNK_SIZE (1 << 20)
+// Bytes of a mapped dataset grouped or searched at a time. Larger datasets are
+// processed block of series by block of series, so that only about this much
+// of the file needs to stay in memory.
+#define OUT_OF_CORE_BLOCK_SIZE ((size_t)256 << 20)
+// Values buffered by convertToBinary before they are written
+#define CONVERT_BUFFER_VALUES (1 << 20)
+// Series read from a compressed dataset before it is worth decompressing
+#define COMPRESSED_HOT_READS 64
+// Searches through all the series of a compressed dataset before it is worth
+// decompressing, see kSimRaw
+#define COMPRESSED_HOT_SCANS 4
 
 using std::string;
 
 namespace konex {
 
+/**
+ *  @brief statistics of the values of a time series
+ */
+struct series_stats_t
+{
+  data_t min;
+  data_t max;
+  double mean;
+  double std;
+};
+
 /**
  *  @brief a TimeSeriesSet object contains values and information of a dataset
  *
@@ -28,7 +67,7 @@ public:
    *  Create a TimeSeriestSet object with is an empty string for name
    */
   TimeSeriesSet()
-    : itemLength(0), itemCount(0), normalized(false) {};
+    : itemLength(0), itemCount(0), normalized(false), normalization(0, 0), envelopeCache(*this), paaCache(*this) {};
 
   /**
    *  @brief destructor
@@ -45,19 +84,120 @@ public:
    *  maxNumRow is larger than or equal to the actual number of lines, or maxNumRow is
    *  not positive all lines are read.
    *
+   *  The file is mapped to memory and parsed in a single pass, see TextParser.
+   *  With several threads, the file is split in chunks of whole lines that are
+   *  parsed in parallel then copied in their order. The statistics of each
+   *  series, see getSeriesStats, are computed as its line is parsed.
+   *
    *  @param filePath path to a text file
    *  @param maxNumRow maximum number of rows to be read. If this value is not positive,
    *         all lines are read
    *  @param startCol columns before startCol are discarded
    *  @param separator a string containings possible separator characters for values
    *         in a line
+   *  @param numThreads number of threads parsing the file
+   *  @param normalize if true, the dataset is normalized as with normalize()
+   *         while the values are stored, rather than in passes of its own
    *
-   *  @throw KOnexException if cannot read from the given file
+   *  @throw KOnexException if cannot read from the given file, if lines have
+   *         different numbers of values or if a value cannot be parsed
    */
-  void loadData(const string& filePath, int maxNumRow, int startCol, const string& separator);
+  void loadData(const string& filePath, int maxNumRow, int startCol, const string& separator,
+                int numThreads = 1, bool normalize = false);
 
+  /**
+   *  @brief adds the series of a text or binary file after those of the dataset
+   *
+   *  The new series are kept in a chunk of their own, so that the series
+   *  already loaded never move: the views taken on them stay valid and
+   *  appending costs as much as loading the new series alone. A normalized
+   *  dataset normalizes the new series with its own minimum and maximum,
+   *  which they may exceed. The statistics and the caches of envelopes and
+   *  PAA of the series already loaded are kept, and extended to the new ones.
+   *
+   *  They are extended in place, so the new series are added once the
+   *  queries in progress are done, see ScopedDatasetQuery, and queries
+   *  starting meanwhile wait for them. The file is read before that.
+   *
+   *  @param filePath path to a text file, see loadData, or to a binary
+   *         dataset, see loadBinary
+   *  @param startCol columns before startCol are discarded
+   *  @param separator a string containings possible separator characters for
+   *         values in a line
+   *  @param numThreads number of threads parsing a text file
+   *  @return the number of series appended
+   *
+   *  @throw KOnexException if the file cannot be read, if its series do not
+   *         have the length of those of the dataset, or if it is a
+   *         normalized binary dataset
+   */
+  int appendData(const string& filePath, int startCol = 0, const string& separator = " ",
+                 int numThreads = 1);
+
+  /**
+   *  @brief saves the values to a text file, with as many digits as needed to
+   *         read them back exactly
+   */
   void saveData(const string& filePath, char separator) const;
 
+  /**
+   *  @brief loads a dataset saved by saveBinary
+   *
+   *  The file is mapped to memory and the values are used in place, so that
+   *  a dataset of any size opens at once and its pages are shared with other
+   *  processes. The mapping is copy-on-write: normalizing the dataset copies
+   *  its pages rather than changing the file. A file saved in single
+   *  precision by a build with double data_t stays mapped as floats: the
+   *  dataset is loaded compressed, its blocks are widened as they are read,
+   *  and it is decompressed to data_t once hot, see compress. A file saved
+   *  in double precision by a build with single-precision data_t is rounded
+   *  into memory.
+   *
+   *  @param filePath path to a binary dataset
+   *  @param maxNumRow maximum number of rows to be read. If this value is not
+   *         positive, all rows are read
+   *  @param verify if true, the values are checked against their checksum,
+   *         which reads the whole file
+   *
+   *  @throw KOnexException if the file cannot be read, is not a binary
+   *         dataset of a known version, or is corrupted
+   */
+  void loadBinary(const string& filePath, int maxNumRow = 0, bool verify = false);
+
+  /**
+   *  @brief saves the values and the normalization of the dataset to a binary
+   *         file, see binary_dataset_header_t
+   *
+   *  @param precision bytes of a saved value, 4 or 8. Values saved in single
+   *         precision are rounded and take half the space, on disk and once
+   *         loaded by loadBinary until the dataset is hot.
+   *
+   *  @throw KOnexException if the file cannot be written or the precision is
+   *         neither 4 nor 8
+   */
+  void saveBinary(const string& filePath, int precision = sizeof(data_t)) const;
+
+  /**
+   *  @brief converts a text dataset to a binary dataset without loading it
+   *
+   *  The lines are parsed as loadData does and their values are written as
+   *  they come, so that datasets larger than the memory can be converted, then
+   *  mapped by loadBinary and grouped or searched block by block.
+   *
+   *  @param textPath path to a text file
+   *  @param binaryPath path to the binary file written
+   *  @param startCol columns before startCol are discarded
+   *  @param separators a string containings possible separator characters for
+   *         values in a line
+   *  @param precision bytes of a written value, 4 or 8, see saveBinary
+   *  @return the number of time series converted
+   *
+   *  @throw KOnexException if a file cannot be read or written, if lines have
+   *         different numbers of values or if a value cannot be parsed
+   */
+  static int convertToBinary(const string& textPath, const string& binaryPath,
+                             int startCol, const string& separators, int precision = sizeof(data_t));
+
   /**
    * @brief clears all data
    */
@@ -77,6 +217,90 @@ public:
    */
   int getItemCount() const { return this->itemCount; }
 
+  /**
+   * @brief checks whether the values are read in place from a mapped file,
+   *        see loadBinary
+   */
+  bool isMapped() const { return this->mappedFile != nullptr; }
+
+  /**
+   * @brief tells the kernel how some rows of a mapped dataset are about to be
+   *        read. Does nothing if the dataset is in memory.
+   *
+   * @param pattern the expected access pattern
+   * @param firstRow the first row of the range
+   * @param rowCount the number of rows of the range, or a negative number for
+   *        all rows from firstRow
+   */
+  void adviseAccess(access_pattern_t pattern, int firstRow = 0, int rowCount = -1) const;
+
+  /**
+   * @brief gets the number of rows processed at a time by grouping and search
+   *
+   * A dataset in memory is processed as a single block. A mapped dataset is
+   * split in blocks of about blockSize bytes, so that datasets larger than the
+   * memory are read block by block rather than once per length.
+   *
+   * @return the number of rows in a block, at least 1
+   */
+  int getBlockRowCount() const;
+
+  /**
+   * @brief sets the size of the blocks of a mapped dataset, see getBlockRowCount
+   */
+  void setBlockSize(size_t bytes) { this->blockSize = bytes; }
+
+  /**
+   * @brief encodes the values without loss and frees them, see
+   *        CompressedDataset
+   *
+   * A compressed dataset keeps its shape and normalization, but its values
+   * cannot be viewed: getTimeSeries throws until decompress is called, and
+   * the views taken before are invalidated. Series are read through a small
+   * cache of decoded blocks with copyTimeSeries, and kSimRaw decodes one
+   * block at a time until the dataset is hot. Compressing a compressed
+   * dataset does nothing. Unlike decompress, it must not run concurrently
+   * with queries.
+   *
+   * @return the bytes taken by the compressed values
+   */
+  size_t compress();
+
+  /**
+   * @brief decodes the values of a compressed dataset back to memory. Does
+   *        nothing if the dataset is not compressed.
+   *
+   * Safe to call from concurrent queries: the values are decoded once, and
+   * the readers of the compressed values keep them until they are done.
+   */
+  void decompress();
+
+  /**
+   * @brief checks whether the values are compressed, see compress
+   */
+  bool isCompressed() const { return std::atomic_load(&this->compressed) != nullptr; }
+
+  /**
+   * @brief gets the bytes in which a value is stored: sizeof(float) for a
+   *        single-precision file kept as floats by loadBinary, sizeof(data_t)
+   *        otherwise
+   */
+  int getStoragePrecision() const
+  {
+    std::shared_ptr<const CompressedDataset> values = std::atomic_load(&this->compressed);
+    return values ? values->getPrecision() : (int)sizeof(data_t);
+  }
+
+  /**
+   * @brief checks whether a compressed dataset is read often enough to
+   *        decompress it, see COMPRESSED_HOT_READS and COMPRESSED_HOT_SCANS
+   */
+  bool isHot() const
+  {
+    return this->compressedReads >= COMPRESSED_HOT_READS
+        || this->compressedScans >= COMPRESSED_HOT_SCANS;
+  }
+
   /**
    * @brief gets the file path of the dataset
    *
@@ -97,6 +321,29 @@ public:
    */
   TimeSeries getTimeSeries(int index, int start = -1, int end = -1) const;
 
+  /**
+   * @brief copies a sub-sequence of a time series, see getTimeSeries
+   *
+   * Unlike getTimeSeries, it works on a compressed dataset, whose series are
+   * decoded through the cache of blocks, and the copy outlives the data. It
+   * keeps the index and the positions of the sub-sequence.
+   *
+   * @throw KOnexException if index, start or end is not in intended range
+   */
+  TimeSeries copyTimeSeries(int index, int start = -1, int end = -1) const;
+
+  /**
+   * @brief creates time series views for compact search results
+   *
+   * @param candidates results of a search on this dataset
+   * @return the same results, each holding a view of its sub-sequence, or a
+   *         copy of it if the dataset is compressed
+   *
+   * @throw KOnexException if a candidate is not a sub-sequence of this dataset
+   */
+  candidate_time_series_t materialize(const candidate_t& candidate) const;
+  std::vector<candidate_time_series_t> materialize(const std::vector<candidate_t>& candidates) const;
+
   /**
    *  @brief normalizes the datset
    *  Each value in the dataset is transformed by the following formula:
@@ -109,11 +356,101 @@ public:
    */
   std::pair<data_t, data_t> normalize();
 
+  /**
+   *  @brief gets the statistics of a time series
+   *
+   *  They are computed while a text dataset is parsed, and on first use
+   *  otherwise. They follow the values when the dataset is normalized.
+   *
+   *  @throw KOnexException if the index is not in range
+   */
+  const series_stats_t& getSeriesStats(int index) const;
+
+  /**
+   *  @brief gets the smallest and the largest value of the dataset, or (0, 0)
+   *         if it is empty
+   */
+  std::pair<data_t, data_t> getBounds() const;
+
+  /**
+   *  @brief gets the cumulative sums of the values of a time series, and of
+   *         their squares
+   *
+   *  Both arrays have itemLength + 1 elements. Element i is the sum over the
+   *  first i values, so that the sum over [start, end) is
+   *  sums[end] - sums[start]. They are computed along with getSeriesStats.
+   *
+   *  They take twice the memory of the values, so they are only kept for
+   *  values in memory. The users of the prefix sums sum the values directly
+   *  when there are none.
+   *
+   *  @return the cumulative sums, or nullptr if the statistics were computed
+   *          while the values were mapped or compressed
+   *
+   *  @throw KOnexException if the index is not in range
+   */
+  const double* getPrefixSums(int index) const;
+  const double* getPrefixSquares(int index) const;
+
+  /**
+   *  @brief gets the bytes taken by the statistics and the prefix sums
+   */
+  size_t getStatsBytes() const;
+
+  /**
+   *  @brief gets the mean and the standard deviation of a sub-sequence in
+   *         constant time, from the prefix sums if there are any
+   *
+   *  @param index index of the time series
+   *  @param start starting position of the sub-sequence
+   *  @param length length of the sub-sequence
+   *
+   *  @throw KOnexException if the sub-sequence is not in the dataset
+   */
+  znorm_t getZNorm(int index, int start, int length) const;
+
+  /**
+   *  @brief gets the minimum and maximum values of the dataset before it was
+   *         normalized, or (0, 0) if it was not
+   */
+  std::pair<data_t, data_t> getNormalization() const { return this->normalization; }
+
+  /**
+   * @brief gets the cache of Keogh envelopes of the sub-sequences in this dataset
+   *
+   * The cache is shared by all TimeSeries views returned by getTimeSeries and is
+   * cleared whenever the data changes.
+   */
+  EnvelopeCache& getEnvelopeCache() { return this->envelopeCache; }
+
+  /**
+   * @brief gets the cache of PAA representations of the sub-sequences in this dataset
+   *
+   * Unlike PAA(), the cache leaves the data of the dataset untouched. It is
+   * cleared whenever the data changes.
+   */
+  const PAACache& getPAACache() const { return this->paaCache; }
+
+  /**
+   * @brief gets the spectra of the series of this dataset, see DistanceProfile
+   *
+   * They are computed on first use and kept until the data changes. The
+   * returned profile stays usable by its holders after that.
+   */
+  std::shared_ptr<const DistanceProfile> getDistanceProfile() const;
+
   /**
   *  @brief check if the dataset is normalized
   */
   bool isNormalized() { return normalized; }
 
+  /**
+   *  @brief replaces every time series with its piecewise aggregate approximation
+   *
+   *  @param n size of a block
+   *
+   *  @throw KOnexException if the block size is not positive
+   */
   void PAA(int n);
 
   /**
@@ -137,24 +474,200 @@ public:
    * 
    * @param query to search for
    * @param k - number of time series to find
+   * @param ctx settings and scratch memory of the query. Without it, the query
+   *        uses the process-wide default settings.
+   * @param PAABlock if positive, candidates are filtered with LB_PAA on the
+   *        PAA of this block size, and those whose bound is below the k-th
+   *        best distance so far are compared on the raw data. The result is
+   *        exact. Otherwise the PAA block of the context is used, if any.
+   *
+   * A compressed dataset is searched block by block of decoded series, and
+   * only decompressed once it is hot, see isHot.
    *  
    * @vector vector of candidates with exact distance from query.
    */
-  std::vector<candidate_time_series_t> kSimRaw(const TimeSeries& query, int k, int PAABlock = 0);
+  std::vector<candidate_t> kSimRaw(const TimeSeries& query, int k, int PAABlock = 0);
+  std::vector<candidate_t> kSimRaw(const TimeSeries& query, int k, QueryContext& ctx, int PAABlock = 0);
       
   /**
    *  @brief check if data is loaded
    */
   bool isLoaded(void);
 
+  /**
+   *  @brief marks the start and the end of a query reading the dataset, see
+   *         ScopedDatasetQuery
+   */
+  void beginQuery() const;
+  void endQuery() const;
+
+  /**
+   *  @brief gets a number that changes once anything searches read changed,
+   *         so that their results can be told apart from later ones
+   */
+  unsigned long getGeneration() const { return this->generation; }
+
 protected:
   data_t* data = nullptr;
   int itemLength;
   int itemCount;
+  // bumped after the values, groups or index changed, see getGeneration
+  std::atomic<unsigned long> generation{0};
+
+  /**
+   *  @brief called once the values moved to another address with the same
+   *         content, so that the views kept on them can be taken again
+   */
+  virtual void _dataMoved() {}
+
+  /**
+   *  @brief called once series were appended, see appendData
+   *
+   *  @param firstRow the index of the first appended series
+   *  @param numThreads number of threads the appending may use
+   */
+  virtual void _dataAppended(int firstRow, int numThreads) {}
 
 private:
   string filePath;
   bool normalized;
+  std::pair<data_t, data_t> normalization;
+  // the binary file data points into, if any
+  MappedFile* mappedFile = nullptr;
+  // series added by appendData, a chunk per call. Chunks never move, so that
+  // views stay valid. The series before the first chunk are in data.
+  std::vector<data_t*> appendedChunks;
+  // the index of the first series of each chunk
+  std::vector<int> appendedFirstRows;
+  // the values once compressed, in which case data is null. Read with
+  // std::atomic_load, so that queries keep it alive while it is decompressed.
+  std::shared_ptr<const CompressedDataset> compressed;
+  mutable std::atomic<int> compressedReads{0};
+  std::atomic<int> compressedScans{0};
+  std::mutex compressionMutex;
+  // queries in progress, and whether series are being appended, see
+  // appendData
+  mutable int activeQueries = 0;
+  int pendingAppends = 0;
+  bool appending = false;
+  mutable std::mutex appendMutex;
+  mutable std::condition_variable appendDone;
+  size_t blockSize = OUT_OF_CORE_BLOCK_SIZE;
+  EnvelopeCache envelopeCache;
+  PAACache paaCache;
+  mutable std::shared_ptr<const DistanceProfile> distanceProfile;
+  mutable std::mutex profileMutex;
+
+  // statistics of each series and their cumulative sums, itemLength + 1 per
+  // series. They are computed on first use unless the loader computed them.
+  mutable std::vector<series_stats_t> seriesStats;
+  mutable std::vector<double> prefixSums;
+  mutable std::vector<double> prefixSquares;
+  mutable std::atomic<bool> statsValid{false};
+  mutable std::mutex statsMutex;
+
+  /**
+   *  @brief frees the values, unmaps them or drops their compressed form
+   */
+  void _releaseData();
+
+  /**
+   *  @brief gets the values of a series, in data or in an appended chunk
+   */
+  data_t* _row(int index) const;
+
+  /**
+   *  @brief gets the number of series in data, before the appended chunks
+   */
+  int _dataItemCount() const;
+
+  /**
+   *  @brief moves the appended chunks and data into a single array, which
+   *         invalidates the views
+   */
+  void _mergeChunks();
+
+  /**
+   *  @brief computes the statistics of the series if they are not up to date
+   */
+  void _ensureStats() const;
+
+  /**
+   *  @brief drops the statistics after the values changed
+   */
+  void _invalidateStats();
+
+  /**
+   *  @brief drops the distance profile after the values changed
+   */
+  void _invalidateDistanceProfile();
+
+  /**
+   *  @brief searches a compressed dataset block by block, see kSimRaw
+   *
+   *  Each block of series is decoded into a scratch dataset, which is searched
+   *  and freed, so that the dataset stays compressed.
+   */
+  std::vector<candidate_t> _kSimRawBlocks(const CompressedDataset& compressed,
+    const TimeSeries& query, int k, QueryContext& ctx, int PAABlock);
+
+  /**
+   *  @brief throws if the values cannot be viewed because they are compressed
+   */
+  void _checkUncompressed() const;
+
+  /**
+   *  @brief checks a sub-sequence, see getTimeSeries, and resolves negative
+   *         start and end to the whole time series
+   */
+  void _checkRange(int index, int& start, int& end) const;
+};
+
+/**
+ *  @brief holds back appendData on a dataset for the lifetime of this object
+ *
+ *  appendData grows the statistics, the caches and the list of series of the
+ *  dataset in place, which concurrent queries read without locks.
+ *
+ *  A query starting while an append waits is held back too, so a query must
+ *  not enter the same dataset twice, nor two datasets one at a time: use the
+ *  constructor taking both, which enters them once each in a fixed order.
+ */
+class ScopedDatasetQuery
+{
+public:
+  ScopedDatasetQuery(const TimeSeriesSet& dataset) : first(&dataset), second(nullptr)
+  {
+    dataset.beginQuery();
+  }
+
+  /**
+   *  @param a, b the datasets the query reads, which may be the same
+   */
+  ScopedDatasetQuery(const TimeSeriesSet& a, const TimeSeriesSet& b)
+    : first(std::less<const TimeSeriesSet*>()(&a, &b) ? &a : &b),
+      second(&a == &b ? nullptr : (this->first == &a ? &b : &a))
+  {
+    this->first->beginQuery();
+    if (this->second != nullptr) {
+      this->second->beginQuery();
+    }
+  }
+
+  ~ScopedDatasetQuery()
+  {
+    if (this->second != nullptr) {
+      this->second->endQuery();
+    }
+    this->first->endQuery();
+  }
+
+  ScopedDatasetQuery(const ScopedDatasetQuery&) = delete;
+  ScopedDatasetQuery& operator=(const ScopedDatasetQuery&) = delete;
+
+private:
+  const TimeSeriesSet* first;
+  const TimeSeriesSet* second;
 };
 
 } // namespace konex
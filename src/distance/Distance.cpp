@@ -3,10 +3,13 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <atomic>
 
 #include "Exception.hpp"
 #include "TimeSeries.hpp"
 #include "distance/Distance.hpp"
+#include "distance/QueryContext.hpp"
+#include "lib/trillionDTW.h"
 
 using std::string;
 using std::vector;
@@ -25,116 +28,204 @@ const dist_t getDistance(const string& distance_name)
   else if (distance_name == "euclidean_dtw") {
     return warpedDistance;
   }
+  else if (distance_name == "euclidean_znorm") {
+    return znormPairwiseDistance;
+  }
+  else if (distance_name == "euclidean_dtw_znorm") {
+    return znormWarpedDistance;
+  }
+  throw KOnexException(string("Cannot find distance with name: ") + distance_name);
+}
+
+bool isLockstepDistance(query_dist_t distance)
+{
+  return distance == static_cast<query_dist_t>(pairwiseDistance)
+      || distance == static_cast<query_dist_t>(znormPairwiseDistance);
+}
+
+const query_dist_t getQueryDistance(const string& distance_name)
+{
+  if (distance_name == "euclidean") {
+    return pairwiseDistance;
+  }
+  else if (distance_name == "euclidean_dtw") {
+    return cascadeDistance;
+  }
+  else if (distance_name == "euclidean_znorm") {
+    return znormPairwiseDistance;
+  }
+  else if (distance_name == "euclidean_dtw_znorm") {
+    return znormCascadeDistance;
+  }
   throw KOnexException(string("Cannot find distance with name: ") + distance_name);
 }
 
-data_t _euc(data_t x_1, data_t x_2)
+/**
+ *  @brief the context used by the distances called without one
+ *
+ *  It follows the process-wide default warping band ratio and keeps its scratch
+ *  buffers for the lifetime of the calling thread.
+ */
+QueryContext& _defaultContext()
+{
+  static thread_local QueryContext ctx;
+  ctx.setWarpingBandRatio(getWarpingBandRatio());
+  return ctx;
+}
+
+/**
+ *  @brief leaves the values as they are, for the kernels on raw values
+ */
+struct _identity_t
 {
-  return pow(x_1 - x_2, 2);
+  data_t operator()(data_t x) const { return x; }
+};
+
+acc_t _euc(data_t x_1, data_t x_2)
+{
+  return pow((acc_t)x_1 - x_2, 2);
 }
 
-data_t _euc_norm(data_t total, const TimeSeries& t_1, const TimeSeries& t_2)
+data_t _euc_norm(acc_t total, const TimeSeries& t_1, const TimeSeries& t_2)
 {
   return sqrt(total / std::max(t_1.getLength(), t_2.getLength()));
 }
 
-data_t _euc_inorm(data_t dropout, const TimeSeries& t_1, const TimeSeries& t_2)
+acc_t _euc_inorm(data_t dropout, const TimeSeries& t_1, const TimeSeries& t_2)
 {
-  return dropout * dropout * std::max(t_1.getLength(), t_2.getLength());
+  return (acc_t)dropout * dropout * std::max(t_1.getLength(), t_2.getLength());
 }
 
-data_t _euc_norm_dtw(data_t total, const TimeSeries& t_1, const TimeSeries& t_2)
+data_t _euc_norm_dtw(acc_t total, const TimeSeries& t_1, const TimeSeries& t_2)
 {
   return sqrt(total) / (2 * std::max(t_1.getLength(), t_2.getLength()));
 }
 
-data_t _euc_inorm_dtw(data_t dropout, const TimeSeries& t_1, const TimeSeries& t_2)
+acc_t _euc_inorm_dtw(data_t dropout, const TimeSeries& t_1, const TimeSeries& t_2)
 {
-  return pow(dropout * 2 * std::max(t_1.getLength(), t_2.getLength()), 2);
+  return pow((acc_t)dropout * 2 * std::max(t_1.getLength(), t_2.getLength()), 2);
 }
 
-data_t warpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+/**
+ *  @brief DTW between the values of a and b, each mapped through its own
+ *         normalization as they are read
+ */
+template <typename Norm>
+data_t _warpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx,
+                       const Norm& na, const Norm& nb)
 {
   int m = a.getLength();
   int n = b.getLength();
-  int r = calculateWarpingBandSize(max(m, n));
-  data_t idropout = _euc_inorm_dtw(dropout, a, b);
+  int r = ctx.getWarpingBandSize(max(m, n));
+  acc_t idropout = _euc_inorm_dtw(dropout, a, b);
 
   // Fastpath for base intervals
   if (m == 1 && n == 1)
   {
-    return _euc_norm_dtw(_euc(a[0], b[0]), a, b);
+    return _euc_norm_dtw(_euc(na(a[0]), nb(b[0])), a, b);
   }
 
-  // create cost matrix
-  vector< vector< data_t >> cost(m, vector< data_t >(n));
-
-  // Preset this in case this cell is never reached due to the warping
-  // band constraint
-  cost[m - 1][n - 1] = INF;
-  cost[0][0] = _euc(a[0], b[0]);
-
-  // calculate first column
-  for(int i = 1; i < min(2*r + 1, m); i++)
-  {
-    cost[i][0] = cost[i-1][0] + _euc(a[i], b[0]);
-  }
+  // Only two rows of the cost matrix are kept. Within a row, only the cells
+  // in the warping band are read, except for the first row and the first
+  // column, which are filled up to 2r.
+  acc_t* prev = ctx.getRowBuffer(n);
+  acc_t* curr = prev + n;
 
   // calculate first row
-  for(int j = 1; j < min(2*r + 1, n); j++)
+  int firstRowEnd = min(2*r + 1, n);
+  data_t a0 = na(a[0]);
+  prev[0] = _euc(a0, nb(b[0]));
+  for(int j = 1; j < firstRowEnd; j++)
   {
-    cost[0][j] = cost[0][j-1] + _euc(a[0], b[j]);
+    prev[j] = prev[j-1] + _euc(a0, nb(b[j]));
   }
 
-  data_t result;
-  bool dropped = false;
+  // whether the last cell of the latest row is reached
+  bool lastReached = n - 1 < firstRowEnd;
+  acc_t firstColumn = prev[0];
+
   for(int i = 1; i < m; i++)
   {
-    data_t bestSoFar = INF;
+    lastReached = false;
+    data_t ai = na(a[i]);
+
+    // calculate first column
+    if (i < 2*r + 1)
+    {
+      firstColumn += _euc(ai, nb(b[0]));
+      curr[0] = firstColumn;
+      lastReached = n == 1;
+    }
+
+    acc_t bestSoFar = INF;
     for(int j = max(i - r, 0); j <= min(i + r, n - 1); j++)
     {
       if (j == 0) {
-        bestSoFar = min(bestSoFar, cost[i][j]);
+        bestSoFar = min(bestSoFar, curr[0]);
         continue;
       }
-      data_t ij1  = (i - r <= j-1 && j-1 <= i + r) ? cost[i][j-1] : INF;
-      data_t i1j1 = cost[i-1][j-1];
-      data_t i1j  = (j - r <= i-1 && i-1 <= j + r) ? cost[i-1][j] : INF;
-      data_t minPrev = cost[i-1][j];
-      if (i1j1 < ij1 && i1j1 < i1j)
-      {
-        minPrev = cost[i-1][j-1];
+      acc_t minPrev = prev[j-1];
+      if (i - r <= j-1) {
+        minPrev = min(minPrev, curr[j-1]);
       }
-      else if (ij1 < i1j)
-      {
-        minPrev = cost[i][j-1];
+      if (j - r <= i-1) {
+        minPrev = min(minPrev, prev[j]);
       }
-      cost[i][j] = minPrev + _euc(a[i], b[j]);
-      bestSoFar = min(bestSoFar, cost[i][j]);
+      curr[j] = minPrev + _euc(ai, nb(b[j]));
+      bestSoFar = min(bestSoFar, curr[j]);
+      lastReached = j == n - 1;
     }
 
     if (bestSoFar > idropout)
     {
-      dropped = true;
-      break;
+      return INF;
     }
+    std::swap(prev, curr);
   }
-  result = dropped ? INF : cost[m - 1][n - 1];
-  return _euc_norm_dtw(result, a, b);
+  return _euc_norm_dtw(lastReached ? prev[n - 1] : INF, a, b);
+}
+
+data_t warpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  return _warpedDistance(a, b, dropout, ctx, _identity_t(), _identity_t());
+}
+
+data_t warpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+{
+  return warpedDistance(a, b, dropout, _defaultContext());
+}
+
+data_t znormWarpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  return _warpedDistance(a, b, dropout, ctx, ctx.getZNorm(a), ctx.getZNorm(b));
+}
+
+data_t znormWarpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+{
+  return znormWarpedDistance(a, b, dropout, _defaultContext());
 }
 
-double warpingBandRatio = 0.1;
+std::atomic<double> defaultWarpingBandRatio(0.1);
 
 void setWarpingBandRatio(double ratio) {
-  warpingBandRatio = ratio;
+  defaultWarpingBandRatio = ratio;
 }
 
-int calculateWarpingBandSize(int length)
+double getWarpingBandRatio() {
+  return defaultWarpingBandRatio;
+}
+
+int calculateWarpingBandSize(int length, double ratio)
 {
-  int bandSize = floor(length * warpingBandRatio);
+  int bandSize = floor(length * ratio);
   return std::min(bandSize, length - 1);
 }
 
+int calculateWarpingBandSize(int length)
+{
+  return calculateWarpingBandSize(length, defaultWarpingBandRatio);
+}
+
 data_t kimLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout)
 {
   int al = a.getLength();
@@ -193,29 +284,71 @@ data_t kimLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout)
   return lb;
 }
 
-data_t keoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+/**
+ *  @brief LB_Keogh of b against the envelope of a, with the values of each
+ *         mapped through its own normalization
+ *
+ *  A normalization is increasing, so the envelope of the normalized values is
+ *  the normalized envelope of the raw ones.
+ */
+template <typename Norm>
+data_t _keoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx,
+                        const Norm& na, const Norm& nb)
 {
-
   int len = min(a.getLength(), b.getLength());
-  int warpingBand = calculateWarpingBandSize(max(a.getLength(), b.getLength()));
-  const data_t* aLower = a.getKeoghLower(warpingBand);
-  const data_t* aUpper = a.getKeoghUpper(warpingBand);
-  data_t idropout = dropout * 2 * max(a.getLength(), b.getLength());
-  idropout *= idropout;
-  data_t lb = 0;
+  int warpingBand = ctx.getWarpingBandSize(max(a.getLength(), b.getLength()));
+
+  // Envelopes cached inside 'a' are not used here, since another query might
+  // be rebuilding them for a different band.
+  const data_t* envelope = a.getSharedKeoghEnvelope(warpingBand);
+  if (envelope == nullptr)
+  {
+    data_t* buffer = ctx.getEnvelopeBuffer(a.getLength());
+    a.computeKeoghEnvelope(warpingBand, buffer, buffer + a.getLength());
+    envelope = buffer;
+  }
+  const data_t* aLower = envelope;
+  const data_t* aUpper = envelope + a.getLength();
+  acc_t idropout = _euc_inorm_dtw(dropout, a, b);
+  acc_t lb = 0;
 
   for (int i = 0; i < len && lb < idropout; i++)
   {
-    if (b[i] > aUpper[i]) {
-      lb += _euc(b[i], aUpper[i]);
+    data_t bi = nb(b[i]);
+    data_t upper = na(aUpper[i]);
+    data_t lower = na(aLower[i]);
+    if (bi > upper) {
+      lb += _euc(bi, upper);
     }
-    else if(b[i] < aLower[i]) {
-      lb += _euc(b[i], aLower[i]);
+    else if(bi < lower) {
+      lb += _euc(bi, lower);
     }
   }
   return _euc_norm_dtw(lb, a, b);
 }
 
+data_t keoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  return _keoghLowerBound(a, b, dropout, ctx, _identity_t(), _identity_t());
+}
+
+data_t keoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+{
+  // The envelopes cached in 'a' itself would race between threads
+  return keoghLowerBound(a, b, dropout, _defaultContext());
+}
+
+data_t crossKeoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  data_t lb = keoghLowerBound(a, b, dropout, ctx);
+  if (lb > dropout) {
+    return INF;
+  }
+  else {
+    return max(lb, keoghLowerBound(b, a, dropout, ctx));
+  }
+}
+
 data_t crossKeoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout)
 {
   data_t lb = keoghLowerBound(a, b, dropout);
@@ -227,37 +360,91 @@ data_t crossKeoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dro
   }
 }
 
-data_t cascadeDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+data_t paaLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  if (dropout == INF) {
+    return 0;
+  }
+  int warpingBand = ctx.getWarpingBandSize(max(a.getLength(), b.getLength()));
+  const TimeSeries* other = &b;
+  const PAAPyramid* pyramid = ctx.getQueryPyramid(a, warpingBand);
+  if (pyramid == nullptr)
+  {
+    other = &a;
+    pyramid = ctx.getQueryPyramid(b, warpingBand);
+  }
+  if (pyramid == nullptr) {
+    return 0;
+  }
+  acc_t lb = pyramid->lowerBound(*other, _euc_inorm_dtw(dropout, a, b));
+
+  // Block means from prefix sums are rounded differently from the sums of the
+  // other kernels, so the bound is lowered slightly to stay below them.
+  return _euc_norm_dtw(lb * (1 - 1e-9), a, b);
+}
+
+data_t cascadeDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
 {
   // Temporarily disable this because the code seems to be problematic
   // data_t lb = kimLowerBound(a, b, dropout);
   // if (lb > dropout) {
   //   return INF;
   // }
-  data_t lb = crossKeoghLowerBound(a, b, dropout);
+  data_t lb = paaLowerBound(a, b, dropout, ctx);
   if (lb > dropout) {
     return INF;
   }
-  data_t d = warpedDistance(a, b, dropout);
+  lb = crossKeoghLowerBound(a, b, dropout, ctx);
+  if (lb > dropout) {
+    return INF;
+  }
+  data_t d = warpedDistance(a, b, dropout, ctx);
   return d;
 }
 
-data_t pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout)
+data_t znormCascadeDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  // LB_PAA bounds the raw values, so only LB_Keogh is used here
+  znorm_t na = ctx.getZNorm(a);
+  znorm_t nb = ctx.getZNorm(b);
+  data_t lb = _keoghLowerBound(a, b, dropout, ctx, na, nb);
+  if (lb > dropout) {
+    return INF;
+  }
+  lb = _keoghLowerBound(b, a, dropout, ctx, nb, na);
+  if (lb > dropout) {
+    return INF;
+  }
+  return _warpedDistance(a, b, dropout, ctx, na, nb);
+}
+
+data_t cascadeDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+{
+  data_t lb = crossKeoghLowerBound(a, b, dropout);
+  if (lb > dropout) {
+    return INF;
+  }
+  return warpedDistance(a, b, dropout);
+}
+
+template <typename Norm>
+data_t _pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout,
+                         const Norm& n_1, const Norm& n_2)
 {
   if (x_1.getLength() != x_2.getLength())
   {
     throw KOnexException("Two time series must have the same length for pairwise distance");
   }
 
-  data_t total = 0;
+  acc_t total = 0;
 
   bool dropped = false;
-  dropout = _euc_inorm(dropout, x_1, x_2);
+  acc_t idropout = _euc_inorm(dropout, x_1, x_2);
 
   for(int i = 0; i < x_1.getLength(); i++)
   {
-    total += _euc(x_1[i], x_2[i]);
-    if (total > dropout)
+    total += _euc(n_1(x_1[i]), n_2(x_2[i]));
+    if (total > idropout)
     {
       dropped = true;
       break;
@@ -267,5 +454,25 @@ data_t pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dro
   return result;
 }
 
+data_t pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout)
+{
+  return _pairwiseDistance(x_1, x_2, dropout, _identity_t(), _identity_t());
+}
+
+data_t pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout, QueryContext& ctx)
+{
+  return pairwiseDistance(x_1, x_2, dropout);
+}
+
+data_t znormPairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout, QueryContext& ctx)
+{
+  return _pairwiseDistance(x_1, x_2, dropout, ctx.getZNorm(x_1), ctx.getZNorm(x_2));
+}
+
+data_t znormPairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout)
+{
+  return znormPairwiseDistance(x_1, x_2, dropout, _defaultContext());
+}
+
 
 } // namespace onex
@@ -16,11 +16,32 @@ using std::pair;
 
 namespace konex {
 
+class QueryContext;
+
 typedef data_t (*dist_t)(const TimeSeries&, const TimeSeries&, data_t);
 
+/**
+ *  @brief a distance that takes its settings and scratch memory from a query context
+ */
+typedef data_t (*query_dist_t)(const TimeSeries&, const TimeSeries&, data_t, QueryContext&);
+
+/**
+ *  @brief calculates the size of the warping band for a given length
+ *
+ *  The version without a ratio uses the process-wide default ratio.
+ */
 int calculateWarpingBandSize(int length);
+int calculateWarpingBandSize(int length, double ratio);
+
+/**
+ *  @brief sets and gets the process-wide default warping band ratio
+ *
+ *  The default is used by the distances without a query context and is copied
+ *  into each QueryContext created without an explicit ratio.
+ */
 void setWarpingBandRatio(double ratio);
-  
+double getWarpingBandRatio();
+
 /**
  *  @brief returns the an object representing a distance metric
  *
@@ -30,6 +51,22 @@ void setWarpingBandRatio(double ratio);
  */
 const dist_t getDistance(const string& distance_name);
 
+/**
+ *  @brief returns the query distance for a distance metric
+ *
+ *  The DTW metric is returned with its lower bounds in front of it.
+ *
+ *  @param distance_name name of a distance metric
+ *  @throw KOnexException if no distance with given name is found
+ */
+const query_dist_t getQueryDistance(const string& distance_name);
+
+/**
+ *  @brief whether a distance compares two time series point by point, so that
+ *         it is only defined between time series of the same length
+ */
+bool isLockstepDistance(query_dist_t distance);
+
 /**
  *  @return a vector of names of available distances
  */
@@ -44,12 +81,31 @@ const vector<string>& getAllDistanceName();
  *  @param dropout drops the calculation of distance if within this
  */
 data_t warpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout);
+data_t warpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx);
+
+/**
+ *  @brief the warped distance between the z-normalized values of a and b
+ *
+ *  Each time series is normalized with its own mean and standard deviation as
+ *  its values are read, see TimeSeries::getZNorm. Registered as
+ *  "euclidean_dtw_znorm".
+ */
+data_t znormWarpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout);
+data_t znormWarpedDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx);
 
 /**
  * Calculates pairwise distance between two time series. This function is enabled if the given
  * distance metric class DM has the 'hasInverseNorm' function.
  */
 data_t pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout);
+data_t pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout, QueryContext& ctx);
+
+/**
+ *  @brief the pairwise distance between the z-normalized values of x_1 and
+ *         x_2, registered as "euclidean_znorm"
+ */
+data_t znormPairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout);
+data_t znormPairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dropout, QueryContext& ctx);
 
 /**
  * ...
@@ -57,11 +113,26 @@ data_t pairwiseDistance(const TimeSeries& x_1, const TimeSeries& x_2, data_t dro
 data_t keoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout);
 data_t kimLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout);
 data_t crossKeoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout);
+data_t keoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx);
+data_t crossKeoghLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx);
+
+/**
+ * Calculates LB_PAA from the PAA pyramid of the query bound to the context to
+ * the other time series. Returns 0 if neither time series is the bound query or
+ * the other one is not backed by a PAA cache.
+ */
+data_t paaLowerBound(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx);
 
 /**
  * ...
  */
 data_t cascadeDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout);
+data_t cascadeDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx);
+
+/**
+ *  @brief znormWarpedDistance behind LB_Keogh on the z-normalized values
+ */
+data_t znormCascadeDistance(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx);
 
 } // namespace onex
 
@@ -0,0 +1,227 @@
+#include "distance/DistanceProfile.hpp"
+#include "TimeSeriesSet.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace konex {
+
+typedef std::complex<double> complex_t;
+
+static std::vector<complex_t> _roots(int n)
+{
+  // Each root is computed directly so rounding does not build up
+  std::vector<complex_t> roots(n / 2);
+  for (int k = 0; k < n / 2; k++) {
+    roots[k] = std::polar(1.0, -2 * M_PI * k / n);
+  }
+  return roots;
+}
+
+/**
+ *  @brief radix-2 FFT with the roots of unity of size n
+ */
+static void _fft(complex_t* a, int n, const complex_t* roots, bool inverse)
+{
+  // bit-reversal permutation
+  for (int i = 1, j = 0; i < n; i++)
+  {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(a[i], a[j]);
+    }
+  }
+
+  for (int len = 2; len <= n; len <<= 1)
+  {
+    int half = len / 2;
+    int stride = n / len;
+    for (int i = 0; i < n; i += len)
+    {
+      for (int k = 0; k < half; k++)
+      {
+        complex_t w = inverse ? std::conj(roots[k * stride]) : roots[k * stride];
+        complex_t u = a[i + k];
+        complex_t v = a[i + k + half] * w;
+        a[i + k] = u + v;
+        a[i + k + half] = u - v;
+      }
+    }
+  }
+}
+
+void DistanceProfile::fft(complex_t* a, int n, bool inverse)
+{
+  std::vector<complex_t> roots = _roots(n);
+  _fft(a, n, roots.data(), inverse);
+}
+
+DistanceProfile::DistanceProfile(const TimeSeriesSet& dataset)
+  : itemCount(dataset.getItemCount()), itemLength(dataset.getItemLength()), maxEnergy(0)
+{
+  if (this->itemCount == 0 || this->itemLength == 0) {
+    throw KOnexException("No data to compute distance profiles on");
+  }
+
+  // Convolutions with queries up to itemLength long only wrap around into
+  // positions that are not read
+  this->fftSize = 1;
+  while (this->fftSize < this->itemLength) {
+    this->fftSize <<= 1;
+  }
+
+  int n = this->itemLength;
+  int N = this->fftSize;
+  this->roots = _roots(N);
+  this->squareSums.resize(this->itemCount * (n + 1));
+  for (int r = 0; r < this->itemCount; r++)
+  {
+    TimeSeries ts = dataset.getTimeSeries(r);
+    double* sums = this->squareSums.data() + r * (n + 1);
+    sums[0] = 0;
+    for (int i = 0; i < n; i++) {
+      sums[i + 1] = sums[i] + (double)ts[i] * ts[i];
+    }
+    this->maxEnergy = std::max(this->maxEnergy, sums[n]);
+  }
+
+  // Two real series a and b are transformed at once as a + ib, then separated
+  // using the conjugate symmetry of the spectrum of a real signal
+  this->spectra.resize((size_t)this->itemCount * N);
+  std::vector<complex_t> packed(N);
+  for (int r = 0; r < this->itemCount; r += 2)
+  {
+    bool pair = r + 1 < this->itemCount;
+    TimeSeries a = dataset.getTimeSeries(r);
+    std::fill(packed.begin(), packed.end(), complex_t(0, 0));
+    for (int i = 0; i < n; i++) {
+      packed[i] = complex_t(a[i], 0);
+    }
+    if (pair)
+    {
+      TimeSeries b = dataset.getTimeSeries(r + 1);
+      for (int i = 0; i < n; i++) {
+        packed[i].imag(b[i]);
+      }
+    }
+    _fft(packed.data(), N, this->roots.data(), false);
+
+    complex_t* specA = this->spectra.data() + (size_t)r * N;
+    for (int k = 0; k < N; k++)
+    {
+      complex_t z = packed[k];
+      complex_t zc = std::conj(packed[(N - k) % N]);
+      specA[k] = (z + zc) * 0.5;
+      if (pair) {
+        specA[N + k] = (z - zc) * complex_t(0, -0.5);
+      }
+    }
+  }
+}
+
+double DistanceProfile::_transformQuery(const TimeSeries& query, std::vector<complex_t>& spectrum) const
+{
+  int m = query.getLength();
+  if (m < 1 || m > this->itemLength) {
+    throw KOnexException("Length of query must be between 1 and " + std::to_string(this->itemLength));
+  }
+
+  spectrum.assign(this->fftSize, complex_t(0, 0));
+  double queryEnergy = 0;
+  for (int j = 0; j < m; j++)
+  {
+    spectrum[j] = complex_t(query[m - 1 - j], 0);
+    queryEnergy += (double)query[j] * query[j];
+  }
+  _fft(spectrum.data(), this->fftSize, this->roots.data(), false);
+  return queryEnergy;
+}
+
+double DistanceProfile::_errorBound(int length, double queryEnergy) const
+{
+  // Rounding of the FFT grows with log N and of the running sums with n, both
+  // relative to the energies involved. Exact distances are computed in data_t.
+  double eps = std::max((double)std::numeric_limits<data_t>::epsilon(),
+                        std::numeric_limits<double>::epsilon());
+  int logN = 0;
+  while ((1 << logN) < this->fftSize) {
+    logN++;
+  }
+  return 8 * eps * (this->itemLength + length + logN) * (queryEnergy + this->maxEnergy);
+}
+
+double DistanceProfile::compute(const TimeSeries& query, double* dest) const
+{
+  int m = query.getLength();
+  int n = this->itemLength;
+  int N = this->fftSize;
+  std::vector<complex_t> reversed;
+  double queryEnergy = this->_transformQuery(query, reversed);
+
+  // The products of two series with the spectrum of the query are packed as
+  // P_a + i P_b, whose inverse has the two real convolutions as its real and
+  // imaginary parts
+  int profileLength = this->getProfileLength(m);
+  std::vector<complex_t> packed(N);
+  for (int r = 0; r < this->itemCount; r += 2)
+  {
+    bool pair = r + 1 < this->itemCount;
+    const complex_t* specA = this->spectra.data() + (size_t)r * N;
+    for (int k = 0; k < N; k++)
+    {
+      complex_t p = specA[k];
+      if (pair) {
+        p += complex_t(0, 1) * specA[N + k];
+      }
+      packed[k] = p * reversed[k];
+    }
+    _fft(packed.data(), N, this->roots.data(), true);
+
+    for (int s = 0; s < (pair ? 2 : 1); s++)
+    {
+      const double* sums = this->squareSums.data() + (r + s) * (n + 1);
+      double* row = dest + (size_t)(r + s) * profileLength;
+      for (int i = 0; i < profileLength; i++)
+      {
+        double dot = (s == 0 ? packed[i + m - 1].real() : packed[i + m - 1].imag()) / N;
+        double d = queryEnergy + (sums[i + m] - sums[i]) - 2 * dot;
+        row[i] = std::max(0.0, d);
+      }
+    }
+  }
+  return this->_errorBound(m, queryEnergy);
+}
+
+double DistanceProfile::compute(const TimeSeries& query, int index, double* dest) const
+{
+  int m = query.getLength();
+  int n = this->itemLength;
+  int N = this->fftSize;
+  if (index < 0 || index >= this->itemCount) {
+    throw KOnexException("Index of time series is out of range");
+  }
+  std::vector<complex_t> product;
+  double queryEnergy = this->_transformQuery(query, product);
+
+  const complex_t* spectrum = this->spectra.data() + (size_t)index * N;
+  for (int k = 0; k < N; k++) {
+    product[k] *= spectrum[k];
+  }
+  _fft(product.data(), N, this->roots.data(), true);
+
+  const double* sums = this->squareSums.data() + index * (n + 1);
+  for (int i = 0; i < this->getProfileLength(m); i++)
+  {
+    double d = queryEnergy + (sums[i + m] - sums[i]) - 2 * product[i + m - 1].real() / N;
+    dest[i] = std::max(0.0, d);
+  }
+  return this->_errorBound(m, queryEnergy);
+}
+
+} // namespace konex
@@ -0,0 +1,107 @@
+#ifndef DISTANCE_PROFILE_H
+#define DISTANCE_PROFILE_H
+
+#include <complex>
+#include <vector>
+
+#include "TimeSeries.hpp"
+
+// Grouping scores new centroids with distance profiles from this length on.
+// Below it, comparing each sub-sequence with every centroid directly is cheaper
+// than the FFTs.
+#define DISTANCE_PROFILE_MIN_LENGTH 32
+
+namespace konex {
+
+class TimeSeriesSet;
+
+/**
+ *  @brief Euclidean distance profiles of queries against a whole dataset (MASS)
+ *
+ *  The squared Euclidean distance between a query q of length m and the
+ *  sub-sequence of a time series t starting at i is
+ *
+ *    sum(q^2) + sum(t[i..i+m)^2) - 2 * sum(q[j] * t[i + j])
+ *
+ *  The last term, for every i at once, is the convolution of t with the
+ *  reversed query. It is computed with an FFT in O(n log n) per time series
+ *  instead of O(n m), and the window sums come from running sums of squares.
+ *
+ *  The spectra of all time series of the dataset are computed once, when the
+ *  profile is constructed, and shared by every query of any length. Each
+ *  query costs one FFT plus one inverse FFT per pair of time series, as two
+ *  real convolutions are packed in one complex transform. Once constructed, a
+ *  DistanceProfile is read-only and can be shared by threads. It must be
+ *  rebuilt if the data of the dataset changes.
+ *
+ *  The values carry the rounding error of the FFT. compute returns a bound of
+ *  that error so that callers can refine the candidates near a decision with
+ *  the exact distance.
+ */
+class DistanceProfile
+{
+public:
+
+  /**
+   *  @brief computes the spectra of all time series of a dataset
+   */
+  explicit DistanceProfile(const TimeSeriesSet& dataset);
+
+  int getFFTSize() const { return this->fftSize; }
+
+  /**
+   *  @brief gets the number of sub-sequences of a time series that a query of a
+   *         given length is compared with
+   */
+  int getProfileLength(int length) const { return this->itemLength - length + 1; }
+
+  /**
+   *  @brief computes the squared, unnormalized Euclidean distances between a
+   *         query and every sub-sequence of its length in the dataset
+   *
+   *  @param query the query, not longer than the time series of the dataset
+   *  @param dest array of getItemCount() rows of getProfileLength(length)
+   *         values. Value i of row r is the distance to the sub-sequence of
+   *         time series r starting at i.
+   *  @return a bound of the absolute error of every value
+   *
+   *  @throw KOnexException if the query is empty or too long
+   */
+  double compute(const TimeSeries& query, double* dest) const;
+
+  /**
+   *  @brief same as compute but against the sub-sequences of one time series
+   *
+   *  @param index index of the time series
+   *  @param dest array of getProfileLength(length) values
+   */
+  double compute(const TimeSeries& query, int index, double* dest) const;
+
+  /**
+   *  @brief in-place radix-2 FFT
+   *
+   *  @param a array of n values
+   *  @param n a power of two
+   *  @param inverse computes the unscaled inverse transform if true
+   */
+  static void fft(std::complex<double>* a, int n, bool inverse);
+
+private:
+  int itemCount;
+  int itemLength;
+  int fftSize;
+  // fftSize / 2 roots of unity
+  std::vector<std::complex<double>> roots;
+  // fftSize values per time series
+  std::vector<std::complex<double>> spectra;
+  // itemLength + 1 values per time series
+  std::vector<double> squareSums;
+  double maxEnergy;
+
+  double _transformQuery(const TimeSeries& query, std::vector<std::complex<double>>& spectrum) const;
+  double _errorBound(int length, double queryEnergy) const;
+};
+
+} // namespace konex
+
+#endif // DISTANCE_PROFILE_H
@@ -0,0 +1,79 @@
+#include "distance/PAAPyramid.hpp"
+
+#include <algorithm>
+
+namespace konex {
+
+PAAPyramid::PAAPyramid(const TimeSeries& series, int warpingBand)
+  : length(series.getLength()), warpingBand(warpingBand)
+{
+  std::vector<data_t> lower(this->length), upper(this->length);
+  series.computeKeoghEnvelope(warpingBand, lower.data(), upper.data());
+
+  // Each level merges pairs of blocks of the level below it
+  for (int blockSize = 2; blockSize <= this->length; blockSize *= 2)
+  {
+    const std::vector<data_t>& belowLower = this->levels.empty() ? lower : this->levels.back().lower;
+    const std::vector<data_t>& belowUpper = this->levels.empty() ? upper : this->levels.back().upper;
+
+    level_t level;
+    level.blockSize = blockSize;
+    int blocks = (this->length - 1) / blockSize + 1;
+    level.lower.resize(blocks);
+    level.upper.resize(blocks);
+    for (int j = 0; j < blocks; j++)
+    {
+      level.lower[j] = belowLower[2 * j];
+      level.upper[j] = belowUpper[2 * j];
+      if (2 * j + 1 < belowLower.size())
+      {
+        level.lower[j] = std::min(level.lower[j], belowLower[2 * j + 1]);
+        level.upper[j] = std::max(level.upper[j], belowUpper[2 * j + 1]);
+      }
+    }
+    this->levels.push_back(std::move(level));
+  }
+}
+
+acc_t PAAPyramid::lowerBound(const TimeSeries& other, acc_t bound) const
+{
+  const double* sums = other.getSharedPrefixSums();
+  if (sums == nullptr) {
+    return 0;
+  }
+  int len = std::min(this->length, other.getLength());
+
+  acc_t best = 0;
+  for (int l = this->levels.size() - 1; l >= 0; l--)
+  {
+    const level_t& level = this->levels[l];
+    int w = level.blockSize;
+    int blocks = len / w;
+    if (w < PAA_PYRAMID_MIN_BLOCK_SIZE) {
+      break;
+    }
+    if (blocks < PAA_PYRAMID_MIN_BLOCKS) {
+      continue;
+    }
+
+    // Only blocks that are full in both series are bounded
+    acc_t lb = 0;
+    for (int j = 0; j < blocks && lb < bound; j++)
+    {
+      acc_t mean = (sums[(j + 1) * w] - sums[j * w]) / w;
+      if (mean > level.upper[j]) {
+        lb += w * (mean - level.upper[j]) * (mean - level.upper[j]);
+      }
+      else if (mean < level.lower[j]) {
+        lb += w * (mean - level.lower[j]) * (mean - level.lower[j]);
+      }
+    }
+    best = std::max(best, lb);
+    if (best >= bound) {
+      break;
+    }
+  }
+  return best;
+}
+
+} // namespace konex
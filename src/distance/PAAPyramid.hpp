@@ -0,0 +1,79 @@
+#ifndef PAA_PYRAMID_H
+#define PAA_PYRAMID_H
+
+#include <vector>
+
+#include "TimeSeries.hpp"
+
+// Levels with larger blocks are kept as long as they hold this many blocks
+#define PAA_PYRAMID_MIN_BLOCKS 4
+// Levels with smaller blocks cost about as much as LB_Keogh itself
+#define PAA_PYRAMID_MIN_BLOCK_SIZE 4
+
+namespace konex {
+
+/**
+ *  @brief a multi-resolution summary of the Keogh envelope of a query
+ *
+ *  Level l of the pyramid holds, for blocks of 2^(l+1) points, the maximum of
+ *  the upper envelope and the minimum of the lower envelope of the query over
+ *  each block. For any time series c compared with the query, the sum over
+ *  the blocks of
+ *
+ *    w * (mean of c over the block - nearest value of [lower, upper])^2
+ *
+ *  never exceeds LB_Keogh, since the squared distance to an interval is
+ *  convex and the block interval contains the envelope of each point. This
+ *  gives a lower bound of the DTW (LB_PAA) that only needs the block means of
+ *  c, which are read in constant time from the prefix sums of the dataset.
+ *
+ *  The levels are visited from the coarsest to the finest, so candidates far
+ *  from the query are rejected after reading a handful of blocks.
+ */
+class PAAPyramid
+{
+public:
+
+  /**
+   *  @brief builds the pyramid of the envelope of a time series
+   *
+   *  @param series the time series, usually a query
+   *  @param warpingBand size of the Sakoe-Chiba warping band of the envelope
+   */
+  PAAPyramid(const TimeSeries& series, int warpingBand);
+
+  int getWarpingBand() const { return this->warpingBand; }
+  int getLevelCount() const { return this->levels.size(); }
+  int getBlockSize(int level) const { return this->levels[level].blockSize; }
+
+  /**
+   *  @brief computes LB_PAA against a time series backed by a PAA cache
+   *
+   *  Only the first min(length of the pyramid, length of other) points of
+   *  other are bounded, as in LB_Keogh.
+   *
+   *  @param other the other time series
+   *  @param bound the bound is abandoned once it reaches this squared,
+   *         unnormalized value
+   *  @return the squared, unnormalized lower bound. Returns 0 if the other
+   *          time series has no prefix sums.
+   */
+  acc_t lowerBound(const TimeSeries& other, acc_t bound) const;
+
+private:
+
+  struct level_t
+  {
+    int blockSize;
+    std::vector<data_t> lower;
+    std::vector<data_t> upper;
+  };
+
+  int length;
+  int warpingBand;
+  std::vector<level_t> levels;
+};
+
+} // namespace konex
+
+#endif // PAA_PYRAMID_H
@@ -0,0 +1,98 @@
+#include "distance/QueryContext.hpp"
+#include "Exception.hpp"
+
+namespace konex {
+
+QueryContext::QueryContext()
+  : warpingBandRatio(konex::getWarpingBandRatio()), distance(cascadeDistance), dropout(INF),
+    numThreads(1), PAABlock(0) {}
+
+QueryContext::QueryContext(double warpingBandRatio, query_dist_t distance, data_t dropout)
+  : distance(distance), dropout(dropout), numThreads(1), PAABlock(0)
+{
+  this->setWarpingBandRatio(warpingBandRatio);
+}
+
+QueryContext::QueryContext(const QueryContext& other)
+  : warpingBandRatio(other.warpingBandRatio), distance(other.distance), dropout(other.dropout),
+    numThreads(other.numThreads), PAABlock(other.PAABlock) {}
+
+QueryContext& QueryContext::operator=(const QueryContext& other)
+{
+  // Scratch buffers and the bound query are not shared between contexts
+  this->warpingBandRatio = other.warpingBandRatio;
+  this->distance = other.distance;
+  this->dropout = other.dropout;
+  this->numThreads = other.numThreads;
+  this->PAABlock = other.PAABlock;
+  return *this;
+}
+
+void QueryContext::setWarpingBandRatio(double ratio)
+{
+  if (ratio < 0 || ratio > 1) {
+    throw KOnexException("Warping band ratio must be between 0 and 1");
+  }
+  this->warpingBandRatio = ratio;
+}
+
+void QueryContext::setNumThreads(int numThreads)
+{
+  if (numThreads <= 0) {
+    throw KOnexException("Number of threads must be positive");
+  }
+  this->numThreads = numThreads;
+}
+
+void QueryContext::bindQuery(const TimeSeries* query)
+{
+  this->boundQuery = query;
+  this->queryPyramids.clear();
+  this->queryZNormValid = false;
+}
+
+const PAAPyramid* QueryContext::getQueryPyramid(const TimeSeries& series, int warpingBand)
+{
+  if (&series != this->boundQuery) {
+    return nullptr;
+  }
+  for (auto i = 0; i < this->queryPyramids.size(); i++)
+  {
+    if (this->queryPyramids[i].getWarpingBand() == warpingBand) {
+      return &this->queryPyramids[i];
+    }
+  }
+  this->queryPyramids.push_back(PAAPyramid(series, warpingBand));
+  return &this->queryPyramids.back();
+}
+
+znorm_t QueryContext::getZNorm(const TimeSeries& series)
+{
+  if (&series != this->boundQuery) {
+    return series.getZNorm();
+  }
+  if (!this->queryZNormValid)
+  {
+    this->queryZNorm = series.getZNorm();
+    this->queryZNormValid = true;
+  }
+  return this->queryZNorm;
+}
+
+acc_t* QueryContext::getRowBuffer(int n)
+{
+  if (this->rowBuffer.size() < 2 * n) {
+    this->rowBuffer.resize(2 * n);
+  }
+  return this->rowBuffer.data();
+}
+
+data_t* QueryContext::getEnvelopeBuffer(int n)
+{
+  if (this->envelopeBuffer.size() < 2 * n) {
+    this->envelopeBuffer.resize(2 * n);
+  }
+  return this->envelopeBuffer.data();
+}
+
+} // namespace konex
@@ -0,0 +1,183 @@
+#ifndef QUERY_CONTEXT_H
+#define QUERY_CONTEXT_H
+
+#include <deque>
+#include <vector>
+
+#include "TimeSeries.hpp"
+#include "distance/Distance.hpp"
+#include "distance/PAAPyramid.hpp"
+
+namespace konex {
+
+/**
+ *  @brief settings and scratch memory of a single query
+ *
+ *  A QueryContext carries everything a search needs besides the query itself:
+ *  the ratio of the Sakoe-Chiba warping band, the distance used to compare the
+ *  query with centroids and members, the initial dropout, the number of
+ *  threads an exhaustive search may use and the PAA block size used to filter
+ *  candidates before comparing them on the raw data. It also owns the
+ *  scratch buffers used by the distance kernels so that repeated distance
+ *  computations do not allocate.
+ *
+ *  Queries with different settings can run concurrently as long as each thread
+ *  uses its own QueryContext. A context can be reused for consecutive queries
+ *  of the same thread.
+ *
+ *  Example:
+ *    QueryContext ctx(0.2);
+ *    candidate_t best = dataset.getBestMatch(query, ctx);
+ */
+class QueryContext
+{
+public:
+
+  /**
+   *  @brief constructs a context with the process-wide default warping band ratio
+   *         and the cascade distance
+   */
+  QueryContext();
+
+  /**
+   *  @brief constructor for QueryContext
+   *
+   *  @param warpingBandRatio ratio of the warping band size to the length of the
+   *         longer time series
+   *  @param distance distance between the query and the candidates
+   *  @param dropout candidates further than this are discarded
+   */
+  explicit QueryContext(double warpingBandRatio,
+                        query_dist_t distance = cascadeDistance,
+                        data_t dropout = INF);
+
+  QueryContext(const QueryContext& other);
+  QueryContext& operator=(const QueryContext& other);
+
+  double getWarpingBandRatio() const { return this->warpingBandRatio; }
+  void setWarpingBandRatio(double ratio);
+
+  /**
+   *  @brief gets the warping band size for time series of a given length
+   */
+  int getWarpingBandSize(int length) const
+  {
+    return calculateWarpingBandSize(length, this->warpingBandRatio);
+  }
+
+  query_dist_t getDistance() const { return this->distance; }
+  void setDistance(query_dist_t distance) { this->distance = distance; }
+
+  /**
+   *  @brief sets the distance by name, see getQueryDistance
+   *
+   *  @throw KOnexException if no distance with given name is found
+   */
+  void setDistance(const std::string& distanceName) { this->distance = getQueryDistance(distanceName); }
+
+  data_t getDropout() const { return this->dropout; }
+  void setDropout(data_t dropout) { this->dropout = dropout; }
+
+  int getNumThreads() const { return this->numThreads; }
+  void setNumThreads(int numThreads);
+
+  /**
+   *  @brief sets the PAA block size of the search
+   *
+   *  If positive, searches select their candidates on the piecewise aggregate
+   *  approximations of this block size and compute the distances of the
+   *  selected candidates on the raw data. Set to 0 or negative to disable.
+   */
+  void setPAABlock(int PAABlock) { this->PAABlock = PAABlock; }
+  int getPAABlock() const { return this->PAABlock; }
+
+  /**
+   *  @brief computes the distance of this context between two time series
+   */
+  data_t distanceBetween(const TimeSeries& a, const TimeSeries& b, data_t dropout)
+  {
+    return this->distance(a, b, dropout, *this);
+  }
+
+  /**
+   *  @brief marks a time series as the query being searched
+   *
+   *  While a query is bound, the distances of this context can keep summaries
+   *  of it across calls, such as its PAA pyramid. Searches bind their query
+   *  for their duration with a ScopedQuery. The query must outlive the binding.
+   *
+   *  @param query the query, or nullptr to unbind
+   */
+  void bindQuery(const TimeSeries* query);
+  const TimeSeries* getBoundQuery() const { return this->boundQuery; }
+
+  /**
+   *  @brief gets the PAA pyramid of the bound query
+   *
+   *  @param series a time series compared by a distance
+   *  @param warpingBand size of the warping band of the comparison
+   *  @return the pyramid, built on first use, if series is the bound query.
+   *          Otherwise nullptr.
+   */
+  const PAAPyramid* getQueryPyramid(const TimeSeries& series, int warpingBand);
+
+  /**
+   *  @brief gets the mean and the standard deviation of a time series, see
+   *         TimeSeries::getZNorm
+   *
+   *  Those of the bound query are computed once per query.
+   */
+  znorm_t getZNorm(const TimeSeries& series);
+
+  /**
+   *  @brief gets a scratch buffer holding two rows of a cost matrix
+   *
+   *  @param n number of columns of the matrix
+   *  @return an array of at least 2 * n values
+   */
+  acc_t* getRowBuffer(int n);
+
+  /**
+   *  @brief gets a scratch buffer holding a lower and an upper envelope
+   *
+   *  @param n length of the envelopes
+   *  @return an array of at least 2 * n values
+   */
+  data_t* getEnvelopeBuffer(int n);
+
+private:
+  double warpingBandRatio;
+  query_dist_t distance;
+  data_t dropout;
+  int numThreads;
+  int PAABlock;
+
+  std::vector<acc_t> rowBuffer;
+  std::vector<data_t> envelopeBuffer;
+
+  const TimeSeries* boundQuery = nullptr;
+  // a deque, so that the pyramids handed out stay put when another is added
+  std::deque<PAAPyramid> queryPyramids;
+  bool queryZNormValid = false;
+  znorm_t queryZNorm;
+};
+
+/**
+ *  @brief binds a query to a context for the lifetime of this object
+ */
+class ScopedQuery
+{
+public:
+  ScopedQuery(QueryContext& ctx, const TimeSeries& query) : ctx(ctx) { ctx.bindQuery(&query); }
+  ~ScopedQuery() { this->ctx.bindQuery(nullptr); }
+
+  ScopedQuery(const ScopedQuery&) = delete;
+  ScopedQuery& operator=(const ScopedQuery&) = delete;
+
+private:
+  QueryContext& ctx;
+};
+
+} // namespace konex
+
+#endif // QUERY_CONTEXT_H
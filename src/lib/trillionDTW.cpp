@@ -9,7 +9,7 @@
 
 #define min(x,y) ((x)<(y)?(x):(y))
 #define max(x,y) ((x)>(y)?(x):(y))
-#define dist(x,y) ((x-y)*(x-y))
+#define dist(x,y) (((acc_t)(x)-(y))*((acc_t)(x)-(y)))
 
 using namespace konex;
 
@@ -68,31 +68,31 @@ void lower_upper_lemire(data_t *t, int len, int r, data_t *l, data_t *u)
 /// However, because of z-normalization the top and bottom cannot give siginifant benefits.
 /// And using the first and last points can be computed in constant time.
 /// The prunning power of LB_Kim is non-trivial, especially when the query is not long, say in length 128.
-data_t lb_kim_hierarchy(data_t *t, data_t *q, int j, int len, data_t mean, data_t std, data_t bsf)
+acc_t lb_kim_hierarchy(data_t *t, data_t *q, int j, int len, double mean, double std, acc_t bsf)
 {
     /// 1 point at front and back
-    data_t d, lb;
-    data_t x0 = (t[j] - mean) / std;
-    data_t y0 = (t[(len-1+j)] - mean) / std;
+    acc_t d, lb;
+    acc_t x0 = (t[j] - mean) / std;
+    acc_t y0 = (t[(len-1+j)] - mean) / std;
     lb = dist(x0,q[0]) + dist(y0,q[len-1]);
     if (lb >= bsf)   return lb;
 
     /// 2 points at front
-    data_t x1 = (t[(j+1)] - mean) / std;
+    acc_t x1 = (t[(j+1)] - mean) / std;
     d = min(dist(x1,q[0]), dist(x0,q[1]));
     d = min(d, dist(x1,q[1]));
     lb += d;
     if (lb >= bsf)   return lb;
 
     /// 2 points at back
-    data_t y1 = (t[(len-2+j)] - mean) / std;
+    acc_t y1 = (t[(len-2+j)] - mean) / std;
     d = min(dist(y1,q[len-1]), dist(y0, q[len-2]) );
     d = min(d, dist(y1,q[len-2]));
     lb += d;
     if (lb >= bsf)   return lb;
 
     /// 3 points at front
-    data_t x2 = (t[(j+2)] - mean) / std;
+    acc_t x2 = (t[(j+2)] - mean) / std;
     d = min(dist(x0,q[2]), dist(x1, q[2]));
     d = min(d, dist(x2,q[2]));
     d = min(d, dist(x2,q[1]));
@@ -101,7 +101,7 @@ data_t lb_kim_hierarchy(data_t *t, data_t *q, int j, int len, data_t mean, data_
     if (lb >= bsf)   return lb;
 
     /// 3 points at back
-    data_t y2 = (t[(len-3+j)] - mean) / std;
+    acc_t y2 = (t[(len-3+j)] - mean) / std;
     d = min(dist(y0,q[len-3]), dist(y1, q[len-3]));
     d = min(d, dist(y2,q[len-3]));
     d = min(d, dist(y2,q[len-2]));
@@ -120,10 +120,10 @@ data_t lb_kim_hierarchy(data_t *t, data_t *q, int j, int len, data_t mean, data_
 /// t     : a circular array keeping the current data.
 /// j     : index of the starting location in t
 /// cb    : (output) current bound at each position. It will be used later for early abandoning in DTW.
-data_t lb_keogh_cumulative(int* order, data_t *t, data_t *uo, data_t *lo, data_t *cb, int j, int len, data_t mean, data_t std, data_t best_so_far)
+acc_t lb_keogh_cumulative(int* order, data_t *t, data_t *uo, data_t *lo, acc_t *cb, int j, int len, double mean, double std, acc_t best_so_far)
 {
-    data_t lb = 0;
-    data_t x, d;
+    acc_t lb = 0;
+    acc_t x, d;
 
     for (int i = 0; i < len && lb < best_so_far; i++)
     {
@@ -147,10 +147,10 @@ data_t lb_keogh_cumulative(int* order, data_t *t, data_t *uo, data_t *lo, data_t
 /// qo: sorted query
 /// cb: (output) current bound at each position. Used later for early abandoning in DTW.
 /// l,u: lower and upper envelop of the current data
-data_t lb_keogh_data_cumulative(int* order, data_t *tz, data_t *qo, data_t *cb, data_t *l, data_t *u, int len, data_t mean, data_t std, data_t best_so_far)
+acc_t lb_keogh_data_cumulative(int* order, data_t *tz, data_t *qo, acc_t *cb, data_t *l, data_t *u, int len, double mean, double std, acc_t best_so_far)
 {
-    data_t lb = 0;
-    data_t uu,ll,d;
+    acc_t lb = 0;
+    acc_t uu,ll,d;
 
     for (int i = 0; i < len && lb < best_so_far; i++)
     {
@@ -173,20 +173,28 @@ data_t lb_keogh_data_cumulative(int* order, data_t *tz, data_t *qo, data_t *cb,
 /// A,B: data and query, respectively
 /// cb : cummulative bound used for early abandoning
 /// r  : size of Sakoe-Chiba warpping band
-data_t dtw(data_t* A, data_t* B, data_t *cb, int m, int r, data_t bsf)
+acc_t dtw(data_t* A, data_t* B, acc_t *cb, int m, int r, acc_t bsf)
+{
+    acc_t *buffer = (acc_t*)malloc(sizeof(acc_t)*2*(2*r+1));
+    acc_t final_dtw = dtw(A, B, cb, m, r, bsf, buffer);
+    free(buffer);
+    return final_dtw;
+}
+
+acc_t dtw(data_t* A, data_t* B, acc_t *cb, int m, int r, acc_t bsf, acc_t *buffer)
 {
 
-    data_t *cost;
-    data_t *cost_prev;
-    data_t *cost_tmp;
+    acc_t *cost;
+    acc_t *cost_prev;
+    acc_t *cost_tmp;
     int i,j,k;
-    data_t x,y,z,min_cost;
+    acc_t x,y,z,min_cost;
 
     /// Instead of using matrix of size O(m^2) or O(mr), we will reuse two array of size O(r).
-    cost = (data_t*)malloc(sizeof(data_t)*(2*r+1));
+    cost = buffer;
     for(k=0; k<2*r+1; k++)    cost[k]=INF_TRILLION;
 
-    cost_prev = (data_t*)malloc(sizeof(data_t)*(2*r+1));
+    cost_prev = buffer + 2*r+1;
     for(k=0; k<2*r+1; k++)    cost_prev[k]=INF_TRILLION;
 
     for (i=0; i<m; i++)
@@ -222,9 +230,7 @@ data_t dtw(data_t* A, data_t* B, data_t *cb, int m, int r, data_t bsf)
 
         /// We can abandon early if the current cummulative distace with lower bound together are larger than bsf
         if (i+r < m-1 && min_cost + cb[i+r+1] >= bsf)
-        {   free(cost);
-            free(cost_prev);
-            return min_cost + cb[i+r+1];
+        {   return min_cost + cb[i+r+1];
         }
 
         /// Move current array to previous array.
@@ -235,9 +241,7 @@ data_t dtw(data_t* A, data_t* B, data_t *cb, int m, int r, data_t bsf)
     k--;
 
     /// the DTW distance is in the last cell in the matrix of size O(m^2) or at the middle of our array.
-    data_t final_dtw = cost_prev[k];
-    free(cost);
-    free(cost_prev);
+    acc_t final_dtw = cost_prev[k];
     return final_dtw;
 }
 
@@ -246,10 +250,11 @@ int calculate(const char *dataPath, const char *queryPath, int queryLength, int
 {
     FILE *fp;            /// data file pointer
     FILE *qp;            /// query file pointer
-    data_t bsf;          /// best-so-far
+    acc_t bsf;           /// best-so-far
     data_t *t, *q;       /// data array and query array
     int *order;          ///new order of the query
-    data_t *u, *l, *qo, *uo, *lo,*tz,*cb, *cb1, *cb2,*u_d, *l_d;
+    data_t *u, *l, *qo, *uo, *lo,*tz,*u_d, *l_d;
+    acc_t *cb, *cb1, *cb2;
 
 
     data_t d;
@@ -259,7 +264,7 @@ int calculate(const char *dataPath, const char *queryPath, int queryLength, int
     long long loc = 0;
     data_t t1,t2;
     int kim = 0,keogh = 0, keogh2 = 0;
-    data_t dist=0, lb_kim=0, lb_k=0, lb_k2=0;
+    acc_t dist=0, lb_kim=0, lb_k=0, lb_k2=0;
     data_t *buffer, *u_buff, *l_buff;
     Index *Q_tmp;
 
@@ -305,15 +310,15 @@ int calculate(const char *dataPath, const char *queryPath, int queryLength, int
     if( l == NULL )
         error(1);
 
-    cb = (data_t *)malloc(sizeof(data_t)*m);
+    cb = (acc_t *)malloc(sizeof(acc_t)*m);
     if( cb == NULL )
         error(1);
 
-    cb1 = (data_t *)malloc(sizeof(data_t)*m);
+    cb1 = (acc_t *)malloc(sizeof(acc_t)*m);
     if( cb1 == NULL )
         error(1);
 
-    cb2 = (data_t *)malloc(sizeof(data_t)*m);
+    cb2 = (acc_t *)malloc(sizeof(acc_t)*m);
     if( cb2 == NULL )
         error(1);
 
@@ -25,7 +25,7 @@ void lower_upper_lemire(data_t *t, int len, int r, data_t *l, data_t *u);
 /// However, because of z-normalization the top and bottom cannot give siginifant benefits.
 /// And using the first and last points can be computed in constant time.
 /// The prunning power of LB_Kim is non-trivial, especially when the query is not long, say in length 128.
-data_t lb_kim_hierarchy(data_t *t, data_t *q, int j, int len, data_t mean, data_t std, data_t bsf = INF_TRILLION);
+acc_t lb_kim_hierarchy(data_t *t, data_t *q, int j, int len, double mean, double std, acc_t bsf = INF_TRILLION);
 
 /// LB_Keogh 1: Create Envelop for the query
 /// Note that because the query is known, envelop can be created once at the begenining.
@@ -36,7 +36,7 @@ data_t lb_kim_hierarchy(data_t *t, data_t *q, int j, int len, data_t mean, data_
 /// t     : a circular array keeping the current data.
 /// j     : index of the starting location in t
 /// cb    : (output) current bound at each position. It will be used later for early abandoning in DTW.
-data_t lb_keogh_cumulative(int* order, data_t *t, data_t *uo, data_t *lo, data_t *cb, int j, int len, data_t mean, data_t std, data_t best_so_far = INF_TRILLION);
+acc_t lb_keogh_cumulative(int* order, data_t *t, data_t *uo, data_t *lo, acc_t *cb, int j, int len, double mean, double std, acc_t best_so_far = INF_TRILLION);
 
 /// LB_Keogh 2: Create Envelop for the data
 /// Note that the envelops have been created (in main function) when each data point has been read.
@@ -46,13 +46,15 @@ data_t lb_keogh_cumulative(int* order, data_t *t, data_t *uo, data_t *lo, data_t
 /// qo: sorted query
 /// cb: (output) current bound at each position. Used later for early abandoning in DTW.
 /// l,u: lower and upper envelop of the current data
-data_t lb_keogh_data_cumulative(int* order, data_t *tz, data_t *qo, data_t *cb, data_t *l, data_t *u, int len, data_t mean, data_t std, data_t best_so_far = INF_TRILLION);
+acc_t lb_keogh_data_cumulative(int* order, data_t *tz, data_t *qo, acc_t *cb, data_t *l, data_t *u, int len, double mean, double std, acc_t best_so_far = INF_TRILLION);
 
 /// Calculate Dynamic Time Wrapping distance
 /// A,B: data and query, respectively
 /// cb : cummulative bound used for early abandoning
 /// r  : size of Sakoe-Chiba warpping band
-data_t dtw(data_t* A, data_t* B, data_t *cb, int m, int r, data_t bsf = INF_TRILLION);
+acc_t dtw(data_t* A, data_t* B, acc_t *cb, int m, int r, acc_t bsf = INF_TRILLION);
+/// Same as above, using the given buffer of 2*(2*r+1) values instead of allocating one
+acc_t dtw(data_t* A, data_t* B, acc_t *cb, int m, int r, acc_t bsf, acc_t *buffer);
 
 /// Main Calculation Function
 int calculate(const char *dataPath, const char *queryPath, int queryLength, int r=2);
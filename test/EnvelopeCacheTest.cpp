@@ -0,0 +1,116 @@
+#define BOOST_TEST_MODULE "Test EnvelopeCache class"
+
+#include <boost/test/unit_test.hpp>
+
+#include "EnvelopeCache.hpp"
+#include "TimeSeriesSet.hpp"
+#include "TimeSeries.hpp"
+#include "distance/Distance.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#define TOLERANCE 1e-9
+
+using namespace konex;
+
+struct MockDataset
+{
+  std::string test_3_10_space = "datasets/test/test_3_10_space.txt";
+} data;
+
+BOOST_AUTO_TEST_CASE( envelope_cache_values, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_10_space, 10, 0, " ");
+  EnvelopeCache& cache = tsSet.getEnvelopeCache();
+
+  // sub-sequence 12 13 14 15 16 of the third series, band 1
+  const data_t* envelope = cache.getEnvelope(2, 1, 5, 1);
+  BOOST_REQUIRE( envelope != nullptr );
+  data_t lower[] = {12, 12, 13, 14, 15};
+  data_t upper[] = {13, 14, 15, 16, 16};
+  for (int i = 0; i < 5; i++)
+  {
+    BOOST_TEST( envelope[i] == lower[i] );
+    BOOST_TEST( envelope[5 + i] == upper[i] );
+  }
+
+  // the same envelope is returned on the next lookup
+  BOOST_CHECK( cache.getEnvelope(2, 1, 5, 1) == envelope );
+
+  // views of the dataset read their envelopes from the cache
+  TimeSeries ts = tsSet.getTimeSeries(2, 1, 6);
+  BOOST_CHECK( ts.getKeoghLower(1) == envelope );
+  BOOST_CHECK( ts.getKeoghUpper(1) == envelope + 5 );
+}
+
+BOOST_AUTO_TEST_CASE( envelope_cache_precompute_and_clear )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_10_space, 10, 0, " ");
+  EnvelopeCache& cache = tsSet.getEnvelopeCache();
+
+  BOOST_CHECK_EQUAL( cache.getMemoryUsage(), 0 );
+  BOOST_CHECK( cache.precompute(4, 2) );
+  size_t usage = cache.getMemoryUsage();
+  BOOST_CHECK( usage >= 3 * 7 * 2 * 4 * sizeof(data_t) );
+
+  // computing the same length and band again does not allocate anything
+  BOOST_CHECK( cache.precompute(4, 2) );
+  BOOST_CHECK_EQUAL( cache.getMemoryUsage(), usage );
+
+  tsSet.normalize();
+  BOOST_CHECK_EQUAL( cache.getMemoryUsage(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( envelope_cache_memory_limit )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_10_space, 10, 0, " ");
+  EnvelopeCache& cache = tsSet.getEnvelopeCache();
+
+  // only the series with an envelope get slots for the others
+  BOOST_REQUIRE( cache.getEnvelope(1, 2, 5, 1) != nullptr );
+  BOOST_CHECK_EQUAL( cache.getMemoryUsage(), (3 + 6) * sizeof(void*) + 2 * 5 * sizeof(data_t) );
+
+  cache.setMemoryLimit(0);
+  BOOST_CHECK( cache.getEnvelope(0, 0, 5, 1) == nullptr );
+  BOOST_CHECK( !cache.precompute(5, 1) );
+
+  // views fall back to computing their own envelope
+  TimeSeries ts = tsSet.getTimeSeries(0, 0, 5);
+  const data_t* lower = ts.getKeoghLower(1);
+  BOOST_REQUIRE( lower != nullptr );
+  BOOST_CHECK_EQUAL( lower[0], 1 );
+  BOOST_CHECK_EQUAL( ts.getKeoghUpper(1)[4], 5 );
+}
+
+BOOST_AUTO_TEST_CASE( envelope_of_owned_series_concurrent )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_10_space, 10, 0, " ");
+  // copies own their values, and have no cache to share
+  TimeSeries a = tsSet.getTimeSeries(0).copy();
+  TimeSeries b = tsSet.getTimeSeries(2).copy();
+  data_t expected = keoghLowerBound(a, b, INF);
+
+  std::vector<data_t> results(4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < results.size(); t++)
+  {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 1000; i++) {
+        results[t] = std::max(results[t], std::abs(keoghLowerBound(a, b, INF) - expected));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (data_t diff : results) {
+    BOOST_CHECK_EQUAL( diff, 0 );
+  }
+}
@@ -0,0 +1,260 @@
+#define BOOST_TEST_MODULE "Test ExhaustiveSearch class"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <limits>
+
+#include "ExhaustiveSearch.hpp"
+#include "TimeSeriesSet.hpp"
+#include "distance/QueryContext.hpp"
+#include "Exception.hpp"
+
+#define TOLERANCE 1e-9
+
+using namespace konex;
+
+struct MockData
+{
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+  std::string italy_power_query = "datasets/test/ItalyPowerDemand_QUERY";
+  std::string test_3_10_space = "datasets/test/test_3_10_space.txt";
+} data;
+
+// Not recognized by ExhaustiveSearch, so kSimRaw falls back to a plain scan
+data_t scanCascade(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  return cascadeDistance(a, b, dropout, ctx);
+}
+
+BOOST_AUTO_TEST_CASE( exhaustive_search_same_as_scan )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 60, 0, " ");
+  TimeSeriesSet querySet;
+  querySet.loadData(data.italy_power_query, 5, 0, " ");
+
+  BOOST_CHECK( ExhaustiveSearch::supports(QueryContext(0.1)) );
+  BOOST_CHECK( !ExhaustiveSearch::supports(QueryContext(0.1, scanCascade)) );
+
+  for (double ratio : {0.0, 0.1, 0.5})
+  {
+    for (int len : {4, 10, 24})
+    {
+      TimeSeries query = querySet.getTimeSeries(len % 5, 0, len);
+      QueryContext scanCtx(ratio, scanCascade);
+      QueryContext ctx(ratio);
+      std::vector<candidate_t> expected = tsSet.kSimRaw(query, 5, scanCtx);
+      std::vector<candidate_t> results = tsSet.kSimRaw(query, 5, ctx);
+
+      BOOST_REQUIRE_EQUAL( results.size(), expected.size() );
+      for (int i = 0; i < results.size(); i++) {
+        BOOST_CHECK_EQUAL( results[i].dist, expected[i].dist );
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( exhaustive_search_reachable_lengths, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_10_space, 3, 0, " ");
+
+  // With no warping, only sub-sequences of the query length can be reached
+  QueryContext ctx(0.0);
+  ExhaustiveSearch search(tsSet, tsSet.getTimeSeries(0, 0, 9), ctx);
+  std::vector<candidate_t> results = search.kSim(100);
+  BOOST_CHECK_EQUAL( results.size(), 6 );
+  BOOST_TEST( results[0].dist == 0.0 );
+  for (int i = 0; i < results.size(); i++)
+  {
+    BOOST_CHECK_EQUAL( results[i].length, 9 );
+    if (i > 0) {
+      BOOST_CHECK( results[i - 1] < results[i] );
+    }
+  }
+
+  // Identical sub-sequences are ordered by their coordinates
+  results = search.kSim(2);
+  BOOST_CHECK_EQUAL( results[0].index, 0 );
+  BOOST_CHECK_EQUAL( results[1].index, 1 );
+  BOOST_TEST( results[1].dist == 0.0 );
+
+  ctx.setDropout(0.01);
+  results = search.kSim(100);
+  BOOST_CHECK_EQUAL( results.size(), 2 );
+}
+
+BOOST_AUTO_TEST_CASE( exhaustive_search_shared_prefix_same_as_per_length )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 60, 0, " ");
+  TimeSeriesSet querySet;
+  querySet.loadData(data.italy_power_query, 5, 0, " ");
+
+  for (double ratio : {0.0, 0.2, 1.0})
+  {
+    for (int len : {3, 12, 24})
+    {
+      TimeSeries query = querySet.getTimeSeries(2, 0, len);
+      QueryContext ctx(ratio);
+      ExhaustiveSearch perLength(tsSet, query, ctx);
+      perLength.setMode(ExhaustiveSearch::PER_LENGTH);
+      ExhaustiveSearch sharedPrefix(tsSet, query, ctx);
+      BOOST_CHECK_EQUAL( sharedPrefix.getMode(), ExhaustiveSearch::SHARED_PREFIX );
+
+      std::vector<candidate_t> expected = perLength.kSim(8);
+      std::vector<candidate_t> results = sharedPrefix.kSim(8);
+      BOOST_REQUIRE_EQUAL( results.size(), expected.size() );
+      for (int i = 0; i < results.size(); i++)
+      {
+        BOOST_CHECK_EQUAL( results[i].index, expected[i].index );
+        BOOST_CHECK_EQUAL( results[i].start, expected[i].start );
+        BOOST_CHECK_EQUAL( results[i].length, expected[i].length );
+        BOOST_CHECK_CLOSE( results[i].dist, expected[i].dist, TOLERANCE );
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( exhaustive_search_parallel_same_as_serial )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 60, 0, " ");
+  TimeSeriesSet querySet;
+  querySet.loadData(data.italy_power_query, 5, 0, " ");
+
+  for (int len : {6, 24})
+  {
+    TimeSeries query = querySet.getTimeSeries(1, 0, len);
+    QueryContext ctx(0.1);
+    std::vector<candidate_t> expected = tsSet.kSimRaw(query, 10, ctx);
+
+    for (int numThreads : {2, 3, 8})
+    {
+      ctx.setNumThreads(numThreads);
+      std::vector<candidate_t> results = tsSet.kSimRaw(query, 10, ctx);
+      BOOST_REQUIRE_EQUAL( results.size(), expected.size() );
+      for (int i = 0; i < results.size(); i++)
+      {
+        BOOST_CHECK_EQUAL( results[i].index, expected[i].index );
+        BOOST_CHECK_EQUAL( results[i].start, expected[i].start );
+        BOOST_CHECK_EQUAL( results[i].length, expected[i].length );
+        BOOST_CHECK_EQUAL( results[i].dist, expected[i].dist );
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( exhaustive_search_euclidean, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 60, 0, " ");
+  QueryContext ctx(0.1, pairwiseDistance);
+  BOOST_CHECK( ExhaustiveSearch::supports(ctx) );
+
+  for (int len : {2, 9, 24})
+  {
+    TimeSeries query = tsSet.getTimeSeries(7, 0, len);
+
+    // only sub-sequences of the length of the query are compared with it
+    std::vector<candidate_t> expected;
+    for (int idx = 0; idx < tsSet.getItemCount(); idx++)
+    {
+      for (int start = 0; start + len <= tsSet.getItemLength(); start++)
+      {
+        TimeSeries ts = tsSet.getTimeSeries(idx, start, start + len);
+        expected.push_back(candidate_t(idx, start, len, pairwiseDistance(query, ts, INF)));
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.resize(5);
+
+    std::vector<candidate_t> results = tsSet.kSimRaw(query, 5, ctx);
+    BOOST_REQUIRE_EQUAL( results.size(), 5 );
+    for (int i = 0; i < results.size(); i++)
+    {
+      BOOST_CHECK_EQUAL( results[i].index, expected[i].index );
+      BOOST_CHECK_EQUAL( results[i].start, expected[i].start );
+      BOOST_CHECK_EQUAL( results[i].length, len );
+      BOOST_CHECK_EQUAL( results[i].dist, expected[i].dist );
+    }
+  }
+
+  // nothing is closer than the dropout
+  ctx.setDropout(1e-6);
+  std::vector<candidate_t> results = tsSet.kSimRaw(tsSet.getTimeSeries(7, 1, 20), 5, ctx);
+  BOOST_REQUIRE_EQUAL( results.size(), 1 );
+  BOOST_CHECK_EQUAL( results[0].index, 7 );
+}
+
+// Not recognized by ExhaustiveSearch either
+data_t scanZNormCascade(const TimeSeries& a, const TimeSeries& b, data_t dropout, QueryContext& ctx)
+{
+  return znormCascadeDistance(a, b, dropout, ctx);
+}
+
+BOOST_AUTO_TEST_CASE( exhaustive_search_znorm, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 60, 0, " ");
+  TimeSeriesSet querySet;
+  querySet.loadData(data.italy_power_query, 5, 0, " ");
+
+  for (double ratio : {0.0, 0.1})
+  {
+    for (int len : {6, 15})
+    {
+      TimeSeries query = querySet.getTimeSeries(len % 5, 0, len);
+      QueryContext scanCtx(ratio, scanZNormCascade);
+      QueryContext ctx(ratio, znormCascadeDistance);
+      BOOST_CHECK( ExhaustiveSearch::supports(ctx) );
+      std::vector<candidate_t> expected = tsSet.kSimRaw(query, 5, scanCtx);
+      std::vector<candidate_t> results = tsSet.kSimRaw(query, 5, ctx);
+
+      BOOST_REQUIRE_EQUAL( results.size(), expected.size() );
+      for (int i = 0; i < results.size(); i++) {
+        BOOST_TEST( results[i].dist == expected[i].dist );
+      }
+    }
+  }
+
+  // a scaled and shifted copy of a sub-sequence is found at distance 0
+  TimeSeries original = tsSet.getTimeSeries(12, 3, 19);
+  TimeSeries query(original.getLength());
+  for (int i = 0; i < query.getLength(); i++) {
+    query[i] = 4 * original[i] - 2;
+  }
+  for (query_dist_t distance : {(query_dist_t)znormCascadeDistance, (query_dist_t)znormPairwiseDistance})
+  {
+    QueryContext ctx(0.1, distance);
+    std::vector<candidate_t> results = tsSet.kSimRaw(query, 3, ctx);
+    BOOST_REQUIRE_EQUAL( results.size(), 3 );
+    BOOST_CHECK_EQUAL( results[0].index, 12 );
+    BOOST_CHECK_EQUAL( results[0].start, 3 );
+    BOOST_CHECK_EQUAL( results[0].length, 16 );
+    BOOST_CHECK_SMALL( results[0].dist, 16 * std::numeric_limits<data_t>::epsilon() );
+  }
+
+  // the z-normalized Euclidean distance compares the length of the query only
+  QueryContext ctx(0.1, znormPairwiseDistance);
+  std::vector<candidate_t> results = tsSet.kSimRaw(query, 5, ctx);
+  for (const candidate_t& c : results)
+  {
+    TimeSeries ts = tsSet.getTimeSeries(c.index, c.start, c.start + c.length);
+    BOOST_CHECK_EQUAL( c.length, 16 );
+    BOOST_TEST( c.dist == znormPairwiseDistance(query, ts, INF) );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( exhaustive_search_invalid )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_10_space, 3, 0, " ");
+  QueryContext ctx(0.1);
+
+  BOOST_CHECK_THROW( ExhaustiveSearch(tsSet, tsSet.getTimeSeries(0, 0, 1), ctx), KOnexException );
+  ExhaustiveSearch search(tsSet, tsSet.getTimeSeries(0, 0, 5), ctx);
+  BOOST_CHECK_THROW( search.kSim(0), KOnexException );
+  BOOST_CHECK_THROW( ctx.setNumThreads(0), KOnexException );
+}
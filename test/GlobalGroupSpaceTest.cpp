@@ -1,6 +1,10 @@
 #define BOOST_TEST_MODULE "Test LocalLengthGroupSpace class"
 
 #include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <tuple>
+
 #include "GlobalGroupSpace.hpp"
 #include "TimeSeriesSet.hpp"
 #include "distance/Distance.hpp"
@@ -16,6 +20,9 @@ struct MockData
   data_t dat[7] = {110, 116, 118, 117, 16.5, 112, 112};
   std::string test_group_5_10_space = "datasets/test/test_group_5_10_space.txt";
   std::string test_group_5_10_different_space = "datasets/test/test_group_5_10_different_space.txt";
+  std::string test_3_10_space = "datasets/test/test_3_10_space.txt";
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+  std::string italy_power_query = "datasets/test/ItalyPowerDemand_QUERY";
 };
 
 BOOST_AUTO_TEST_CASE( local_length_group_space, *boost::unit_test::tolerance(TOLERANCE) )
@@ -30,28 +37,29 @@ BOOST_AUTO_TEST_CASE( local_length_group_space, *boost::unit_test::tolerance(TOL
 
   GlobalGroupSpace gSet(tsSet);
   gSet.group("euclidean", 0.5);
-  candidate_time_series_t best = gSet.getBestMatch(tsSet.getTimeSeries(0, 0, 10));
+  QueryContext ctx;
+  candidate_t best = gSet.getBestMatch(tsSet.getTimeSeries(0, 0, 10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,4,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,4,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,6,9));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,6,9), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,2,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,2,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,3,7));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,3,7), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,0,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,0,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,4,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,4,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,6,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,6,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,2,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,2,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,3,7));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,3,7), ctx);
   BOOST_TEST((best.dist) == 0);
   TimeSeries ts1(data.dat, 0,0,7);
-  best = gSet.getBestMatch(ts1);
+  best = gSet.getBestMatch(ts1, ctx);
   BOOST_TEST((best.dist)> 0);
 }
 
@@ -67,28 +75,29 @@ BOOST_AUTO_TEST_CASE( local_length_group_space_multi_threaded, *boost::unit_test
 
   GlobalGroupSpace gSet(tsSet);
   gSet.groupMultiThreaded("euclidean", 0.5, 4);
-  candidate_time_series_t best = gSet.getBestMatch(tsSet.getTimeSeries(0, 0, 10));
+  QueryContext ctx;
+  candidate_t best = gSet.getBestMatch(tsSet.getTimeSeries(0, 0, 10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,4,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,4,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,6,9));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,6,9), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,2,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,2,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(0,3,7));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(0,3,7), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,0,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,0,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,4,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,4,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,6,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,6,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,2,10));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,2,10), ctx);
   BOOST_TEST((best.dist) == 0);
-  best = gSet.getBestMatch(tsSet.getTimeSeries(4,3,7));
+  best = gSet.getBestMatch(tsSet.getTimeSeries(4,3,7), ctx);
   BOOST_TEST((best.dist) == 0);
   TimeSeries ts1(data.dat, 0,0,7);
-  best = gSet.getBestMatch(ts1);
+  best = gSet.getBestMatch(ts1, ctx);
   BOOST_TEST((best.dist)> 0);
 }
 
@@ -98,4 +107,222 @@ BOOST_AUTO_TEST_CASE( traverse_order )
   vector<int> order = generateTraverseOrder(3, 7);
   vector<int> expected = { 3, 2, 4, 5 };
   BOOST_CHECK_EQUAL_COLLECTIONS(order.begin(), order.end(), expected.begin(), expected.end());
-}
\ No newline at end of file
+}
+BOOST_AUTO_TEST_CASE( progressive_ksim_exact, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  TimeSeriesSet querySet;
+  querySet.loadData(data.italy_power_query, 3, 0, " ");
+
+  for (std::string distance : {"euclidean", "euclidean_dtw"})
+  {
+    GlobalGroupSpace gSet(tsSet);
+    gSet.group(distance, 0.5);
+    for (query_dist_t queryDistance : {static_cast<query_dist_t>(cascadeDistance),
+                                       static_cast<query_dist_t>(pairwiseDistance)})
+    {
+      QueryContext ctx(0.1, queryDistance);
+      TimeSeries query = querySet.getTimeSeries(1, 4, 16);
+      std::vector<candidate_t> expected = tsSet.kSimRaw(query, 5, ctx);
+
+      int snapshots = 0;
+      data_t lastKth = INF;
+      progressive_result_t progress = gSet.progressiveKSim(query, 5, ctx, query_budget_t(),
+        [&](const progressive_result_t& snapshot) {
+          // snapshots only ever improve
+          BOOST_CHECK( snapshot.results.back().dist <= lastKth );
+          lastKth = snapshot.results.size() == 5 ? snapshot.results.back().dist : INF;
+          snapshots++;
+          return true;
+        });
+
+      BOOST_CHECK( progress.exact );
+      BOOST_CHECK( snapshots > 0 );
+      BOOST_CHECK_EQUAL( progress.groupsExamined, progress.groupCount );
+      BOOST_REQUIRE_EQUAL( progress.results.size(), expected.size() );
+      for (int i = 0; i < expected.size(); i++) {
+        BOOST_TEST( progress.results[i].dist == expected[i].dist );
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( progressive_ksim_budget )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  GlobalGroupSpace gSet(tsSet);
+  gSet.group("euclidean", 0.5);
+  QueryContext ctx(0.1);
+  TimeSeries query = tsSet.getTimeSeries(3, 2, 14);
+
+  // the budget runs out while examining the members
+  progressive_result_t full = gSet.progressiveKSim(query, 3, ctx, query_budget_t());
+  progressive_result_t partial = gSet.progressiveKSim(query, 3, ctx, query_budget_t(0, full.evaluations / 2));
+  BOOST_CHECK( !partial.exact );
+  BOOST_CHECK_EQUAL( partial.evaluations, full.evaluations / 2 );
+  BOOST_CHECK( partial.groupsExamined < partial.groupCount );
+  for (int i = 0; i < partial.results.size(); i++) {
+    BOOST_CHECK( partial.results[i].dist >= full.results[i].dist );
+  }
+
+  // the callback stops the query
+  int snapshots = 0;
+  progressive_result_t stopped = gSet.progressiveKSim(query, 3, ctx, query_budget_t(),
+    [&snapshots](const progressive_result_t&) { snapshots++; return false; });
+  BOOST_CHECK( !stopped.exact );
+  BOOST_CHECK_EQUAL( snapshots, 1 );
+  BOOST_CHECK_EQUAL( stopped.results.size(), 1 );
+  BOOST_CHECK_EQUAL( stopped.groupsExamined, 0 );
+
+  BOOST_CHECK_THROW( gSet.progressiveKSim(query, 0, ctx, query_budget_t()), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( range_query, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  GlobalGroupSpace gSet(tsSet);
+  gSet.group("euclidean", 0.1);
+  TimeSeries query = tsSet.getTimeSeries(2, 5, 17);
+
+  for (query_dist_t queryDistance : {static_cast<query_dist_t>(cascadeDistance),
+                                     static_cast<query_dist_t>(pairwiseDistance)})
+  {
+    QueryContext ctx(0.1, queryDistance);
+    std::vector<int> lengths = generateTraverseOrder(12, 24, 0.1);
+    if (queryDistance == static_cast<query_dist_t>(pairwiseDistance)) {
+      lengths = {12};
+    }
+
+    for (data_t epsilon : {0.0, 0.1, 0.3})
+    {
+      std::set<std::tuple<int, int, int>> expected;
+      for (int length : lengths)
+      {
+        for (int index = 0; index < 20; index++)
+        {
+          for (int start = 0; start + length <= 24; start++)
+          {
+            if (ctx.distanceBetween(query, tsSet.getTimeSeries(index, start, start + length), INF) <= epsilon) {
+              expected.insert(std::make_tuple(index, start, length));
+            }
+          }
+        }
+      }
+
+      std::set<std::tuple<int, int, int>> found;
+      range_stats_t stats = gSet.rangeQuery(query, epsilon, ctx, [&](const candidate_t& match) {
+        BOOST_CHECK( match.dist <= epsilon );
+        TimeSeries member = tsSet.getTimeSeries(match.index, match.start, match.start + match.length);
+        BOOST_TEST( match.dist == ctx.distanceBetween(query, member, INF) );
+        found.insert(std::make_tuple(match.index, match.start, match.length));
+        return true;
+      }, true);
+
+      BOOST_CHECK( stats.complete );
+      BOOST_CHECK_EQUAL( stats.matches, found.size() );
+      BOOST_CHECK( found == expected );
+      if (queryDistance == static_cast<query_dist_t>(pairwiseDistance) && epsilon == 0.3) {
+        BOOST_CHECK( stats.groupsSkipped > 0 && stats.groupsIncluded > 0 );
+      }
+    }
+  }
+
+  // matches of groups included as a whole are given a bound of their distance
+  QueryContext ctx(0.1, pairwiseDistance);
+  int matches = 0;
+  range_stats_t stats = gSet.rangeQuery(query, 0.3, ctx, [&](const candidate_t& match) {
+    TimeSeries member = tsSet.getTimeSeries(match.index, match.start, match.start + match.length);
+    BOOST_CHECK( match.dist >= ctx.distanceBetween(query, member, INF) - TOLERANCE );
+    return ++matches < 3;
+  });
+  BOOST_CHECK( !stats.complete );
+  BOOST_CHECK_EQUAL( matches, 3 );
+  BOOST_CHECK_THROW( gSet.rangeQuery(query, -1, ctx, [](const candidate_t&) { return true; }), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( out_of_core_grouping )
+{
+  MockData data;
+  std::string path = "out_of_core_grouping.bin";
+  TimeSeriesSet inMemory;
+  inMemory.loadData(data.italy_power, 0, 0, " ");
+  BOOST_REQUIRE_EQUAL( TimeSeriesSet::convertToBinary(data.italy_power, path, 0, " "),
+                       inMemory.getItemCount() );
+
+  TimeSeriesSet mapped;
+  mapped.loadBinary(path, 0, true);
+  BOOST_REQUIRE( mapped.isMapped() );
+  BOOST_REQUIRE_EQUAL( mapped.getItemLength(), inMemory.getItemLength() );
+  BOOST_CHECK_EQUAL( mapped.getBlockRowCount(), mapped.getItemCount() );
+
+  // A mapped dataset fitting in a block is grouped as if it were in memory
+  GlobalGroupSpace expected(inMemory), actual(mapped);
+  int groupCount = expected.group("euclidean_dtw", 0.3);
+  BOOST_CHECK_EQUAL( actual.group("euclidean_dtw", 0.3), groupCount );
+
+  // In blocks of a few series, every sub-sequence still joins a group
+  mapped.setBlockSize(3 * mapped.getItemLength() * sizeof(data_t));
+  BOOST_CHECK_EQUAL( mapped.getBlockRowCount(), 3 );
+  BOOST_CHECK( actual.groupMultiThreaded("euclidean_dtw", 0.3, 2) > 0 );
+  int n = mapped.getItemLength();
+  for (int length = 2; length <= n; length++) {
+    BOOST_CHECK_EQUAL( actual.getLengthStats()[length].memberCount,
+                       mapped.getItemCount() * (n - length + 1) );
+  }
+
+  // and exact searches find the same sub-sequences
+  TimeSeries query = inMemory.getTimeSeries(1, 2, 12);
+  std::vector<candidate_t> a = inMemory.kSimRaw(query, 5);
+  std::vector<candidate_t> b = mapped.kSimRaw(query, 5);
+  BOOST_REQUIRE_EQUAL( a.size(), b.size() );
+  for (int i = 0; i < a.size(); i++)
+  {
+    BOOST_CHECK_EQUAL( a[i].index, b[i].index );
+    BOOST_CHECK_EQUAL( a[i].start, b[i].start );
+    BOOST_CHECK_EQUAL( a[i].length, b[i].length );
+    BOOST_CHECK_EQUAL( a[i].dist, b[i].dist );
+  }
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( extend_groups )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_group_5_10_different_space, 0, 0, " ");
+  GlobalGroupSpace gSet(tsSet);
+  BOOST_CHECK_THROW( gSet.extend(0, 1), KOnexException );
+  int groupCount = gSet.group("euclidean", 0.5);
+  unsigned long generation = gSet.getGeneration();
+
+  // Copies of grouped series join the groups of the originals
+  tsSet.appendData(data.test_group_5_10_different_space);
+  BOOST_CHECK_EQUAL( gSet.extend(5, 2), 0 );
+  BOOST_CHECK_GT( gSet.getGeneration(), generation );
+  int n = tsSet.getItemLength();
+  for (int length = 2; length <= n; length++) {
+    BOOST_CHECK_EQUAL( gSet.getLengthStats()[length].memberCount, 10 * (n - length + 1) );
+  }
+
+  // New series start groups of their own when they are not close enough
+  tsSet.appendData(data.test_3_10_space);
+  int newGroups = gSet.extend(10, 1);
+  BOOST_CHECK_GT( newGroups, 0 );
+  int total = 0;
+  for (int length = 2; length <= n; length++)
+  {
+    BOOST_CHECK_EQUAL( gSet.getLengthStats()[length].memberCount, 13 * (n - length + 1) );
+    total += gSet.getLengthStats()[length].groupCount;
+  }
+  BOOST_CHECK_EQUAL( total, groupCount + newGroups );
+
+  QueryContext ctx;
+  candidate_t best = gSet.getBestMatch(tsSet.getTimeSeries(12, 1, 9), ctx);
+  BOOST_CHECK_EQUAL( best.dist, 0 );
+}
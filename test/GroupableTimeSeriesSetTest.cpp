@@ -48,6 +48,6 @@ BOOST_AUTO_TEST_CASE( basic_get_best_match )
   GroupableTimeSeriesSet tsSet;
   tsSet.loadData(data.test_3_10_space, 20, 0, " ");
   tsSet.groupAllLengths("euclidean", 0.5, 1);
-  candidate_time_series_t best = tsSet.getBestMatch(tsSet.getTimeSeries(0));
+  candidate_t best = tsSet.getBestMatch(tsSet.getTimeSeries(0));
   BOOST_TEST( best.dist == 0.0 );
 }
\ No newline at end of file
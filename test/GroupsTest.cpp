@@ -77,7 +77,8 @@ BOOST_AUTO_TEST_CASE( basic_groups, *boost::unit_test::tolerance(TOLERANCE) )
 BOOST_AUTO_TEST_CASE( group_get_best_match, *boost::unit_test::tolerance(TOLERANCE) )
 {
   MockData data;
-  dist_t distance = warpedDistance;
+  QueryContext ctx;
+  ctx.setDistance(warpedDistance);
 
   int timeSeriesCount = 3;
   int timeSeriesLengths = 10;
@@ -96,6 +97,6 @@ BOOST_AUTO_TEST_CASE( group_get_best_match, *boost::unit_test::tolerance(TOLERAN
   g.addMember(0, 0);
   TimeSeries t = tsSet.getTimeSeries(1,0,memberLength);
   BOOST_TEST(t[0] == 1.0);
-  candidate_time_series_t best = g.getBestMatch(t, distance);
+  candidate_t best = g.getBestMatch(t, ctx);
   BOOST_TEST(best.dist == sqrt(1.0)/(2 * 10.0));
 }
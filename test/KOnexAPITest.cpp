@@ -293,4 +293,72 @@ BOOST_AUTO_TEST_CASE( api_kx_k_1 )
    BOOST_TEST(containsTimeSeries(best_2, expected_2.data));
    BOOST_TEST(containsTimeSeries(best_3, expected_3.data));
    BOOST_TEST(containsTimeSeries(best_4, expected_4.data));
-  }
\ No newline at end of file
+  }
+
+BOOST_AUTO_TEST_CASE( api_compress_dataset )
+{
+  KOnexAPI api;
+  api.loadDataset(data.test_10_20_space, 5, 0, " ");
+  api.groupDataset(0, 0.5, "euclidean");
+  std::vector<candidate_time_series_t> expected = api.kSim(3, 3, 0, 0, 1, 2, 12);
+
+  BOOST_CHECK_GT( api.compressDataset(0), 0 );
+  BOOST_CHECK( api.getDatasetInfo(0).isGrouped );
+
+  // Searching the groups decompresses the dataset, and the centroids follow
+  std::vector<candidate_time_series_t> best = api.kSim(3, 3, 0, 0, 1, 2, 12);
+  BOOST_REQUIRE_EQUAL( best.size(), expected.size() );
+  for (int i = 0; i < best.size(); i++)
+  {
+    BOOST_TEST( timeSeriesEqual(best[i].data, expected[i].data) );
+    BOOST_CHECK_EQUAL( best[i].dist, expected[i].dist );
+  }
+
+  api.compressDataset(0);
+  BOOST_CHECK_EQUAL( api.distanceBetween(0, 1, 0, 10, 0, 1, 0, 10, "euclidean"), 0 );
+  BOOST_CHECK_THROW( api.compressDataset(1), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( api_distance_between_datasets )
+{
+  KOnexAPI api;
+  api.loadDataset(data.test_10_20_space, 0, 0, " ");
+  api.loadDataset(data.test_15_20_comma, 0, 0, ",");
+  TimeSeriesSet first, second;
+  first.loadData(data.test_10_20_space, 0, 0, " ");
+  second.loadData(data.test_15_20_comma, 0, 0, ",");
+  const dist_t euclidean = getDistance("euclidean");
+  data_t expected = euclidean(first.getTimeSeries(2, 3, 13), second.getTimeSeries(7, 5, 15), INF);
+  BOOST_REQUIRE_GT( expected, 0 );
+
+  // Each series is read from its own dataset, compressed or not
+  BOOST_CHECK_EQUAL( api.distanceBetween(0, 2, 3, 13, 1, 7, 5, 15, "euclidean"), expected );
+  api.compressDataset(0);
+  api.compressDataset(1);
+  BOOST_CHECK_EQUAL( api.distanceBetween(0, 2, 3, 13, 1, 7, 5, 15, "euclidean"), expected );
+  BOOST_CHECK_EQUAL( api.distanceBetween(1, 7, 5, 15, 0, 2, 3, 13, "euclidean"), expected );
+
+  // Raw searches of a compressed dataset return copies of their results
+  std::vector<candidate_time_series_t> best = api.kSimRaw(1, 1, 1, 7, 5, 15);
+  BOOST_REQUIRE_EQUAL( best.size(), 1 );
+  BOOST_CHECK_EQUAL( best[0].data.getIndex(), 7 );
+  BOOST_CHECK_EQUAL( best[0].data.getStart(), 5 );
+  BOOST_CHECK_EQUAL( best[0].dist, 0 );
+  BOOST_CHECK_THROW( api.distanceBetween(0, 2, 3, 13, 2, 7, 5, 15, "euclidean"), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( api_append_dataset )
+{
+  KOnexAPI api;
+  api.loadDataset(data.test_10_20_space, 5, 0, " ");
+  api.groupDataset(0, 0.5, "euclidean");
+
+  BOOST_CHECK_EQUAL( api.appendDataset(0, data.test_10_20_space).itemCount, 15 );
+  BOOST_CHECK( api.getDatasetInfo(0).isGrouped );
+
+  // Series 12 was not in the dataset when it was grouped, and is found in the groups
+  candidate_time_series_t best = api.getBestMatch(0, 0, 12, 2, 12);
+  BOOST_CHECK_EQUAL( best.data.getIndex(), 12 );
+  BOOST_CHECK_EQUAL( best.dist, 0 );
+  BOOST_CHECK_THROW( api.appendDataset(0, data.uneven_rows), KOnexException );
+}
@@ -0,0 +1,144 @@
+#define BOOST_TEST_MODULE "Test MatrixProfile class"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+
+#include "MatrixProfile.hpp"
+#include "TimeSeriesSet.hpp"
+#include "KOnexAPI.hpp"
+#include "distance/Distance.hpp"
+#include "Exception.hpp"
+
+#define TOLERANCE 1e-9
+
+using namespace konex;
+
+struct MockData
+{
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+} data;
+
+static data_t bruteForce(const TimeSeriesSet& tsSet, MatrixProfile::join_t join, int length,
+                         int exclusionZone, int index, int start)
+{
+  TimeSeries query = tsSet.getTimeSeries(index, start, start + length);
+  data_t best = INF;
+  for (int b = 0; b < tsSet.getItemCount(); b++)
+  {
+    if ((join == MatrixProfile::WITHIN_SERIES) != (b == index)) {
+      continue;
+    }
+    for (int j = 0; j + length <= tsSet.getItemLength(); j++)
+    {
+      if (b == index && std::abs(j - start) < exclusionZone) {
+        continue;
+      }
+      best = std::min(best, pairwiseDistance(query, tsSet.getTimeSeries(b, j, j + length), INF));
+    }
+  }
+  return best;
+}
+
+BOOST_AUTO_TEST_CASE( matrix_profile_exact, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 10, 0, " ");
+
+  for (MatrixProfile::join_t join : {MatrixProfile::WITHIN_SERIES, MatrixProfile::ACROSS_SERIES})
+  {
+    MatrixProfile profile(tsSet, 6);
+    BOOST_CHECK_EQUAL( profile.getExclusionZone(), 2 );
+    profile.compute(join);
+    for (int index = 0; index < 10; index++)
+    {
+      for (int start = 0; start + 6 <= 24; start++)
+      {
+        BOOST_TEST( profile.getDistance(index, start) ==
+                    bruteForce(tsSet, join, 6, profile.getExclusionZone(), index, start) );
+
+        // the distance is the one to the recorded neighbor
+        std::pair<int, int> neighbor = profile.getNeighbor(index, start);
+        BOOST_CHECK( (join == MatrixProfile::WITHIN_SERIES) == (neighbor.first == index) );
+        TimeSeries a = tsSet.getTimeSeries(index, start, start + 6);
+        TimeSeries b = tsSet.getTimeSeries(neighbor.first, neighbor.second, neighbor.second + 6);
+        BOOST_TEST( profile.getDistance(index, start) == pairwiseDistance(a, b, INF) );
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( matrix_profile_parallel_and_anytime, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 30, 0, " ");
+  MatrixProfile serial(tsSet, 8), parallel(tsSet, 8), anytime(tsSet, 8);
+  serial.compute(MatrixProfile::ACROSS_SERIES);
+  parallel.compute(MatrixProfile::ACROSS_SERIES, 1.0, 4);
+  anytime.compute(MatrixProfile::ACROSS_SERIES, 0.05, 2);
+
+  int exact = 0;
+  for (int index = 0; index < 30; index++)
+  {
+    for (int start = 0; start + 8 <= 24; start++)
+    {
+      BOOST_CHECK_EQUAL( parallel.getDistance(index, start), serial.getDistance(index, start) );
+      BOOST_CHECK( parallel.getNeighbor(index, start) == serial.getNeighbor(index, start) );
+
+      // the anytime profile is an upper bound of the exact one
+      data_t approximate = anytime.getDistance(index, start);
+      BOOST_CHECK( approximate != INF );
+      BOOST_CHECK( approximate >= serial.getDistance(index, start) - TOLERANCE );
+      exact += std::abs(approximate - serial.getDistance(index, start)) < TOLERANCE;
+    }
+  }
+  // PreSCRIMP alone already finds most of the exact profile
+  BOOST_CHECK( exact > 30 * 17 / 2 );
+}
+
+BOOST_AUTO_TEST_CASE( matrix_profile_motifs_and_discords, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  MatrixProfile profile(tsSet, 6);
+  profile.compute(MatrixProfile::WITHIN_SERIES);
+  matrix_profile_summary_t summary = profile.summarize(3);
+
+  BOOST_REQUIRE_EQUAL( summary.motifs.size(), 3 );
+  BOOST_REQUIRE_EQUAL( summary.discords.size(), 3 );
+  for (int i = 0; i < 3; i++)
+  {
+    const motif_t& motif = summary.motifs[i];
+    BOOST_CHECK_EQUAL( motif.index, motif.neighborIndex );
+    BOOST_CHECK( std::abs(motif.start - motif.neighborStart) >= profile.getExclusionZone() );
+    BOOST_TEST( motif.dist == profile.getDistance(motif.index, motif.start) );
+    BOOST_TEST( summary.discords[i].dist ==
+                profile.getDistance(summary.discords[i].index, summary.discords[i].start) );
+  }
+  BOOST_CHECK( summary.motifs[0].dist <= summary.motifs[2].dist );
+  BOOST_CHECK( summary.discords[0].dist >= summary.discords[2].dist );
+  BOOST_CHECK( summary.motifs[2].dist <= summary.discords[2].dist );
+
+  KOnexAPI api;
+  api.loadDataset(data.italy_power, 20, 0, " ");
+  matrix_profile_summary_t fromAPI = api.findMotifs(0, 6, 3);
+  BOOST_CHECK_EQUAL( fromAPI.motifs[0].index, summary.motifs[0].index );
+  BOOST_CHECK_EQUAL( fromAPI.motifs[0].start, summary.motifs[0].start );
+  BOOST_CHECK_THROW( api.findMotifs(0, 6, 3, "everywhere"), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( matrix_profile_invalid )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 5, 0, " ");
+  BOOST_CHECK_THROW( MatrixProfile(tsSet, 1), KOnexException );
+  BOOST_CHECK_THROW( MatrixProfile(tsSet, 25), KOnexException );
+
+  MatrixProfile profile(tsSet, 10);
+  BOOST_CHECK_THROW( profile.summarize(1), KOnexException );
+  BOOST_CHECK_THROW( profile.compute(MatrixProfile::WITHIN_SERIES, 0.0), KOnexException );
+  BOOST_CHECK_THROW( profile.compute(MatrixProfile::WITHIN_SERIES, 1.5), KOnexException );
+  BOOST_CHECK_THROW( profile.compute(MatrixProfile::WITHIN_SERIES, 1.0, 0), KOnexException );
+  profile.compute(MatrixProfile::WITHIN_SERIES);
+  BOOST_CHECK_THROW( profile.summarize(0), KOnexException );
+}
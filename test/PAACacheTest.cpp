@@ -0,0 +1,150 @@
+#define BOOST_TEST_MODULE "Test PAACache class"
+
+#include <boost/test/unit_test.hpp>
+
+#include "PAACache.hpp"
+#include "GroupableTimeSeriesSet.hpp"
+#include "TimeSeriesSet.hpp"
+#include "TimeSeries.hpp"
+#include "Exception.hpp"
+
+#include <algorithm>
+#include <limits>
+
+// a few roundings of data_t apart
+#define TOLERANCE std::max(1e-9, 16 * (double)std::numeric_limits<data_t>::epsilon())
+
+using namespace konex;
+
+struct MockDataset
+{
+  std::string test_3_11_space = "datasets/test/test_3_11_space.txt";
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+} data;
+
+BOOST_AUTO_TEST_CASE( paa_cache_whole_series, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_11_space, 11, 0, " ");
+  const PAACache& cache = tsSet.getPAACache();
+
+  const double* sums = cache.getPrefixSums();
+  BOOST_TEST( sums[0] == 0.0 );
+  BOOST_TEST( sums[11] == 66.0 );
+  BOOST_TEST( sums[12 + 3] == 6.0 );
+
+  // same values as TimeSeriesSet::PAA
+  const data_t* blocks = cache.getPAA(3);
+  data_t expected[] = {2.0, 5.0, 8.0, 10.5, 12.0, 15.0, 18.0, 20.5};
+  for (int i = 0; i < 4; i++)
+  {
+    BOOST_TEST( blocks[i] == expected[i] );
+    BOOST_TEST( blocks[8 + i] == expected[4 + i] );
+  }
+  BOOST_CHECK( cache.getPAA(3) == blocks );
+
+  // the data of the dataset is untouched
+  BOOST_CHECK_EQUAL( tsSet.getItemLength(), 11 );
+  BOOST_TEST( tsSet.getTimeSeries(0)[1] == 2.0 );
+
+  BOOST_CHECK_THROW( cache.getPAA(0), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( paa_cache_sub_sequences, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_11_space, 11, 0, " ");
+  const PAACache& cache = tsSet.getPAACache();
+  data_t dest[8];
+
+  // aligned with the blocks of the series: 4 5 6 | 7 8 9
+  BOOST_CHECK_EQUAL( PAACache::getPAALength(6, 3), 2 );
+  cache.getPAA(0, 3, 6, 3, dest);
+  BOOST_TEST( dest[0] == 5.0 );
+  BOOST_TEST( dest[1] == 8.0 );
+  // read from the cached PAA of the series, with the same rounding as the
+  // blocks of unaligned sub-sequences
+  const double* sums = cache.getPrefixSums(0);
+  BOOST_CHECK_EQUAL( dest[1], (data_t)((sums[9] - sums[6]) / 3) );
+
+  // not aligned: 2 3 4 | 5 6 7 | 8
+  cache.getPAA(0, 1, 7, 3, dest);
+  BOOST_TEST( dest[0] == 3.0 );
+  BOOST_TEST( dest[1] == 6.0 );
+  BOOST_TEST( dest[2] == 8.0 );
+
+  // the last block of the series: 7 8 9 | 11 11
+  cache.getPAA(1, 6, 5, 3, dest);
+  BOOST_TEST( dest[0] == 8.0 );
+  BOOST_TEST( dest[1] == 11.0 );
+
+  TimeSeries ts = tsSet.getTimeSeries(2, 2, 9);
+  PAACache::computePAA(ts, 3, dest);
+  cache.getPAA(2, 2, 7, 3, dest + 3);
+  for (int i = 0; i < 3; i++) {
+    BOOST_TEST( dest[i] == dest[3 + i] );
+  }
+
+  // the cache follows changes of the data
+  tsSet.normalize();
+  cache.getPAA(0, 0, 3, 3, dest);
+  BOOST_TEST( dest[0] == 0.05 );
+}
+
+BOOST_AUTO_TEST_CASE( paa_filter_and_refine, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  GroupableTimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 30, 0, " ");
+  tsSet.normalize();
+  tsSet.groupAllLengths("euclidean", 0.2, 1);
+  TimeSeries query = tsSet.getTimeSeries(3, 2, 14);
+
+  QueryContext ctx(0.1);
+  ctx.setPAABlock(3);
+
+  // candidates are selected on the PAA but their distances are computed on
+  // the raw data
+  std::vector<candidate_t> raw = tsSet.kSimRaw(query, 5, ctx);
+  BOOST_REQUIRE_EQUAL( raw.size(), 5 );
+  for (int i = 0; i < raw.size(); i++)
+  {
+    TimeSeries ts = tsSet.getTimeSeries(raw[i].index, raw[i].start, raw[i].start + raw[i].length);
+    BOOST_TEST( raw[i].dist == ctx.distanceBetween(query, ts, INF) );
+  }
+  BOOST_TEST( raw[0].dist == 0.0 );
+
+  // LB_PAA never drops a candidate of the exact result
+  for (const string& distance : {"euclidean_dtw", "euclidean"})
+  {
+    for (int block : {1, 2, 3, 5})
+    {
+      QueryContext exactCtx(0.1);
+      exactCtx.setDistance(distance);
+      QueryContext paaCtx(exactCtx);
+      paaCtx.setPAABlock(block);
+      std::vector<candidate_t> expected = tsSet.kSimRaw(query, 10, exactCtx);
+      std::vector<candidate_t> filtered = tsSet.kSimRaw(query, 10, paaCtx);
+      BOOST_REQUIRE_EQUAL( filtered.size(), expected.size() );
+      for (int i = 0; i < expected.size(); i++)
+      {
+        BOOST_CHECK_EQUAL( filtered[i].index, expected[i].index );
+        BOOST_CHECK_EQUAL( filtered[i].start, expected[i].start );
+        BOOST_CHECK_EQUAL( filtered[i].length, expected[i].length );
+        BOOST_TEST( filtered[i].dist == expected[i].dist );
+      }
+    }
+  }
+
+  std::vector<candidate_t> grouped = tsSet.kSim(query, 5, 5, ctx);
+  BOOST_REQUIRE_EQUAL( grouped.size(), 5 );
+  for (int i = 0; i < grouped.size(); i++)
+  {
+    TimeSeries ts = tsSet.getTimeSeries(grouped[i].index, grouped[i].start,
+                                        grouped[i].start + grouped[i].length);
+    BOOST_TEST( grouped[i].dist == ctx.distanceBetween(query, ts, INF) );
+  }
+
+  candidate_t best = tsSet.getBestMatch(query, ctx);
+  TimeSeries ts = tsSet.getTimeSeries(best.index, best.start, best.start + best.length);
+  BOOST_TEST( best.dist == ctx.distanceBetween(query, ts, INF) );
+}
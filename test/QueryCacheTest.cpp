@@ -0,0 +1,127 @@
+#define BOOST_TEST_MODULE "Test QueryCache class"
+
+#include <boost/test/unit_test.hpp>
+
+#include "QueryCache.hpp"
+#include "KOnexAPI.hpp"
+#include "TimeSeriesSet.hpp"
+#include "distance/QueryContext.hpp"
+
+#define TOLERANCE 1e-9
+
+using namespace konex;
+
+struct MockData
+{
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+  std::string italy_power_query = "datasets/test/ItalyPowerDemand_QUERY";
+} data;
+
+BOOST_AUTO_TEST_CASE( query_cache_keys )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 5, 0, " ");
+  QueryContext ctx(0.1);
+  QueryCache cache;
+
+  query_key_t key(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 3, 0, ctx);
+  std::vector<candidate_t> results = { candidate_t(2, 4, 10, 0.5) };
+  std::vector<candidate_t> found;
+  BOOST_CHECK( !cache.find(key, found) );
+  cache.insert(key, results);
+  BOOST_REQUIRE( cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 3, 0, ctx), found) );
+  BOOST_CHECK_EQUAL( found.size(), 1 );
+  BOOST_CHECK_EQUAL( found[0].start, 4 );
+
+  // any difference of the values or the settings is another query
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(2, 0, 10), 3, 3, 0, ctx), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 9), 3, 3, 0, ctx), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_RAW_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 3, 0, ctx), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 1, tsSet.getTimeSeries(1, 0, 10), 3, 3, 0, ctx), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 4, 0, ctx), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 3, 2, ctx), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 3, 0,
+                                       QueryContext(0.2)), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 3, 0,
+                                       QueryContext(0.1, pairwiseDistance)), found) );
+  // and so is a query of the dataset once it changed
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 3, 3, 0, ctx, 1), found) );
+
+  query_cache_stats_t stats = cache.getStats();
+  BOOST_CHECK_EQUAL( stats.hits, 1 );
+  BOOST_CHECK_EQUAL( stats.misses, 10 );
+  BOOST_CHECK_EQUAL( stats.entries, 1 );
+
+  cache.invalidate(1);
+  BOOST_CHECK_EQUAL( cache.getStats().entries, 1 );
+  cache.invalidate(0);
+  BOOST_CHECK_EQUAL( cache.getStats().entries, 0 );
+  BOOST_CHECK_EQUAL( cache.getStats().bytes, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( query_cache_lru )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 5, 0, " ");
+  QueryContext ctx(0.1);
+  QueryCache cache;
+  std::vector<candidate_t> results(10, candidate_t(0, 0, 10, 1.0));
+  std::vector<candidate_t> found;
+
+  for (int i = 0; i < 3; i++) {
+    cache.insert(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(i, 0, 10), 10, 10, 0, ctx), results);
+  }
+  size_t entryBytes = cache.getStats().bytes / 3;
+
+  // the first query is used again, so the second is the least recently used
+  BOOST_CHECK( cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(0, 0, 10), 10, 10, 0, ctx), found) );
+  cache.setCapacity(entryBytes * 2);
+  query_cache_stats_t stats = cache.getStats();
+  BOOST_CHECK_EQUAL( stats.entries, 2 );
+  BOOST_CHECK_EQUAL( stats.evictions, 1 );
+  BOOST_CHECK( stats.bytes <= stats.capacity );
+  BOOST_CHECK( cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(0, 0, 10), 10, 10, 0, ctx), found) );
+  BOOST_CHECK( !cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(1, 0, 10), 10, 10, 0, ctx), found) );
+  BOOST_CHECK( cache.find(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(2, 0, 10), 10, 10, 0, ctx), found) );
+
+  // disabled
+  cache.setCapacity(0);
+  cache.insert(query_key_t(KSIM_QUERY, 0, tsSet.getTimeSeries(3, 0, 10), 10, 10, 0, ctx), results);
+  BOOST_CHECK_EQUAL( cache.getStats().entries, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( query_cache_api, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  KOnexAPI api;
+  api.loadDataset(data.italy_power, 20, 0, " ");
+  api.loadDataset(data.italy_power_query, 5, 0, " ");
+  api.groupDataset(0, 0.3, "euclidean");
+
+  std::vector<candidate_time_series_t> first = api.kSim(3, 3, 0, 1, 2, 0, 12);
+  std::vector<candidate_time_series_t> again = api.kSim(3, 3, 0, 1, 2, 0, 12);
+  BOOST_CHECK_EQUAL( api.getQueryCacheStats().hits, 1 );
+  BOOST_REQUIRE_EQUAL( first.size(), again.size() );
+  for (int i = 0; i < first.size(); i++)
+  {
+    BOOST_TEST( first[i].dist == again[i].dist );
+    BOOST_CHECK_EQUAL( first[i].data.getIndex(), again[i].data.getIndex() );
+    BOOST_CHECK_EQUAL( first[i].data.getStart(), again[i].data.getStart() );
+  }
+
+  // changing the groups or the data drops the results
+  api.groupDataset(0, 0.5, "euclidean");
+  BOOST_CHECK_EQUAL( api.getQueryCacheStats().entries, 0 );
+  api.kSim(3, 3, 0, 1, 2, 0, 12);
+  api.kSimRaw(3, 0, 1, 2, 0, 12);
+  api.getBestMatch(0, 1, 2, 0, 12);
+  BOOST_CHECK_EQUAL( api.getQueryCacheStats().entries, 3 );
+  api.normalizeDataset(1);
+  BOOST_CHECK_EQUAL( api.getQueryCacheStats().entries, 3 );
+  api.normalizeDataset(0);
+  BOOST_CHECK_EQUAL( api.getQueryCacheStats().entries, 0 );
+
+  query_cache_stats_t stats = api.getQueryCacheStats();
+  BOOST_CHECK_EQUAL( stats.hits, 1 );
+  BOOST_CHECK_EQUAL( stats.misses, 4 );
+  BOOST_TEST( stats.getHitRate() == 0.2 );
+}
@@ -0,0 +1,127 @@
+#define BOOST_TEST_MODULE "Test QueryPlanner class"
+
+#include <boost/test/unit_test.hpp>
+
+#include "QueryPlanner.hpp"
+#include "GroupableTimeSeriesSet.hpp"
+#include "Exception.hpp"
+#include "distance/QueryContext.hpp"
+
+#define TOLERANCE 1e-9
+
+using namespace konex;
+
+struct MockData
+{
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+  std::string italy_power_query = "datasets/test/ItalyPowerDemand_QUERY";
+} data;
+
+static const plan_estimate_t& findEstimate(const query_plan_t& plan, plan_strategy_t strategy)
+{
+  for (const plan_estimate_t& estimate : plan.estimates)
+  {
+    if (estimate.strategy == strategy) {
+      return estimate;
+    }
+  }
+  throw KOnexException("No estimate");
+}
+
+BOOST_AUTO_TEST_CASE( group_length_stats )
+{
+  GroupableTimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  int totalGroups = tsSet.groupAllLengths("euclidean", 0.3, 1);
+
+  const std::vector<group_length_stats_t>& stats = tsSet.getGroupSpace()->getLengthStats();
+  BOOST_REQUIRE_EQUAL( stats.size(), tsSet.getItemLength() + 1 );
+  int groupCount = 0;
+  for (int length = 2; length <= tsSet.getItemLength(); length++)
+  {
+    BOOST_CHECK_EQUAL( stats[length].memberCount, 20 * (tsSet.getItemLength() - length + 1) );
+    BOOST_CHECK( stats[length].groupCount > 0 );
+    groupCount += stats[length].groupCount;
+  }
+  BOOST_CHECK_EQUAL( groupCount, totalGroups );
+}
+
+BOOST_AUTO_TEST_CASE( planner_eligibility )
+{
+  GroupableTimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  TimeSeriesSet querySet;
+  querySet.loadData(data.italy_power_query, 3, 0, " ");
+  const TimeSeries& query = querySet.getTimeSeries(0, 0, 12);
+  QueryContext ctx(0.1);
+  QueryPlanner planner(tsSet);
+
+  BOOST_CHECK_THROW( planner.plan(query, 0, 1, true, ctx), KOnexException );
+  BOOST_CHECK_THROW( planner.plan(query, 3, 2, true, ctx), KOnexException );
+
+  // Without groups, only the scans are left
+  query_plan_t plan = planner.plan(query, 3, 3, false, ctx);
+  BOOST_CHECK_EQUAL( plan.estimates.size(), 4 );
+  BOOST_CHECK( !findEstimate(plan, GROUPED_PLAN).eligible );
+  BOOST_CHECK( !findEstimate(plan, GROUPED_EXACT_PLAN).eligible );
+  BOOST_CHECK( findEstimate(plan, EXHAUSTIVE_PLAN).eligible );
+  BOOST_CHECK( findEstimate(plan, PAA_FILTER_PLAN).eligible );
+  BOOST_CHECK( plan.getChosen().eligible );
+  BOOST_CHECK( plan.explain().find("* " + QueryPlanner::getStrategyName(plan.strategy)) != std::string::npos );
+
+  plan = planner.plan(query, 3, 3, true, ctx);
+  BOOST_CHECK_EQUAL( plan.strategy, EXHAUSTIVE_PLAN );
+  BOOST_CHECK( !findEstimate(plan, PAA_FILTER_PLAN).eligible );
+
+  // The PAA filter compares every length, which the Euclidean distance cannot
+  QueryContext euclideanCtx(0.1, pairwiseDistance);
+  tsSet.groupAllLengths("euclidean", 0.3, 1);
+  plan = planner.plan(query, 3, 3, false, euclideanCtx);
+  BOOST_CHECK( !findEstimate(plan, PAA_FILTER_PLAN).eligible );
+  BOOST_CHECK( findEstimate(plan, GROUPED_PLAN).eligible );
+  BOOST_CHECK( findEstimate(plan, GROUPED_EXACT_PLAN).eligible );
+  BOOST_CHECK( findEstimate(plan, GROUPED_EXACT_PLAN).cost < findEstimate(plan, GROUPED_PLAN).cost * 3 );
+}
+
+BOOST_AUTO_TEST_CASE( planner_exact_strategies )
+{
+  GroupableTimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  tsSet.groupAllLengths("euclidean", 0.3, 1);
+  TimeSeriesSet querySet;
+  querySet.loadData(data.italy_power_query, 3, 0, " ");
+  QueryPlanner planner(tsSet);
+  int k = 5;
+
+  for (query_dist_t distance : { static_cast<query_dist_t>(cascadeDistance),
+                                 static_cast<query_dist_t>(pairwiseDistance) })
+  {
+    QueryContext ctx(0.1, distance);
+    for (int q = 0; q < 3; q++)
+    {
+      const TimeSeries& query = querySet.getTimeSeries(q, 2, 18);
+      std::vector<candidate_t> expected = tsSet.kSimRaw(query, k, ctx);
+
+      query_plan_t plan = planner.plan(query, k, k, true, ctx);
+      BOOST_CHECK( plan.getChosen().exact );
+      for (plan_strategy_t strategy : { plan.strategy, GROUPED_EXACT_PLAN, EXHAUSTIVE_PLAN })
+      {
+        plan.strategy = strategy;
+        std::vector<candidate_t> results = planner.execute(plan, query, ctx);
+        BOOST_REQUIRE_EQUAL( results.size(), k );
+        for (int i = 0; i < k; i++) {
+          BOOST_CHECK_CLOSE( results[i].dist, expected[i].dist, TOLERANCE );
+        }
+      }
+
+      // Approximate strategies give k results no better than the exact ones
+      plan = planner.plan(query, k, 2 * k, false, ctx);
+      plan.strategy = GROUPED_PLAN;
+      std::vector<candidate_t> results = planner.execute(plan, query, ctx);
+      BOOST_REQUIRE_EQUAL( results.size(), k );
+      BOOST_CHECK( results.back().dist >= expected.back().dist - TOLERANCE );
+
+      BOOST_CHECK_THROW( planner.execute(plan, querySet.getTimeSeries(q, 2, 17), ctx), KOnexException );
+    }
+  }
+}
@@ -0,0 +1,166 @@
+#define BOOST_TEST_MODULE "Test SAXIndex class"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+#include "SAXIndex.hpp"
+#include "GroupableTimeSeriesSet.hpp"
+#include "KOnexAPI.hpp"
+#include "TimeSeriesSet.hpp"
+#include "Exception.hpp"
+
+#define TOLERANCE 1e-9
+
+using namespace konex;
+
+struct MockDataset
+{
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+} data;
+
+static std::vector<candidate_t> bruteForce(const TimeSeriesSet& tsSet, const TimeSeries& query,
+                                           const std::vector<int>& lengths, int k, QueryContext& ctx)
+{
+  std::vector<candidate_t> all;
+  for (int length : lengths)
+  {
+    for (int index = 0; index < tsSet.getItemCount(); index++)
+    {
+      for (int start = 0; start + length <= tsSet.getItemLength(); start++)
+      {
+        data_t dist = ctx.distanceBetween(query, tsSet.getTimeSeries(index, start, start + length), INF);
+        if (dist != INF) {
+          all.push_back(candidate_t(index, start, length, dist));
+        }
+      }
+    }
+  }
+  std::sort(all.begin(), all.end());
+  all.resize(std::min((int)all.size(), k));
+  return all;
+}
+
+BOOST_AUTO_TEST_CASE( sax_index_build )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+
+  SAXIndex index(tsSet, 4, 8);
+  index.build({12, 10, 12});
+  BOOST_CHECK( index.getLengths() == std::vector<int>({10, 12}) );
+  BOOST_CHECK_EQUAL( index.getEntryCount(), 20 * (24 - 10 + 1) + 20 * (24 - 12 + 1) );
+  BOOST_CHECK( index.getLeafCount() > 2 * (index.getEntryCount() / 8) / 4 );
+
+  // inserted sub-sequences land in a leaf, which is split when full
+  int leaves = index.getLeafCount();
+  for (int i = 0; i < 40; i++) {
+    index.insert(i % 20, 0, 12);
+  }
+  BOOST_CHECK_EQUAL( index.getEntryCount(), 20 * 15 + 20 * 13 + 40 );
+  BOOST_CHECK( index.getLeafCount() > leaves );
+
+  BOOST_CHECK_THROW( index.insert(0, 0, 11), KOnexException );
+  BOOST_CHECK_THROW( index.insert(0, 20, 10), KOnexException );
+  BOOST_CHECK_THROW( index.build({1}), KOnexException );
+  BOOST_CHECK_THROW( index.build({25}), KOnexException );
+  BOOST_CHECK_THROW( SAXIndex(tsSet, 0), KOnexException );
+  BOOST_CHECK_THROW( SAXIndex(tsSet, SAX_MAX_WORD_LENGTH + 1), KOnexException );
+  BOOST_CHECK_THROW( SAXIndex(tsSet, 8, 0), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( sax_index_exact_search, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 40, 0, " ");
+  std::vector<int> lengths = {12, 16, 18, 20, 24};
+  SAXIndex index(tsSet, 8, 16);
+  index.build(lengths);
+
+  for (double ratio : {0.0, 0.1, 0.3})
+  {
+    QueryContext ctx(ratio);
+    for (int qi = 0; qi < 3; qi++)
+    {
+      TimeSeries query = tsSet.getTimeSeries(qi * 7, 2, 20);
+      std::vector<candidate_t> expected = bruteForce(tsSet, query, lengths, 5, ctx);
+      std::vector<candidate_t> results = index.kSim(query, 5, ctx);
+      BOOST_REQUIRE_EQUAL( results.size(), expected.size() );
+      for (int i = 0; i < results.size(); i++)
+      {
+        BOOST_CHECK_EQUAL( results[i].index, expected[i].index );
+        BOOST_CHECK_EQUAL( results[i].start, expected[i].start );
+        BOOST_CHECK_EQUAL( results[i].length, expected[i].length );
+        BOOST_TEST( results[i].dist == expected[i].dist );
+      }
+    }
+  }
+
+  // euclidean only compares sub-sequences of the length of the query
+  QueryContext ctx(0.1, pairwiseDistance);
+  TimeSeries query = tsSet.getTimeSeries(3, 4, 20);
+  std::vector<candidate_t> expected = bruteForce(tsSet, query, {16}, 3, ctx);
+  std::vector<candidate_t> results = index.kSim(query, 3, ctx);
+  BOOST_REQUIRE_EQUAL( results.size(), 3 );
+  for (int i = 0; i < results.size(); i++)
+  {
+    BOOST_CHECK_EQUAL( results[i].length, 16 );
+    BOOST_TEST( results[i].dist == expected[i].dist );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( sax_index_approximate_search, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 40, 0, " ");
+  SAXIndex index(tsSet);
+  index.build({20});
+  QueryContext ctx(0.1);
+  TimeSeries query = tsSet.getTimeSeries(5, 0, 20);
+
+  std::vector<candidate_t> results = index.approximateKSim(query, 3, 10, ctx);
+  BOOST_REQUIRE( results.size() <= 3 );
+  BOOST_REQUIRE( !results.empty() );
+  for (int i = 0; i < results.size(); i++)
+  {
+    TimeSeries ts = tsSet.getTimeSeries(results[i].index, results[i].start, results[i].start + 20);
+    BOOST_TEST( results[i].dist == ctx.distanceBetween(query, ts, INF) );
+  }
+  // the query itself is in the first leaf visited
+  BOOST_TEST( results[0].dist == 0.0 );
+
+  BOOST_CHECK_THROW( index.approximateKSim(query, 3, 2, ctx), KOnexException );
+  BOOST_CHECK_THROW( index.kSim(query, 0, ctx), KOnexException );
+  QueryContext unsupported(0.1, keoghLowerBound);
+  BOOST_CHECK_THROW( index.kSim(query, 1, unsupported), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( sax_index_search_backend, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  GroupableTimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 20, 0, " ");
+  TimeSeries query = tsSet.getTimeSeries(2, 0, 20);
+  QueryContext ctx(0.1);
+
+  BOOST_CHECK_THROW( tsSet.setSearchBackend(SAX_BACKEND), KOnexException );
+  BOOST_CHECK_EQUAL( tsSet.buildSAXIndex({20}), 20 * 5 );
+  tsSet.setSearchBackend(SAX_BACKEND);
+  candidate_t best = tsSet.getBestMatch(query, ctx);
+  BOOST_CHECK_EQUAL( best.index, 2 );
+  BOOST_TEST( best.dist == 0.0 );
+  BOOST_CHECK_EQUAL( tsSet.kSim(query, 4, 4, ctx).size(), 4 );
+
+  tsSet.setSearchBackend(SAX_APPROXIMATE_BACKEND);
+  BOOST_CHECK( tsSet.kSim(query, 2, 5, ctx).size() <= 2 );
+
+  tsSet.clearSAXIndex();
+  BOOST_CHECK_EQUAL( tsSet.getSearchBackend(), GROUP_BACKEND );
+  BOOST_CHECK_THROW( tsSet.getBestMatch(query, ctx), KOnexException );
+
+  KOnexAPI api;
+  api.loadDataset(data.italy_power, 20, 0, " ");
+  BOOST_CHECK_EQUAL( api.buildSAXIndex(0, {18, 20}), 20 * 7 + 20 * 5 );
+  api.setSearchBackend(0, "sax");
+  BOOST_TEST( api.getBestMatch(ctx, 0, 0, 4, 0, 20).dist == 0.0 );
+  BOOST_CHECK_THROW( api.setSearchBackend(0, "btree"), KOnexException );
+}
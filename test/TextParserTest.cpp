@@ -0,0 +1,113 @@
+#define BOOST_TEST_MODULE "Test TextParser class"
+
+#include <boost/test/unit_test.hpp>
+
+#include "TextParser.hpp"
+#include "Exception.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#define TOLERANCE 1e-9
+
+using namespace konex;
+
+struct MockData
+{
+  std::string numbers[12] = { "0", "-0.5", "+3.25", "0.000123", "1e3", "2.5E-4", "-7.", ".5",
+                              "12345678901234567890", "0.1234567890123456789", "1e-300", "inf" };
+  std::string table = "a,1.5, 2\n"
+                      "b ,-3,4e1 \r\n"
+                      "c,,5,6\n";
+} data;
+
+static int parseAll(const std::string& text, const std::string& separators, int startCol, ValueBuffer& values)
+{
+  const char* p = text.data();
+  const char* end = p + text.size();
+  int lines = 0;
+  while (p < end)
+  {
+    TextParser(separators, startCol).parseLine(p, end, values);
+    lines++;
+  }
+  return lines;
+}
+
+BOOST_AUTO_TEST_CASE( parse_value_like_strtod )
+{
+  for (const std::string& number : data.numbers)
+  {
+    double value = 0;
+    const char* end = parseValue(number.data(), number.data() + number.size(), value);
+    BOOST_CHECK_EQUAL( end - number.data(), number.size() );
+    BOOST_CHECK_EQUAL( value, strtod(number.c_str(), nullptr) );
+  }
+
+  // Rounded the same as strtod, bit for bit
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<double> uniform(-1000, 1000);
+  std::uniform_int_distribution<int> precision(1, 17);
+  char text[64];
+  for (int i = 0; i < 10000; i++)
+  {
+    snprintf(text, sizeof(text), i % 2 ? "%.*f" : "%.*e", precision(generator), uniform(generator));
+    double value = 0;
+    parseValue(text, text + strlen(text), value);
+    BOOST_REQUIRE_EQUAL( value, strtod(text, nullptr) );
+  }
+
+  // The text does not need to end after the number
+  std::string text2 = "1.5e";
+  double value = 0;
+  BOOST_CHECK_EQUAL( parseValue(text2.data(), text2.data() + text2.size(), value) - text2.data(), 3 );
+  BOOST_CHECK_EQUAL( value, 1.5 );
+  text2 = "abc";
+  BOOST_CHECK( parseValue(text2.data(), text2.data() + text2.size(), value) == text2.data() );
+  text2 = "1e999";
+  BOOST_CHECK_THROW( parseValue(text2.data(), text2.data() + text2.size(), value), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( parse_lines )
+{
+  ValueBuffer values;
+  const char* p = data.table.data();
+  const char* end = p + data.table.size();
+  TextParser parser(",", 1);
+  BOOST_CHECK_EQUAL( parser.parseLine(p, end, values), 3 );
+  BOOST_CHECK_EQUAL( parser.parseLine(p, end, values), 3 );
+  // Empty values are skipped like the separators around them
+  BOOST_CHECK_EQUAL( parser.parseLine(p, end, values), 3 );
+  BOOST_CHECK( p == end );
+
+  double expected[] = { 1.5, 2, -3, 40, 5, 6 };
+  BOOST_REQUIRE_EQUAL( values.getSize(), 6 );
+  for (int i = 0; i < 6; i++) {
+    BOOST_TEST( values.getValues()[i] == expected[i], boost::test_tools::tolerance(TOLERANCE) );
+  }
+
+  // Columns before startCol are not parsed, the others must be numbers
+  ValueBuffer others;
+  BOOST_CHECK_THROW( parseAll(data.table, ",", 0, others), KOnexException );
+  BOOST_CHECK_THROW( parseAll("1 2x 3\n", " ", 0, others), KOnexException );
+  BOOST_CHECK_EQUAL( parseAll("1\t2 \n3  4", " \t", 0, others), 2 );
+}
+
+BOOST_AUTO_TEST_CASE( value_buffer_release )
+{
+  ValueBuffer values;
+  BOOST_CHECK( values.release() == nullptr );
+
+  for (int i = 0; i < 3000; i++) {
+    values.push_back(i);
+  }
+  BOOST_CHECK( values.getCapacity() >= 3000 );
+  values.truncate(10);
+  data_t* released = values.release();
+  BOOST_CHECK_EQUAL( released[9], 9 );
+  BOOST_CHECK_EQUAL( values.getSize(), 0 );
+  delete[] released;
+}
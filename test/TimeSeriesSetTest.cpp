@@ -3,12 +3,25 @@
 #include <boost/test/unit_test.hpp>
 
 #include "TimeSeriesSet.hpp"
+#include "BinaryDataset.hpp"
 #include "Exception.hpp"
 #include "TimeSeries.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
 
 #define TOLERANCE 1e-9
+// in percent, for values rounded to data_t
+#define DATA_TOLERANCE std::max(TOLERANCE, 100 * (double)std::numeric_limits<data_t>::epsilon())
 
 using namespace konex;
 
@@ -91,6 +104,483 @@ BOOST_AUTO_TEST_CASE( timeseries_set_load_all )
   BOOST_CHECK( tsSet.getFilePath() == data.test_15_20_comma );
 }
 
+BOOST_AUTO_TEST_CASE( time_series_set_load_parallel )
+{
+  // Large enough to be split in several chunks
+  std::string path = "time_series_set_load_parallel.txt";
+  {
+    std::ofstream f(path);
+    for (int i = 0; i < 400; i++)
+    {
+      for (int j = 0; j < 1000; j++) {
+        f << (i * 1000 + j) * 0.001 << (j % 2 ? ", " : " ");
+      }
+      f << (i % 3 ? "\n" : "\r\n");
+    }
+    f << "1 2 3" << std::endl;
+  }
+
+  TimeSeriesSet serial, parallel;
+  serial.loadData(path, 400, 1, " ,");
+  parallel.loadData(path, 400, 1, " ,", 4);
+  BOOST_REQUIRE_EQUAL( parallel.getItemCount(), 400 );
+  BOOST_REQUIRE_EQUAL( parallel.getItemLength(), 999 );
+  BOOST_CHECK_EQUAL( serial.getItemCount(), 400 );
+  for (int i = 0; i < 400; i += 57)
+  {
+    for (int j = 0; j < 999; j += 13)
+    {
+      BOOST_CHECK_EQUAL( parallel.getTimeSeries(i)[j], serial.getTimeSeries(i)[j] );
+      BOOST_CHECK_CLOSE( parallel.getTimeSeries(i)[j], (i * 1000 + j + 1) * 0.001, DATA_TOLERANCE );
+    }
+  }
+
+  // Statistics computed by each thread are stitched in order, and
+  // normalizing while loading matches normalizing afterwards
+  TimeSeriesSet normalizedOnLoad;
+  normalizedOnLoad.loadData(path, 400, 1, " ,", 4, true);
+  std::pair<data_t, data_t> bounds = serial.normalize();
+  BOOST_CHECK_EQUAL( normalizedOnLoad.getNormalization().first, bounds.first );
+  BOOST_CHECK_EQUAL( normalizedOnLoad.getNormalization().second, bounds.second );
+  BOOST_CHECK( normalizedOnLoad.isNormalized() );
+  for (int i = 0; i < 400; i += 57)
+  {
+    BOOST_CHECK_EQUAL( parallel.getSeriesStats(i).max, parallel.getTimeSeries(i)[998] );
+    BOOST_CHECK_EQUAL( normalizedOnLoad.getSeriesStats(i).mean, serial.getSeriesStats(i).mean );
+    BOOST_CHECK_EQUAL( normalizedOnLoad.getPrefixSquares(i)[999], serial.getPrefixSquares(i)[999] );
+    for (int j = 0; j < 999; j += 13) {
+      BOOST_CHECK_EQUAL( normalizedOnLoad.getTimeSeries(i)[j], serial.getTimeSeries(i)[j] );
+    }
+  }
+
+  // The short last line is only an error when it is read
+  BOOST_CHECK_THROW( parallel.loadData(path, 0, 0, " ,", 4), KOnexException );
+  BOOST_CHECK_EQUAL( parallel.getItemCount(), 0 );
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( time_series_set_save_load_binary )
+{
+  std::string path = "time_series_set_save_load_binary.bin";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_10_20_space, 0, 0, " ");
+  std::pair<data_t, data_t> bounds = tsSet.normalize();
+  tsSet.saveBinary(path);
+
+  TimeSeriesSet loaded;
+  loaded.loadBinary(path, 0, true);
+  BOOST_REQUIRE_EQUAL( loaded.getItemCount(), tsSet.getItemCount() );
+  BOOST_REQUIRE_EQUAL( loaded.getItemLength(), tsSet.getItemLength() );
+  BOOST_CHECK( loaded.isNormalized() );
+  BOOST_CHECK_EQUAL( loaded.getNormalization().first, bounds.first );
+  BOOST_CHECK_EQUAL( loaded.getNormalization().second, bounds.second );
+  for (int i = 0; i < tsSet.getItemCount(); i++)
+  {
+    for (int j = 0; j < tsSet.getItemLength(); j++) {
+      BOOST_CHECK_EQUAL( loaded.getTimeSeries(i)[j], tsSet.getTimeSeries(i)[j] );
+    }
+  }
+  // Values are read in place, aligned
+  BOOST_CHECK_EQUAL( (uintptr_t)&loaded.getTimeSeries(0)[0] % BINARY_DATASET_ALIGNMENT, 0 );
+
+  // Changing the loaded values leaves the file untouched
+  data_t first = loaded.getTimeSeries(0)[0];
+  loaded.normalize();
+  loaded.PAA(2);
+  loaded.loadBinary(path, 3);
+  BOOST_CHECK_EQUAL( loaded.getItemCount(), 3 );
+  BOOST_CHECK_EQUAL( loaded.getTimeSeries(0)[0], first );
+
+  // Corrupted values are found when verified
+  {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(-1, std::ios::end);
+    f.put(0x55);
+  }
+  BOOST_CHECK_NO_THROW( loaded.loadBinary(path) );
+  BOOST_CHECK_THROW( loaded.loadBinary(path, 0, true), KOnexException );
+  BOOST_CHECK_THROW( loaded.loadBinary(data.test_10_20_space), KOnexException );
+  BOOST_CHECK_EQUAL( loaded.getItemCount(), 0 );
+  std::remove(path.c_str());
+
+  // Values saved or converted in single precision are rounded to it, and
+  // stay floats until the dataset is hot
+  tsSet.saveBinary(path, sizeof(float));
+  loaded.loadBinary(path, 0, true);
+  std::string convertedPath = "time_series_set_convert_binary.bin";
+  TimeSeriesSet::convertToBinary(data.test_10_20_space, convertedPath, 0, " ", sizeof(float));
+  TimeSeriesSet converted;
+  converted.loadBinary(convertedPath, 0, true);
+  TimeSeriesSet text;
+  text.loadData(data.test_10_20_space, 0, 0, " ");
+  BOOST_REQUIRE_EQUAL( loaded.getItemCount(), tsSet.getItemCount() );
+  BOOST_REQUIRE_EQUAL( converted.getItemCount(), text.getItemCount() );
+  BOOST_CHECK_EQUAL( loaded.getStoragePrecision(), sizeof(float) );
+  BOOST_CHECK_EQUAL( converted.getStoragePrecision(), sizeof(float) );
+  for (int i = 0; i < tsSet.getItemCount(); i++)
+  {
+    TimeSeries loadedSeries = loaded.copyTimeSeries(i);
+    TimeSeries convertedSeries = converted.copyTimeSeries(i);
+    for (int j = 0; j < tsSet.getItemLength(); j++)
+    {
+      BOOST_CHECK_EQUAL( loadedSeries[j], (data_t)(float)tsSet.getTimeSeries(i)[j] );
+      BOOST_CHECK_EQUAL( convertedSeries[j], (data_t)(float)text.getTimeSeries(i)[j] );
+    }
+  }
+  if (sizeof(data_t) == sizeof(double))
+  {
+    BOOST_CHECK( loaded.isCompressed() );
+    BOOST_CHECK_EQUAL( loaded.compress(), (size_t)tsSet.getItemCount() * tsSet.getItemLength() * sizeof(float) );
+
+    // The floats are searched as the widened values are
+    TimeSeriesSet widened;
+    widened.loadBinary(path);
+    widened.decompress();
+    BOOST_CHECK( !widened.isCompressed() );
+    BOOST_CHECK_EQUAL( widened.getStoragePrecision(), sizeof(data_t) );
+    std::vector<candidate_t> expected = widened.kSimRaw(widened.getTimeSeries(2, 3, 11), 4);
+    std::vector<candidate_t> found = loaded.kSimRaw(widened.getTimeSeries(2, 3, 11), 4);
+    BOOST_REQUIRE_EQUAL( found.size(), expected.size() );
+    for (int i = 0; i < expected.size(); i++)
+    {
+      BOOST_CHECK_EQUAL( found[i].index, expected[i].index );
+      BOOST_CHECK_EQUAL( found[i].start, expected[i].start );
+      BOOST_CHECK_EQUAL( found[i].dist, expected[i].dist );
+    }
+    BOOST_CHECK( loaded.isCompressed() );
+    loaded.decompress();
+    BOOST_CHECK( !loaded.isCompressed() );
+    BOOST_CHECK_EQUAL( loaded.getStoragePrecision(), sizeof(data_t) );
+    BOOST_CHECK_EQUAL( loaded.getTimeSeries(3)[7], widened.getTimeSeries(3)[7] );
+  }
+
+  // Values saved in double precision are rounded to a single-precision data_t
+  tsSet.saveBinary(path, sizeof(double));
+  loaded.loadBinary(path, 0, true);
+  BOOST_CHECK_EQUAL( loaded.getStoragePrecision(), sizeof(data_t) );
+  BOOST_CHECK_EQUAL( loaded.getTimeSeries(3)[7], tsSet.getTimeSeries(3)[7] );
+  BOOST_CHECK_THROW( tsSet.saveBinary(path, 2), KOnexException );
+  std::remove(path.c_str());
+  std::remove(convertedPath.c_str());
+
+  // Text files keep every digit too
+  path = "time_series_set_save_load_text.txt";
+  tsSet.saveData(path, ' ');
+  loaded.loadData(path, 0, 0, " ");
+  BOOST_CHECK_EQUAL( loaded.getTimeSeries(3)[7], tsSet.getTimeSeries(3)[7] );
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( time_series_set_compress )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_10_20_space, 0, 0, " ");
+  TimeSeriesSet expected;
+  expected.loadData(data.test_10_20_space, 0, 0, " ");
+  std::pair<data_t, data_t> bounds = expected.getBounds();
+
+  tsSet.compress();
+  BOOST_CHECK( tsSet.isCompressed() );
+  BOOST_CHECK( tsSet.isLoaded() );
+  BOOST_CHECK_EQUAL( tsSet.getItemCount(), 10 );
+  BOOST_CHECK_THROW( tsSet.getTimeSeries(0), KOnexException );
+  BOOST_CHECK_THROW( tsSet.copyTimeSeries(10), KOnexException );
+  BOOST_CHECK( tsSet.getBounds() == bounds );
+  BOOST_CHECK_EQUAL( tsSet.getSeriesStats(9).mean, expected.getSeriesStats(9).mean );
+
+  // Copies are exact, from the compressed values or not
+  TimeSeries copy = tsSet.copyTimeSeries(3, 5, 12);
+  BOOST_REQUIRE_EQUAL( copy.getLength(), 7 );
+  BOOST_CHECK_EQUAL( copy.getIndex(), 3 );
+  BOOST_CHECK_EQUAL( copy.getStart(), 5 );
+  for (int j = 0; j < 7; j++) {
+    BOOST_CHECK_EQUAL( copy[j], expected.getTimeSeries(3)[5 + j] );
+  }
+  TimeSeries copyOfCopy(copy);
+  BOOST_CHECK_EQUAL( copyOfCopy[6], copy[6] );
+
+  // Raw searches decode the blocks until the dataset is hot
+  TimeSeries query = expected.getTimeSeries(2, 4, 12);
+  std::vector<candidate_t> raw = expected.kSimRaw(query, 3);
+  for (int scan = 0; scan < COMPRESSED_HOT_SCANS; scan++)
+  {
+    std::vector<candidate_t> fromBlocks = tsSet.kSimRaw(query, 3);
+    BOOST_REQUIRE_EQUAL( fromBlocks.size(), raw.size() );
+    for (int i = 0; i < raw.size(); i++)
+    {
+      BOOST_CHECK_EQUAL( fromBlocks[i].index, raw[i].index );
+      BOOST_CHECK_EQUAL( fromBlocks[i].start, raw[i].start );
+      BOOST_CHECK_EQUAL( fromBlocks[i].dist, raw[i].dist );
+    }
+    BOOST_CHECK( tsSet.isCompressed() );
+  }
+  BOOST_CHECK( tsSet.isHot() );
+  BOOST_CHECK_EQUAL( tsSet.materialize(raw[0]).data.getIndex(), raw[0].index );
+  tsSet.kSimRaw(query, 3);
+  BOOST_CHECK( !tsSet.isCompressed() );
+  tsSet.compress();
+  tsSet.decompress();
+  BOOST_CHECK( !tsSet.isCompressed() );
+  for (int i = 0; i < tsSet.getItemCount(); i++)
+  {
+    for (int j = 0; j < tsSet.getItemLength(); j++) {
+      BOOST_CHECK_EQUAL( tsSet.getTimeSeries(i)[j], expected.getTimeSeries(i)[j] );
+    }
+  }
+  BOOST_CHECK_EQUAL( tsSet.copyTimeSeries(3)[19], expected.getTimeSeries(3)[19] );
+
+  // Normalizing decompresses
+  tsSet.compress();
+  tsSet.normalize();
+  BOOST_CHECK( !tsSet.isCompressed() );
+  BOOST_CHECK( tsSet.isNormalized() );
+}
+
+BOOST_AUTO_TEST_CASE( time_series_set_append )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_10_20_space, 0, 0, " ");
+  TimeSeries view = tsSet.getTimeSeries(2);
+  const data_t* first = &view[0];
+  series_stats_t stats = tsSet.getSeriesStats(4);
+  const data_t* paa = tsSet.getPAACache().getPAA(4);
+  std::vector<data_t> paaBefore(paa, paa + 10 * 5);
+  const data_t* envelope = tsSet.getEnvelopeCache().getEnvelope(3, 2, 10, 2);
+  BOOST_REQUIRE( envelope != nullptr );
+
+  BOOST_CHECK_EQUAL( tsSet.appendData(data.test_10_20_space), 10 );
+  BOOST_CHECK_EQUAL( tsSet.getItemCount(), 20 );
+
+  // The series loaded before keep their values, views and caches
+  BOOST_CHECK_EQUAL( &tsSet.getTimeSeries(2)[0], first );
+  BOOST_CHECK_EQUAL( tsSet.getEnvelopeCache().getEnvelope(3, 2, 10, 2), envelope );
+  for (int i = 0; i < 10; i++)
+  {
+    for (int j = 0; j < 20; j++) {
+      BOOST_CHECK_EQUAL( tsSet.getTimeSeries(10 + i)[j], tsSet.getTimeSeries(i)[j] );
+    }
+  }
+  // and the new ones get theirs
+  BOOST_CHECK_EQUAL( tsSet.getSeriesStats(14).mean, stats.mean );
+  BOOST_CHECK_EQUAL( tsSet.getPrefixSums(14)[20], tsSet.getPrefixSums(4)[20] );
+  paa = tsSet.getPAACache().getPAA(4);
+  BOOST_CHECK( std::equal(paaBefore.begin(), paaBefore.end(), paa) );
+  BOOST_CHECK( std::equal(paaBefore.begin(), paaBefore.end(), paa + 10 * 5) );
+  const data_t* appendedEnvelope = tsSet.getEnvelopeCache().getEnvelope(13, 2, 10, 2);
+  BOOST_REQUIRE( appendedEnvelope != nullptr );
+  BOOST_CHECK( std::equal(envelope, envelope + 20, appendedEnvelope) );
+
+  BOOST_CHECK_THROW( tsSet.appendData(data.test_3_11_space), KOnexException );
+  BOOST_CHECK_THROW( tsSet.appendData(data.not_exist), KOnexException );
+  BOOST_CHECK_EQUAL( tsSet.getItemCount(), 20 );
+
+  // Saved and compressed in their order
+  std::string path = "time_series_set_append.bin";
+  tsSet.saveBinary(path);
+  TimeSeriesSet loaded;
+  loaded.loadBinary(path, 0, true);
+  std::remove(path.c_str());
+  tsSet.compress();
+  tsSet.decompress();
+  BOOST_REQUIRE_EQUAL( loaded.getItemCount(), 20 );
+  for (int i = 0; i < 20; i++) {
+    BOOST_CHECK_EQUAL( loaded.getTimeSeries(i)[7], tsSet.getTimeSeries(i)[7] );
+  }
+
+  // New series are normalized with the bounds of the dataset
+  TimeSeriesSet normalized;
+  normalized.loadData(data.test_10_20_space, 0, 0, " ", 1, true);
+  normalized.appendData(data.test_10_20_space);
+  BOOST_CHECK_EQUAL( normalized.getTimeSeries(19)[3], normalized.getTimeSeries(9)[3] );
+  BOOST_CHECK_EQUAL( normalized.getSeriesStats(19).max, normalized.getSeriesStats(9).max );
+  normalized.normalize();
+  BOOST_CHECK_EQUAL( normalized.getTimeSeries(19)[3], normalized.getTimeSeries(9)[3] );
+
+  // Series are appended once the queries in progress are done
+  std::atomic<bool> appended(false);
+  std::thread appender;
+  {
+    ScopedDatasetQuery query(tsSet);
+    const data_t* paa = tsSet.getPAACache().getPAA(4);
+    appender = std::thread([&]() {
+      tsSet.appendData(data.test_10_20_space);
+      appended = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK( !appended );
+    BOOST_CHECK_EQUAL( tsSet.getItemCount(), 20 );
+    BOOST_CHECK_EQUAL( paa[19 * 5], tsSet.getPAACache().getPAA(4)[19 * 5] );
+  }
+  appender.join();
+  BOOST_CHECK( appended );
+  BOOST_CHECK_EQUAL( tsSet.getItemCount(), 30 );
+
+  // Overlapping queries, which always leave one in progress, do not starve
+  // an append
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 2; t++)
+  {
+    readers.emplace_back([&]() {
+      while (!done && std::chrono::steady_clock::now() < deadline)
+      {
+        ScopedDatasetQuery query(tsSet, tsSet);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  tsSet.appendData(data.test_10_20_space);
+  BOOST_CHECK( std::chrono::steady_clock::now() < deadline );
+  done = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  BOOST_CHECK_EQUAL( tsSet.getItemCount(), 40 );
+}
+
+BOOST_AUTO_TEST_CASE( compressed_dataset_blocks )
+{
+  // Series longer than a block, sampled from a slow signal with repeats
+  int itemCount = 3, itemLength = COMPRESSED_BLOCK_VALUES + 10;
+  std::vector<data_t> values((size_t)itemCount * itemLength);
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = std::round(std::sin(i * 1e-3) * 1000) / 8;
+  }
+  values[1] = -0.0;
+  values[2] = INF;
+
+  CompressedDataset compressed(values.data(), itemCount, itemLength);
+  BOOST_CHECK_EQUAL( compressed.getBlockRowCount(), 1 );
+  BOOST_CHECK_EQUAL( compressed.getBlockCount(), 3 );
+  BOOST_CHECK_LT( compressed.getCompressedBytes() * 4, values.size() * sizeof(data_t) );
+
+  std::vector<data_t> decoded(values.size());
+  compressed.decompress(decoded.data());
+  BOOST_CHECK( std::memcmp(decoded.data(), values.data(), values.size() * sizeof(data_t)) == 0 );
+
+  std::vector<data_t> row(itemLength);
+  compressed.readRow(2, row.data());
+  BOOST_CHECK( std::equal(row.begin(), row.end(), values.begin() + 2 * itemLength) );
+  BOOST_CHECK_EQUAL( compressed.getBlock(2)->size(), itemLength );
+  BOOST_CHECK_THROW( compressed.readRow(3, row.data()), KOnexException );
+  BOOST_CHECK_THROW( compressed.getBlock(-1), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( compressed_dataset_block_search )
+{
+  // Two blocks of short series
+  std::string path = "compressed_dataset_block_search.txt";
+  int itemLength = 16, itemCount = COMPRESSED_BLOCK_VALUES / itemLength + 100;
+  {
+    std::ofstream f(path);
+    for (int i = 0; i < itemCount; i++)
+    {
+      for (int j = 0; j < itemLength; j++) {
+        f << std::round(std::sin((i * 3 + j) * 0.3) * 100) / 8 << " ";
+      }
+      f << std::endl;
+    }
+  }
+  TimeSeriesSet expected, tsSet;
+  expected.loadData(path, 0, 0, " ");
+  tsSet.loadData(path, 0, 0, " ");
+  std::remove(path.c_str());
+  tsSet.compress();
+  BOOST_CHECK( tsSet.getSeriesStats(0).mean == expected.getSeriesStats(0).mean );
+
+  // The blocks after the first only look for what beats its k-th best, under
+  // the dropout of the context if smaller
+  TimeSeries query = expected.getTimeSeries(4000, 2, 12);
+  QueryContext warped, euclidean, dropout(0.1, cascadeDistance, 0.05);
+  euclidean.setDistance("euclidean");
+  for (QueryContext* ctx : {&warped, &euclidean, &dropout})
+  {
+    std::vector<candidate_t> raw = expected.kSimRaw(query, 4, *ctx);
+    std::vector<candidate_t> fromBlocks = tsSet.kSimRaw(query, 4, *ctx);
+    BOOST_REQUIRE_EQUAL( fromBlocks.size(), raw.size() );
+    for (int i = 0; i < raw.size(); i++)
+    {
+      BOOST_CHECK_EQUAL( fromBlocks[i].index, raw[i].index );
+      BOOST_CHECK_EQUAL( fromBlocks[i].start, raw[i].start );
+      BOOST_CHECK_EQUAL( fromBlocks[i].length, raw[i].length );
+      BOOST_CHECK_EQUAL( fromBlocks[i].dist, raw[i].dist );
+    }
+    BOOST_CHECK( tsSet.isCompressed() );
+  }
+  BOOST_CHECK_EQUAL( dropout.getDropout(), (data_t)0.05 );
+
+  // The statistics gathered while compressed get their prefix sums back
+  BOOST_CHECK( tsSet.getPrefixSums(0) == nullptr );
+  tsSet.decompress();
+  const double* sums = tsSet.getPrefixSums(itemCount - 1);
+  BOOST_REQUIRE( sums != nullptr );
+  for (int j = 0; j <= itemLength; j++) {
+    BOOST_CHECK_EQUAL( sums[j], expected.getPrefixSums(itemCount - 1)[j] );
+  }
+  BOOST_CHECK( tsSet.getPrefixSquares(0) != nullptr );
+}
+
+BOOST_AUTO_TEST_CASE( compressed_dataset_concurrent_queries )
+{
+  // Several blocks of series, from a slow signal
+  std::string path = "compressed_dataset_concurrent_queries.txt";
+  int itemCount = 7, itemLength = COMPRESSED_BLOCK_VALUES / 3;
+  {
+    std::ofstream f(path);
+    for (int i = 0; i < itemCount; i++)
+    {
+      for (int j = 0; j < itemLength; j++) {
+        f << std::round(std::sin((i * 7 + j) * 1e-2) * 1000) / 8 + i << " ";
+      }
+      f << std::endl;
+    }
+  }
+  TimeSeriesSet expected, tsSet;
+  expected.loadData(path, 0, 0, " ");
+  tsSet.loadData(path, 0, 0, " ");
+  std::remove(path.c_str());
+  tsSet.compress();
+
+  // A lockstep distance, so that only sub-sequences of the query length are
+  // compared
+  QueryContext ctx;
+  ctx.setDistance("euclidean");
+  TimeSeries query = expected.getTimeSeries(4, 100, 132);
+  std::vector<candidate_t> raw = expected.kSimRaw(query, 5, ctx);
+  std::vector<candidate_t> paa = expected.kSimRaw(query, 5, ctx, 4);
+
+  // Queries of cold and hot blocks run while the dataset is decompressed
+  std::vector<std::vector<candidate_t>> results(8);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < results.size(); t++)
+  {
+    threads.emplace_back([&, t]() {
+      QueryContext threadCtx(ctx);
+      results[t] = tsSet.kSimRaw(query, 5, threadCtx, t % 2 ? 4 : 0);
+      if (t == 3) {
+        tsSet.decompress();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  BOOST_CHECK( !tsSet.isCompressed() );
+  for (int t = 0; t < results.size(); t++)
+  {
+    const std::vector<candidate_t>& exact = t % 2 ? paa : raw;
+    BOOST_REQUIRE_EQUAL( results[t].size(), exact.size() );
+    for (int i = 0; i < exact.size(); i++)
+    {
+      BOOST_CHECK_EQUAL( results[t][i].index, exact[i].index );
+      BOOST_CHECK_EQUAL( results[t][i].start, exact[i].start );
+      BOOST_CHECK_CLOSE( results[t][i].dist, exact[i].dist, TOLERANCE );
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE( time_series_set_get_sub_time_series, *boost::unit_test::tolerance(TOLERANCE) )
 {
   TimeSeriesSet tsSet;
@@ -165,6 +655,119 @@ BOOST_AUTO_TEST_CASE( normalize_2, *boost::unit_test::tolerance(TOLERANCE) )
   }
 }
 
+BOOST_AUTO_TEST_CASE( series_stats )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_11_space, 11, 0, " ");
+  BOOST_CHECK_EQUAL( tsSet.getBounds().first, 1 );
+  BOOST_CHECK_EQUAL( tsSet.getBounds().second, 21 );
+
+  for (int ts = 0; ts < tsSet.getItemCount(); ts++)
+  {
+    TimeSeries t = tsSet.getTimeSeries(ts);
+    const double* sums = tsSet.getPrefixSums(ts);
+    const double* squares = tsSet.getPrefixSquares(ts);
+    double sum = 0, sumOfSquares = 0;
+    BOOST_CHECK_EQUAL( sums[0], 0 );
+    for (int i = 0; i < t.getLength(); i++)
+    {
+      sum += t[i];
+      sumOfSquares += t[i] * t[i];
+      BOOST_CHECK_CLOSE( sums[i + 1], sum, TOLERANCE );
+      BOOST_CHECK_CLOSE( squares[i + 1], sumOfSquares, TOLERANCE );
+    }
+    const series_stats_t& stats = tsSet.getSeriesStats(ts);
+    double mean = sum / t.getLength();
+    BOOST_CHECK_CLOSE( stats.mean, mean, TOLERANCE );
+    BOOST_CHECK_CLOSE( stats.std, std::sqrt(sumOfSquares / t.getLength() - mean * mean), TOLERANCE );
+    BOOST_CHECK_EQUAL( stats.min, *std::min_element(&t[0], &t[0] + t.getLength()) );
+    BOOST_CHECK_EQUAL( stats.max, *std::max_element(&t[0], &t[0] + t.getLength()) );
+  }
+
+  // The statistics follow the values
+  tsSet.normalize();
+  BOOST_CHECK_EQUAL( tsSet.getBounds().first, 0 );
+  BOOST_CHECK_EQUAL( tsSet.getBounds().second, 1 );
+  BOOST_CHECK_CLOSE( tsSet.getSeriesStats(0).mean, 0.25, DATA_TOLERANCE );
+  tsSet.PAA(2);
+  BOOST_CHECK_CLOSE( tsSet.getPrefixSums(0)[1], 0.025, DATA_TOLERANCE );
+  BOOST_CHECK_THROW( tsSet.getSeriesStats(3), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( distance_profile_kept, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_10_20_space, 0, 0, " ");
+  std::shared_ptr<const DistanceProfile> profile = tsSet.getDistanceProfile();
+  BOOST_CHECK_EQUAL( tsSet.getDistanceProfile(), profile );
+
+  // A new profile is computed once the values change, while the old one stays
+  // usable by its holder
+  tsSet.normalize();
+  std::shared_ptr<const DistanceProfile> normalized = tsSet.getDistanceProfile();
+  BOOST_CHECK( normalized != profile );
+  TimeSeries query = tsSet.getTimeSeries(3, 2, 9);
+  std::vector<double> kept(10 * 14), fresh(10 * 14);
+  normalized->compute(query, kept.data());
+  DistanceProfile(tsSet).compute(query, fresh.data());
+  BOOST_TEST( kept == fresh, boost::test_tools::per_element() );
+  profile->compute(query, kept.data());
+
+  tsSet.appendData(data.test_10_20_space);
+  BOOST_CHECK( tsSet.getDistanceProfile() != normalized );
+}
+
+BOOST_AUTO_TEST_CASE( mapped_stats_bounded )
+{
+  std::string path = "mapped_stats_bounded.bin";
+  TimeSeriesSet inMemory;
+  inMemory.loadData(data.test_10_20_space, 0, 0, " ");
+  inMemory.saveBinary(path);
+  TimeSeriesSet mapped;
+  mapped.loadBinary(path);
+  BOOST_REQUIRE( mapped.isMapped() );
+
+  // The prefix sums would take twice the size of the values, so a mapped
+  // dataset only keeps the statistics of each series
+  TimeSeries query = inMemory.getTimeSeries(2, 3, 15);
+  for (const string& distance : {"euclidean_dtw", "euclidean_dtw_znorm", "euclidean_znorm"})
+  {
+    QueryContext ctx(0.1);
+    ctx.setDistance(distance);
+    std::vector<candidate_t> expected = inMemory.kSimRaw(query, 5, ctx);
+    std::vector<candidate_t> results = mapped.kSimRaw(query, 5, ctx);
+    ctx.setPAABlock(3);
+    std::vector<candidate_t> filtered = mapped.kSimRaw(query, 5, ctx);
+    BOOST_REQUIRE_EQUAL( results.size(), expected.size() );
+    BOOST_REQUIRE_EQUAL( filtered.size(), expected.size() );
+    for (int i = 0; i < expected.size(); i++)
+    {
+      BOOST_CHECK_EQUAL( results[i].index, expected[i].index );
+      BOOST_CHECK_EQUAL( results[i].start, expected[i].start );
+      // z-normalized distances of equal sub-sequences round to about 0
+      BOOST_CHECK_SMALL( results[i].dist - expected[i].dist, (data_t)TOLERANCE );
+      BOOST_CHECK_EQUAL( filtered[i].index, expected[i].index );
+      BOOST_CHECK_SMALL( filtered[i].dist - expected[i].dist, (data_t)TOLERANCE );
+    }
+  }
+  BOOST_CHECK_EQUAL( mapped.getBounds().second, inMemory.getBounds().second );
+  znorm_t a = inMemory.getZNorm(4, 2, 9), b = mapped.getZNorm(4, 2, 9);
+  BOOST_CHECK_CLOSE( a.mean, b.mean, TOLERANCE );
+  BOOST_CHECK_CLOSE( a.std, b.std, TOLERANCE );
+  data_t expectedPAA[4], actualPAA[4];
+  inMemory.getPAACache().getPAA(5, 1, 11, 3, expectedPAA);
+  mapped.getPAACache().getPAA(5, 1, 11, 3, actualPAA);
+  for (int i = 0; i < 4; i++) {
+    BOOST_CHECK_CLOSE( actualPAA[i], expectedPAA[i], TOLERANCE );
+  }
+
+  BOOST_CHECK( inMemory.getPrefixSums(0) != nullptr );
+  BOOST_CHECK( mapped.getPrefixSums(0) == nullptr );
+  BOOST_CHECK( mapped.getStatsBytes() <= mapped.getItemCount() * sizeof(series_stats_t) );
+  BOOST_CHECK( inMemory.getStatsBytes() > 2 * mapped.getItemCount() * mapped.getItemLength() * sizeof(double) );
+  std::remove(path.c_str());
+}
+
 BOOST_AUTO_TEST_CASE( normalize_exception )
 {
   TimeSeriesSet tsSet;
@@ -219,6 +822,6 @@ BOOST_AUTO_TEST_CASE( basic_k_exhaustive )
 {
   TimeSeriesSet tsSet;
   tsSet.loadData(data.test_3_10_space, 20, 0, " ");
-  std::vector<candidate_time_series_t> best = tsSet.kSimRaw(tsSet.getTimeSeries(0), 1);
+  std::vector<candidate_t> best = tsSet.kSimRaw(tsSet.getTimeSeries(0), 1);
   BOOST_TEST( best[0].dist == 0.0 );
 }
@@ -113,3 +113,28 @@ BOOST_AUTO_TEST_CASE( time_series_keogh_upper_lower, *boost::unit_test::toleranc
     BOOST_TEST( data.dat3Lower5[i] == ts2.getKeoghLower(2)[i] );    
   }
 }
+
+BOOST_AUTO_TEST_CASE( time_series_move )
+{
+  MockData data;
+  TimeSeries owner(7);
+  for (int i = 0; i < owner.getLength(); i++)
+  {
+    owner[i] = data.dat2[i];
+  }
+  const data_t* upper = owner.getKeoghUpper(1);
+
+  TimeSeries moved(std::move(owner));
+  BOOST_CHECK_EQUAL( moved.getLength(), 7 );
+  BOOST_CHECK_EQUAL( moved.getKeoghUpper(1), upper );
+  BOOST_CHECK( owner.getData() == nullptr );
+
+  TimeSeries assigned(3);
+  assigned = std::move(moved);
+  BOOST_CHECK_EQUAL( assigned.getLength(), 7 );
+  for (int i = 0; i < assigned.getLength(); i++)
+  {
+    BOOST_CHECK_EQUAL( assigned[i], data.dat2[i] );
+    BOOST_CHECK_EQUAL( assigned.getKeoghUpper(1)[i], data.dat2Upper3[i] );
+  }
+}
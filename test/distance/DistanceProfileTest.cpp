@@ -0,0 +1,115 @@
+#define BOOST_TEST_MODULE "Test DistanceProfile class"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+
+#include "distance/DistanceProfile.hpp"
+#include "distance/Distance.hpp"
+#include "LocalLengthGroupSpace.hpp"
+#include "TimeSeriesSet.hpp"
+#include "Exception.hpp"
+
+using namespace konex;
+
+struct MockData
+{
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+} data;
+
+BOOST_AUTO_TEST_CASE( fft_round_trip )
+{
+  std::complex<double> a[8];
+  for (int i = 0; i < 8; i++) {
+    a[i] = std::complex<double>(i * i - 3, 0);
+  }
+  DistanceProfile::fft(a, 8, false);
+  // the first bin is the sum of the values
+  BOOST_CHECK_CLOSE( a[0].real(), 116.0, 1e-9 );
+  DistanceProfile::fft(a, 8, true);
+  for (int i = 0; i < 8; i++)
+  {
+    BOOST_CHECK_SMALL( a[i].real() / 8 - (i * i - 3), 1e-12 );
+    BOOST_CHECK_SMALL( a[i].imag() / 8, 1e-12 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( distance_profile_same_as_direct )
+{
+  // an odd number of time series leaves the last one unpaired
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 15, 0, " ");
+  DistanceProfile profile(tsSet);
+  BOOST_CHECK_EQUAL( profile.getFFTSize(), 32 );
+
+  for (int len : {1, 5, 24})
+  {
+    TimeSeries query = tsSet.getTimeSeries(3, 0, len);
+    int profileLength = profile.getProfileLength(len);
+    std::vector<double> dest(tsSet.getItemCount() * profileLength);
+    double slack = profile.compute(query, dest.data());
+    BOOST_CHECK( slack > 0 && slack < 1e7 * std::numeric_limits<data_t>::epsilon() );
+
+    for (int idx = 0; idx < tsSet.getItemCount(); idx++)
+    {
+      for (int start = 0; start < profileLength; start++)
+      {
+        TimeSeries ts = tsSet.getTimeSeries(idx, start, start + len);
+        data_t dist = pairwiseDistance(query, ts, INF);
+        BOOST_CHECK( std::abs(dest[idx * profileLength + start] - dist * dist * len) <= slack );
+      }
+    }
+  }
+
+  std::vector<double> dest(1);
+  BOOST_CHECK_THROW( profile.compute(TimeSeries(25), dest.data()), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( distance_profile_grouping_same_as_direct )
+{
+  // a random walk long enough for the profiles to be used
+  std::string path = "distance_profile_test_data.txt";
+  {
+    std::mt19937 gen(7);
+    std::normal_distribution<double> step(0, 1);
+    std::ofstream f(path);
+    for (int r = 0; r < 9; r++)
+    {
+      double x = 0;
+      for (int i = 0; i < 80; i++)
+      {
+        x += step(gen);
+        f << x << " ";
+      }
+      f << std::endl;
+    }
+  }
+  TimeSeriesSet tsSet;
+  tsSet.loadData(path, 0, 0, " ");
+  std::remove(path.c_str());
+  tsSet.normalize();
+  DistanceProfile profile(tsSet);
+
+  for (int len : {DISTANCE_PROFILE_MIN_LENGTH, 50})
+  {
+    for (data_t threshold : {0.05, 0.2})
+    {
+      LocalLengthGroupSpace direct(tsSet, len), withProfile(tsSet, len);
+      direct.generateGroups(pairwiseDistance, threshold);
+      withProfile.generateGroups(pairwiseDistance, threshold, &profile);
+      BOOST_REQUIRE_EQUAL( withProfile.getNumberOfGroups(), direct.getNumberOfGroups() );
+      for (int g = 0; g < direct.getNumberOfGroups(); g++)
+      {
+        BOOST_CHECK( withProfile.getGroup(g)->getMembers() == direct.getGroup(g)->getMembers() );
+        BOOST_CHECK_EQUAL( withProfile.getGroup(g)->getCentroid().getIndex(),
+                           direct.getGroup(g)->getCentroid().getIndex() );
+        BOOST_CHECK_EQUAL( withProfile.getGroup(g)->getCentroid().getStart(),
+                           direct.getGroup(g)->getCentroid().getStart() );
+      }
+    }
+  }
+}
@@ -5,6 +5,7 @@
 #include <iostream>
 
 #include "distance/Distance.hpp"
+#include "distance/QueryContext.hpp"
 #include "Exception.hpp"
 
 using namespace konex;
@@ -124,4 +125,49 @@ BOOST_AUTO_TEST_CASE( keogh_lower_bound, *boost::unit_test::tolerance(TOLERANCE)
   data_t klb = keoghLowerBound(a, b, 10);
 
   BOOST_TEST( klb == sqrt(31.0) / (2 * 10) );
-}
\ No newline at end of file
+}
+BOOST_AUTO_TEST_CASE( znorm_distance, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  MockData data;
+  TimeSeries a{data.dat_13, 10};
+  TimeSeries b{data.dat_14, 7};
+
+  // mean and standard deviation of the population
+  double sum = 0, squares = 0;
+  for (int i = 0; i < 10; i++)
+  {
+    sum += data.dat_13[i];
+    squares += data.dat_13[i] * data.dat_13[i];
+  }
+  znorm_t zn = a.getZNorm();
+  BOOST_TEST( zn.mean == sum / 10 );
+  BOOST_TEST( zn.std == sqrt(squares / 10 - zn.mean * zn.mean) );
+
+  // a scaled and shifted copy is at distance 0
+  data_t scaled[10];
+  for (int i = 0; i < 10; i++) {
+    scaled[i] = 3 * data.dat_13[i] + 5;
+  }
+  TimeSeries c{scaled, 10};
+  BOOST_TEST( znormPairwiseDistance(a, c, INF) == 0 );
+  BOOST_TEST( znormWarpedDistance(a, c, INF) == 0 );
+  BOOST_TEST( pairwiseDistance(a, c, INF) > 1 );
+
+  // same as the raw distances between the normalized copies
+  TimeSeries na(10), nb(7);
+  znorm_t znb = b.getZNorm();
+  for (int i = 0; i < 10; i++) {
+    na[i] = zn(a[i]);
+  }
+  for (int i = 0; i < 7; i++) {
+    nb[i] = znb(b[i]);
+  }
+  QueryContext ctx(0.2, getQueryDistance("euclidean_dtw_znorm"));
+  BOOST_TEST( znormWarpedDistance(a, b, INF) == warpedDistance(na, nb, INF) );
+  BOOST_TEST( ctx.distanceBetween(a, b, INF) == warpedDistance(na, nb, INF) );
+  BOOST_TEST( ctx.distanceBetween(a, b, 1e-3) == INF );
+
+  BOOST_CHECK( getDistance("euclidean_znorm") == static_cast<dist_t>(znormPairwiseDistance) );
+  BOOST_CHECK( isLockstepDistance(getQueryDistance("euclidean_znorm")) );
+  BOOST_CHECK( !isLockstepDistance(getQueryDistance("euclidean_dtw_znorm")) );
+}
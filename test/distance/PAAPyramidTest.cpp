@@ -0,0 +1,90 @@
+#define BOOST_TEST_MODULE "Test PAAPyramid class"
+
+#include <boost/test/unit_test.hpp>
+
+#include "distance/Distance.hpp"
+#include "distance/PAAPyramid.hpp"
+#include "distance/QueryContext.hpp"
+#include "TimeSeriesSet.hpp"
+
+using namespace konex;
+
+#define TOLERANCE 1e-9
+
+struct MockData
+{
+  data_t dat_1[10] = {0, 2, 3, 5, 8, 6, 3, 2, 3, 5};
+
+  std::string italy_power = "datasets/test/ItalyPowerDemand_DATA";
+} data;
+
+BOOST_AUTO_TEST_CASE( paa_pyramid_levels, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeries ts(data.dat_1, 10);
+
+  // without warping the envelope is the series itself
+  PAAPyramid pyramid(ts, 0);
+  BOOST_CHECK_EQUAL( pyramid.getWarpingBand(), 0 );
+  BOOST_REQUIRE_EQUAL( pyramid.getLevelCount(), 3 );
+  BOOST_CHECK_EQUAL( pyramid.getBlockSize(0), 2 );
+  BOOST_CHECK_EQUAL( pyramid.getBlockSize(2), 8 );
+
+  // not backed by a dataset, so there is nothing to bound
+  TimeSeries other(data.dat_1, 10);
+  BOOST_TEST( pyramid.lowerBound(other, INF) == 0.0 );
+}
+
+BOOST_AUTO_TEST_CASE( paa_pyramid_lower_bound )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 40, 0, " ");
+
+  for (double ratio : {0.0, 0.1, 0.5})
+  {
+    QueryContext ctx(ratio);
+    for (int qi = 0; qi < 4; qi++)
+    {
+      TimeSeries query = tsSet.getTimeSeries(qi, 0, 20);
+      ScopedQuery scopedQuery(ctx, query);
+      for (int idx = 4; idx < 40; idx++)
+      {
+        for (int length : {16, 20, 24})
+        {
+          TimeSeries candidate = tsSet.getTimeSeries(idx, 0, length);
+          data_t lb = paaLowerBound(query, candidate, 1.0, ctx);
+          BOOST_CHECK( lb <= keoghLowerBound(query, candidate, INF, ctx) );
+          BOOST_CHECK( lb <= warpedDistance(query, candidate, INF, ctx) );
+          BOOST_CHECK( lb == paaLowerBound(candidate, query, 1.0, ctx) );
+        }
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( paa_pyramid_bound_query )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.italy_power, 10, 0, " ");
+  TimeSeries query = tsSet.getTimeSeries(0, 0, 24);
+  TimeSeries candidate = tsSet.getTimeSeries(5, 0, 24);
+  QueryContext ctx(0.1);
+
+  BOOST_CHECK( ctx.getQueryPyramid(query, 2) == nullptr );
+  {
+    ScopedQuery scopedQuery(ctx, query);
+    BOOST_CHECK( ctx.getBoundQuery() == &query );
+    const PAAPyramid* pyramid = ctx.getQueryPyramid(query, 2);
+    BOOST_REQUIRE( pyramid != nullptr );
+    BOOST_CHECK( ctx.getQueryPyramid(query, 2) == pyramid );
+    BOOST_CHECK( ctx.getQueryPyramid(candidate, 2) == nullptr );
+    // Pyramids of other bands do not move the ones handed out
+    for (int band = 3; band < 20; band++) {
+      BOOST_CHECK_EQUAL( ctx.getQueryPyramid(query, band)->getWarpingBand(), band );
+    }
+    BOOST_CHECK( ctx.getQueryPyramid(query, 2) == pyramid );
+    BOOST_CHECK_EQUAL( pyramid->getWarpingBand(), 2 );
+    BOOST_CHECK( paaLowerBound(query, candidate, 0.01, ctx) > 0 );
+  }
+  BOOST_CHECK( ctx.getBoundQuery() == nullptr );
+  BOOST_TEST( paaLowerBound(query, candidate, 0.01, ctx) == 0.0 );
+}
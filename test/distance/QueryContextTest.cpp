@@ -0,0 +1,113 @@
+#define BOOST_TEST_MODULE "Test QueryContext class"
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "distance/Distance.hpp"
+#include "distance/QueryContext.hpp"
+#include "GroupableTimeSeriesSet.hpp"
+#include "Exception.hpp"
+
+using namespace konex;
+
+// a few roundings of data_t apart
+#define TOLERANCE std::max(1e-9, 16 * (double)std::numeric_limits<data_t>::epsilon())
+
+struct MockData
+{
+  data_t dat_11[7] = {4, 3, 5, 3, 5, 3, 4};
+  data_t dat_12[7] = {4, 3, 3, 1, 1, 3, 4};
+  data_t dat_13[10] = {0, 2, 3, 5, 8, 6, 3, 2, 3, 5};
+  data_t dat_14[7] =  {8, 4, 6, 1, 5, 10, 9};
+
+  std::string test_10_20_space = "datasets/test/test_10_20_space.txt";
+};
+
+BOOST_AUTO_TEST_CASE( query_context_defaults )
+{
+  setWarpingBandRatio(0.3);
+  QueryContext ctx;
+  BOOST_TEST( ctx.getWarpingBandRatio() == 0.3 );
+  BOOST_CHECK( ctx.getDistance() == (query_dist_t)cascadeDistance );
+  BOOST_TEST( ctx.getDropout() == INF );
+  BOOST_CHECK_EQUAL( ctx.getWarpingBandSize(10), 3 );
+
+  // changing the default does not affect existing contexts
+  setWarpingBandRatio(0.1);
+  BOOST_TEST( ctx.getWarpingBandRatio() == 0.3 );
+
+  BOOST_CHECK_THROW( ctx.setWarpingBandRatio(1.5), KOnexException );
+  BOOST_CHECK_THROW( QueryContext(-0.1), KOnexException );
+}
+
+BOOST_AUTO_TEST_CASE( query_context_distances, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  MockData data;
+  TimeSeries ts_11{data.dat_11, 0, 0, 7};
+  TimeSeries ts_12{data.dat_12, 0, 0, 7};
+  TimeSeries a{data.dat_13, 10};
+  TimeSeries b{data.dat_14, 7};
+
+  // the process default is ignored by distances given a context
+  setWarpingBandRatio(0.0);
+  QueryContext full(1.0);
+  QueryContext narrow(0.2);
+
+  BOOST_TEST( warpedDistance(ts_11, ts_12, INF, full) == sqrt(12.0) / (2 * 7) );
+  BOOST_TEST( keoghLowerBound(a, b, 10, narrow) == sqrt(31.0) / (2 * 10) );
+
+  for (double ratio : {0.0, 0.2, 0.5, 1.0})
+  {
+    setWarpingBandRatio(ratio);
+    QueryContext ctx(ratio);
+    BOOST_TEST( warpedDistance(a, b, INF, ctx) == warpedDistance(a, b, INF) );
+    BOOST_TEST( cascadeDistance(a, b, INF, ctx) == cascadeDistance(a, b, INF) );
+    BOOST_TEST( crossKeoghLowerBound(a, b, INF, ctx) == crossKeoghLowerBound(a, b, INF) );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( query_context_concurrent_queries )
+{
+  MockData data;
+  GroupableTimeSeriesSet tsSet;
+  tsSet.loadData(data.test_10_20_space, 10, 0, " ");
+  tsSet.groupAllLengths("euclidean", 0.5, 1);
+
+  double ratios[] = {0.1, 0.5, 1.0};
+  std::vector<std::vector<candidate_t>> expected;
+  for (double ratio : ratios)
+  {
+    QueryContext ctx(ratio);
+    expected.push_back(tsSet.kSim(tsSet.getTimeSeries(3, 2, 15), 3, 5, ctx));
+  }
+
+  std::vector<std::vector<candidate_t>> results(3);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 3; t++)
+  {
+    threads.emplace_back([&tsSet, &results, &ratios, t] {
+      QueryContext ctx(ratios[t]);
+      for (int i = 0; i < 20; i++) {
+        results[t] = tsSet.kSim(tsSet.getTimeSeries(3, 2, 15), 3, 5, ctx);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 0; t < 3; t++)
+  {
+    BOOST_REQUIRE_EQUAL( results[t].size(), expected[t].size() );
+    for (int i = 0; i < results[t].size(); i++)
+    {
+      BOOST_CHECK_EQUAL( results[t][i].index, expected[t][i].index );
+      BOOST_CHECK_EQUAL( results[t][i].start, expected[t][i].start );
+      BOOST_CHECK_EQUAL( results[t][i].length, expected[t][i].length );
+      BOOST_CHECK_EQUAL( results[t][i].dist, expected[t][i].dist );
+    }
+  }
+}